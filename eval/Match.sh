@@ -8,7 +8,9 @@ p="--patterns $BASEDIR/IdiomMatcher_arm.json --patterns $BASEDIR/IdiomMatcher_x8
 
 echo "patterns are $p";
 
-for f in $(find . -name "$s"); do
-echo "Processing $f file..";
-$BASEDIR/../build/src/Standalone/IdiomMatcherStandalone $p  --file $f $m
-done
+# one process matches all dumps, patterns are read and compiled only once
+manifest=$(mktemp)
+find "$PWD" -name "$s" > $manifest
+echo "Processing $(wc -l < $manifest) files.."
+$BASEDIR/../build/src/Standalone/IdiomMatcherStandalone $p --batch $manifest $m
+rm $manifest
@@ -0,0 +1,395 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "SyntheticDisassembly.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace IdiomMatcher {
+
+	// instructions are planned in regions, each region has at most one switch idiom
+	static const uint64_t regionSize = 64;
+	static const unsigned instructionSize = 4;
+	static const unsigned maximumCaseCount = 8;
+
+	static uint64_t mix(uint64_t value) {
+		// splitmix64 finalizer
+		value += 0x9E3779B97F4A7C15ull;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	}
+
+	static std::string hexString(uint64_t value) {
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%jX", (uintmax_t)value);
+		return buffer;
+	}
+
+#pragma mark - Instructions
+
+	static Operand_Ref readOperand(const std::string &reg) {
+		return std::make_shared<Operand>(reg, std::vector<std::string>(1, reg));
+	}
+
+	static Operand_Ref writeOperand(const std::string &reg, const bool alsoRead = false) {
+		return std::make_shared<Operand>(reg, std::vector<std::string>(1, reg), alsoRead, true, 0);
+	}
+
+	static Operand_Ref textOperand(const std::string &text, const uintmax_t address = 0) {
+		return std::make_shared<Operand>(text, std::vector<std::string>(), true, false, address);
+	}
+
+	static Operand_Ref memoryOperand(const std::string &text, const std::vector<std::string> &registers, const uintmax_t address = 0) {
+		return std::make_shared<Operand>(text, registers, true, false, address);
+	}
+
+	static XRefs flowXRefs(const std::vector<EA> &targets, const EA &dataTarget = InvalidEA) {
+		XRefs xrefs;
+		for (auto &target : targets) {
+			xrefs.push_back(std::make_shared<XRef>(target));
+		}
+		if (!(dataTarget == InvalidEA)) {
+			xrefs.push_back(std::make_shared<XRef>(dataTarget, true));
+		}
+		return xrefs;
+	}
+
+	// EAs and registers of one switch idiom
+	struct IdiomPlacement {
+		EA startEA = InvalidEA;
+		EA defaultEA = InvalidEA;
+		std::vector<EA> caseEAs;
+		EA tableEA = InvalidEA;
+		std::string reg;
+		std::string temp;
+		std::string temp2;
+
+		EA ea(unsigned position) const { return EA(startEA.getValue() + position * instructionSize); }
+	};
+
+	typedef std::function<Instructions(const IdiomPlacement &placement)> IdiomBuilder;
+
+	static Instructions x86Idiom(const IdiomPlacement &p) {
+		const std::string defaultLabel = "loc_" + hexString(p.defaultEA.getValue());
+		const std::string table = "ds:off_" + hexString(p.tableEA.getValue()) + "[" + p.reg + "*4]";
+		return {
+			std::make_shared<Instruction>("cmp", Operands{readOperand(p.reg), textOperand(std::to_string(p.caseEAs.size() - 1))}, flowXRefs({p.ea(1)}), instructionSize, p.ea(0)),
+			std::make_shared<Instruction>("ja", Operands{textOperand(defaultLabel, p.defaultEA.getValue())}, flowXRefs({p.ea(2), p.defaultEA}), instructionSize, p.ea(1)),
+			std::make_shared<Instruction>("jmp", Operands{memoryOperand(table, {p.reg}, p.tableEA.getValue())}, flowXRefs(p.caseEAs, p.tableEA), instructionSize, p.ea(2)),
+		};
+	}
+
+	static Instructions armIdiom(const IdiomPlacement &p) {
+		std::vector<EA> loadTargets(1, p.ea(2));
+		loadTargets.insert(loadTargets.end(), p.caseEAs.begin(), p.caseEAs.end());
+		return {
+			std::make_shared<Instruction>("CMP", Operands{readOperand(p.reg), textOperand("#" + std::to_string(p.caseEAs.size() - 1))}, flowXRefs({p.ea(1)}), instructionSize, p.ea(0)),
+			std::make_shared<Instruction>("LDRLS", Operands{writeOperand("PC"), memoryOperand("[PC," + p.reg + ",LSL#2]", {"PC", p.reg})}, flowXRefs(loadTargets), instructionSize, p.ea(1)),
+			std::make_shared<Instruction>("B", Operands{textOperand("def_" + hexString(p.ea(1).getValue()), p.defaultEA.getValue())}, flowXRefs({p.defaultEA}), instructionSize, p.ea(2)),
+		};
+	}
+
+	static Instructions mipsIdiom(const IdiomPlacement &p) {
+		const std::string table = "jpt_" + hexString(p.tableEA.getValue());
+		return {
+			std::make_shared<Instruction>("sltiu", Operands{writeOperand(p.temp), readOperand(p.reg), textOperand(std::to_string(p.caseEAs.size()))}, flowXRefs({p.ea(1)}), instructionSize, p.ea(0)),
+			std::make_shared<Instruction>("beqz", Operands{readOperand(p.temp), textOperand("def_" + hexString(p.ea(1).getValue()), p.defaultEA.getValue())}, flowXRefs({p.ea(2), p.defaultEA}), instructionSize, p.ea(1)),
+			std::make_shared<Instruction>("sll", Operands{writeOperand(p.temp), readOperand(p.reg), textOperand("2")}, flowXRefs({p.ea(3)}), instructionSize, p.ea(2)),
+			std::make_shared<Instruction>("la", Operands{writeOperand(p.temp2), textOperand(table, p.tableEA.getValue())}, flowXRefs({p.ea(4)}, p.tableEA), instructionSize, p.ea(3)),
+			std::make_shared<Instruction>("addu", Operands{writeOperand(p.temp2, true), readOperand(p.temp)}, flowXRefs({p.ea(5)}), instructionSize, p.ea(4)),
+			std::make_shared<Instruction>("lw", Operands{writeOperand(p.temp2), memoryOperand("0(" + p.temp2 + ")", {p.temp2})}, flowXRefs({p.ea(6)}), instructionSize, p.ea(5)),
+			std::make_shared<Instruction>("jr", Operands{readOperand(p.temp2)}, flowXRefs(p.caseEAs), instructionSize, p.ea(6)),
+		};
+	}
+
+	static Instructions ppcIdiom(const IdiomPlacement &p) {
+		const std::string table = "jpt_" + hexString(p.tableEA.getValue());
+		return {
+			std::make_shared<Instruction>("cmplwi", Operands{writeOperand("cr0"), readOperand(p.reg), textOperand(std::to_string(p.caseEAs.size() - 1))}, flowXRefs({p.ea(1)}), instructionSize, p.ea(0)),
+			std::make_shared<Instruction>("bgt", Operands{readOperand("cr0"), textOperand("def_" + hexString(p.ea(1).getValue()), p.defaultEA.getValue())}, flowXRefs({p.ea(2), p.defaultEA}), instructionSize, p.ea(1)),
+			std::make_shared<Instruction>("lis", Operands{writeOperand("r11"), textOperand(table + "@ha", p.tableEA.getValue())}, flowXRefs({p.ea(3)}, p.tableEA), instructionSize, p.ea(2)),
+			std::make_shared<Instruction>("addi", Operands{writeOperand("r11"), readOperand("r11"), textOperand(table + "@l", p.tableEA.getValue())}, flowXRefs({p.ea(4)}, p.tableEA), instructionSize, p.ea(3)),
+			std::make_shared<Instruction>("slwi", Operands{writeOperand("r0"), readOperand(p.reg), textOperand("2")}, flowXRefs({p.ea(5)}), instructionSize, p.ea(4)),
+			std::make_shared<Instruction>("lwzx", Operands{writeOperand(p.temp), readOperand("r11"), readOperand("r0")}, flowXRefs({p.ea(6)}), instructionSize, p.ea(5)),
+			std::make_shared<Instruction>("mtctr", Operands{writeOperand("ctr"), readOperand(p.temp)}, flowXRefs({p.ea(7)}), instructionSize, p.ea(6)),
+			std::make_shared<Instruction>("bctr", Operands{readOperand("ctr")}, flowXRefs(p.caseEAs), instructionSize, p.ea(7)),
+		};
+	}
+
+#pragma mark - Architectures
+
+	struct SyntheticDisassemblerAPI::Architecture {
+		std::string shortName;
+		// architecture name as written by IDA, the same as in the eval patterns
+		std::string name;
+		std::vector<std::string> registers;
+		// register to register instructions, the first operand is written
+		std::vector<std::string> fillerMnemonics;
+		unsigned fillerOperandCount;
+		// conditional branches ending basic blocks, never part of the idiom
+		std::vector<std::string> branchMnemonics;
+		bool branchHasRegister;
+		// mnemonics neither the filler nor the idiom uses, for the decoy patterns
+		std::vector<std::string> unusedMnemonics;
+		unsigned idiomLength;
+		IdiomBuilder idiom;
+		std::string switchComment;
+	};
+
+	static const std::vector<SyntheticDisassemblerAPI::Architecture> &architectures() {
+		static const std::vector<SyntheticDisassemblerAPI::Architecture> all = {
+			{"x86", "ELF for Intel 386 (Executable); CPU-ID: 0",
+				{"eax", "ebx", "ecx", "edx", "esi", "edi", "ebp"},
+				{"mov", "add", "sub", "and", "or", "xor", "lea", "test"}, 2,
+				{"jz", "jnz"}, false,
+				{"jb", "jbe", "jg", "jl"},
+				3, x86Idiom, "switch jump"},
+			{"arm", "ELF for ARM (Executable); CPU-ID: 13",
+				{"R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7", "R8", "R9", "R10", "R11", "R12"},
+				{"MOV", "ADD", "SUB", "AND", "ORR", "EOR", "MVN", "TST"}, 3,
+				{"BNE", "BEQ"}, false,
+				{"BHI", "BGT", "BLT", "BLE"},
+				3, armIdiom, "switch jump"},
+			{"mips", "ELF for MIPS (Executable); CPU-ID: 12",
+				{"$v0", "$v1", "$a0", "$a1", "$a2", "$a3", "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7", "$s0", "$s1", "$s2", "$s3"},
+				{"move", "addu", "subu", "and", "or", "xor", "nor", "slt"}, 3,
+				{"bnez", "bgtz"}, true,
+				{"bgez", "bltz", "blez", "bltzal"},
+				7, mipsIdiom, "switch jump"},
+			{"ppc", "ELF for PowerPC (Executable); CPU-ID: 15",
+				{"r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "r12", "r14", "r15", "r16", "r17", "r18", "r19", "r20"},
+				{"mr", "add", "subf", "and", "or", "xor", "mullw", "divw"}, 3,
+				{"bne", "beq"}, true,
+				{"blt", "bge", "ble", "bso"},
+				8, ppcIdiom, "switch jump"},
+		};
+		return all;
+	}
+
+	std::vector<std::string> SyntheticDisassemblerAPI::architectureNames() {
+		std::vector<std::string> names;
+		for (auto &architecture : architectures()) {
+			names.push_back(architecture.shortName);
+		}
+		return names;
+	}
+
+#pragma mark - Layout
+
+	struct SyntheticDisassemblerAPI::Slot {
+		enum Kind {
+			Filler,
+			Branch,
+			Idiom
+		};
+		Kind kind = Filler;
+		uint64_t hash = 0;
+		unsigned idiomPosition = 0;
+		IdiomPlacement placement;
+	};
+
+	SyntheticDisassemblerAPI::SyntheticDisassemblerAPI(const SyntheticDisassemblyOptions &options, const std::string &path)
+			: DisassemblerAPI(InvalidEA, InvalidInstruction), _options(options), _path(path), _architecture(nullptr) {
+		for (auto &architecture : architectures()) {
+			if (architecture.shortName == options.architecture) {
+				_architecture = &architecture;
+			}
+		}
+	}
+
+	bool SyntheticDisassemblerAPI::idiomInRegion(uint64_t region, uint64_t &idiomStart, unsigned &caseCount, uint64_t &regionHash) const {
+		regionHash = mix(_options.seed ^ mix(region));
+		const uint64_t regionStart = region * regionSize;
+		// only regions completely inside the document get an idiom
+		const double idiomProbability = std::min(1.0, _options.switchDensity * regionSize / 1000.0);
+		if (regionStart + regionSize > _options.instructionCount || (regionHash % 1000000) >= idiomProbability * 1000000) {
+			return false;
+		}
+		caseCount = 2 + (regionHash >> 20) % (maximumCaseCount - 1);
+		idiomStart = regionStart + (regionHash >> 32) % (regionSize - _architecture->idiomLength - caseCount - 1);
+		return true;
+	}
+
+	SyntheticDisassemblerAPI::Slot SyntheticDisassemblerAPI::slotForIndex(uint64_t index) const {
+		Slot slot;
+		const unsigned registerCount = std::max(1u, std::min(_options.registerCount, (unsigned)_architecture->registers.size()));
+		const uint64_t region = index / regionSize;
+		uint64_t idiomStart;
+		unsigned caseCount;
+		uint64_t regionHash;
+		if (idiomInRegion(region, idiomStart, caseCount, regionHash)) {
+			const unsigned length = _architecture->idiomLength;
+			if (idiomStart <= index && index < idiomStart + length) {
+				slot.kind = Slot::Idiom;
+				slot.idiomPosition = (unsigned)(index - idiomStart);
+				auto &placement = slot.placement;
+				auto eaForIndex = [this](uint64_t i) { return EA(_options.baseEA + i * instructionSize); };
+				placement.startEA = eaForIndex(idiomStart);
+				for (unsigned i = 0; i < caseCount; ++i) {
+					placement.caseEAs.push_back(eaForIndex(idiomStart + length + i));
+				}
+				placement.defaultEA = eaForIndex(idiomStart + length + caseCount);
+				// jump tables are in a data segment after the code
+				placement.tableEA = EA(_options.baseEA + _options.instructionCount * instructionSize + region * maximumCaseCount * 4);
+				const unsigned reg = (regionHash >> 40) % registerCount;
+				placement.reg = _architecture->registers[reg];
+				placement.temp = _architecture->registers[(reg + 1) % registerCount];
+				placement.temp2 = _architecture->registers[(reg + 2) % registerCount];
+				return slot;
+			}
+		}
+
+		slot.hash = mix(_options.seed ^ mix(index ^ 0x5EED5EED5EED5EEDull));
+		if (_options.basicBlockSize <= 1 || slot.hash % _options.basicBlockSize == 0) {
+			slot.kind = Slot::Branch;
+		}
+		return slot;
+	}
+
+#pragma mark - DisassemblerAPI
+
+	EA SyntheticDisassemblerAPI::minEA() const {
+		return EA(_options.baseEA);
+	}
+
+	EA SyntheticDisassemblerAPI::maxEA() const {
+		// EA of the last instruction, like the dumps written by the plugin
+		return EA(_options.baseEA + (_options.instructionCount > 0 ? _options.instructionCount - 1 : 0) * instructionSize);
+	}
+
+	EA SyntheticDisassemblerAPI::nextEA(const EA &ea) const {
+		if (ea < minEA()) {
+			return _options.instructionCount > 0 ? minEA() : InvalidEA;
+		}
+		uint64_t index = (ea.getValue() - _options.baseEA) / instructionSize + 1;
+		return index < _options.instructionCount ? EA(_options.baseEA + index * instructionSize) : InvalidEA;
+	}
+
+	Instruction SyntheticDisassemblerAPI::instructionForEA(const EA &instructionEA) const {
+		if (_architecture == nullptr || instructionEA < minEA() || maxEA() < instructionEA || (instructionEA.getValue() - _options.baseEA) % instructionSize != 0) {
+			return InvalidInstruction;
+		}
+		const uint64_t index = (instructionEA.getValue() - _options.baseEA) / instructionSize;
+		const Slot slot = slotForIndex(index);
+		if (slot.kind == Slot::Idiom) {
+			return *_architecture->idiom(slot.placement)[slot.idiomPosition];
+		}
+
+		auto &architecture = *_architecture;
+		const unsigned registerCount = std::max(1u, std::min(_options.registerCount, (unsigned)architecture.registers.size()));
+		const uint64_t hash = slot.hash;
+		const EA next(instructionEA.getValue() + instructionSize);
+		const bool isLast = index + 1 == _options.instructionCount;
+
+		if (slot.kind == Slot::Branch) {
+			// forward branches within a few blocks
+			uint64_t targetIndex = std::min(index + 2 + (hash >> 8) % (4 * std::max(_options.basicBlockSize, 1u)), _options.instructionCount - 1);
+			EA target(_options.baseEA + targetIndex * instructionSize);
+			Operands operands;
+			if (architecture.branchHasRegister) {
+				operands.push_back(readOperand(architecture.registers[(hash >> 16) % registerCount]));
+			}
+			operands.push_back(textOperand("loc_" + hexString(target.getValue()), target.getValue()));
+			std::vector<EA> targets;
+			if (!isLast) {
+				targets.push_back(next);
+			}
+			if (!(target == next) && !(target == instructionEA)) {
+				targets.push_back(target);
+			}
+			return Instruction(architecture.branchMnemonics[(hash >> 24) % architecture.branchMnemonics.size()], operands, flowXRefs(targets), instructionSize, instructionEA);
+		}
+
+		const std::string &mnemonic = architecture.fillerMnemonics[(hash >> 8) % architecture.fillerMnemonics.size()];
+		Operands operands;
+		operands.push_back(writeOperand(architecture.registers[(hash >> 16) % registerCount], true));
+		for (unsigned i = 1; i < architecture.fillerOperandCount; ++i) {
+			operands.push_back(readOperand(architecture.registers[(hash >> (24 + 8 * i)) % registerCount]));
+		}
+		return Instruction(mnemonic, operands, isLast ? XRefs() : flowXRefs({next}), instructionSize, instructionEA);
+	}
+
+	std::string SyntheticDisassemblerAPI::commentForEA(const EA &instructionEA) const {
+		if (_architecture == nullptr || instructionEA < minEA() || maxEA() < instructionEA) {
+			return "";
+		}
+		const Slot slot = slotForIndex((instructionEA.getValue() - _options.baseEA) / instructionSize);
+		if (slot.kind == Slot::Idiom && slot.idiomPosition + 1 == _architecture->idiomLength) {
+			return _architecture->switchComment;
+		}
+		return "";
+	}
+
+	std::string SyntheticDisassemblerAPI::executableName() const {
+		return "synthetic_" + _options.architecture;
+	}
+
+	std::string SyntheticDisassemblerAPI::executableArchitecture() const {
+		return _architecture != nullptr ? _architecture->name : "";
+	}
+
+#pragma mark - Patterns and ground truth
+
+	Patterns SyntheticDisassemblerAPI::patterns() const {
+		Patterns patterns;
+		if (_architecture == nullptr) {
+			return patterns;
+		}
+		// an idiom at a made up place, with every register as template
+		IdiomPlacement placement;
+		placement.startEA = EA(0x1000);
+		const unsigned length = _architecture->idiomLength;
+		placement.caseEAs = {placement.ea(length), placement.ea(length + 1)};
+		placement.defaultEA = placement.ea(length + 2);
+		placement.tableEA = EA(0x100000);
+		placement.reg = _architecture->registers[0];
+		placement.temp = _architecture->registers[1];
+		placement.temp2 = _architecture->registers[2];
+
+		Instructions instructions;
+		for (auto &instruction : _architecture->idiom(placement)) {
+			Operands operands;
+			for (auto &operand : instruction->getOperands()) {
+				bool isTemplate = !operand->getRegisters().empty();
+				operands.push_back(std::make_shared<Operand>(operand->getText(), operand->getRegisters(), "", "", isTemplate, operand->getUsed(), operand->getModified(), operand->getAddress()));
+			}
+			instructions.push_back(std::make_shared<Instruction>(instruction->getMnemonic(), operands, instruction->getXrefs(), instruction->getSize(), instruction->getEA()));
+		}
+		patterns.push_back(std::make_shared<Pattern>("synthetic switch", instructions, _architecture->name));
+
+		// decoys share a prefix with the switch, one instruction has a mnemonic that never occurs
+		auto &unused = _architecture->unusedMnemonics;
+		for (unsigned decoy = 0; decoy < _options.decoyPatternCount; ++decoy) {
+			Instructions decoyInstructions(instructions);
+			unsigned position = length - 1 - (decoy / unused.size()) % (length - 1);
+			auto &original = *decoyInstructions[position];
+			decoyInstructions[position] = std::make_shared<Instruction>(unused[decoy % unused.size()], original.getOperands(), original.getXrefs(), original.getSize(), original.getEA());
+			patterns.push_back(std::make_shared<Pattern>("synthetic decoy " + std::to_string(decoy), decoyInstructions, _architecture->name));
+		}
+		return patterns;
+	}
+
+	void SyntheticDisassemblerAPI::forEachPlantedIdiom(const std::function<void(const Match &match)> &callback) const {
+		if (_architecture == nullptr) {
+			return;
+		}
+		const unsigned length = _architecture->idiomLength;
+		for (uint64_t region = 0; (region + 1) * regionSize <= _options.instructionCount; ++region) {
+			uint64_t idiomStart;
+			unsigned caseCount;
+			uint64_t regionHash;
+			if (idiomInRegion(region, idiomStart, caseCount, regionHash)) {
+				EA startEA(_options.baseEA + idiomStart * instructionSize);
+				callback(Match(startEA, EA(startEA.getValue() + (length - 1) * instructionSize), "synthetic switch"));
+			}
+		}
+	}
+
+	uint64_t SyntheticDisassemblerAPI::plantedIdiomCount() const {
+		uint64_t count = 0;
+		forEachPlantedIdiom([&count](const Match &) { ++count; });
+		return count;
+	}
+}
@@ -0,0 +1,75 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_SYNTHETICDISASSEMBLY_H
+#define IDIOMMATCHER_SYNTHETICDISASSEMBLY_H
+
+#include <functional>
+#include <Matching/DisassemblerAPI.h>
+#include <Matching/MatchPersistence.h>
+
+namespace IdiomMatcher {
+
+	struct SyntheticDisassemblyOptions {
+		// x86, arm, mips or ppc
+		std::string architecture = "x86";
+		uint64_t instructionCount = 1 << 20;
+		// average number of instructions per basic block
+		unsigned basicBlockSize = 8;
+		// planted switch idioms per 1000 instructions
+		double switchDensity = 2;
+		// number of distinct general purpose registers used by the code
+		unsigned registerCount = 6;
+		// patterns that share a prefix with the switch idiom but never match
+		unsigned decoyPatternCount = 3;
+		uint64_t seed = 1;
+		EA::EAValue_t baseEA = 0x10000;
+	};
+
+	// Disassembly of a made up binary, every instruction is computed from its EA,
+	// so documents of any size can be written without holding them in memory.
+	//
+	// The code is filler instructions in basic blocks ending with conditional
+	// branches, with switch idioms of the architecture planted at random places.
+	// Instructions are 4 bytes for all architectures.
+	class SyntheticDisassemblerAPI : public DisassemblerAPI {
+	public:
+		SyntheticDisassemblerAPI(const SyntheticDisassemblyOptions &options, const std::string &path = "");
+
+		// false if the architecture is unknown
+		bool isValid() const { return _architecture != nullptr; }
+		static std::vector<std::string> architectureNames();
+
+		virtual EA minEA() const override;
+		virtual EA maxEA() const override;
+		virtual EA nextEA(const EA &ea) const override;
+		virtual Instruction instructionForEA(const EA &instructionEA) const override;
+		virtual std::string commentForEA(const EA &instructionEA) const override;
+		virtual std::string executableName() const override;
+		virtual std::string executablePath() const override { return _path; }
+		virtual std::string executableArchitecture() const override;
+		virtual std::string getDisassemblerName() const override { return "IdiomMatcherGenerator"; }
+
+		// The switch pattern matching every planted idiom, followed by the decoy patterns.
+		Patterns patterns() const;
+
+		// Calls callback with the match of the switch pattern for every planted idiom, ordered by EA.
+		void forEachPlantedIdiom(const std::function<void(const Match &match)> &callback) const;
+		uint64_t plantedIdiomCount() const;
+
+		struct Architecture;
+		struct Slot;
+
+	private:
+		// regions of instructions have at most one idiom, returns false if region has none
+		bool idiomInRegion(uint64_t region, uint64_t &idiomStart, unsigned &caseCount, uint64_t &regionHash) const;
+		Slot slotForIndex(uint64_t index) const;
+
+		const SyntheticDisassemblyOptions _options;
+		const std::string _path;
+		const Architecture *_architecture;
+	};
+}
+
+#endif //IDIOMMATCHER_SYNTHETICDISASSEMBLY_H
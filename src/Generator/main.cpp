@@ -0,0 +1,159 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include <getopt.h>
+#include <sysexits.h>
+#include <chrono>
+#include <cstdarg>
+#include <Generator/SyntheticDisassembly.h>
+#include <Model/DisassemblyPersistence.h>
+#include <Model/PatternPersistence.h>
+#include <Model/Logging.h>
+#include <Matching/MatchStreamWriter.h>
+
+using namespace IdiomMatcher;
+
+void mylogging(const char *format, ...);
+void printUsage(char *name);
+bool parseArguments(SyntheticDisassemblyOptions &options, std::string &outputPath, int argc, char *argv[]);
+
+int main(int argc, char* argv[]) {
+
+    IdiomMatcher::warning = mylogging;
+    IdiomMatcher::info = mylogging;
+    IdiomMatcher::msg = printf;
+
+    SyntheticDisassemblyOptions options;
+    std::string outputPath;
+    if (!parseArguments(options, outputPath, argc, argv)) {
+        printUsage(argv[0]);
+        return EX_USAGE;
+    }
+
+    const std::string dumpPath = outputPath + "_dump.json";
+    SyntheticDisassemblerAPI api(options, dumpPath);
+    if (!api.isValid()) {
+        printf("unknown architecture %s\n", options.architecture.c_str());
+        printUsage(argv[0]);
+        return EX_USAGE;
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+    printf("Writing %ju %s instructions to %s\n", (uintmax_t)options.instructionCount, options.architecture.c_str(), dumpPath.c_str());
+    if (!dumpDisassemblyToFilePath(dumpPath, api)) {
+        printf("Failed to write %s\n", dumpPath.c_str());
+        return EX_CANTCREAT;
+    }
+
+    const std::string patternPath = outputPath + "_patterns.json";
+    auto patterns = api.patterns();
+    if (!PatternPersistence::writeToFilePath(patternPath, patterns)) {
+        printf("Failed to write %s\n", patternPath.c_str());
+        return EX_CANTCREAT;
+    }
+    printf("Wrote %zu patterns to %s\n", patterns.size(), patternPath.c_str());
+
+    // same format as the matches the standalone streams, matcher name GroundTruth
+    MatchStreamWriter groundTruth(api.executableName(), "GroundTruth", api.executableArchitecture(), MatchStreamWriter::FormatNDJSON);
+    const std::string groundTruthPath = groundTruth.matchPathForExecutablePath(dumpPath);
+    if (!groundTruth.openFilePath(groundTruthPath)) {
+        return EX_CANTCREAT;
+    }
+    {
+        MatchStreamWriter::Buffer buffer(groundTruth);
+        api.forEachPlantedIdiom([&buffer](const Match &match) {
+            buffer.addMatch(match);
+        });
+    }
+    std::chrono::duration<double> diff = std::chrono::steady_clock::now() - t1;
+    if (!groundTruth.finish(diff.count(), 0)) {
+        printf("Failed to write %s\n", groundTruthPath.c_str());
+        return EX_CANTCREAT;
+    }
+    printf("Wrote %zu planted idioms to %s in %f s\n", groundTruth.getMatchCount(), groundTruthPath.c_str(), diff.count());
+    return EXIT_SUCCESS;
+}
+
+void mylogging(const char *format, ...) {
+    va_list vaargs;
+    va_start(vaargs, format);
+    vprintf(format, vaargs);
+    va_end(vaargs);
+}
+
+void printUsage(char *name) {
+    SyntheticDisassemblyOptions defaults;
+    std::string architectures;
+    for (auto &architecture : SyntheticDisassemblerAPI::architectureNames()) {
+        architectures += (architectures.empty() ? "" : " | ") + architecture;
+    }
+    printf("usage: %s --output OutputBasePath [--architecture %s] [--instructions N] [--blockSize N] [--switchDensity F] [--registers N] [--decoys N] [--seed N]\n"
+           "Writes OutputBasePath_dump.json, OutputBasePath_patterns.json and the planted idioms to OutputBasePath_dump_matched_GroundTruth.ndjson.\n"
+           "--instructions number of instructions, default %ju.\n"
+           "--blockSize average instructions per basic block, default %u.\n"
+           "--switchDensity planted switch idioms per 1000 instructions, default %.1f.\n"
+           "--registers number of distinct registers used, default %u.\n"
+           "--decoys patterns sharing a prefix with the switch idiom that never match, default %u.\n",
+           name, architectures.c_str(), (uintmax_t)defaults.instructionCount, defaults.basicBlockSize, defaults.switchDensity, defaults.registerCount, defaults.decoyPatternCount);
+}
+
+bool parseArguments(SyntheticDisassemblyOptions &options, std::string &outputPath, int argc, char *argv[]) {
+
+    int c;
+    bool success = true;
+    while (1) {
+        static struct option long_options[] =
+                {
+                        {"output",        required_argument, 0, 'o'},
+                        {"architecture",  required_argument, 0, 'a'},
+                        {"instructions",  required_argument, 0, 'n'},
+                        {"blockSize",     required_argument, 0, 'b'},
+                        {"switchDensity", required_argument, 0, 's'},
+                        {"registers",     required_argument, 0, 'r'},
+                        {"decoys",        required_argument, 0, 'd'},
+                        {"seed",          required_argument, 0, 'S'},
+                        {0,               0,                 0,  0}
+                };
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "o:a:n:", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 'o':
+                outputPath = std::string(optarg);
+                break;
+            case 'a':
+                options.architecture = std::string(optarg);
+                break;
+            case 'n':
+                options.instructionCount = std::stoull(optarg,nullptr,0);
+                break;
+            case 'b':
+                options.basicBlockSize = std::stoul(optarg,nullptr,0);
+                break;
+            case 's':
+                options.switchDensity = std::stod(optarg);
+                break;
+            case 'r':
+                options.registerCount = std::stoul(optarg,nullptr,0);
+                break;
+            case 'd':
+                options.decoyPatternCount = std::stoul(optarg,nullptr,0);
+                break;
+            case 'S':
+                options.seed = std::stoull(optarg,nullptr,0);
+                break;
+            case '?':
+                success = false;
+                break;
+            default:
+                abort();
+        }
+    }
+    if (outputPath.empty())
+        success = false;
+    return success;
+}
@@ -5,6 +5,7 @@
 
 #include "IDAAdapter.h"
 #include <Model/DisassemblyPersistence.h>
+#include <Matching/Telemetry.h>
 #include <idp.hpp>
 #include <loader.hpp>
 #include <frame.hpp>
@@ -201,6 +202,7 @@ namespace IDAAdapter {
 
 	Instruction IDA::instructionForEA(const EA &instructionEA) const {
 		ea_t ea = (ea_t)instructionEA.getValue();
+		IDIOMMATCHER_COUNT(InstructionsDecoded, 1);
 		decode_insn(ea);
 		uint32 feature = cmd.get_canon_feature();
 
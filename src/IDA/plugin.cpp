@@ -20,6 +20,7 @@
 #include <Model/DisassemblyPersistence.h>
 #include <Matching/Matcher/DependenceGraphMatching.h>
 #include <Matching/MatchPersistence.h>
+#include <Model/TraceRecorder.h>
 #include <chrono>
 
 int IDAP_init(void);
@@ -143,7 +144,8 @@ void IDAP_term(void)
 // The plugin can be passed an integer argument from the plugins.cfg
 // file. This can be useful when you want the one plug-in to do
 // something different depending on the hot-key pressed or menu
-// item selected.
+// item selected. 2 matches like 0 and writes a trace of the run
+// next to the executable.
 
 void IDAP_run(int arg)
 {
@@ -228,11 +230,19 @@ void IDAP_run(int arg)
 			return;
 	}
 
+	const bool recordTrace = arg == 2;
+	if (recordTrace) {
+		IdiomMatcher::TraceRecorder::shared().start();
+	}
+
 	msg("Start matching with %s algorithm.\n",matcher->getName().c_str());
 
 	auto t1 = std::chrono::high_resolution_clock::now();
 	clock_t clockS = clock();
-	matcher->searchForPatterns(allPatterns, idaAPI,callback);
+	{
+		IdiomMatcher::TraceSpan span("match", "match " + matcher->getName());
+		matcher->searchForPatterns(allPatterns, idaAPI,callback);
+	}
 	clock_t clockE = clock();
 	auto t2 = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> diff = t2 - t1;
@@ -251,6 +261,16 @@ void IDAP_run(int arg)
 		IdiomMatcher::msg("Failed to save matches to %s\n",path.c_str());
 #endif
 
+	if (recordTrace) {
+		auto &recorder = IdiomMatcher::TraceRecorder::shared();
+		recorder.stop();
+		auto tracePath = IdiomMatcher::TraceRecorder::tracePathForExecutablePath(idaAPI.executablePath());
+		if (recorder.writeToFilePath(tracePath))
+			IdiomMatcher::msg("Saved trace to %s\n",tracePath.c_str());
+		else
+			IdiomMatcher::msg("Failed to save trace to %s\n",tracePath.c_str());
+	}
+
 	delete matcher;
 }
 
@@ -0,0 +1,35 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "CachingDisassemblerAPI.h"
+
+namespace IdiomMatcher {
+
+	Instruction_ref CachingDisassemblerAPI::instructionRefForEA(const EA &instructionEA) const {
+		auto it = _instructions.find(instructionEA.getValue());
+		if (it != _instructions.end()) {
+			return it->second;
+		}
+		// start over instead of tracking usage, the start EAs only move forward
+		if (_instructions.size() >= _capacity) {
+			_instructions.clear();
+		}
+		auto instruction = std::make_shared<Instruction>(_api.instructionForEA(instructionEA));
+		_instructions.emplace(instructionEA.getValue(), instruction);
+		return instruction;
+	}
+
+	EA CachingDisassemblerAPI::nextEA(const EA &ea) const {
+		auto it = _nextEAs.find(ea.getValue());
+		if (it != _nextEAs.end()) {
+			return EA(it->second);
+		}
+		if (_nextEAs.size() >= _capacity) {
+			_nextEAs.clear();
+		}
+		EA next = _api.nextEA(ea);
+		_nextEAs.emplace(ea.getValue(), next.getValue());
+		return next;
+	}
+}
@@ -0,0 +1,40 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_CACHINGDISASSEMBLERAPI_H
+#define IDIOMMATCHER_CACHINGDISASSEMBLERAPI_H
+
+#include <unordered_map>
+#include <Matching/DisassemblerAPI.h>
+
+namespace IdiomMatcher {
+
+	// Decodes every instruction of the wrapped API once and hands out shared
+	// instructions, so the windows of neighbouring start EAs and of several
+	// matchers reuse them. Not thread safe, use one instance per thread.
+	class CachingDisassemblerAPI : public DisassemblerAPI {
+	public:
+		CachingDisassemblerAPI(DisassemblerAPI &api, const size_t capacity = 1 << 14) : DisassemblerAPI(InvalidEA, InvalidInstruction), _api(api), _capacity(capacity) { }
+
+		Instruction_ref instructionRefForEA(const EA &instructionEA) const;
+
+		virtual EA minEA() const override { return _api.minEA(); }
+		virtual EA maxEA() const override { return _api.maxEA(); }
+		virtual EA nextEA(const EA &ea) const override;
+		virtual Instruction instructionForEA(const EA &instructionEA) const override { return *instructionRefForEA(instructionEA); }
+		virtual std::string commentForEA(const EA &instructionEA) const override { return _api.commentForEA(instructionEA); }
+		virtual std::string executableName() const override { return _api.executableName(); }
+		virtual std::string executablePath() const override { return _api.executablePath(); }
+		virtual std::string executableArchitecture() const override { return _api.executableArchitecture(); }
+		virtual std::string getDisassemblerName() const override { return _api.getDisassemblerName(); }
+
+	private:
+		DisassemblerAPI &_api;
+		const size_t _capacity;
+		mutable std::unordered_map<EA::EAValue_t, Instruction_ref> _instructions;
+		mutable std::unordered_map<EA::EAValue_t, EA::EAValue_t> _nextEAs;
+	};
+}
+
+#endif //IDIOMMATCHER_CACHINGDISASSEMBLERAPI_H
@@ -0,0 +1,205 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "DumpDiff.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <Model/ByteCoding.h>
+
+namespace IdiomMatcher {
+
+	static uint64_t hashString(const std::string &string, uint64_t hash) {
+		// the length separates consecutive strings
+		uint64_t length = string.size();
+		hash = fnv1aHash(&length, sizeof(length), hash);
+		return fnv1aHash(string.data(), string.size(), hash);
+	}
+
+	// the text with the hex digits of address replaced, e.g. off_82E15DC[edx*4] or
+	// [ebp+0Ch], displacements written another way stay in the text
+	static std::string maskedOperandText(const std::string &text, uint64_t address) {
+		std::string masked = text;
+		for (auto format : {"%jX", "%jx"}) {
+			char digits[32];
+			snprintf(digits, sizeof(digits), format, (uintmax_t)address);
+			const size_t length = strlen(digits);
+			for (size_t position = masked.find(digits); position != std::string::npos; position = masked.find(digits, position + 1)) {
+				masked.replace(position, length, "#");
+			}
+		}
+		return masked;
+	}
+
+	uint64_t DumpDiff::hashForInstruction(const Instruction &instruction, AddressNumbers &addressNumbers, bool rawOperandTexts) {
+		uint64_t hash = hashString(instruction.getMnemonic(), fnv1aOffsetBasis);
+		uint16_t size = instruction.getSize();
+		hash = fnv1aHash(&size, sizeof(size), hash);
+		for (auto &operand : instruction.getOperands()) {
+			// the address changes when the code or its target moves, testInstructionsMatch
+			// compares it to the template names bound to other operands
+			uint64_t address = operand->getAddress();
+			uint64_t addressNumber = 0;
+			if (address != 0) {
+				addressNumber = addressNumbers.emplace(address, addressNumbers.size() + 1).first->second;
+			}
+			hash = hashString(rawOperandTexts || address == 0 ? operand->getText() : maskedOperandText(operand->getText(), address), hash);
+			hash = fnv1aHash(&addressNumber, sizeof(addressNumber), hash);
+			auto registers = operand->getRegisters();
+			uint64_t registerCount = registers.size();
+			hash = fnv1aHash(&registerCount, sizeof(registerCount), hash);
+			for (auto &reg : registers) {
+				hash = hashString(reg, hash);
+			}
+		}
+		for (auto &xref : instruction.getXrefs()) {
+			uint8_t flags = (xref->isData() ? 1 : 0) | (xref->isUnordinaryFlow() ? 2 : 0);
+			hash = fnv1aHash(&flags, sizeof(flags), hash);
+		}
+		return hash;
+	}
+
+	uint64_t DumpDiff::hashForInstruction(const Instruction &instruction, bool rawOperandTexts) {
+		AddressNumbers addressNumbers;
+		return hashForInstruction(instruction, addressNumbers, rawOperandTexts);
+	}
+
+	bool DumpDiff::patternsTestOperandTexts(const Patterns &patterns) {
+		for (auto &pattern : patterns) {
+			for (auto &instruction : pattern->getInstructions()) {
+				for (auto &operand : instruction->getOperands()) {
+					if (!operand->getRegex().empty())
+						return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	static void hashInstructions(DisassemblerAPI &api, const EA &startEA, const EA &endEA, bool rawOperandTexts, std::vector<EA> &eas, std::vector<uint64_t> &hashes) {
+		for (EA ea = startEA; ea < endEA; ea = api.nextEA(ea)) {
+			eas.push_back(ea);
+			hashes.push_back(DumpDiff::hashForInstruction(api.instructionForEA(ea), rawOperandTexts));
+		}
+	}
+
+	static uint64_t hashForWindow(const std::vector<uint64_t> &hashes, size_t index, size_t length) {
+		return fnv1aHash(&hashes[index], length * sizeof(uint64_t));
+	}
+
+	DumpDiff::DumpDiff(DisassemblerAPI &oldAPI, const EA &oldStartEA, const EA &oldEndEA,
+					   DisassemblerAPI &newAPI, const EA &newStartEA, const EA &newEndEA, size_t anchorLength, bool rawOperandTexts) : _newEndEA(newEndEA) {
+		std::vector<uint64_t> oldHashes;
+		std::vector<uint64_t> newHashes;
+		hashInstructions(oldAPI, oldStartEA, oldEndEA, rawOperandTexts, _oldEAs, oldHashes);
+		hashInstructions(newAPI, newStartEA, newEndEA, rawOperandTexts, _newEAs, newHashes);
+		anchorLength = std::max<size_t>(anchorLength, 1);
+
+		// windows occurring more than once in the old version are no anchors
+		const size_t ambiguous = SIZE_MAX;
+		std::unordered_map<uint64_t, size_t> anchors;
+		for (size_t j = 0; j + anchorLength <= oldHashes.size(); ++j) {
+			auto inserted = anchors.emplace(hashForWindow(oldHashes, j, anchorLength), j);
+			if (!inserted.second)
+				inserted.first->second = ambiguous;
+		}
+
+		std::vector<bool> oldUsed(oldHashes.size(), false);
+		size_t previousEnd = 0;
+		for (size_t i = 0; i + anchorLength <= newHashes.size();) {
+			auto anchor = anchors.find(hashForWindow(newHashes, i, anchorLength));
+			if (anchor == anchors.end() || anchor->second == ambiguous || oldUsed[anchor->second]
+				|| !std::equal(newHashes.begin() + i, newHashes.begin() + i + anchorLength, oldHashes.begin() + anchor->second)) {
+				++i;
+				continue;
+			}
+			size_t oldIndex = anchor->second;
+			size_t newIndex = i;
+			while (newIndex > previousEnd && oldIndex > 0 && !oldUsed[oldIndex - 1] && newHashes[newIndex - 1] == oldHashes[oldIndex - 1]) {
+				--newIndex;
+				--oldIndex;
+			}
+			size_t length = i - newIndex;
+			while (newIndex + length < newHashes.size() && oldIndex + length < oldHashes.size() && !oldUsed[oldIndex + length]
+				   && newHashes[newIndex + length] == oldHashes[oldIndex + length]) {
+				++length;
+			}
+			std::fill(oldUsed.begin() + oldIndex, oldUsed.begin() + oldIndex + length, true);
+			_runsByNewIndex.push_back({oldIndex, newIndex, length});
+			i = previousEnd = newIndex + length;
+		}
+		_runs = _runsByNewIndex;
+		std::sort(_runs.begin(), _runs.end(), [](const Run &a, const Run &b) { return a.oldIndex < b.oldIndex; });
+	}
+
+	EA DumpDiff::translate(const EA &oldEA) const {
+		auto eaIt = std::lower_bound(_oldEAs.begin(), _oldEAs.end(), oldEA);
+		if (eaIt == _oldEAs.end() || !(*eaIt == oldEA))
+			return InvalidEA;
+		size_t oldIndex = eaIt - _oldEAs.begin();
+		auto run = std::upper_bound(_runs.begin(), _runs.end(), oldIndex, [](size_t index, const Run &run) { return index < run.oldIndex; });
+		if (run == _runs.begin())
+			return InvalidEA;
+		--run;
+		if (oldIndex >= run->oldIndex + run->length)
+			return InvalidEA;
+		return _newEAs[run->newIndex + oldIndex - run->oldIndex];
+	}
+
+	EA DumpDiff::originalEA(const EA &newEA) const {
+		auto eaIt = std::lower_bound(_newEAs.begin(), _newEAs.end(), newEA);
+		if (eaIt == _newEAs.end() || !(*eaIt == newEA))
+			return InvalidEA;
+		size_t newIndex = eaIt - _newEAs.begin();
+		auto run = std::upper_bound(_runsByNewIndex.begin(), _runsByNewIndex.end(), newIndex, [](size_t index, const Run &run) { return index < run.newIndex; });
+		if (run == _runsByNewIndex.begin())
+			return InvalidEA;
+		--run;
+		if (newIndex >= run->newIndex + run->length)
+			return InvalidEA;
+		return _oldEAs[run->oldIndex + newIndex - run->newIndex];
+	}
+
+	std::vector<std::pair<EA, EA> > DumpDiff::changedRanges(size_t margin) const {
+		// changed instructions as [first, end) of new indices, empty where runs meet
+		std::vector<std::pair<size_t, size_t> > changes;
+		size_t newEnd = 0;
+		size_t oldEnd = 0;
+		for (auto &run : _runsByNewIndex) {
+			if (newEnd < run.newIndex || oldEnd != run.oldIndex)
+				changes.push_back(std::make_pair(newEnd, run.newIndex));
+			newEnd = run.newIndex + run.length;
+			oldEnd = run.oldIndex + run.length;
+		}
+		if (newEnd < _newEAs.size() || oldEnd != _oldEAs.size())
+			changes.push_back(std::make_pair(newEnd, _newEAs.size()));
+
+		std::vector<std::pair<size_t, size_t> > widened;
+		for (auto &change : changes) {
+			size_t first = change.first > margin ? change.first - margin : 0;
+			size_t end = std::min(change.second + margin, _newEAs.size());
+			if (first >= end)
+				continue;
+			if (!widened.empty() && first <= widened.back().second) {
+				widened.back().second = std::max(widened.back().second, end);
+			} else {
+				widened.push_back(std::make_pair(first, end));
+			}
+		}
+
+		std::vector<std::pair<EA, EA> > ranges;
+		for (auto &range : widened) {
+			ranges.push_back(std::make_pair(_newEAs[range.first], range.second < _newEAs.size() ? _newEAs[range.second] : _newEndEA));
+		}
+		return ranges;
+	}
+
+	size_t DumpDiff::getUnchangedInstructionCount() const {
+		size_t count = 0;
+		for (auto &run : _runs) {
+			count += run.length;
+		}
+		return count;
+	}
+}
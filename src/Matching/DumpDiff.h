@@ -0,0 +1,71 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_DUMPDIFF_H
+#define IDIOMMATCHER_DUMPDIFF_H
+
+#include <unordered_map>
+#include <Matching/DisassemblerAPI.h>
+
+namespace IdiomMatcher {
+
+	// Aligns the instructions of two versions of a binary, so matches of the old
+	// version can be carried over and only the changed regions rematched.
+	//
+	// Instructions are compared by a hash of what stays the same when code moves:
+	// mnemonic, size, operand texts with their address masked, registers and the
+	// kind of the xrefs.
+	// Runs of equal instructions are anchored at windows of anchorLength
+	// instructions that are unique in the old version and extended in both
+	// directions, so moved and shifted functions are found again.
+	class DumpDiff {
+	public:
+		// equal instructions at oldIndex and newIndex in both versions
+		struct Run {
+			size_t oldIndex;
+			size_t newIndex;
+			size_t length;
+		};
+
+		// Compares the instructions in [oldStartEA, oldEndEA) and [newStartEA, newEndEA),
+		// with rawOperandTexts instructions differing in the address of an operand differ.
+		DumpDiff(DisassemblerAPI &oldAPI, const EA &oldStartEA, const EA &oldEndEA,
+				 DisassemblerAPI &newAPI, const EA &newStartEA, const EA &newEndEA, size_t anchorLength = 8, bool rawOperandTexts = false);
+
+		// EA in the new version of an instruction of a run, InvalidEA if it changed
+		EA translate(const EA &oldEA) const;
+		// EA in the old version of an instruction of a run, InvalidEA if it changed
+		EA originalEA(const EA &newEA) const;
+		// Ranges of the new version to rematch, the changed instructions and the
+		// places where consecutive runs come from different places, widened by
+		// margin instructions on both sides. Sorted and not overlapping.
+		std::vector<std::pair<EA, EA> > changedRanges(size_t margin) const;
+
+		const std::vector<Run> &getRuns() const { return _runs; }
+		size_t getOldInstructionCount() const { return _oldEAs.size(); }
+		size_t getNewInstructionCount() const { return _newEAs.size(); }
+		size_t getUnchangedInstructionCount() const;
+
+		// numbers of the operand addresses of a region in order of appearance
+		typedef std::unordered_map<EA::EAValue_t, uint64_t> AddressNumbers;
+		// The address in an operand text is masked and the address is hashed as its
+		// number, so addresses equal in a region stay equal in the hashes of the region.
+		// With rawOperandTexts the texts are hashed unmasked, for patterns testing them.
+		static uint64_t hashForInstruction(const Instruction &instruction, AddressNumbers &addressNumbers, bool rawOperandTexts = false);
+		// the addresses numbered within the instruction
+		static uint64_t hashForInstruction(const Instruction &instruction, bool rawOperandTexts = false);
+		// true if an operand of patterns has a regex, it is tested on the whole operand text
+		static bool patternsTestOperandTexts(const Patterns &patterns);
+
+	private:
+		std::vector<EA> _oldEAs;
+		std::vector<EA> _newEAs;
+		const EA _newEndEA;
+		// sorted by oldIndex and by newIndex
+		std::vector<Run> _runs;
+		std::vector<Run> _runsByNewIndex;
+	};
+}
+
+#endif //IDIOMMATCHER_DUMPDIFF_H
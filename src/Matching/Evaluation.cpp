@@ -0,0 +1,90 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "Evaluation.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <Matching/MatchStreamWriter.h>
+
+namespace IdiomMatcher {
+
+	static bool hasSuffix(const std::string &string, const std::string &suffix) {
+		return string.size() >= suffix.size() && string.compare(string.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+
+	static bool endsBefore(const Match_Ref &a, const Match_Ref &b) {
+		return a->getEndEA() < b->getEndEA();
+	}
+
+	// one match per endEA, the one of the least frequent pattern, sorted by endEA
+	static Matches uniqueMatchesByEndEA(const Matches &matches) {
+		std::unordered_map<std::string, size_t> patternMatchCounts;
+		for (auto &match : matches) {
+			++patternMatchCounts[match->getPatternName()];
+		}
+		Matches sorted(matches);
+		std::stable_sort(sorted.begin(), sorted.end(), [&patternMatchCounts](const Match_Ref &a, const Match_Ref &b) {
+			if (a->getEndEA() < b->getEndEA() || b->getEndEA() < a->getEndEA())
+				return a->getEndEA() < b->getEndEA();
+			return patternMatchCounts[a->getPatternName()] < patternMatchCounts[b->getPatternName()];
+		});
+		sorted.erase(std::unique(sorted.begin(), sorted.end(), [](const Match_Ref &a, const Match_Ref &b) {
+			return a->getEndEA() == b->getEndEA();
+		}), sorted.end());
+		return sorted;
+	}
+
+	Evaluation evaluateMatches(const Matches &matches, const Matches &references) {
+		Evaluation evaluation;
+		auto sortedMatches = uniqueMatchesByEndEA(matches);
+		Matches sortedReferences(references);
+		std::sort(sortedReferences.begin(), sortedReferences.end(), endsBefore);
+		sortedReferences.erase(std::unique(sortedReferences.begin(), sortedReferences.end(), [](const Match_Ref &a, const Match_Ref &b) {
+			return a->getEndEA() == b->getEndEA();
+		}), sortedReferences.end());
+
+		auto match = sortedMatches.begin();
+		auto reference = sortedReferences.begin();
+		while (match != sortedMatches.end() && reference != sortedReferences.end()) {
+			if (endsBefore(*match, *reference)) {
+				evaluation.wrongMatches.push_back(*match++);
+			} else if (endsBefore(*reference, *match)) {
+				evaluation.missingMatches.push_back(*reference++);
+			} else {
+				evaluation.correctMatches.push_back(*match++);
+				++reference;
+			}
+		}
+		evaluation.wrongMatches.insert(evaluation.wrongMatches.end(), match, sortedMatches.end());
+		evaluation.missingMatches.insert(evaluation.missingMatches.end(), reference, sortedReferences.end());
+
+		std::unordered_set<std::string> usedPatternNames;
+		for (auto &correctMatch : evaluation.correctMatches) {
+			usedPatternNames.insert(correctMatch->getPatternName());
+		}
+		evaluation.usedPatternCount = usedPatternNames.size();
+		return evaluation;
+	}
+
+	MatchPersistence readMatchesFromFilePath(const std::string &path) {
+		if (hasSuffix(path, ".json"))
+			return MatchPersistence::readFromFilePath(path);
+		return readMatchStreamFromFilePath(path);
+	}
+
+	std::string referencePathForMatchPath(const std::string &path) {
+		static const std::string matchedInfix = "_matched_";
+		static const std::string referenceSuffix = "_matched_comments.json";
+		size_t slash = path.find_last_of("/");
+		size_t infix = path.rfind(matchedInfix);
+		if (infix == std::string::npos || (slash != std::string::npos && infix < slash))
+			return "";
+		if (!hasSuffix(path, ".json") && !hasSuffix(path, ".ndjson") && !hasSuffix(path, ".imm"))
+			return "";
+		if (hasSuffix(path, referenceSuffix))
+			return "";
+		return path.substr(0, infix) + referenceSuffix;
+	}
+}
@@ -0,0 +1,36 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_EVALUATION_H
+#define IDIOMMATCHER_EVALUATION_H
+
+#include <Matching/MatchPersistence.h>
+
+namespace IdiomMatcher {
+
+	// Matches compared to reference matches, e.g. the switches IDA commented.
+	// A match is correct if a reference ends at the same EA, as in eval/Eval.swift.
+	struct Evaluation {
+		Matches correctMatches;
+		Matches wrongMatches;
+		// references without a match ending at their EA
+		Matches missingMatches;
+		// distinct pattern names of the correct matches
+		size_t usedPatternCount = 0;
+	};
+
+	// Joins matches and references sorted by endEA in O((n + m) log(n + m)).
+	// Of several matches ending at the same EA only the one of the pattern with
+	// the fewest matches is kept, several references ending at the same EA count once.
+	Evaluation evaluateMatches(const Matches &matches, const Matches &references);
+
+	// Reads match files saved as json, ndjson or binary stream.
+	MatchPersistence readMatchesFromFilePath(const std::string &path);
+
+	// The reference next to a match file, x_matched_Naive.json has x_matched_comments.json.
+	// Empty if path is not a match file or is a reference itself.
+	std::string referencePathForMatchPath(const std::string &path);
+}
+
+#endif //IDIOMMATCHER_EVALUATION_H
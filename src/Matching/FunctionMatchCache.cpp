@@ -0,0 +1,244 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "FunctionMatchCache.h"
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <Matching/DumpDiff.h>
+#include <Matching/Graph/CFGBuilder.h>
+#include <Matching/Matcher/ControlFlowGraphMatching.h>
+#include <Model/ByteCoding.h>
+
+namespace IdiomMatcher {
+
+	static const char functionCacheMagic[4] = {'I','M','F','C'};
+	static const uint64_t functionCacheVersion = 3;
+
+	const size_t FunctionMatchCache::minimumFunctionLength;
+	const size_t FunctionMatchCache::maximumFunctionLength;
+
+	// a boundary follows an instruction if the hash of the last boundaryWindow
+	// instructions has the low bits of boundaryMask cleared, every 64th on average
+	static const size_t boundaryWindow = 4;
+	static const uint64_t boundaryMask = 63;
+
+	// hash of the contextLength instructions from ea on
+	static uint64_t hashForCode(DisassemblerAPI &api, EA ea, size_t contextLength, bool rawOperandTexts) {
+		uint64_t hash = fnv1aOffsetBasis;
+		DumpDiff::AddressNumbers addressNumbers;
+		for (size_t i = 0; i < contextLength && !(ea == InvalidEA); ++i, ea = api.nextEA(ea)) {
+			uint64_t instructionHash = DumpDiff::hashForInstruction(api.instructionForEA(ea), addressNumbers, rawOperandTexts);
+			hash = fnv1aHash(&instructionHash, sizeof(instructionHash), hash);
+		}
+		return hash;
+	}
+
+	std::vector<FunctionMatchCache::Function> FunctionMatchCache::functionsInRange(DisassemblerAPI &api, const EA &startEA, const EA &endEA, size_t contextLength,
+																			  const StartEAKeyFunction &startEAKey, bool rawOperandTexts) {
+		// the instructions of the range and the context after it, the boundaries
+		// are found with the hashes of the single instructions
+		std::vector<EA> eas;
+		std::vector<Instruction> instructions;
+		std::vector<uint64_t> hashes;
+		std::vector<std::vector<EA> > targets;
+		size_t rangeLength = 0;
+		for (EA ea = startEA; !(ea == InvalidEA) && (ea < endEA || eas.size() < rangeLength + contextLength); ea = api.nextEA(ea)) {
+			if (ea < endEA)
+				++rangeLength;
+			auto instruction = api.instructionForEA(ea);
+			eas.push_back(ea);
+			hashes.push_back(DumpDiff::hashForInstruction(instruction));
+			instructions.push_back(instruction);
+			targets.push_back(std::vector<EA>());
+			for (auto &xref : instruction.getXrefs()) {
+				targets.back().push_back(xref->getTarget());
+			}
+		}
+
+		std::vector<Function> functions;
+		std::unordered_map<EA::EAValue_t, uint64_t> hashForTarget;
+		size_t first = 0;
+		for (size_t i = 0; i < rangeLength; ++i) {
+			size_t length = i + 1 - first;
+			size_t windowStart = i + 1 >= first + boundaryWindow ? i + 1 - boundaryWindow : first;
+			bool isBoundary = length >= maximumFunctionLength || i + 1 == rangeLength
+				|| (length >= minimumFunctionLength && (fnv1aHash(&hashes[windowStart], (i + 1 - windowStart) * sizeof(uint64_t)) & boundaryMask) == 0);
+			if (!isBoundary)
+				continue;
+
+			size_t end = i + 1;
+			size_t contextEnd = std::min(end + contextLength, eas.size());
+			const EA &functionEA = eas[first];
+			const EA &lastEA = eas[contextEnd - 1];
+			uint64_t key = fnv1aOffsetBasis;
+			// addresses are numbered within the function and its context
+			DumpDiff::AddressNumbers addressNumbers;
+			for (size_t k = first; k < contextEnd; ++k) {
+				uint64_t instructionHash = DumpDiff::hashForInstruction(instructions[k], addressNumbers, rawOperandTexts);
+				key = fnv1aHash(&instructionHash, sizeof(instructionHash), key);
+				for (auto &target : targets[k]) {
+					uint64_t targetKey;
+					if (!(target < functionEA) && !(lastEA < target)) {
+						targetKey = target.getValue() - functionEA.getValue();
+					} else {
+						auto it = hashForTarget.find(target.getValue());
+						if (it == hashForTarget.end())
+							it = hashForTarget.emplace(target.getValue(), hashForCode(api, target, contextLength, rawOperandTexts)).first;
+						targetKey = it->second;
+					}
+					key = fnv1aHash(&targetKey, sizeof(targetKey), key);
+				}
+			}
+			if (startEAKey) {
+				for (size_t k = first; k < end; ++k) {
+					uint64_t startKey = startEAKey(api, eas[k], functionEA);
+					key = fnv1aHash(&startKey, sizeof(startKey), key);
+				}
+			}
+			// the length separates functions that end in each others context
+			uint64_t functionLength = end - first;
+			key = fnv1aHash(&functionLength, sizeof(functionLength), key);
+			functions.push_back({functionEA, end < rangeLength ? eas[end] : endEA, key});
+			first = end;
+		}
+		return functions;
+	}
+
+	FunctionMatchCache::StartEAKeyFunction FunctionMatchCache::graphWindowKey(const ControlFlowGraphMatching &graphMatcher, const Patterns &patterns) {
+		const bool rawOperandTexts = DumpDiff::patternsTestOperandTexts(patterns);
+		return [&graphMatcher, patterns, rawOperandTexts](DisassemblerAPI &api, const EA &startEA, const EA &functionEA) -> uint64_t {
+			size_t maxDepth = 0;
+			if (graphMatcher.candidatePatterns(patterns, api.instructionForEA(startEA).getMnemonic(), maxDepth).empty())
+				return 0;
+			// the window the matcher builds its instruction graph from, the EAs of its
+			// vertices become the end EAs of matches
+			CFGWindow window;
+			auto instructionForEA = [&api](const EA &ea) -> Instruction_ref {
+				return std::make_shared<Instruction>(api.instructionForEA(ea));
+			};
+			fillCFGWindow(window, startEA, graphMatcher.instructionGraphDepth(maxDepth), instructionForEA, graphMatcher.maxXrefFanOut);
+			uint64_t hash = fnv1aHash(&window.depth, sizeof(window.depth));
+			DumpDiff::AddressNumbers addressNumbers;
+			for (size_t i = 0; i < window.instructions.size(); ++i) {
+				uint64_t values[3] = {
+					window.eas[i] == InvalidEA ? ~0ull : (uint64_t)(window.eas[i].getValue() - functionEA.getValue()),
+					DumpDiff::hashForInstruction(*window.instructions[i], addressNumbers, rawOperandTexts),
+					(uint64_t)window.distances[i]
+				};
+				hash = fnv1aHash(values, sizeof(values), hash);
+			}
+			for (auto &edge : window.edges) {
+				uint64_t values[2] = {edge.first, edge.second};
+				hash = fnv1aHash(values, sizeof(values), hash);
+			}
+			return hash;
+		};
+	}
+
+	uint64_t FunctionMatchCache::entryKey(const Function &function, const std::string &matcherName) {
+		return fnv1aHash(matcherName.data(), matcherName.size(), function.key);
+	}
+
+	bool FunctionMatchCache::lookup(const Function &function, const std::string &matcherName, Matches &matches) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _entries.find(entryKey(function, matcherName));
+		if (it == _entries.end()) {
+			++_missCount;
+			return false;
+		}
+		++_hitCount;
+		for (auto &cachedMatch : it->second) {
+			matches.push_back(std::make_shared<Match>(EA(function.startEA.getValue() + cachedMatch.startOffset), EA(function.startEA.getValue() + cachedMatch.endOffset), cachedMatch.patternName));
+		}
+		return true;
+	}
+
+	void FunctionMatchCache::insert(const Function &function, const std::string &matcherName, const Matches &matches) {
+		std::vector<CachedMatch> cachedMatches;
+		for (auto &match : matches) {
+			cachedMatches.push_back({(int64_t)(match->getStartEA().getValue() - function.startEA.getValue()), (int64_t)(match->getEndEA().getValue() - function.startEA.getValue()), match->getPatternName()});
+		}
+		std::lock_guard<std::mutex> lock(_mutex);
+		_entries.emplace(entryKey(function, matcherName), std::move(cachedMatches));
+	}
+
+	size_t FunctionMatchCache::getEntryCount() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _entries.size();
+	}
+
+	bool FunctionMatchCache::readFromFilePath(const std::string &path) {
+		auto fh = fopen(path.c_str(), "rb");
+		if (fh == nullptr)
+			return false;
+		std::string bytes;
+		char buffer[1 << 16];
+		size_t length;
+		while ((length = fread(buffer, 1, sizeof(buffer), fh)) > 0) {
+			bytes.append(buffer, length);
+		}
+		bool failed = ferror(fh) != 0;
+		fclose(fh);
+		if (failed || bytes.size() < sizeof(functionCacheMagic) || memcmp(bytes.data(), functionCacheMagic, sizeof(functionCacheMagic)) != 0)
+			return false;
+
+		ByteReader reader(bytes.data() + sizeof(functionCacheMagic), bytes.size() - sizeof(functionCacheMagic));
+		if (reader.getVarint() != functionCacheVersion)
+			return false;
+		if (reader.getFixed64() != _patternsHash)
+			return reader.valid;
+		std::unordered_map<uint64_t, std::vector<CachedMatch> > entries;
+		uint64_t entryCount = reader.getVarint();
+		for (uint64_t i = 0; i < entryCount && reader.valid; ++i) {
+			uint64_t key = reader.getFixed64();
+			uint64_t matchCount = reader.getVarint();
+			std::vector<CachedMatch> cachedMatches;
+			for (uint64_t j = 0; j < matchCount && reader.valid; ++j) {
+				int64_t startOffset = reader.getSigned();
+				int64_t endOffset = reader.getSigned();
+				cachedMatches.push_back({startOffset, endOffset, reader.getString()});
+			}
+			entries.emplace(key, std::move(cachedMatches));
+		}
+		if (!reader.valid)
+			return false;
+		std::lock_guard<std::mutex> lock(_mutex);
+		_entries.insert(entries.begin(), entries.end());
+		return true;
+	}
+
+	bool FunctionMatchCache::writeToFilePath(const std::string &path) const {
+		ByteWriter writer;
+		writer.bytes.append(functionCacheMagic, sizeof(functionCacheMagic));
+		writer.putVarint(functionCacheVersion);
+		writer.putFixed64(_patternsHash);
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			writer.putVarint(_entries.size());
+			for (auto &entry : _entries) {
+				writer.putFixed64(entry.first);
+				writer.putVarint(entry.second.size());
+				for (auto &cachedMatch : entry.second) {
+					writer.putSigned(cachedMatch.startOffset);
+					writer.putSigned(cachedMatch.endOffset);
+					writer.putString(cachedMatch.patternName);
+				}
+			}
+		}
+
+		// written next to the cache and renamed, a failed run keeps the previous cache
+		auto temporaryPath = path + ".tmp" + std::to_string((uintmax_t)getpid());
+		auto fh = fopen(temporaryPath.c_str(), "wb");
+		if (fh == nullptr)
+			return false;
+		bool written = fwrite(writer.bytes.data(), 1, writer.bytes.size(), fh) == writer.bytes.size();
+		written = fclose(fh) == 0 && written;
+		if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+			remove(temporaryPath.c_str());
+			return false;
+		}
+		return true;
+	}
+}
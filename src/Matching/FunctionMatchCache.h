@@ -0,0 +1,94 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_FUNCTIONMATCHCACHE_H
+#define IDIOMMATCHER_FUNCTIONMATCHCACHE_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <Matching/DisassemblerAPI.h>
+#include <Matching/MatchPersistence.h>
+
+namespace IdiomMatcher {
+
+	class ControlFlowGraphMatching;
+
+	// Matches of code that appears in many binaries, e.g. statically linked
+	// libraries, looked up by the content of the code instead of its EAs.
+	//
+	// Dumps have no function boundaries, the code is split into functions at
+	// content defined boundaries instead, so equal code is split equally in every
+	// binary once a few boundaries passed. The key of a function covers its
+	// instructions, the contextLength instructions after it that matches starting
+	// in it can reach and the first contextLength instructions at the targets of
+	// its xrefs leaving that code. Instructions are hashed like DumpDiff does with
+	// the addresses numbered per function, internal xref targets relative to the
+	// function start. Graph matchers read
+	// further, through the targets of targets, their keys also cover the windows
+	// of the start EAs in the function, see graphWindowKey.
+	//
+	// Entries are only valid for the patterns they were matched with, a cache
+	// read for other patterns is empty. Extracted values are not cached.
+	class FunctionMatchCache {
+	public:
+		// [startEA, endEA) of one function, its matches start in it
+		struct Function {
+			EA startEA;
+			EA endEA;
+			uint64_t key;
+		};
+
+		FunctionMatchCache(uint64_t patternsHash) : _patternsHash(patternsHash) { }
+
+		// functions with fewer instructions are extended to the next boundary
+		static const size_t minimumFunctionLength = 16;
+		static const size_t maximumFunctionLength = 1024;
+
+		// Hash of the code a matcher reads for matches starting at startEA, EAs relative to functionEA.
+		typedef std::function<uint64_t(DisassemblerAPI &api, const EA &startEA, const EA &functionEA)> StartEAKeyFunction;
+
+		// Splits the instructions in [startEA, endEA) into functions, startEAKey is
+		// added to the key for every instruction of a function if set. Operand texts
+		// are keyed unmasked with rawOperandTexts, see DumpDiff::patternsTestOperandTexts.
+		static std::vector<Function> functionsInRange(DisassemblerAPI &api, const EA &startEA, const EA &endEA, size_t contextLength,
+													  const StartEAKeyFunction &startEAKey = nullptr, bool rawOperandTexts = false);
+
+		// StartEAKeyFunction of graphMatcher: the CFG window it builds for a start EA where
+		// one of patterns can start, 0 for the other start EAs.
+		static StartEAKeyFunction graphWindowKey(const ControlFlowGraphMatching &graphMatcher, const Patterns &patterns);
+
+		// Appends the matches of matcherName cached for function, rebased to its startEA.
+		// Thread safe, false if there is no entry.
+		bool lookup(const Function &function, const std::string &matcherName, Matches &matches);
+		// Adds the matches of matcherName starting in function. Thread safe.
+		void insert(const Function &function, const std::string &matcherName, const Matches &matches);
+
+		// false if the file can't be read, entries of other patterns are skipped
+		bool readFromFilePath(const std::string &path);
+		bool writeToFilePath(const std::string &path) const;
+
+		size_t getEntryCount() const;
+		size_t getHitCount() const { return _hitCount; }
+		size_t getMissCount() const { return _missCount; }
+
+	private:
+		struct CachedMatch {
+			int64_t startOffset;
+			int64_t endOffset;
+			std::string patternName;
+		};
+
+		static uint64_t entryKey(const Function &function, const std::string &matcherName);
+
+		const uint64_t _patternsHash;
+		mutable std::mutex _mutex;
+		std::unordered_map<uint64_t, std::vector<CachedMatch> > _entries;
+		std::atomic<size_t> _hitCount{0};
+		std::atomic<size_t> _missCount{0};
+	};
+}
+
+#endif //IDIOMMATCHER_FUNCTIONMATCHCACHE_H
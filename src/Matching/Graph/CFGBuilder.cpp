@@ -3,11 +3,40 @@
 // Licensed under MIT License, see LICENSE for full text.
 
 #include "CFGBuilder.h"
+#include <Matching/Telemetry.h>
 
 namespace IdiomMatcher {
 
+    Instruction_ref xrefSummaryInstruction(const EA &firstTargetEA, const size_t targetCount) {
+        Operands operands{std::make_shared<Operand>(std::to_string(targetCount), std::vector<std::string>(), false, false, 0)};
+        return std::make_shared<Instruction>(XrefSummaryMnemonic, operands, XRefs(), 0, firstTargetEA);
+    }
+
+    // Calls follow for the non-data xref targets of instruction to follow, see fillCFG, and
+    // returns the number of targets left for a summary vertex starting at firstSummarizedEA.
+    template<typename IsInGraph, typename Follow>
+    static size_t followXrefs(const Instruction &instruction, const size_t maxXrefFanOut, const IsInGraph &isInGraph,
+                              const Follow &follow, EA &firstSummarizedEA) {
+        size_t followedCount = 0;
+        size_t summarizedCount = 0;
+        for (auto &ref : instruction.getXrefs()) {
+            if (ref->isData()) continue;
+            EA targetEA = ref->getTarget();
+            if (maxXrefFanOut == 0 || isInGraph(targetEA)) {
+                follow(targetEA);
+            } else if (followedCount < maxXrefFanOut) {
+                follow(targetEA);
+                ++followedCount;
+            } else if (summarizedCount++ == 0) {
+                firstSummarizedEA = targetEA;
+            }
+        }
+        return summarizedCount;
+    }
+
     std::map <EA, GraphVertexDescriptor> fillCFG(Graph &graph, const EA &startEA, const int depth,
-                                                               const InstructionForEACallback instructionForEA) {
+                                                               const InstructionForEACallback instructionForEA,
+                                                               const size_t maxXrefFanOut) {
         std::deque <CFGToDoItem> todos;
         todos.push_back(CFGToDoItem(startEA, GraphTraits::null_vertex(), depth));
 
@@ -18,7 +47,11 @@ namespace IdiomMatcher {
             todos.pop_front();
             GraphVertexDescriptor currentVertex;
             auto eaVertIt = eaToVertexDescriptor.find(todoItem.ea);
-            if (eaVertIt != eaToVertexDescriptor.end()) {
+            if (todoItem.summarizedCount > 0) {
+                // not found by EA, the summarized targets are not in the graph
+                currentVertex = graph.add_vertex(xrefSummaryInstruction(todoItem.ea, todoItem.summarizedCount));
+                IDIOMMATCHER_COUNT(GraphVertices, 1);
+            } else if (eaVertIt != eaToVertexDescriptor.end()) {
                 currentVertex = eaVertIt->second;
             } else {
                 auto instruction = instructionForEA(todoItem.ea);
@@ -27,21 +60,111 @@ namespace IdiomMatcher {
                 }
                 currentVertex = graph.add_vertex(instruction);
                 eaToVertexDescriptor[todoItem.ea] = currentVertex;
+                IDIOMMATCHER_COUNT(GraphVertices, 1);
 
                 if (todoItem.ttl > 0 || todoItem.ttl == -1) {
-                    for (auto ref : instruction->getXrefs()) {
-                        if (ref->isData()) continue;
-                        EA targetEA = ref->getTarget();
-                        int newTTL = todoItem.ttl > 0 ? todoItem.ttl - 1 : todoItem.ttl;
-                        auto todo = CFGToDoItem(targetEA, currentVertex, newTTL);
-                        todos.push_back(todo);
+                    int newTTL = todoItem.ttl > 0 ? todoItem.ttl - 1 : todoItem.ttl;
+                    EA firstSummarizedEA = InvalidEA;
+                    size_t summarizedCount = followXrefs(*instruction, maxXrefFanOut, [&eaToVertexDescriptor](const EA &targetEA) {
+                        return eaToVertexDescriptor.count(targetEA) != 0;
+                    }, [&todos, currentVertex, newTTL](const EA &targetEA) {
+                        todos.push_back(CFGToDoItem(targetEA, currentVertex, newTTL));
+                    }, firstSummarizedEA);
+                    if (summarizedCount > 0) {
+                        todos.push_back(CFGToDoItem(firstSummarizedEA, currentVertex, newTTL, summarizedCount));
                     }
                 }
             }
             if (todoItem.previousVertex != GraphTraits::null_vertex()) {
                 graph.add_edge(todoItem.previousVertex, currentVertex, GraphEdge());
+                IDIOMMATCHER_COUNT(GraphEdges, 1);
+            }
+        }
+        IDIOMMATCHER_COUNT(GraphsBuilt, 1);
+        return eaToVertexDescriptor;
+    }
+
+    void fillCFGWindow(CFGWindow &window, const EA &startEA, const int depth,
+                       const InstructionForEACallback instructionForEA,
+                       const size_t maxXrefFanOut) {
+        window = CFGWindow();
+        window.depth = depth;
+        window.maxXrefFanOut = maxXrefFanOut;
+
+        // same traversal as fillCFG, previous is the index of the vertex the xref comes from
+        struct WindowToDoItem {
+            EA ea;
+            size_t previous;
+            int distance;
+            size_t summarizedCount;
+        };
+        const size_t noPrevious = (size_t)-1;
+        std::deque <WindowToDoItem> todos;
+        todos.push_back(WindowToDoItem{startEA, noPrevious, 0, 0});
+
+        std::map <EA, size_t> eaToIndex;
+        while (todos.size() > 0) {
+            auto todoItem = todos.front();
+            todos.pop_front();
+            size_t currentIndex;
+            auto eaIndexIt = eaToIndex.find(todoItem.ea);
+            if (todoItem.summarizedCount > 0) {
+                currentIndex = window.instructions.size();
+                window.eas.push_back(InvalidEA);
+                window.instructions.push_back(xrefSummaryInstruction(todoItem.ea, todoItem.summarizedCount));
+                window.distances.push_back(todoItem.distance);
+            } else if (eaIndexIt != eaToIndex.end()) {
+                currentIndex = eaIndexIt->second;
+            } else {
+                auto instruction = instructionForEA(todoItem.ea);
+                if (instruction->getMnemonic() == InvalidInstruction.getMnemonic()) {
+                    continue;
+                }
+                currentIndex = window.instructions.size();
+                window.eas.push_back(todoItem.ea);
+                window.instructions.push_back(instruction);
+                window.distances.push_back(todoItem.distance);
+                eaToIndex[todoItem.ea] = currentIndex;
+
+                if (todoItem.distance < depth) {
+                    int distance = todoItem.distance + 1;
+                    EA firstSummarizedEA = InvalidEA;
+                    size_t summarizedCount = followXrefs(*instruction, maxXrefFanOut, [&eaToIndex](const EA &targetEA) {
+                        return eaToIndex.count(targetEA) != 0;
+                    }, [&todos, currentIndex, distance](const EA &targetEA) {
+                        todos.push_back(WindowToDoItem{targetEA, currentIndex, distance, 0});
+                    }, firstSummarizedEA);
+                    if (summarizedCount > 0) {
+                        todos.push_back(WindowToDoItem{firstSummarizedEA, currentIndex, distance, summarizedCount});
+                    }
+                }
+            }
+            if (todoItem.previous != noPrevious) {
+                window.edges.push_back(std::make_pair(todoItem.previous, currentIndex));
+            }
+        }
+    }
+
+    std::map <EA, GraphVertexDescriptor> fillCFGFromWindow(Graph &graph, const CFGWindow &window, const int depth) {
+        // fillCFG visits the vertices up to depth in the same order, deeper vertices are only
+        // added after them. Edges start at vertices that were expanded, those closer than depth.
+        std::map <EA, GraphVertexDescriptor> eaToVertexDescriptor;
+        std::vector<GraphVertexDescriptor> vertexDescriptors(window.instructions.size(), GraphTraits::null_vertex());
+        for (size_t i = 0; i < window.instructions.size(); ++i) {
+            if (window.distances[i] > depth)
+                continue;
+            vertexDescriptors[i] = graph.add_vertex(window.instructions[i]);
+            if (!(window.eas[i] == InvalidEA))
+                eaToVertexDescriptor[window.eas[i]] = vertexDescriptors[i];
+            IDIOMMATCHER_COUNT(GraphVertices, 1);
+        }
+        for (auto &edge : window.edges) {
+            if (window.distances[edge.first] < depth) {
+                graph.add_edge(vertexDescriptors[edge.first], vertexDescriptors[edge.second], GraphEdge());
+                IDIOMMATCHER_COUNT(GraphEdges, 1);
             }
         }
+        IDIOMMATCHER_COUNT(GraphsBuilt, 1);
         return eaToVertexDescriptor;
     }
 }
\ No newline at end of file
@@ -11,17 +11,50 @@ namespace IdiomMatcher {
 
 
     struct CFGToDoItem {
-        CFGToDoItem(const IdiomMatcher::EA &ea, const GraphVertexDescriptor &previousVertex, const uint ttl) : ea(ea),previousVertex(previousVertex),ttl(ttl) {};
+        CFGToDoItem(const IdiomMatcher::EA &ea, const GraphVertexDescriptor &previousVertex, const uint ttl, const size_t summarizedCount = 0) : ea(ea),previousVertex(previousVertex),ttl(ttl),summarizedCount(summarizedCount) {};
         const EA ea;
         const GraphVertexDescriptor previousVertex;
         const uint ttl;
+        // xref targets the summary vertex stands for, 0 for an instruction
+        const size_t summarizedCount;
     };
 
     typedef std::function<Instruction_ref(const EA& ea)> InstructionForEACallback;
 
+    // Mnemonic of the vertex standing for the xref targets of an instruction past maxXrefFanOut,
+    // e.g. the cases of a large jump table. Its only operand is the number of targets.
+    const std::string XrefSummaryMnemonic = "(xref summary)";
+    Instruction_ref xrefSummaryInstruction(const EA &firstTargetEA, const size_t targetCount);
+
     // Constructs a control flow graph starting at startEA with a maximum graph depth of depth.
+    // With maxXrefFanOut > 0 the xref targets of an instruction already in the graph are always
+    // followed, of the others only the first maxXrefFanOut, the rest become one summary vertex.
     std::map <EA, GraphVertexDescriptor> fillCFG(Graph &graph, const EA &startEA, const int depth,
-                                                 const InstructionForEACallback instructionForEA);
+                                                 const InstructionForEACallback instructionForEA,
+                                                 const size_t maxXrefFanOut = 0);
+
+    // Result of the breadth first search of fillCFG, recorded in the order fillCFG adds
+    // vertices and edges, with the distance of every vertex from the start instruction.
+    struct CFGWindow {
+        int depth = 0;
+        size_t maxXrefFanOut = 0;
+        // InvalidEA for summary vertices
+        std::vector<EA> eas;
+        std::vector<Instruction_ref> instructions;
+        std::vector<int> distances;
+        // indexes into instructions
+        std::vector<std::pair<size_t, size_t> > edges;
+    };
+
+    // Decodes the window fillCFG would visit for startEA and depth >= 0, without building a graph.
+    void fillCFGWindow(CFGWindow &window, const EA &startEA, const int depth,
+                       const InstructionForEACallback instructionForEA,
+                       const size_t maxXrefFanOut = 0);
+
+    // Builds the same graph fillCFG builds for the start EA of window, depth <= window.depth
+    // and the maxXrefFanOut of window.
+    // Vertices and edges are added in the same order, so matching results are identical.
+    std::map <EA, GraphVertexDescriptor> fillCFGFromWindow(Graph &graph, const CFGWindow &window, const int depth);
 
 }
 
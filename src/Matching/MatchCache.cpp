@@ -0,0 +1,117 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "MatchCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <Model/ByteCoding.h>
+#include <Model/PatternPersistence.h>
+
+namespace IdiomMatcher {
+
+	static const char matchCacheMagic[4] = {'I','M','M','C'};
+	static const uint64_t matchCacheVersion = 1;
+
+	static std::string hexString(uint64_t value) {
+		char string[17];
+		snprintf(string, sizeof(string), "%016jx", (uintmax_t)value);
+		return string;
+	}
+
+	uint64_t MatchCache::hashForPattern(const Pattern &pattern) {
+		auto json = PatternPersistence::jsonForPatterns(Patterns(1, std::make_shared<Pattern>(pattern)));
+		return fnv1aHash(json.data(), json.size());
+	}
+
+	uint64_t MatchCache::dumpKeyForRange(uint64_t dumpHash, const EA &startEA, const EA &endEA) {
+		uint64_t values[] = {dumpHash, (uint64_t)startEA.getValue(), (uint64_t)endEA.getValue()};
+		return fnv1aHash(values, sizeof(values));
+	}
+
+	bool MatchCache::createDirectory(const std::string &directory) {
+		return mkdir(directory.c_str(), 0755) == 0 || errno == EEXIST;
+	}
+
+	std::string MatchCache::pathForPattern(const Pattern &pattern) const {
+		return _directory + "/" + hexString(_dumpKey) + "_" + _matcherName + "_" + hexString(hashForPattern(pattern)) + ".imc";
+	}
+
+	bool MatchCache::readMatches(const Pattern &pattern, Matches &matches) const {
+		auto fh = fopen(pathForPattern(pattern).c_str(), "rb");
+		if (fh == nullptr)
+			return false;
+		std::string bytes;
+		char buffer[1 << 16];
+		size_t length;
+		while ((length = fread(buffer, 1, sizeof(buffer), fh)) > 0) {
+			bytes.append(buffer, length);
+		}
+		bool failed = ferror(fh) != 0;
+		fclose(fh);
+		if (failed || bytes.size() < sizeof(matchCacheMagic) || memcmp(bytes.data(), matchCacheMagic, sizeof(matchCacheMagic)) != 0)
+			return false;
+
+		ByteReader reader(bytes.data() + sizeof(matchCacheMagic), bytes.size() - sizeof(matchCacheMagic));
+		if (reader.getVarint() != matchCacheVersion || reader.getFixed64() != _dumpKey || reader.getString() != _matcherName)
+			return false;
+		// the file name only has the hash, the name guards against collisions of patterns named differently
+		if (reader.getString() != pattern.getName())
+			return false;
+		uint64_t count = reader.getVarint();
+		Matches entryMatches;
+		uint64_t previousStart = 0;
+		for (uint64_t i = 0; i < count && reader.valid; ++i) {
+			uint64_t start = previousStart + reader.getVarint();
+			uint64_t end = start + reader.getSigned();
+			entryMatches.push_back(std::make_shared<Match>(EA(start), EA(end), pattern.getName()));
+			previousStart = start;
+		}
+		if (!reader.valid || reader.position != reader.end)
+			return false;
+		matches.insert(matches.end(), entryMatches.begin(), entryMatches.end());
+		return true;
+	}
+
+	bool MatchCache::writeMatches(const Pattern &pattern, const Matches &matches) const {
+		// matches are written in EA order as deltas
+		std::vector<std::pair<uint64_t, uint64_t> > ranges;
+		ranges.reserve(matches.size());
+		for (auto &match : matches) {
+			ranges.push_back(std::make_pair((uint64_t)match->getStartEA().getValue(), (uint64_t)match->getEndEA().getValue()));
+		}
+		std::sort(ranges.begin(), ranges.end());
+
+		ByteWriter writer;
+		writer.bytes.append(matchCacheMagic, sizeof(matchCacheMagic));
+		writer.putVarint(matchCacheVersion);
+		writer.putFixed64(_dumpKey);
+		writer.putString(_matcherName);
+		writer.putString(pattern.getName());
+		writer.putVarint(ranges.size());
+		uint64_t previousStart = 0;
+		for (auto &range : ranges) {
+			writer.putVarint(range.first - previousStart);
+			writer.putSigned((int64_t)(range.second - range.first));
+			previousStart = range.first;
+		}
+
+		// written next to the entry and renamed, so concurrent runs never read a partial entry
+		auto path = pathForPattern(pattern);
+		auto temporaryPath = path + ".tmp" + std::to_string((uintmax_t)getpid());
+		auto fh = fopen(temporaryPath.c_str(), "wb");
+		if (fh == nullptr)
+			return false;
+		bool written = fwrite(writer.bytes.data(), 1, writer.bytes.size(), fh) == writer.bytes.size();
+		written = fclose(fh) == 0 && written;
+		if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+			remove(temporaryPath.c_str());
+			return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,45 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_MATCHCACHE_H
+#define IDIOMMATCHER_MATCHCACHE_H
+
+#include <string>
+#include <Matching/MatchPersistence.h>
+
+namespace IdiomMatcher {
+
+	// On-disk cache of the matches of single patterns, so a rerun on the same dump
+	// only matches the patterns that changed.
+	//
+	// An entry is a file named by the dump key, the matcher name and the hash of
+	// the pattern. The dump key must change with everything else the matches
+	// depend on, e.g. the content of the dump and the matched EA range.
+	// Extracted values are not cached.
+	class MatchCache {
+	public:
+		MatchCache(const std::string &directory, const std::string &matcherName, uint64_t dumpKey)
+				: _directory(directory), _matcherName(matcherName), _dumpKey(dumpKey) { }
+
+		// Appends the cached matches of pattern, false if there is no valid entry.
+		bool readMatches(const Pattern &pattern, Matches &matches) const;
+		// Replaces the entry of pattern, the matches must all be of pattern.
+		bool writeMatches(const Pattern &pattern, const Matches &matches) const;
+		std::string pathForPattern(const Pattern &pattern) const;
+
+		// FNV-1a of the serialized pattern
+		static uint64_t hashForPattern(const Pattern &pattern);
+		// combines the content hash of the dump with the matched range
+		static uint64_t dumpKeyForRange(uint64_t dumpHash, const EA &startEA, const EA &endEA);
+		// creates directory if it doesn't exist
+		static bool createDirectory(const std::string &directory);
+
+	private:
+		const std::string _directory;
+		const std::string _matcherName;
+		const uint64_t _dumpKey;
+	};
+}
+
+#endif //IDIOMMATCHER_MATCHCACHE_H
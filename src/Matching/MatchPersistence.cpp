@@ -3,6 +3,7 @@
 // Licensed under MIT License, see LICENSE for full text.
 
 #include "MatchPersistence.h"
+#include <Model/Logging.h>
 
 #define RAPIDJSON_HAS_STDSTRING 1
 #include <rapidjson/prettywriter.h>
@@ -97,6 +98,27 @@ namespace IdiomMatcher {
         return true;
     }
 
+    MatchPersistence MatchPersistence::readFromFilePath(const std::string &path) {
+
+        using namespace rapidjson;
+
+        char readBuffer[65536];
+        auto fh = fopen(path.c_str(),"r");
+        if (fh == nullptr) {
+            warning("failed to open match json file %s\n", path.c_str());
+            return MatchPersistence("", "", "", 0, 0, Matches());
+        }
+        FileReadStream is(fh, readBuffer, sizeof(readBuffer));
+        GenericDocument<ASCII<> > d;
+        d.ParseStream(is);
+        fclose(fh);
+        if (d.HasParseError() || !d.IsObject() || !d.HasMember("matches")) {
+            warning("failed to parse match json %s\n", path.c_str());
+            return MatchPersistence("", "", "", 0, 0, Matches());
+        }
+        return MatchPersistenceFromJSON(d);
+    }
+
     std::string MatchPersistence::matchPathForExecutablePath(const std::string &binaryPath) const {
         auto jsonpath = std::string(binaryPath);
         size_t lastPoint = jsonpath.find_last_of(".");
@@ -47,6 +47,8 @@ namespace IdiomMatcher {
                 : _executableName(executableName), _matcherName(matcherName), _executableArchitecture(exectuableArchitecture), _realTime(realTime), _cpuTime(cpuTime), _matches(matches) { }
 
         bool saveToFilePath(const std::string &path) const;
+        // reads files written by saveToFilePath, without matches and names if it fails
+        static MatchPersistence readFromFilePath(const std::string &path);
         std::string matchPathForExecutablePath(const std::string &path) const;
     };
 }
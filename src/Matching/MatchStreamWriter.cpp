@@ -0,0 +1,345 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "MatchStreamWriter.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <Model/ByteCoding.h>
+#include <Model/Logging.h>
+
+#define RAPIDJSON_HAS_STDSTRING 1
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/document.h>
+
+namespace IdiomMatcher {
+
+	static const char matchStreamMagic[4] = {'I','M','M','S'};
+	static const uint32_t matchStreamVersion = 1;
+
+	enum MatchStreamRecordType {
+		RecordPatternName = 1,
+		RecordMatch = 2,
+		RecordFooter = 3
+	};
+
+	typedef rapidjson::Writer<rapidjson::StringBuffer, rapidjson::ASCII<>, rapidjson::ASCII<> > StringWriter;
+	typedef rapidjson::GenericDocument<rapidjson::ASCII<> > StreamDocument;
+
+	static uint64_t bitsForDouble(double value) {
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	static double doubleForBits(uint64_t bits) {
+		double value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+#pragma mark - Writing
+
+	void MatchStreamWriter::Buffer::addMatch(const Match &match) {
+		if (_writer._format == FormatBinary) {
+			auto it = _patternNameIds.find(match.getPatternName());
+			if (it == _patternNameIds.end()) {
+				it = _patternNameIds.emplace(match.getPatternName(), _writer.idForPatternName(match.getPatternName())).first;
+			}
+			ByteWriter writer;
+			writer.putVarint(RecordMatch);
+			writer.putVarint(it->second);
+			writer.putVarint(match.getStartEA().getValue());
+			writer.putSigned((int64_t)(match.getEndEA().getValue() - match.getStartEA().getValue()));
+			_bytes.append(writer.bytes);
+		} else {
+			rapidjson::StringBuffer buffer;
+			StringWriter writer(buffer);
+			writer.StartObject();
+			writer.Key("startEA");
+			writer.Uint64(match.getStartEA().getValue());
+			writer.Key("endEA");
+			writer.Uint64(match.getEndEA().getValue());
+			writer.Key("patternName");
+			writer.String(match.getPatternName());
+			writer.EndObject();
+			_bytes.append(buffer.GetString(), buffer.GetSize());
+			_bytes.push_back('\n');
+		}
+		++_matchCount;
+
+		auto now = std::chrono::steady_clock::now();
+		if (_bytes.size() >= _writer.bufferSize || now - _lastAppend >= _writer.flushInterval) {
+			appendToWriter(false);
+		}
+	}
+
+	void MatchStreamWriter::Buffer::flush() {
+		appendToWriter(true);
+	}
+
+	void MatchStreamWriter::Buffer::appendToWriter(bool flushFile) {
+		if (!_bytes.empty() || flushFile) {
+			_writer.append(_bytes, _matchCount, flushFile);
+			_bytes.clear();
+			_matchCount = 0;
+		}
+		_lastAppend = std::chrono::steady_clock::now();
+	}
+
+	MatchStreamWriter::~MatchStreamWriter() {
+		if (_file != nullptr) {
+			fclose(_file);
+		}
+	}
+
+	bool MatchStreamWriter::openFilePath(const std::string &path) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_file != nullptr) {
+			fclose(_file);
+		}
+		_file = fopen(path.c_str(), "wb");
+		if (_file == nullptr) {
+			warning("failed to create %s\n", path.c_str());
+			return false;
+		}
+		_matchCount = 0;
+		_patternNameIds.clear();
+		_lastFlush = std::chrono::steady_clock::now();
+
+		std::string head;
+		if (_format == FormatBinary) {
+			ByteWriter writer;
+			writer.bytes.append(matchStreamMagic, sizeof(matchStreamMagic));
+			writer.putVarint(matchStreamVersion);
+			writer.putString(_executableName);
+			writer.putString(_matcherName);
+			writer.putString(_executableArchitecture);
+			head = writer.bytes;
+		} else {
+			rapidjson::StringBuffer buffer;
+			StringWriter writer(buffer);
+			writer.StartObject();
+			writer.Key("executableName");
+			writer.String(_executableName);
+			writer.Key("matcherName");
+			writer.String(_matcherName);
+			writer.Key("executableArchitecture");
+			writer.String(_executableArchitecture);
+			writer.EndObject();
+			head.assign(buffer.GetString(), buffer.GetSize());
+			head.push_back('\n');
+		}
+		fwrite(head.data(), 1, head.size(), _file);
+		fflush(_file);
+		return !ferror(_file);
+	}
+
+	void MatchStreamWriter::append(const std::string &bytes, size_t matchCount, bool flushFile) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_file == nullptr)
+			return;
+		fwrite(bytes.data(), 1, bytes.size(), _file);
+		_matchCount += matchCount;
+
+		auto now = std::chrono::steady_clock::now();
+		if (flushFile || now - _lastFlush >= flushInterval) {
+			fflush(_file);
+			_lastFlush = now;
+		}
+	}
+
+	uint64_t MatchStreamWriter::idForPatternName(const std::string &patternName) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _patternNameIds.find(patternName);
+		if (it != _patternNameIds.end())
+			return it->second;
+
+		uint64_t patternNameId = _patternNameIds.size();
+		_patternNameIds.emplace(patternName, patternNameId);
+		// the definition is in the file before any buffer can append a match using it
+		if (_file != nullptr) {
+			ByteWriter writer;
+			writer.putVarint(RecordPatternName);
+			writer.putVarint(patternNameId);
+			writer.putString(patternName);
+			fwrite(writer.bytes.data(), 1, writer.bytes.size(), _file);
+		}
+		return patternNameId;
+	}
+
+	bool MatchStreamWriter::finish(double realTime, double cpuTime) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_file == nullptr)
+			return false;
+
+		std::string footer;
+		if (_format == FormatBinary) {
+			ByteWriter writer;
+			writer.putVarint(RecordFooter);
+			writer.putFixed64(bitsForDouble(realTime));
+			writer.putFixed64(bitsForDouble(cpuTime));
+			writer.putVarint(_matchCount);
+			footer = writer.bytes;
+		} else {
+			rapidjson::StringBuffer buffer;
+			StringWriter writer(buffer);
+			writer.StartObject();
+			writer.Key("realTime");
+			writer.Double(realTime);
+			writer.Key("cpuTime");
+			writer.Double(cpuTime);
+			writer.Key("matchCount");
+			writer.Uint64(_matchCount);
+			writer.EndObject();
+			footer.assign(buffer.GetString(), buffer.GetSize());
+			footer.push_back('\n');
+		}
+		fwrite(footer.data(), 1, footer.size(), _file);
+		bool success = !ferror(_file);
+		success = fclose(_file) == 0 && success;
+		_file = nullptr;
+		return success;
+	}
+
+	size_t MatchStreamWriter::getMatchCount() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _matchCount;
+	}
+
+	std::string MatchStreamWriter::matchPathForExecutablePath(const std::string &binaryPath) const {
+		auto path = std::string(binaryPath);
+		size_t lastPoint = path.find_last_of(".");
+		if (lastPoint != std::string::npos) {
+			path.erase(lastPoint);
+		}
+		path.append("_matched_");
+		path.append(_matcherName);
+		path.append(_format == FormatBinary ? ".imm" : ".ndjson");
+		return path;
+	}
+
+#pragma mark - Reading
+
+	static MatchPersistence readBinaryMatchStream(const std::string &bytes, bool *complete) {
+		ByteReader reader(bytes.data(), bytes.size());
+		reader.position += sizeof(matchStreamMagic);
+		uint64_t version = reader.getVarint();
+		auto executableName = reader.getString();
+		auto matcherName = reader.getString();
+		auto executableArchitecture = reader.getString();
+		if (!reader.valid || version != matchStreamVersion) {
+			warning("unsupported match stream version %ju\n", (uintmax_t)version);
+			return MatchPersistence("", "", "", 0, 0, Matches());
+		}
+
+		std::vector<std::string> patternNames;
+		Matches matches;
+		double realTime = 0;
+		double cpuTime = 0;
+		bool foundFooter = false;
+		while (reader.position < reader.end && !foundFooter) {
+			uint64_t type = reader.getVarint();
+			if (type == RecordPatternName) {
+				uint64_t patternNameId = reader.getVarint();
+				auto patternName = reader.getString();
+				if (!reader.valid)
+					break;
+				if (patternNames.size() <= patternNameId) {
+					patternNames.resize(patternNameId + 1);
+				}
+				patternNames[patternNameId] = patternName;
+			} else if (type == RecordMatch) {
+				uint64_t patternNameId = reader.getVarint();
+				uint64_t startEA = reader.getVarint();
+				int64_t length = reader.getSigned();
+				// a truncated last record is from a run that didn't finish
+				if (!reader.valid || patternNameId >= patternNames.size())
+					break;
+				matches.push_back(std::make_shared<Match>(EA(startEA), EA(startEA + length), patternNames[patternNameId]));
+			} else if (type == RecordFooter) {
+				realTime = doubleForBits(reader.getFixed64());
+				cpuTime = doubleForBits(reader.getFixed64());
+				reader.getVarint();
+				foundFooter = reader.valid;
+			} else {
+				break;
+			}
+		}
+		if (complete != nullptr) {
+			*complete = foundFooter;
+		}
+		if (!foundFooter) {
+			realTime = cpuTime = 0;
+		}
+		return MatchPersistence(executableName, matcherName, executableArchitecture, realTime, cpuTime, matches);
+	}
+
+	static MatchPersistence readNDJSONMatchStream(std::istream &stream, bool *complete) {
+		std::string executableName, matcherName, executableArchitecture;
+		Matches matches;
+		double realTime = 0;
+		double cpuTime = 0;
+		bool foundFooter = false;
+
+		std::string line;
+		bool isHead = true;
+		while (std::getline(stream, line) && !foundFooter) {
+			StreamDocument d;
+			d.Parse(line.c_str());
+			// a truncated last line is from a run that didn't finish
+			if (d.HasParseError() || !d.IsObject())
+				break;
+			// values of the wrong type end the stream like a parse error
+			if (isHead) {
+				if (!d.HasMember("executableName") || !d.HasMember("matcherName") || !d.HasMember("executableArchitecture"))
+					break;
+				if (!d["executableName"].IsString() || !d["matcherName"].IsString() || !d["executableArchitecture"].IsString())
+					break;
+				executableName = d["executableName"].GetString();
+				matcherName = d["matcherName"].GetString();
+				executableArchitecture = d["executableArchitecture"].GetString();
+				isHead = false;
+			} else if (d.HasMember("startEA") && d.HasMember("endEA") && d.HasMember("patternName")) {
+				if (!d["startEA"].IsUint64() || !d["endEA"].IsUint64() || !d["patternName"].IsString())
+					break;
+				matches.push_back(std::make_shared<Match>(EA(d["startEA"].GetUint64()), EA(d["endEA"].GetUint64()), d["patternName"].GetString()));
+			} else if (d.HasMember("realTime") && d.HasMember("cpuTime")) {
+				if (!d["realTime"].IsNumber() || !d["cpuTime"].IsNumber())
+					break;
+				realTime = d["realTime"].GetDouble();
+				cpuTime = d["cpuTime"].GetDouble();
+				foundFooter = true;
+			}
+		}
+		if (complete != nullptr) {
+			*complete = foundFooter;
+		}
+		return MatchPersistence(executableName, matcherName, executableArchitecture, realTime, cpuTime, matches);
+	}
+
+	MatchPersistence readMatchStreamFromFilePath(const std::string &path, bool *complete) {
+		if (complete != nullptr) {
+			*complete = false;
+		}
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			warning("failed to open %s\n", path.c_str());
+			return MatchPersistence("", "", "", 0, 0, Matches());
+		}
+
+		char magic[sizeof(matchStreamMagic)] = {0};
+		file.read(magic, sizeof(magic));
+		if (file.gcount() == sizeof(magic) && memcmp(magic, matchStreamMagic, sizeof(magic)) == 0) {
+			std::stringstream bytes;
+			bytes.write(magic, sizeof(magic));
+			bytes << file.rdbuf();
+			return readBinaryMatchStream(bytes.str(), complete);
+		}
+		file.clear();
+		file.seekg(0);
+		return readNDJSONMatchStream(file, complete);
+	}
+}
@@ -0,0 +1,100 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_MATCHSTREAMWRITER_H
+#define IDIOMMATCHER_MATCHSTREAMWRITER_H
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+#include <Matching/MatchPersistence.h>
+
+namespace IdiomMatcher {
+
+	// Writes matches to a file while they are found instead of collecting them
+	// for MatchPersistence.
+	//
+	// NDJSON: one object per line, a head line with executable and matcher,
+	// one line per match and a footer line with realTime, cpuTime and matchCount.
+	// Binary: magic "IMMS", version and head, then records tagged with
+	// MatchStreamRecordType. Pattern names are defined once and referenced by id.
+	//
+	// Matches are in the order they were written, not sorted by EA. Files without
+	// footer are from runs that did not finish, their matches are still readable.
+	class MatchStreamWriter {
+	public:
+		enum Format {
+			FormatNDJSON,
+			FormatBinary
+		};
+
+		// Collects the matches of one thread and appends them to the file in larger
+		// pieces. Not thread safe, use one buffer per thread. Flushes on destruction.
+		class Buffer {
+		public:
+			Buffer(MatchStreamWriter &writer) : _writer(writer) { }
+			~Buffer() { flush(); }
+
+			Buffer(const Buffer &) = delete;
+			Buffer &operator=(const Buffer &) = delete;
+
+			void addMatch(const Match &match);
+			// appends the collected matches and flushes the file
+			void flush();
+
+		private:
+			void appendToWriter(bool flushFile);
+
+			MatchStreamWriter &_writer;
+			std::string _bytes;
+			size_t _matchCount = 0;
+			std::unordered_map<std::string, uint64_t> _patternNameIds;
+			std::chrono::steady_clock::time_point _lastAppend = std::chrono::steady_clock::now();
+		};
+
+		MatchStreamWriter(const std::string &executableName, const std::string &matcherName, const std::string &executableArchitecture, const Format format)
+				: _executableName(executableName), _matcherName(matcherName), _executableArchitecture(executableArchitecture), _format(format) { }
+		~MatchStreamWriter();
+
+		MatchStreamWriter(const MatchStreamWriter &) = delete;
+		MatchStreamWriter &operator=(const MatchStreamWriter &) = delete;
+
+		// Creates the file and writes the head.
+		bool openFilePath(const std::string &path);
+		// Writes the footer and closes the file.
+		bool finish(double realTime, double cpuTime);
+
+		// bytes a buffer collects before appending to the file
+		size_t bufferSize = 1 << 16;
+		// buffers and file are flushed at least that often while matches are added
+		std::chrono::milliseconds flushInterval = std::chrono::milliseconds(1000);
+
+		Format getFormat() const { return _format; }
+		size_t getMatchCount() const;
+		std::string matchPathForExecutablePath(const std::string &path) const;
+
+	private:
+		void append(const std::string &bytes, size_t matchCount, bool flushFile);
+		// id of a pattern name, the first request writes the definition record
+		uint64_t idForPatternName(const std::string &patternName);
+
+		const std::string _executableName;
+		const std::string _matcherName;
+		const std::string _executableArchitecture;
+		const Format _format;
+
+		mutable std::mutex _mutex;
+		FILE *_file = nullptr;
+		size_t _matchCount = 0;
+		std::unordered_map<std::string, uint64_t> _patternNameIds;
+		std::chrono::steady_clock::time_point _lastFlush;
+	};
+
+	// Reads files of both formats. complete is set to false if the footer is missing,
+	// realTime and cpuTime are 0 in that case.
+	MatchPersistence readMatchStreamFromFilePath(const std::string &path, bool *complete = nullptr);
+}
+
+#endif //IDIOMMATCHER_MATCHSTREAMWRITER_H
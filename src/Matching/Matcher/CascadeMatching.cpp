@@ -0,0 +1,88 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "CascadeMatching.h"
+#include <algorithm>
+#include <Matching/CachingDisassemblerAPI.h>
+#include <Matching/Graph/CFGBuilder.h>
+#include <Matching/Telemetry.h>
+
+namespace IdiomMatcher {
+
+	void CascadeMatching::prepareForPatterns(const Patterns &patterns) {
+		_verifier->prepareForPatterns(patterns);
+		_requiredMnemonics.clear();
+		_rejectedCandidateCount = 0;
+		for (auto &pattern : patterns) {
+			// of the pattern graph, instructions it doesn't reach are not matched
+			std::map<std::string, size_t> counts;
+			for (auto &instruction : _verifier->patternGraphInstructions(pattern)) {
+				if (!instruction->getIsRegex())
+					++counts[instruction->getMnemonic()];
+			}
+			_requiredMnemonics[pattern].assign(counts.begin(), counts.end());
+		}
+	}
+
+	void CascadeMatching::setProfiler(PatternProfiler *profiler) {
+		Matching::setProfiler(profiler);
+		_verifier->setProfiler(profiler);
+	}
+
+	void CascadeMatching::testForPatternsStartingAtEA(const Patterns &patterns, const EA &startEA, DisassemblerAPI &disassemblerAPI, const FoundMatchFunctionCallback &callback) {
+		auto cachingAPI = dynamic_cast<CachingDisassemblerAPI *>(&disassemblerAPI);
+		auto instructionForEA = [cachingAPI, &disassemblerAPI](const EA &ea) -> Instruction_ref {
+			if (cachingAPI)
+				return cachingAPI->instructionRefForEA(ea);
+			return std::make_shared<Instruction>(disassemblerAPI.instructionForEA(ea));
+		};
+
+		size_t maxDepth = 0;
+		Patterns canditates = _verifier->candidatePatterns(patterns, instructionForEA(startEA)->getMnemonic(), maxDepth);
+		_verifier->profileCandidates(patterns, canditates);
+		if (canditates.empty()) {
+			return;
+		}
+
+		// the window and graph depth of all canditates, so the survivors are matched
+		// against the instruction graph the verifier alone would build
+		int depth = _verifier->instructionGraphDepth(maxDepth);
+		CFGWindow window;
+		Patterns survivors;
+		{
+			// the prefilter is profiled like building the instruction graph
+			ProfileTimer timer(_profiler);
+			fillCFGWindow(window, startEA, depth, instructionForEA, _verifier->maxXrefFanOut);
+			// windows have few instructions, counting by scanning them is cheaper than a map
+			for (auto &pattern : canditates) {
+				auto it = _requiredMnemonics.find(pattern);
+				bool survives = it == _requiredMnemonics.end() || std::all_of(it->second.begin(), it->second.end(), [&window](const std::pair<std::string, size_t> &required) {
+					size_t count = 0;
+					for (auto &instruction : window.instructions) {
+						if (instruction->getMnemonic() == required.first && ++count == required.second)
+							return true;
+					}
+					return false;
+				});
+				if (survives)
+					survivors.push_back(pattern);
+			}
+		}
+		if (survivors.size() < canditates.size()) {
+			_rejectedCandidateCount += canditates.size() - survivors.size();
+			IDIOMMATCHER_COUNT(CascadeRejectedCandidates, canditates.size() - survivors.size());
+		}
+		if (survivors.empty()) {
+			return;
+		}
+
+		Graph instructionGraph;
+		{
+			ProfileTimer timer(_profiler);
+			fillCFGFromWindow(instructionGraph, window, depth);
+			_verifier->transformInstructionGraph(instructionGraph);
+		}
+		_verifier->testCandidatesInInstructionGraph(survivors, startEA, instructionGraph, callback);
+	}
+}
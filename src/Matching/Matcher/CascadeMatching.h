@@ -0,0 +1,48 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_CASCADEMATCHING_H
+#define IDIOMMATCHER_CASCADEMATCHING_H
+
+#include <memory>
+#include <Matching/Matcher/ControlFlowGraphMatching.h>
+
+namespace IdiomMatcher {
+
+	// Runs a graph matcher only where a linear prefilter passes.
+	//
+	// The prefilter decodes the window the graph matcher would build its instruction
+	// graph from, see fillCFGWindow, and counts its mnemonics. A candidate needing a
+	// mnemonic more often than the window has it can't be mapped into the instruction
+	// graph, in whatever order the instructions are, so it is dropped without a VF2
+	// run. The instruction graph and its transformation, e.g. to a PDG, are only built
+	// for windows with a surviving candidate. Regex mnemonics are not counted.
+	// The matches are the ones of the graph matcher alone.
+	class CascadeMatching : public Matching {
+	public:
+		// takes ownership of verifier
+		CascadeMatching(ControlFlowGraphMatching *verifier) : Matching("Cascade" + verifier->getName(), verifier->getConcurrencyAllowed()), _verifier(verifier) { }
+
+		// shares the instructions of a CachingDisassemblerAPI, e.g. of CombinedMatching
+		virtual void testForPatternsStartingAtEA(const Patterns &patterns, const EA &startEA, DisassemblerAPI &disassemblerAPI, const FoundMatchFunctionCallback &callback) override;
+
+		virtual void prepareForPatterns(const Patterns &patterns) override;
+
+		// the verifier profiles the patterns, its cost includes the prefilter
+		virtual void setProfiler(PatternProfiler *profiler) override;
+
+		ControlFlowGraphMatching &getVerifier() const { return *_verifier; }
+
+		// candidates dropped by the prefilter since prepareForPatterns
+		uint64_t getRejectedCandidateCount() const { return _rejectedCandidateCount; }
+
+	private:
+		std::unique_ptr<ControlFlowGraphMatching> _verifier;
+		// the mnemonics of the instructions of a pattern and how often it has them
+		std::map<Pattern_ref, std::vector<std::pair<std::string, size_t> > > _requiredMnemonics;
+		std::atomic<uint64_t> _rejectedCandidateCount{0};
+	};
+}
+
+#endif //IDIOMMATCHER_CASCADEMATCHING_H
@@ -0,0 +1,93 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "CombinedMatching.h"
+#include <algorithm>
+
+namespace IdiomMatcher {
+
+	CombinedMatching::CombinedMatching(const std::vector<Matching *> &matchers) : _matchers(matchers) {
+		for (size_t i = 0; i < _matchers.size(); ++i) {
+			auto graphMatcher = dynamic_cast<ControlFlowGraphMatching *>(_matchers[i]);
+			if (graphMatcher) {
+				_graphMatchers.push_back(std::make_pair(graphMatcher, i));
+			}
+		}
+	}
+
+	void CombinedMatching::prepareForPatterns(const Patterns &patterns) {
+		for (auto matcher : _matchers) {
+			matcher->prepareForPatterns(patterns);
+		}
+	}
+
+	bool CombinedMatching::getConcurrencyAllowed() const {
+		return std::all_of(_matchers.begin(), _matchers.end(), [](const Matching *matcher) { return matcher->getConcurrencyAllowed(); });
+	}
+
+	void CombinedMatching::searchForPatterns(const Patterns &patterns, DisassemblerAPI &disassemblerAPI, const FoundMatchFunctionCallback &callback, const EA &startEA, const EA &endEA) const {
+		if (patterns.empty()) {
+			return;
+		}
+		CachingDisassemblerAPI cachingAPI(disassemblerAPI);
+		EA currentEA = startEA;
+		while (currentEA < endEA) {
+			testForPatternsStartingAtEA(patterns, currentEA, cachingAPI, callback);
+			currentEA = cachingAPI.nextEA(currentEA);
+		}
+	}
+
+	void CombinedMatching::testForPatternsStartingAtEA(const Patterns &patterns, const EA &startEA, CachingDisassemblerAPI &disassemblerAPI, const FoundMatchFunctionCallback &callback) const {
+		// keeps the order of the matchers for the results of one start EA
+		for (size_t i = 0; i < _matchers.size(); ++i) {
+			if (dynamic_cast<ControlFlowGraphMatching *>(_matchers[i]))
+				continue;
+			_matchers[i]->testForPatternsStartingAtEA(patterns, startEA, disassemblerAPI, [&callback, i](const Pattern &pattern, const EA &start, const EA &end, const Matching::ExtractedValuesMap &extractedValues) -> bool {
+				return callback(i, pattern, start, end, extractedValues);
+			});
+		}
+
+		if (_graphMatchers.empty()) {
+			return;
+		}
+
+		// all graph matchers select the canditates by the first mnemonic
+		size_t maxDepth = 0;
+		auto mnemonic = disassemblerAPI.instructionRefForEA(startEA)->getMnemonic();
+		Patterns canditates = _graphMatchers.front().first->candidatePatterns(patterns, mnemonic, maxDepth);
+		for (auto &graphMatcher : _graphMatchers) {
+			graphMatcher.first->profileCandidates(patterns, canditates);
+		}
+		if (canditates.empty()) {
+			return;
+		}
+
+		int windowDepth = 0;
+		for (auto &graphMatcher : _graphMatchers) {
+			windowDepth = std::max(windowDepth, graphMatcher.first->instructionGraphDepth(maxDepth));
+		}
+		CFGWindow window;
+		{
+			// the shared window is profiled as cost of the first graph matcher
+			ProfileTimer timer(_graphMatchers.front().first->getProfiler());
+			fillCFGWindow(window, startEA, windowDepth, [&disassemblerAPI](const EA &ea) -> Instruction_ref {
+				return disassemblerAPI.instructionRefForEA(ea);
+			}, _graphMatchers.front().first->maxXrefFanOut);
+		}
+
+		for (auto &graphMatcher : _graphMatchers) {
+			auto matcher = graphMatcher.first;
+			size_t matcherIndex = graphMatcher.second;
+			Graph instructionGraph;
+			{
+				ProfileTimer timer(matcher->getProfiler());
+				fillCFGFromWindow(instructionGraph, window, matcher->instructionGraphDepth(maxDepth));
+				matcher->transformInstructionGraph(instructionGraph);
+			}
+			matcher->testCandidatesInInstructionGraph(canditates, startEA, instructionGraph, [&callback, matcherIndex](const Pattern &pattern, const EA &start, const EA &end, const Matching::ExtractedValuesMap &extractedValues) -> bool {
+				return callback(matcherIndex, pattern, start, end, extractedValues);
+			});
+		}
+	}
+}
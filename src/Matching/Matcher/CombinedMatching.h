@@ -0,0 +1,45 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_COMBINEDMATCHING_H
+#define IDIOMMATCHER_COMBINEDMATCHING_H
+
+#include <Matching/Matcher/ControlFlowGraphMatching.h>
+#include <Matching/CachingDisassemblerAPI.h>
+#include <Matching/Graph/CFGBuilder.h>
+
+namespace IdiomMatcher {
+
+	// Runs several matchers in one pass over the disassembly.
+	//
+	// Instructions are decoded once through a CachingDisassemblerAPI for all
+	// matchers. For every start EA the graph matchers share one CFG window,
+	// decoded with fillCFGWindow at the largest depth any of them needs; each
+	// derives its instruction graph from it with fillCFGFromWindow. The results
+	// are the same as running the matchers one after another if the graph matchers
+	// have the same maxXrefFanOut, the window has the one of the first.
+	class CombinedMatching {
+	public:
+		typedef std::function<bool(size_t matcherIndex, const Pattern&, const EA& start, const EA& end, const Matching::ExtractedValuesMap&)> FoundMatchFunctionCallback;
+
+		// the matchers are not owned and must outlive this object
+		CombinedMatching(const std::vector<Matching *> &matchers);
+
+		void prepareForPatterns(const Patterns &patterns);
+
+		// Searches start EAs in [startEA, endEA), thread safe after prepareForPatterns.
+		void searchForPatterns(const Patterns &patterns, DisassemblerAPI &disassemblerAPI, const FoundMatchFunctionCallback &callback, const EA &startEA, const EA &endEA) const;
+
+		void testForPatternsStartingAtEA(const Patterns &patterns, const EA &startEA, CachingDisassemblerAPI &disassemblerAPI, const FoundMatchFunctionCallback &callback) const;
+
+		bool getConcurrencyAllowed() const;
+
+	private:
+		std::vector<Matching *> _matchers;
+		// the graph matchers and their index in _matchers
+		std::vector<std::pair<ControlFlowGraphMatching *, size_t> > _graphMatchers;
+	};
+}
+
+#endif //IDIOMMATCHER_COMBINEDMATCHING_H
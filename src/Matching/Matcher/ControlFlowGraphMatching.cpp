@@ -4,8 +4,13 @@
 
 #include "ControlFlowGraphMatching.h"
 #include <algorithm>
+#include <chrono>
+#include <set>
 #include <boost/graph/vf2_sub_graph_iso.hpp>
 #include <Matching/Graph/CFGBuilder.h>
+#include <Matching/Telemetry.h>
+#include <Model/ByteCoding.h>
+#include <Model/TraceRecorder.h>
 
 namespace IdiomMatcher {
 
@@ -14,40 +19,170 @@ namespace IdiomMatcher {
 		disassemblerAPI.setCurrentEAAndDecodeInstruction(startEA);
 		auto dissMnemonic = disassemblerAPI.getCurrentInstruction().getMnemonic();
 
-		Patterns canditates;
-
 		size_t maxDepth = 0;
+		Patterns canditates = candidatePatterns(patterns, dissMnemonic, maxDepth);
+		profileCandidates(patterns, canditates);
+
+		// early return if no canditate patterns were found
+		if (canditates.empty()) return;
+
+		Graph instructionGraph;
+		disassemblerAPI.setCurrentEAAndDecodeInstruction(startEA);
+		{
+			ProfileTimer timer(_profiler);
+			fillInstruction(instructionGraph,disassemblerAPI, maxDepth);
+		}
+
+		testCandidatesInInstructionGraph(canditates, startEA, instructionGraph, callback);
+	}
+
+	Patterns ControlFlowGraphMatching::candidatePatterns(const Patterns &patterns, const std::string &mnemonic, size_t &maxDepth) const {
+		Patterns canditates;
+		maxDepth = 0;
 		for (auto &pattern: patterns) {
 			// early continue if pattern empty
 			auto &instructions = pattern->getInstructions();
 			if (instructions.empty())
 				continue;
 			// early continue if first instructions don't match
-			if (instructions[0]->getMnemonic() != dissMnemonic) {
+			if (instructions[0]->getMnemonic() != mnemonic) {
 				continue;
 			}
 
 			canditates.push_back(pattern);
 			maxDepth = std::max(maxDepth, instructions.size());
 		}
+		return canditates;
+	}
 
-		// early return if no canditate patterns were found
-		if (canditates.empty()) return;
+	void ControlFlowGraphMatching::profileCandidates(const Patterns &patterns, const Patterns &canditates) {
+		if (!_profiler)
+			return;
+		for (auto &pattern : patterns) {
+			_profiler->profileForPattern(pattern.get()).testedStartEAs++;
+		}
+		for (auto &pattern : canditates) {
+			_profiler->profileForPattern(pattern.get()).passedFirstInstruction++;
+		}
+	}
 
-		Graph instructionGraph;
-		disassemblerAPI.setCurrentEAAndDecodeInstruction(startEA);
-		fillInstruction(instructionGraph,disassemblerAPI, maxDepth);
+	void ControlFlowGraphMatching::testCandidatesInInstructionGraph(const Patterns &canditates, const EA &startEA, const Graph &instructionGraph, const FoundMatchFunctionCallback &callback) {
+		// results of the shared prefixes for this instruction graph, 0 if not matched yet
+		std::vector<signed char> prefixResults;
+		// an abandoned prefix doesn't tell if the patterns sharing it match
+		bool prefixBudgetExhausted = false;
+		auto prefixMatches = [&](size_t prefixIndex) {
+			if (prefixResults.empty())
+				prefixResults.resize(prefixGraphs.size(), 0);
+			if (prefixResults[prefixIndex] == 0) {
+				Matching::ExtractedValuesMap prefixValues;
+				EA prefixEndEA = startEA;
+				bool matched;
+				bool budgetExhausted = false;
+				if (_profiler) {
+					// prefixes are shared, their cost is not of a single pattern
+					auto &profile = _profiler->profileForPattern(nullptr);
+					{
+						ProfileTimer timer(profile.matchTime);
+						matched = matchGraphs(*prefixGraphs[prefixIndex], instructionGraph, Graph::null_vertex(), &prefixEndEA, prefixValues, nullptr, &budgetExhausted);
+					}
+					profile.vf2Calls++;
+					if (budgetExhausted)
+						profile.budgetExhausted++;
+				} else {
+					matched = matchGraphs(*prefixGraphs[prefixIndex], instructionGraph, Graph::null_vertex(), &prefixEndEA, prefixValues, nullptr, &budgetExhausted);
+				}
+				if (budgetExhausted) {
+					recordExhaustedAttempt(startEA);
+					prefixBudgetExhausted = true;
+				}
+				prefixResults[prefixIndex] = matched ? 1 : -1;
+			}
+			return prefixResults[prefixIndex] > 0;
+		};
+
+		// fingerprint of the instruction graph, computed for the first memoizable candidate
+		uint64_t fingerprint = 0;
+		std::vector<GraphVertexDescriptor> windowVertices;
+		std::unordered_map<GraphVertexDescriptor, uint32_t> positionForVertex;
 
 		for (auto &pattern : canditates) {
 			auto &pattern_ref = *pattern;
-			GraphContainer graphContainer = patternGraphForPattern(pattern);
+			const GraphContainer &graphContainer = patternGraphForPattern(pattern);
 			GraphVertexDescriptor lastPatternVertexDesc = graphContainer.lastPatternVertexDescriptor;
 			Graph &patternGraph = *(graphContainer.graph);
 
 			std::map<std::string, std::string> extractedValues;
 			EA matchedEndEA = startEA;
 
-			bool matched = matchGraphs(patternGraph,instructionGraph,lastPatternVertexDesc,&matchedEndEA,extractedValues);
+			bool memoize = memoizeWindows && graphContainer.memoizable && !windowMemoStopped.load(std::memory_order_relaxed);
+			uint64_t memoKey = 0;
+			WindowMatch windowMatch;
+			if (memoize) {
+				if (windowVertices.empty())
+					fingerprint = windowFingerprint(instructionGraph, windowVertices);
+				uintptr_t patternIdentifier = (uintptr_t)&pattern_ref;
+				memoKey = fnv1aHash(&patternIdentifier, sizeof(patternIdentifier), fingerprint);
+				bool found = lookupWindowMatch(memoKey, windowMatch);
+				memoize = !windowMemoStopped.load(std::memory_order_relaxed);
+				if (found) {
+					IDIOMMATCHER_COUNT(WindowMemoHits, 1);
+					// values are extracted from this instruction graph, only the VF2 search is skipped
+					if (windowMatch.matched && replayWindowMatch(patternGraph, windowVertices, instructionGraph, windowMatch, lastPatternVertexDesc, &matchedEndEA, extractedValues)) {
+						if (_profiler)
+							_profiler->profileForPattern(&pattern_ref).matches++;
+						if (callback)
+							callback(pattern_ref, startEA, matchedEndEA, extractedValues);
+					}
+					continue;
+				}
+			}
+
+			if (!std::all_of(graphContainer.prefixGraphIndices.begin(), graphContainer.prefixGraphIndices.end(), prefixMatches)) {
+				if (memoize && !prefixBudgetExhausted)
+					storeWindowMatch(memoKey, WindowMatch());
+				continue;
+			}
+
+			bool matched;
+			bool budgetExhausted = false;
+			std::vector<GraphVertexDescriptor> mapping;
+			std::vector<GraphVertexDescriptor> *mappingPointer = memoize ? &mapping : nullptr;
+			if (_profiler) {
+				auto &profile = _profiler->profileForPattern(&pattern_ref);
+				uint64_t instructionTests = PatternProfiler::threadInstructionTests();
+				{
+					ProfileTimer timer(profile.matchTime);
+					matched = matchGraphs(patternGraph,instructionGraph,lastPatternVertexDesc,&matchedEndEA,extractedValues,mappingPointer,&budgetExhausted);
+				}
+				profile.vf2Calls++;
+				profile.instructionTests += PatternProfiler::threadInstructionTests() - instructionTests;
+				if (matched)
+					profile.matches++;
+				if (budgetExhausted)
+					profile.budgetExhausted++;
+			} else {
+				matched = matchGraphs(patternGraph,instructionGraph,lastPatternVertexDesc,&matchedEndEA,extractedValues,mappingPointer,&budgetExhausted);
+			}
+			if (budgetExhausted) {
+				// a time budget makes the outcome depend on the load, it isn't memoized
+				recordExhaustedAttempt(startEA);
+				memoize = false;
+			}
+			if (memoize) {
+				windowMatch.matched = matched;
+				if (matched) {
+					if (positionForVertex.empty()) {
+						for (uint32_t position = 0; position < windowVertices.size(); ++position) {
+							positionForVertex.emplace(windowVertices[position], position);
+						}
+					}
+					for (auto &vertex : mapping) {
+						windowMatch.mapping.push_back(positionForVertex[vertex]);
+					}
+				}
+				storeWindowMatch(memoKey, windowMatch);
+			}
 			if (matched && callback) {
 				callback(pattern_ref, startEA, matchedEndEA, extractedValues);
 			}
@@ -81,13 +216,222 @@ namespace IdiomMatcher {
 
 	void ControlFlowGraphMatching::fillInstruction(Graph &instructionGraph, DisassemblerAPI &disassemblerAPI, int maxInstructions) const {
 		EA startEA = disassemblerAPI.getCurrentEA();
-		fillCFG(instructionGraph, startEA, maxInstructions,[&disassemblerAPI] (const EA &ea) -> Instruction_ref {
+		fillCFG(instructionGraph, startEA, instructionGraphDepth(maxInstructions),[&disassemblerAPI] (const EA &ea) -> Instruction_ref {
 			auto instruction = disassemblerAPI.instructionForEA(ea);
 			return std::make_shared<Instruction>(instruction);
-		});
+		}, maxXrefFanOut);
+		transformInstructionGraph(instructionGraph);
+	}
+
+	void ControlFlowGraphMatching::prepareForPatterns(const Patterns &patterns) {
+		TraceSpan span("patterns", "build pattern graphs " + getName());
+		for (auto &pattern : patterns) {
+			patternGraphForPattern(pattern);
+		}
+		if (sharePatternPrefixes) {
+			buildPrefixGraphs(patterns);
+		}
+
+		// the fingerprints change with the names, outcomes of earlier ones are dropped
+		for (auto &shard : windowMemo) {
+			shard.matches.clear();
+		}
+		windowMemoLookups = 0;
+		windowMemoHits = 0;
+		windowMemoStopped = false;
+		memoRegisterNames.clear();
+		memoOperandTexts = false;
+		memoMnemonics.clear();
+		memoAllMnemonics = false;
+		exhaustedAttemptCount = 0;
+		{
+			std::lock_guard<std::mutex> lock(exhaustedMutex);
+			exhaustedStartEAs.clear();
+		}
+		for (auto &pattern : patterns) {
+			// of the pattern graph, a transformed one has vertices of its own
+			auto &patternGraph = *patternToGraphMap[pattern].graph;
+			BGL_FORALL_VERTICES (vertex, patternGraph, Graph) {
+				auto &instruction = patternGraph[vertex];
+				memoAllMnemonics = memoAllMnemonics || instruction->getIsRegex();
+				memoMnemonics.insert(instruction->getMnemonic());
+				for (auto &operand : instruction->getOperands()) {
+					memoOperandTexts = memoOperandTexts || !operand->getRegex().empty();
+					if (operand->getNameIsTemplate())
+						continue;
+					for (auto &reg : operand->getRegisters()) {
+						if (!reg.empty())
+							memoRegisterNames.insert(reg);
+					}
+				}
+			}
+			patternToGraphMap[pattern].memoizable = true;
+		}
+	}
+
+	Instructions ControlFlowGraphMatching::patternGraphInstructions(const Pattern_ref &pattern) const {
+		Instructions instructions;
+		auto it = patternToGraphMap.find(pattern);
+		if (it == patternToGraphMap.end())
+			return instructions;
+		auto &patternGraph = *it->second.graph;
+		BGL_FORALL_VERTICES (vertex, patternGraph, Graph) {
+			auto &instruction = patternGraph[vertex];
+			if (instruction->getMnemonic() != InvalidInstruction.getMnemonic())
+				instructions.push_back(instruction);
+		}
+		return instructions;
+	}
+
+	namespace {
+		void hashString(const std::string &string, uint64_t &hash) {
+			uint64_t length = string.size();
+			hash = fnv1aHash(&length, sizeof(length), hash);
+			hash = fnv1aHash(string.data(), string.size(), hash);
+		}
+
+		void hashValue(uint64_t value, uint64_t &hash) {
+			hash = fnv1aHash(&value, sizeof(value), hash);
+		}
 	}
 
-	ControlFlowGraphMatching::GraphContainer ControlFlowGraphMatching::patternGraphForPattern(const Pattern_ref &pattern) {
+	uint64_t ControlFlowGraphMatching::windowFingerprint(const Graph &instructionGraph, std::vector<GraphVertexDescriptor> &windowVertices) const {
+		uint64_t hash = fnv1aOffsetBasis;
+		// names the patterns can only compare with each other, by order of appearance,
+		// a window has few of them
+		std::vector<std::string> canonicalNames;
+		auto hashName = [&](const std::string &name) {
+			if (memoRegisterNames.count(name)) {
+				hashValue(0, hash);
+				hashString(name, hash);
+			} else {
+				auto it = std::find(canonicalNames.begin(), canonicalNames.end(), name);
+				if (it == canonicalNames.end())
+					it = canonicalNames.insert(it, name);
+				hashValue(1, hash);
+				hashValue(it - canonicalNames.begin(), hash);
+			}
+		};
+
+		auto vertexIndices = boost::get(boost::vertex_index, instructionGraph);
+		std::vector<uint32_t> positionForIndex(boost::num_vertices(instructionGraph), UINT32_MAX);
+		BGL_FORALL_VERTICES (vertex, instructionGraph, Graph) {
+			auto &instruction = *instructionGraph[vertex];
+			// VF2 only extends mappings with vertices passing the predicates, the others don't change the outcome
+			if (!memoAllMnemonics && !memoMnemonics.count(instruction.getMnemonic()))
+				continue;
+			positionForIndex[vertexIndices[vertex]] = (uint32_t)windowVertices.size();
+			windowVertices.push_back(vertex);
+			hashString(instruction.getMnemonic(), hash);
+			hashValue(instruction.getOperands().size(), hash);
+			for (auto &operand : instruction.getOperands()) {
+				if (memoOperandTexts)
+					hashString(operand->getText(), hash);
+				auto registers = operand->getRegisters();
+				hashValue(registers.size(), hash);
+				for (auto &reg : registers) {
+					hashName(reg);
+				}
+				// the name testInstructionsMatch compares for registers missing in the operand
+				hashName(operand->getAddress() != 0 ? std::to_string(operand->getAddress()) : operand->getText());
+			}
+		}
+		BGL_FORALL_EDGES (edge, instructionGraph, Graph) {
+			auto source = positionForIndex[vertexIndices[boost::source(edge, instructionGraph)]];
+			auto target = positionForIndex[vertexIndices[boost::target(edge, instructionGraph)]];
+			if (source == UINT32_MAX || target == UINT32_MAX)
+				continue;
+			hashValue(source, hash);
+			hashValue(target, hash);
+			hashValue((uint64_t)instructionGraph[edge].type, hash);
+		}
+		hashValue(windowVertices.size(), hash);
+		return hash;
+	}
+
+	bool ControlFlowGraphMatching::lookupWindowMatch(uint64_t key, WindowMatch &windowMatch) {
+		static const uint64_t trialLookups = 4096;
+		if (windowMemoStopped.load(std::memory_order_relaxed))
+			return false;
+		bool found = false;
+		{
+			auto &shard = windowMemo[key % windowMemo.size()];
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto it = shard.matches.find(key);
+			if (it != shard.matches.end()) {
+				windowMatch = it->second;
+				found = true;
+			}
+		}
+		if (found)
+			++windowMemoHits;
+		if (++windowMemoLookups == trialLookups && windowMemoHits < windowMemoMinHitRate * trialLookups)
+			windowMemoStopped = true;
+		return found;
+	}
+
+	void ControlFlowGraphMatching::storeWindowMatch(uint64_t key, const WindowMatch &windowMatch) {
+		auto &shard = windowMemo[key % windowMemo.size()];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		if (shard.matches.size() < windowMemoCapacity / windowMemo.size())
+			shard.matches.emplace(key, windowMatch);
+	}
+
+	void ControlFlowGraphMatching::recordExhaustedAttempt(const EA &startEA) {
+		++exhaustedAttemptCount;
+		std::lock_guard<std::mutex> lock(exhaustedMutex);
+		if (exhaustedStartEAs.size() < maxExhaustedStartEAs && (exhaustedStartEAs.empty() || !(exhaustedStartEAs.back() == startEA)))
+			exhaustedStartEAs.push_back(startEA);
+	}
+
+	std::vector<EA> ControlFlowGraphMatching::getExhaustedStartEAs() const {
+		std::lock_guard<std::mutex> lock(exhaustedMutex);
+		return exhaustedStartEAs;
+	}
+
+	bool ControlFlowGraphMatching::replayWindowMatch(const Graph &patternGraph, const std::vector<GraphVertexDescriptor> &windowVertices, const Graph &instructionGraph,
+													 const WindowMatch &windowMatch, const GraphVertexDescriptor &lastPatternVertexDesc, EA *matchedEndEA, Matching::ExtractedValuesMap &extractedValues) const {
+		Matching::ExtractedValuesMap values;
+		Matching::PatternNameMap patternNameMap;
+		Instruction_ref lastMatchedInstruction;
+		auto patternIndices = boost::get(boost::vertex_index, patternGraph);
+		std::vector<GraphVertexDescriptor> mapped(boost::num_vertices(patternGraph), Graph::null_vertex());
+		std::set<GraphVertexDescriptor> mappedVertices;
+		size_t index = 0;
+		BGL_FORALL_VERTICES (vertex, patternGraph, Graph) {
+			if (index >= windowMatch.mapping.size() || windowMatch.mapping[index] >= windowVertices.size())
+				return false;
+			auto instructionVertex = windowVertices[windowMatch.mapping[index++]];
+			if (!mappedVertices.insert(instructionVertex).second)
+				return false;
+			mapped[patternIndices[vertex]] = instructionVertex;
+			auto &instruction = instructionGraph[instructionVertex];
+			if (!testInstructionsMatch(*patternGraph[vertex], *instruction, &values, &patternNameMap))
+				return false;
+			if (vertex == lastPatternVertexDesc)
+				lastMatchedInstruction = instruction;
+		}
+		// a fingerprint collision can map to vertices without the edges of the pattern
+		BGL_FORALL_EDGES (patternEdge, patternGraph, Graph) {
+			auto source = mapped[patternIndices[boost::source(patternEdge, patternGraph)]];
+			auto target = mapped[patternIndices[boost::target(patternEdge, patternGraph)]];
+			bool found = false;
+			BGL_FORALL_OUTEDGES (source, instructionEdge, instructionGraph, Graph) {
+				if (boost::target(instructionEdge, instructionGraph) == target && instructionGraph[instructionEdge].type == patternGraph[patternEdge].type) {
+					found = true;
+					break;
+				}
+			}
+			if (!found)
+				return false;
+		}
+		if (lastMatchedInstruction != nullptr)
+			*matchedEndEA = lastMatchedInstruction->getEA();
+		extractedValues.insert(values.cbegin(), values.cend());
+		return true;
+	}
+
+	const ControlFlowGraphMatching::GraphContainer &ControlFlowGraphMatching::patternGraphForPattern(const Pattern_ref &pattern) {
 		auto it = patternToGraphMap.find(pattern);
 		if (it != patternToGraphMap.end()) {
 			return it->second;
@@ -95,8 +439,121 @@ namespace IdiomMatcher {
 			GraphContainer container;
 			Graph &graph = *(container.graph);
 			container.lastPatternVertexDescriptor = fillPatternGraph(graph, *pattern);
-			patternToGraphMap.emplace(pattern,container);
-			return container;
+			return patternToGraphMap.emplace(pattern,container).first->second;
+		}
+	}
+
+	namespace {
+		// vertices of a pattern graph by the index of their instruction in the pattern
+		std::vector<GraphVertexDescriptor> verticesByInstructionIndex(const Graph &graph, const Pattern &pattern) {
+			auto &instructions = pattern.getInstructions();
+			std::map<const Instruction *, size_t> indexForInstruction;
+			for (size_t i = 0; i < instructions.size(); ++i) {
+				indexForInstruction.emplace(instructions[i].get(), i);
+			}
+			std::vector<GraphVertexDescriptor> instructionVertices(instructions.size(), Graph::null_vertex());
+			BGL_FORALL_VERTICES (vertex, graph, Graph) {
+				auto it = indexForInstruction.find(graph[vertex].get());
+				if (it != indexForInstruction.end())
+					instructionVertices[it->second] = vertex;
+			}
+			return instructionVertices;
+		}
+
+		// What the VF2 predicates test of the subgraph induced by the first length
+		// instructions. Template names are renamed in order of appearance, equal
+		// keys match the same instruction graphs.
+		std::string prefixKey(const Graph &graph, const std::vector<GraphVertexDescriptor> &instructionVertices, size_t length) {
+			std::string key;
+			std::map<std::string, std::string> templateNames;
+			std::map<GraphVertexDescriptor, size_t> indexForVertex;
+			for (size_t i = 0; i < length; ++i) {
+				if (instructionVertices[i] == Graph::null_vertex())
+					continue;
+				indexForVertex.emplace(instructionVertices[i], i);
+				auto &instruction = *graph[instructionVertices[i]];
+				key += std::to_string(i) + (instruction.getIsRegex() ? " regex " : " ") + instruction.getMnemonic();
+				for (auto &operand : instruction.getOperands()) {
+					key += " (" + operand->getRegex();
+					for (auto &reg : operand->getRegisters()) {
+						if (operand->getNameIsTemplate())
+							key += " $" + templateNames.emplace(reg, std::to_string(templateNames.size())).first->second;
+						else
+							key += " =" + reg;
+					}
+					key += ")";
+				}
+				key += "\n";
+			}
+			std::vector<std::string> edgeKeys;
+			BGL_FORALL_EDGES (edge, graph, Graph) {
+				auto source = indexForVertex.find(boost::source(edge, graph));
+				auto target = indexForVertex.find(boost::target(edge, graph));
+				if (source != indexForVertex.end() && target != indexForVertex.end())
+					edgeKeys.push_back(std::to_string(source->second) + ">" + std::to_string(target->second) + ":" + std::to_string(graph[edge].type));
+			}
+			std::sort(edgeKeys.begin(), edgeKeys.end());
+			for (auto &edge : edgeKeys) {
+				key += edge + "\n";
+			}
+			return key;
+		}
+
+		// the subgraph of graph induced by the first length instructions
+		std::shared_ptr<Graph> prefixGraph(const Graph &graph, const std::vector<GraphVertexDescriptor> &instructionVertices, size_t length) {
+			auto prefix = std::make_shared<Graph>();
+			std::map<GraphVertexDescriptor, GraphVertexDescriptor> prefixVertices;
+			for (size_t i = 0; i < length; ++i) {
+				if (instructionVertices[i] != Graph::null_vertex())
+					prefixVertices.emplace(instructionVertices[i], prefix->add_vertex(graph[instructionVertices[i]]));
+			}
+			BGL_FORALL_EDGES (edge, graph, Graph) {
+				auto source = prefixVertices.find(boost::source(edge, graph));
+				auto target = prefixVertices.find(boost::target(edge, graph));
+				if (source != prefixVertices.end() && target != prefixVertices.end())
+					prefix->add_edge(source->second, target->second, graph[edge]);
+			}
+			return prefix;
+		}
+	}
+
+	void ControlFlowGraphMatching::buildPrefixGraphs(const Patterns &patterns) {
+		// keys of the prefixes with at least 2 instructions, without the whole pattern
+		std::map<Pattern_ref, std::vector<std::string> > keysForPattern;
+		std::map<std::string, size_t> patternCountForKey;
+		for (auto &pattern : patterns) {
+			if (keysForPattern.count(pattern))
+				continue;
+			auto &graph = *patternGraphForPattern(pattern).graph;
+			auto instructionVertices = verticesByInstructionIndex(graph, *pattern);
+			auto &keys = keysForPattern[pattern];
+			for (size_t length = 2; length < instructionVertices.size(); ++length) {
+				keys.push_back(prefixKey(graph, instructionVertices, length));
+				++patternCountForKey[keys.back()];
+			}
+		}
+
+		// like a trie, a prefix is tested where patterns diverge: shared by more
+		// patterns than the next longer prefix
+		prefixGraphs.clear();
+		std::map<std::string, size_t> prefixIndexForKey;
+		for (auto &entry : keysForPattern) {
+			auto &pattern = entry.first;
+			auto &keys = entry.second;
+			auto &container = patternToGraphMap[pattern];
+			container.prefixGraphIndices.clear();
+			for (size_t i = 0; i < keys.size(); ++i) {
+				size_t count = patternCountForKey[keys[i]];
+				if (count < 2 || (i + 1 < keys.size() && patternCountForKey[keys[i + 1]] == count))
+					continue;
+				auto it = prefixIndexForKey.find(keys[i]);
+				if (it == prefixIndexForKey.end()) {
+					auto instructionVertices = verticesByInstructionIndex(*container.graph, *pattern);
+					prefixGraphs.push_back(prefixGraph(*container.graph, instructionVertices, i + 2));
+					it = prefixIndexForKey.emplace(keys[i], prefixGraphs.size() - 1).first;
+				}
+				container.prefixGraphIndices.push_back(it->second);
+			}
 		}
 	}
 
@@ -105,8 +562,8 @@ namespace IdiomMatcher {
 			typename Graph2>
 	struct lastEACallback {
 
-		lastEACallback(const Graph1& graph1, const Graph2& graph2, const GraphVertexDescriptor &vertexDescriptor, Instruction_ref *lastMatchedInstruction, const ControlFlowGraphMatching &graphMatcher, Matching::ExtractedValuesMap &extractedValuesMap, bool *verifiedMatch = nullptr)
-				: graph1_(graph1), graph2_(graph2), _lastPatternVertexDescriptor(vertexDescriptor), _lastMatchedInstruction(lastMatchedInstruction), _graphMatcher(graphMatcher), _extractedValuesMap(extractedValuesMap), _matched(verifiedMatch) { }
+		lastEACallback(const Graph1& graph1, const Graph2& graph2, const GraphVertexDescriptor &vertexDescriptor, Instruction_ref *lastMatchedInstruction, const ControlFlowGraphMatching &graphMatcher, Matching::ExtractedValuesMap &extractedValuesMap, bool *verifiedMatch = nullptr, std::vector<GraphVertexDescriptor> *mapping = nullptr)
+				: graph1_(graph1), graph2_(graph2), _lastPatternVertexDescriptor(vertexDescriptor), _lastMatchedInstruction(lastMatchedInstruction), _graphMatcher(graphMatcher), _extractedValuesMap(extractedValuesMap), _matched(verifiedMatch), _mapping(mapping) { }
 
 		template <typename CorrespondenceMap1To2,
 				typename CorrespondenceMap2To1>
@@ -128,6 +585,12 @@ namespace IdiomMatcher {
 
 			if (_matched)
 				*_matched = matches;
+			if (_mapping) {
+				_mapping->clear();
+				BGL_FORALL_VERTICES (vert, graph1_, Graph) {
+					_mapping->push_back(boost::get(f,vert));
+				}
+			}
 
 			if (_lastPatternVertexDescriptor != Graph::null_vertex()) {
 				auto lastInstructionVertexDescriptor = f[_lastPatternVertexDescriptor];
@@ -145,16 +608,36 @@ namespace IdiomMatcher {
 		const ControlFlowGraphMatching &_graphMatcher;
 		Matching::ExtractedValuesMap &_extractedValuesMap;
 		bool *_matched;
+		std::vector<GraphVertexDescriptor> *_mapping;
 	};
 
 
 	bool ControlFlowGraphMatching::matchGraphs(const Graph &patternGraph, const Graph &instructionGraph,
                                           const GraphVertexDescriptor &lastPatternVertexDesc,
                                           EA *matchedEndEA,
-                                          Matching::ExtractedValuesMap &extractedValues) const {
+                                          Matching::ExtractedValuesMap &extractedValues,
+                                          std::vector<GraphVertexDescriptor> *mapping,
+                                          bool *budgetExhausted) const {
         Instruction_ref lastMatchedInstruction;
 		bool verifiedMatched = false;
-        auto callback = lastEACallback<Graph,Graph>(patternGraph,instructionGraph,lastPatternVertexDesc, &lastMatchedInstruction, *this, extractedValues, &verifiedMatched);
+        auto callback = lastEACallback<Graph,Graph>(patternGraph,instructionGraph,lastPatternVertexDesc, &lastMatchedInstruction, *this, extractedValues, &verifiedMatched, mapping);
+
+		// once exhausted the predicates reject every pair, so VF2 returns without extending any mapping
+		bool exhausted = false;
+		uint64_t states = 0;
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(maxMicrosecondsPerAttempt);
+		auto withinBudget = [this, &exhausted, &states, &deadline]() -> bool {
+			if (exhausted)
+				return false;
+			++states;
+			// reading the clock costs about as much as a state, it is read every 64 states
+			if ((maxStatesPerAttempt != 0 && states > maxStatesPerAttempt) ||
+				(maxMicrosecondsPerAttempt != 0 && states % 64 == 0 && std::chrono::steady_clock::now() > deadline)) {
+				exhausted = true;
+				return false;
+			}
+			return true;
+		};
         using namespace boost;
         bool matched = vf2_subgraph_mono(patternGraph,
                                         instructionGraph,
@@ -162,7 +645,9 @@ namespace IdiomMatcher {
                                         get(vertex_index, patternGraph),
                                         get(vertex_index, instructionGraph),
                                         vertex_order_by_mult(patternGraph),
-                                        [this, &patternGraph, &instructionGraph](GraphEdgeDescriptor small_edge, GraphEdgeDescriptor large_edge) {
+                                        [this, &patternGraph, &instructionGraph, &exhausted](GraphEdgeDescriptor small_edge, GraphEdgeDescriptor large_edge) {
+											if (exhausted)
+												return false;
 											auto &patternEdge = patternGraph[small_edge];
 											auto &instructionEdge = instructionGraph[large_edge];
 											if (patternEdge.type != instructionEdge.type)
@@ -175,13 +660,18 @@ namespace IdiomMatcher {
                                             auto target2 = instructionGraph[target(large_edge,instructionGraph)];
                                             return testInstructionsMatch(*target1, *target2);
                                         },
-                                        [this, &patternGraph, &instructionGraph](GraphVertexDescriptor small_vd, GraphVertexDescriptor large_vd) {
+                                        [this, &patternGraph, &instructionGraph, &withinBudget](GraphVertexDescriptor small_vd, GraphVertexDescriptor large_vd) {
+                                            if (!withinBudget())
+                                                return false;
+                                            IDIOMMATCHER_COUNT(VF2States, 1);
                                             auto patternInstr = patternGraph[small_vd];
                                             auto dissInstr = instructionGraph[large_vd];
                                             return testInstructionsMatch(*patternInstr,*dissInstr);
                                         });
 		
-		matched = matched && verifiedMatched;
+		matched = matched && verifiedMatched && !exhausted;
+		if (budgetExhausted)
+			*budgetExhausted = exhausted;
 
         if (matched && lastMatchedInstruction != nullptr) {
             *matchedEndEA = lastMatchedInstruction->getEA();
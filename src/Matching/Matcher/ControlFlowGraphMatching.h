@@ -5,6 +5,11 @@
 #ifndef IDIOMMATCHER_CONTROLFLOWGRAPHMATCHING_H
 #define IDIOMMATCHER_CONTROLFLOWGRAPHMATCHING_H
 
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <Matching/Matcher/Matching.h>
 #include <Matching/Graph/Graph.h>
 
@@ -12,11 +17,15 @@ namespace IdiomMatcher {
 
     class ControlFlowGraphMatching : public Matching {
     protected:
+        // mapping gets the instruction vertex of every pattern vertex, in the order of the pattern vertices,
+        // budgetExhausted is set if the search was abandoned, see maxStatesPerAttempt
         virtual bool matchGraphs(const Graph &patternGraph,
                                  const Graph &instructionGraph,
                                  const GraphVertexDescriptor &lastPatternVertexDesc,
                                  EA *matchedEndEA,
-                                 Matching::ExtractedValuesMap &extractedValues) const;
+                                 Matching::ExtractedValuesMap &extractedValues,
+                                 std::vector<GraphVertexDescriptor> *mapping = nullptr,
+                                 bool *budgetExhausted = nullptr) const;
 
         virtual GraphVertexDescriptor fillPatternGraph(Graph &patternGraph, const Pattern &pattern) const;
 		virtual void fillInstruction(Graph &instructionGraph, DisassemblerAPI &disassemblerAPI, int maxInstructions) const;
@@ -27,22 +36,117 @@ namespace IdiomMatcher {
 		struct GraphContainer {
 			Graph_ref graph = std::make_shared<Graph>();
 			GraphVertexDescriptor lastPatternVertexDescriptor = Graph::null_vertex();
+			// indices in prefixGraphs of the prefixes the pattern shares, shortest first
+			std::vector<size_t> prefixGraphIndices;
+			// prepared by prepareForPatterns, windowFingerprint covers what it tests
+			bool memoizable = false;
 		};
 		std::map<Pattern_ref,GraphContainer> patternToGraphMap;
 
 		// Always returns a pattern graph for a pattern.
 		// Looks up the pattern in patternToGraphMap, if the pattern wasn't found
 		// build sthe pattern graph using fillPatternGraph() and stores in map.
-		virtual GraphContainer patternGraphForPattern(const Pattern_ref &pattern);
+		virtual const GraphContainer &patternGraphForPattern(const Pattern_ref &pattern);
+
+		// Subgraphs of the pattern graphs induced by their first instructions, shared
+		// by several patterns. A prefix is matched once per instruction graph, if it
+		// doesn't match none of the patterns sharing it can, their VF2 runs are skipped.
+		std::vector<Graph_ref> prefixGraphs;
+		// builds prefixGraphs for the patterns of patternToGraphMap, see sharePatternPrefixes
+		void buildPrefixGraphs(const Patterns &patterns);
+
+		// The outcome of matching a pattern against instruction graphs with one
+		// fingerprint, mapping has the position in the fingerprint of the instruction
+		// vertex of every pattern vertex.
+		struct WindowMatch {
+			bool matched = false;
+			std::vector<uint32_t> mapping;
+		};
+		struct WindowMemoShard {
+			std::mutex mutex;
+			std::unordered_map<uint64_t, WindowMatch> matches;
+		};
+		std::array<WindowMemoShard, 16> windowMemo;
+		// lookups of the current search, memoization stops when the first ones hardly hit
+		std::atomic<uint64_t> windowMemoLookups{0};
+		std::atomic<uint64_t> windowMemoHits{0};
+		std::atomic<bool> windowMemoStopped{false};
+		// what the prepared patterns test exactly, the other names are only compared with each other
+		std::unordered_set<std::string> memoRegisterNames;
+		bool memoOperandTexts = false;
+		// instructions with other mnemonics can't be mapped to a pattern vertex
+		std::unordered_set<std::string> memoMnemonics;
+		bool memoAllMnemonics = false;
+
+		// Hash of what the VF2 predicates test of the vertices of instructionGraph a pattern
+		// vertex can be mapped to: mnemonics, operands with register names no pattern
+		// names renamed in order of appearance, and the edges between their positions.
+		// windowVertices gets these vertices by position.
+		uint64_t windowFingerprint(const Graph &instructionGraph, std::vector<GraphVertexDescriptor> &windowVertices) const;
+		// also counts the lookup, false without looking up once memoization stopped
+		bool lookupWindowMatch(uint64_t key, WindowMatch &windowMatch);
+		void storeWindowMatch(uint64_t key, const WindowMatch &windowMatch);
+		std::atomic<uint64_t> exhaustedAttemptCount{0};
+		mutable std::mutex exhaustedMutex;
+		std::vector<EA> exhaustedStartEAs;
+		void recordExhaustedAttempt(const EA &startEA);
+
+		// Tests the memoized mapping again, vertices and edges, which extracts the values. False if it doesn't match.
+		bool replayWindowMatch(const Graph &patternGraph, const std::vector<GraphVertexDescriptor> &windowVertices, const Graph &instructionGraph,
+							   const WindowMatch &windowMatch, const GraphVertexDescriptor &lastPatternVertexDesc, EA *matchedEndEA, Matching::ExtractedValuesMap &extractedValues) const;
 
 	public:
 
 		ControlFlowGraphMatching(const std::string &name = "ControlFlowGraph") : Matching(name , true) { };
 
+		// match prefixes shared by several patterns first, set before prepareForPatterns
+		bool sharePatternPrefixes = true;
+		// Reuse the outcome of a pattern for instruction graphs with the same fingerprint
+		// instead of running VF2 again, e.g. for repeated switch prologues.
+		bool memoizeWindows = true;
+		// outcomes kept at most, the memo stops growing when it is full
+		size_t windowMemoCapacity = 1 << 20;
+		// fingerprints cost about as much as VF2 on small windows, memoization stops
+		// for the rest of a search if fewer of its first lookups hit
+		double windowMemoMinHitRate = 0.2;
+		// VF2 states and microseconds one attempt of a pattern or shared prefix at a start EA
+		// may take, 0 for no limit. An attempt exceeding them is abandoned and doesn't match,
+		// so a window with a large jump table can't stall a thread.
+		uint64_t maxStatesPerAttempt = 0;
+		uint64_t maxMicrosecondsPerAttempt = 0;
+		// xref targets of one instruction the instruction graphs follow, the others become a
+		// summary vertex, see fillCFG. Keeps windows of large jump tables small, 0 follows all.
+		size_t maxXrefFanOut = 0;
+		// attempts abandoned since prepareForPatterns and the start EAs of the first of them
+		uint64_t getExhaustedAttemptCount() const { return exhaustedAttemptCount; }
+		std::vector<EA> getExhaustedStartEAs() const;
+		static const size_t maxExhaustedStartEAs = 256;
+
 		virtual void testForPatternsStartingAtEA(const Patterns &patterns,
 												 const EA &startEA,
 												 DisassemblerAPI &disassemblerAPI,
 												 const FoundMatchFunctionCallback &callback);
+
+		// builds the pattern graphs, so searching threads only read patternToGraphMap
+		virtual void prepareForPatterns(const Patterns &patterns) override;
+
+		// Patterns whose first instruction has mnemonic, maxDepth is set to the most instructions of them.
+		Patterns candidatePatterns(const Patterns &patterns, const std::string &mnemonic, size_t &maxDepth) const;
+
+		// Instructions of the pattern graph of a prepared pattern that are mapped to code, without the
+		// start vertex of a PDG. Instructions the CFG of the pattern doesn't reach aren't in it.
+		Instructions patternGraphInstructions(const Pattern_ref &pattern) const;
+
+		// depth of the CFG fillInstruction builds to match patterns of up to maxInstructions
+		virtual int instructionGraphDepth(size_t maxInstructions) const { return (int)maxInstructions; }
+		// turns the CFG into the graph the pattern graphs are matched against, called by fillInstruction
+		virtual void transformInstructionGraph(Graph &instructionGraph) const { }
+
+		// counts the tested start EA for all patterns and the passed first instruction filter for the canditates, if profiling
+		void profileCandidates(const Patterns &patterns, const Patterns &canditates);
+
+		// Matches the canditates against an instruction graph built for startEA, see fillInstruction.
+		void testCandidatesInInstructionGraph(const Patterns &canditates, const EA &startEA, const Graph &instructionGraph, const FoundMatchFunctionCallback &callback);
 	};
 }
 
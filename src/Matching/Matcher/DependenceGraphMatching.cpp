@@ -22,9 +22,11 @@ namespace IdiomMatcher {
 		removeEdgesFromGraph(graph);
 	}
 
-	void DependenceGraphMatching::fillInstruction(Graph &instructionGraph, DisassemblerAPI &disassemblerAPI, int maxInstructions) const {
-		auto depth = maxInstructions*2+2;
-		ControlFlowGraphMatching::fillInstruction(instructionGraph,disassemblerAPI, depth);
+	int DependenceGraphMatching::instructionGraphDepth(size_t maxInstructions) const {
+		return (int)maxInstructions*2+2;
+	}
+
+	void DependenceGraphMatching::transformInstructionGraph(Graph &instructionGraph) const {
 		transformToPDGAndRemoveCFGEdges(instructionGraph);
 	}
 
@@ -17,9 +17,11 @@ namespace IdiomMatcher {
 
 		bool addEdgesToBasicBlockEnd = false;
 
+		virtual int instructionGraphDepth(size_t maxInstructions) const override;
+		virtual void transformInstructionGraph(Graph &instructionGraph) const override;
+
 	protected:
 		virtual GraphVertexDescriptor fillPatternGraph(Graph &patternGraph, const Pattern &pattern) const override;
-		virtual void fillInstruction(Graph &instructionGraph, DisassemblerAPI &disassemblerAPI, int maxInstructions) const override;
 
 		void transformToPDGAndRemoveCFGEdges(Graph &graph) const;
     };
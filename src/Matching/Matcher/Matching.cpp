@@ -3,6 +3,7 @@
 // Licensed under MIT License, see LICENSE for full text.
 
 #include "Matching.h"
+#include <Matching/Telemetry.h>
 namespace IdiomMatcher {
 
 	void Matching::searchForPatterns(const Patterns &patterns,
@@ -28,9 +29,13 @@ namespace IdiomMatcher {
     }
 
     bool Matching::testInstructionsMatch(const Instruction &patternInstr, const Instruction &dissInstruction, ExtractedValuesMap *externalExtractedValuesMap, PatternNameMap *patternNameMap) const {
+		if (_profiler) {
+			PatternProfiler::countInstructionTest();
+		}
 
 		bool mnenomicMatch = false;
         if (patternInstr.getIsRegex()) {
+			IDIOMMATCHER_COUNT(RegexEvaluations, 1);
 			mnenomicMatch = std::regex_match(dissInstruction.getMnemonic(), std::regex(patternInstr.getMnemonic()));
 		} else {
 			mnenomicMatch = patternInstr.getMnemonic() == dissInstruction.getMnemonic();
@@ -58,6 +63,7 @@ namespace IdiomMatcher {
 			auto disassembledOperandText = disassembledOperand->getText();
             auto regexString = operand->getRegex();
             if (!regexString.empty()) {
+                IDIOMMATCHER_COUNT(RegexEvaluations, 1);
                 bool matched = std::regex_match(disassembledOperandText, std::regex(regexString));
                 if (!matched) {
                     matchedOperands = false;
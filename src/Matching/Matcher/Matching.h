@@ -11,6 +11,7 @@
 #include <map>
 #include <Model/Pattern.h>
 #include <Matching/DisassemblerAPI.h>
+#include <Matching/PatternProfiler.h>
 
 namespace IdiomMatcher {
 
@@ -31,11 +32,20 @@ namespace IdiomMatcher {
 
 		virtual void testForPatternsStartingAtEA(const Patterns &patterns, const EA &startEA, DisassemblerAPI &disassemblerAPI, const FoundMatchFunctionCallback &callback) = 0;
 
+		// Builds per pattern state up front, call before searching concurrently with the same matcher.
+		virtual void prepareForPatterns(const Patterns &patterns) { };
+
         virtual bool testInstructionsMatch(const Instruction &patternInstr, const Instruction &dissInstruction, ExtractedValuesMap *extractedValuesMap = nullptr, PatternNameMap *patternNameMap = nullptr) const;
 
         virtual std::string getName() const { return _name; };
 
 		virtual bool getConcurrencyAllowed() const { return _concurrencyAllowed; };
+
+		// records the cost of every pattern while searching, nullptr disables profiling
+		virtual void setProfiler(PatternProfiler *profiler) { _profiler = profiler; }
+		PatternProfiler *getProfiler() const { return _profiler; }
+	protected:
+		PatternProfiler *_profiler = nullptr;
     private:
         const std::string _name;
 		const bool _concurrencyAllowed;
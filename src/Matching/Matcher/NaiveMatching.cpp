@@ -14,7 +14,25 @@ namespace IdiomMatcher {
             EA matchedEnd = startEA;
 
             auto &pattern_ref = *pattern.get();
-            bool matched = testForPatternStartingAtEA(pattern_ref, startEA, &matchedEnd, disassemblerAPI, extractedValues);
+            bool matched;
+            if (_profiler) {
+                auto &profile = _profiler->profileForPattern(&pattern_ref);
+                uint64_t instructionTests = PatternProfiler::threadInstructionTests();
+                {
+                    ProfileTimer timer(profile.matchTime);
+                    matched = testForPatternStartingAtEA(pattern_ref, startEA, &matchedEnd, disassemblerAPI, extractedValues);
+                }
+                instructionTests = PatternProfiler::threadInstructionTests() - instructionTests;
+                profile.testedStartEAs++;
+                profile.instructionTests += instructionTests;
+                // the first instruction failing ends the test after one instruction test
+                if (instructionTests > 1 || matched)
+                    profile.passedFirstInstruction++;
+                if (matched)
+                    profile.matches++;
+            } else {
+                matched = testForPatternStartingAtEA(pattern_ref, startEA, &matchedEnd, disassemblerAPI, extractedValues);
+            }
             if (matched && callback) {
                 callback(pattern_ref, startEA, matchedEnd, extractedValues);
             }
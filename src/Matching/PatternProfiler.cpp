@@ -0,0 +1,152 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "PatternProfiler.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+
+#define RAPIDJSON_HAS_STDSTRING 1
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/filewritestream.h>
+#include <rapidjson/encodedstream.h>
+
+namespace IdiomMatcher {
+
+	const char *const PatternProfiler::sharedCostName = "(instruction graphs)";
+	thread_local uint64_t PatternProfiler::_threadInstructionTests = 0;
+
+	// the table of a thread is found by the identifier of the profiler, a new
+	// profiler at the address of a destroyed one never sees the old tables
+	static std::atomic<uint64_t> nextProfilerIdentifier(1);
+
+	void PatternProfile::add(const PatternProfile &other) {
+		testedStartEAs += other.testedStartEAs;
+		passedFirstInstruction += other.passedFirstInstruction;
+		vf2Calls += other.vf2Calls;
+		instructionTests += other.instructionTests;
+		matchTime += other.matchTime;
+		matches += other.matches;
+		budgetExhausted += other.budgetExhausted;
+	}
+
+	PatternProfiler::PatternProfiler() : _identifier(nextProfilerIdentifier++) { }
+
+	PatternProfile &PatternProfiler::profileForPattern(const Pattern *pattern) {
+		// a thread can record for several profilers, e.g. one per matcher in combined mode
+		static thread_local std::vector<std::pair<uint64_t, Table *> > threadTables;
+		Table *cachedTable = nullptr;
+		for (auto &entry : threadTables) {
+			if (entry.first == _identifier) {
+				cachedTable = entry.second;
+				break;
+			}
+		}
+		if (cachedTable == nullptr) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			_tables.emplace_back(new Table());
+			cachedTable = _tables.back().get();
+			threadTables.push_back(std::make_pair(_identifier, cachedTable));
+		}
+		auto it = cachedTable->find(pattern);
+		if (it == cachedTable->end()) {
+			it = cachedTable->emplace(pattern, std::make_pair(pattern != nullptr ? pattern->getName() : sharedCostName, PatternProfile())).first;
+		}
+		return it->second.second;
+	}
+
+	PatternProfiler::Report PatternProfiler::report() const {
+		std::map<std::string, PatternProfile> merged;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (auto &table : _tables) {
+				for (auto &entry : *table) {
+					merged[entry.second.first].add(entry.second.second);
+				}
+			}
+		}
+		Report report(merged.begin(), merged.end());
+		std::stable_sort(report.begin(), report.end(), [](const Report::value_type &a, const Report::value_type &b) {
+			if (a.second.matchTime != b.second.matchTime)
+				return a.second.matchTime > b.second.matchTime;
+			return a.second.instructionTests > b.second.instructionTests;
+		});
+		return report;
+	}
+
+	bool PatternProfiler::writeReportToFilePath(const std::string &path, const std::string &matcherName) const {
+		using namespace rapidjson;
+
+		char writeBuffer[65536];
+		auto fh = fopen(path.c_str(),"w");
+		if (fh == NULL)
+			return false;
+
+		FileWriteStream os(fh, writeBuffer, sizeof(writeBuffer));
+		typedef EncodedOutputStream<ASCII<>,FileWriteStream> OutputStream;
+		OutputStream eos(os, true);
+		PrettyWriter<OutputStream, ASCII<>, ASCII<> > writer(eos);
+
+		writer.StartObject();
+		writer.Key("matcherName");
+		writer.String(matcherName);
+		writer.Key("patterns");
+		writer.StartArray();
+		for (auto &entry : report()) {
+			auto &profile = entry.second;
+			writer.StartObject();
+			writer.Key("patternName");
+			writer.String(entry.first);
+			writer.Key("testedStartEAs");
+			writer.Uint64(profile.testedStartEAs);
+			writer.Key("passedFirstInstruction");
+			writer.Uint64(profile.passedFirstInstruction);
+			writer.Key("vf2Calls");
+			writer.Uint64(profile.vf2Calls);
+			writer.Key("instructionTests");
+			writer.Uint64(profile.instructionTests);
+			writer.Key("matchTime");
+			writer.Double(profile.matchTime);
+			writer.Key("matches");
+			writer.Uint64(profile.matches);
+			writer.Key("budgetExhausted");
+			writer.Uint64(profile.budgetExhausted);
+			writer.EndObject();
+		}
+		writer.EndArray();
+		writer.EndObject();
+
+		eos.Flush();
+		os.Flush();
+		bool success = !ferror(fh);
+		return fclose(fh) == 0 && success;
+	}
+
+	std::string PatternProfiler::reportTable() const {
+		std::string table;
+		char line[512];
+		snprintf(line, sizeof(line), "%-40s %12s %12s %10s %14s %12s %8s %10s\n", "pattern", "tested", "1st instr", "vf2 calls", "instr tests", "time [s]", "matches", "exhausted");
+		table.append(line);
+		for (auto &entry : report()) {
+			auto &profile = entry.second;
+			snprintf(line, sizeof(line), "%-40.40s %12ju %12ju %10ju %14ju %12.6f %8ju %10ju\n", entry.first.c_str(),
+					 (uintmax_t)profile.testedStartEAs, (uintmax_t)profile.passedFirstInstruction, (uintmax_t)profile.vf2Calls,
+					 (uintmax_t)profile.instructionTests, profile.matchTime, (uintmax_t)profile.matches, (uintmax_t)profile.budgetExhausted);
+			table.append(line);
+		}
+		return table;
+	}
+
+	std::string PatternProfiler::reportPathForExecutablePath(const std::string &binaryPath, const std::string &matcherName) const {
+		auto path = std::string(binaryPath);
+		size_t lastPoint = path.find_last_of(".");
+		if (lastPoint != std::string::npos) {
+			path.erase(lastPoint);
+		}
+		path.append("_profile_");
+		path.append(matcherName);
+		path.append(".json");
+		return path;
+	}
+}
@@ -0,0 +1,97 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_PATTERNPROFILER_H
+#define IDIOMMATCHER_PATTERNPROFILER_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <Model/Pattern.h>
+
+namespace IdiomMatcher {
+
+	struct PatternProfile {
+		// start EAs the pattern was tested at
+		uint64_t testedStartEAs = 0;
+		// start EAs whose first instruction matched the first pattern instruction
+		uint64_t passedFirstInstruction = 0;
+		uint64_t vf2Calls = 0;
+		uint64_t instructionTests = 0;
+		// seconds in matchGraphs for graph matchers, in testing the instructions for the others
+		double matchTime = 0;
+		uint64_t matches = 0;
+		// graph matcher attempts abandoned for exceeding the search budget
+		uint64_t budgetExhausted = 0;
+
+		void add(const PatternProfile &other);
+	};
+
+	// Per pattern cost of a matcher, enabled with Matching::setProfiler.
+	//
+	// Every thread records into its own table, the tables are merged by report(),
+	// so profiling doesn't add locking to the matching. Call report() after all
+	// matching threads finished.
+	class PatternProfiler {
+	public:
+		PatternProfiler();
+
+		PatternProfiler(const PatternProfiler &) = delete;
+		PatternProfiler &operator=(const PatternProfiler &) = delete;
+
+		// profile of the calling thread, nullptr collects the cost not belonging to a pattern
+		PatternProfile &profileForPattern(const Pattern *pattern);
+
+		// instruction tests of the calling thread, counted by Matching::testInstructionsMatch
+		static void countInstructionTest() { ++_threadInstructionTests; }
+		static uint64_t threadInstructionTests() { return _threadInstructionTests; }
+
+		typedef std::vector<std::pair<std::string, PatternProfile> > Report;
+		// merged profiles by pattern name, the most expensive first
+		Report report() const;
+
+		bool writeReportToFilePath(const std::string &path, const std::string &matcherName) const;
+		std::string reportTable() const;
+		std::string reportPathForExecutablePath(const std::string &path, const std::string &matcherName) const;
+
+		// name of the entry for the cost not belonging to a pattern, e.g. building instruction graphs
+		static const char *const sharedCostName;
+
+	private:
+		typedef std::unordered_map<const Pattern *, std::pair<std::string, PatternProfile> > Table;
+
+		const uint64_t _identifier;
+		mutable std::mutex _mutex;
+		std::vector<std::unique_ptr<Table> > _tables;
+
+		static thread_local uint64_t _threadInstructionTests;
+	};
+
+	// Adds the seconds since construction to a time of a profile.
+	class ProfileTimer {
+	public:
+		ProfileTimer(double &time) : _time(&time), _start(std::chrono::steady_clock::now()) { }
+		// times the shared cost of profiler, does nothing without profiler
+		ProfileTimer(PatternProfiler *profiler) : _time(profiler ? &profiler->profileForPattern(nullptr).matchTime : nullptr) {
+			if (_time)
+				_start = std::chrono::steady_clock::now();
+		}
+		~ProfileTimer() {
+			if (!_time)
+				return;
+			std::chrono::duration<double> duration = std::chrono::steady_clock::now() - _start;
+			*_time += duration.count();
+		}
+
+		ProfileTimer(const ProfileTimer &) = delete;
+		ProfileTimer &operator=(const ProfileTimer &) = delete;
+	private:
+		double *_time;
+		std::chrono::steady_clock::time_point _start;
+	};
+}
+
+#endif //IDIOMMATCHER_PATTERNPROFILER_H
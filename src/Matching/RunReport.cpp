@@ -0,0 +1,269 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "RunReport.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <Model/ByteCoding.h>
+#include <Model/PatternPersistence.h>
+
+#define RAPIDJSON_HAS_STDSTRING 1
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/filewritestream.h>
+#include <rapidjson/encodedstream.h>
+
+namespace IdiomMatcher {
+
+	RunReport::PhaseTimer::PhaseTimer(RunReport &report, const std::string &name) : _report(&report), _start(std::chrono::steady_clock::now()), _processCPUStart(processCPUTime()), _threadCPUStart(threadCPUTime()) {
+		_phase.name = name;
+	}
+
+	void RunReport::PhaseTimer::finish() {
+		if (_report == nullptr)
+			return;
+		std::chrono::duration<double> realTime = std::chrono::steady_clock::now() - _start;
+		_phase.realTime = realTime.count();
+		_phase.cpuTime = processCPUTime() - _processCPUStart;
+		if (_phase.threadCPUTimes.empty()) {
+			_phase.threadCPUTimes.push_back(threadCPUTime() - _threadCPUStart);
+		}
+		_report->phases.push_back(_phase);
+		_report = nullptr;
+	}
+
+	static double secondsForClock(clockid_t clock) {
+		struct timespec time;
+		clock_gettime(clock, &time);
+		return time.tv_sec + time.tv_nsec / 1e9;
+	}
+
+	double RunReport::threadCPUTime() {
+		return secondsForClock(CLOCK_THREAD_CPUTIME_ID);
+	}
+
+	double RunReport::processCPUTime() {
+		return secondsForClock(CLOCK_PROCESS_CPUTIME_ID);
+	}
+
+	uint64_t RunReport::peakResidentBytes() {
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0;
+#ifdef __APPLE__
+		return (uint64_t)usage.ru_maxrss;
+#else
+		// kilobytes on Linux
+		return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+	}
+
+	uint64_t RunReport::hashForPatterns(const Patterns &patterns) {
+		auto json = PatternPersistence::jsonForPatterns(patterns);
+		return fnv1aHash(json.data(), json.size());
+	}
+
+	RunReport::FileIdentity RunReport::identityForFilePath(const std::string &path) {
+		FileIdentity identity;
+		struct stat status;
+		auto file = fopen(path.c_str(), "rb");
+		if (file == nullptr || fstat(fileno(file), &status) != 0) {
+			if (file != nullptr)
+				fclose(file);
+			return identity;
+		}
+		identity.size = status.st_size;
+		identity.modificationTime = status.st_mtime;
+		identity.hash = fnv1aOffsetBasis;
+		char buffer[1 << 16];
+		size_t length;
+		while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+			identity.hash = fnv1aHash(buffer, length, identity.hash);
+		}
+		identity.valid = !ferror(file);
+		fclose(file);
+		return identity;
+	}
+
+	static std::string hexString(uint64_t value) {
+		char string[17];
+		snprintf(string, sizeof(string), "%016jx", (uintmax_t)value);
+		return string;
+	}
+
+	template<typename Writer>
+	void SerializePhase(Writer &writer, const RunReport::Phase &phase) {
+		writer.StartObject();
+		writer.Key("name");
+		writer.String(phase.name);
+		writer.Key("realTime");
+		writer.Double(phase.realTime);
+		writer.Key("cpuTime");
+		writer.Double(phase.cpuTime);
+		writer.Key("threadCount");
+		writer.Uint((unsigned)phase.threadCPUTimes.size());
+		writer.Key("threadCPUTimes");
+		writer.StartArray();
+		for (auto time : phase.threadCPUTimes) {
+			writer.Double(time);
+		}
+		writer.EndArray();
+		writer.EndObject();
+	}
+
+	template<typename Writer>
+	void SerializeChunks(Writer &writer, const std::vector<RunReport::Chunk> &chunks) {
+		double minimum = 0, maximum = 0, sum = 0;
+		uint64_t instructionCount = 0;
+		for (size_t i = 0; i < chunks.size(); ++i) {
+			auto time = chunks[i].realTime;
+			minimum = i == 0 ? time : std::min(minimum, time);
+			maximum = std::max(maximum, time);
+			sum += time;
+			instructionCount += chunks[i].instructionCount;
+		}
+		double mean = chunks.empty() ? 0 : sum / chunks.size();
+
+		writer.StartObject();
+		writer.Key("count");
+		writer.Uint64(chunks.size());
+		writer.Key("instructionCount");
+		writer.Uint64(instructionCount);
+		writer.Key("minRealTime");
+		writer.Double(minimum);
+		writer.Key("maxRealTime");
+		writer.Double(maximum);
+		writer.Key("meanRealTime");
+		writer.Double(mean);
+		// the slowest chunk compared to the mean, 1 is a perfect split
+		writer.Key("imbalance");
+		writer.Double(mean > 0 ? maximum / mean : 1);
+		writer.Key("ranges");
+		writer.StartArray();
+		for (auto &chunk : chunks) {
+			writer.StartObject();
+			writer.Key("startEA");
+			writer.Uint64(chunk.startEA.getValue());
+			writer.Key("endEA");
+			writer.Uint64(chunk.endEA.getValue());
+			writer.Key("instructionCount");
+			writer.Uint64(chunk.instructionCount);
+			writer.Key("realTime");
+			writer.Double(chunk.realTime);
+			writer.Key("cpuTime");
+			writer.Double(chunk.cpuTime);
+			writer.EndObject();
+		}
+		writer.EndArray();
+		writer.EndObject();
+	}
+
+	bool RunReport::writeToFilePath(const std::string &path) const {
+		using namespace rapidjson;
+
+		char writeBuffer[65536];
+		auto fh = fopen(path.c_str(),"w");
+		if (fh == NULL)
+			return false;
+
+		FileWriteStream os(fh, writeBuffer, sizeof(writeBuffer));
+		typedef EncodedOutputStream<ASCII<>,FileWriteStream> OutputStream;
+		OutputStream eos(os, true);
+		PrettyWriter<OutputStream, ASCII<>, ASCII<> > writer(eos);
+
+		uint64_t instructionCount = 0;
+		for (auto &chunk : chunks) {
+			instructionCount += chunk.instructionCount;
+		}
+		double matchTime = 0;
+		for (auto &phase : phases) {
+			if (phase.name == "match")
+				matchTime += phase.realTime;
+		}
+
+		writer.StartObject();
+		writer.Key("executableName");
+		writer.String(executableName);
+		writer.Key("executableArchitecture");
+		writer.String(executableArchitecture);
+		writer.Key("matcherName");
+		writer.String(matcherName);
+		writer.Key("dump");
+		writer.StartObject();
+		writer.Key("path");
+		writer.String(dumpPath);
+		if (dumpIdentity.valid) {
+			writer.Key("size");
+			writer.Uint64(dumpIdentity.size);
+			writer.Key("modificationTime");
+			writer.Int64(dumpIdentity.modificationTime);
+			writer.Key("fnv1a");
+			writer.String(hexString(dumpIdentity.hash));
+		}
+		writer.EndObject();
+		writer.Key("patterns");
+		writer.StartObject();
+		writer.Key("count");
+		writer.Uint64(patternCount);
+		writer.Key("fnv1a");
+		writer.String(hexString(patternsHash));
+		writer.EndObject();
+		writer.Key("hardwareConcurrency");
+		writer.Uint(std::thread::hardware_concurrency());
+		writer.Key("threadCount");
+		writer.Uint(threadCount);
+		writer.Key("phases");
+		writer.StartArray();
+		for (auto &phase : phases) {
+			SerializePhase(writer, phase);
+		}
+		writer.EndArray();
+		writer.Key("chunks");
+		SerializeChunks(writer, chunks);
+		writer.Key("instructionCount");
+		writer.Uint64(instructionCount);
+		writer.Key("instructionsPerSecond");
+		writer.Double(matchTime > 0 ? instructionCount / matchTime : 0);
+		writer.Key("matchCount");
+		writer.Uint64(matchCount);
+		writer.Key("searchBudget");
+		writer.StartObject();
+		writer.Key("maxStates");
+		writer.Uint64(searchBudget.maxStates);
+		writer.Key("maxMicroseconds");
+		writer.Uint64(searchBudget.maxMicroseconds);
+		writer.Key("exhaustedAttempts");
+		writer.Uint64(searchBudget.exhaustedAttempts);
+		writer.Key("exhaustedStartEAs");
+		writer.StartArray();
+		for (auto &startEA : searchBudget.exhaustedStartEAs) {
+			writer.Uint64(startEA.getValue());
+		}
+		writer.EndArray();
+		writer.EndObject();
+		writer.Key("peakResidentBytes");
+		writer.Uint64(peakResidentBytes());
+		writer.EndObject();
+
+		eos.Flush();
+		os.Flush();
+		bool success = !ferror(fh);
+		return fclose(fh) == 0 && success;
+	}
+
+	std::string RunReport::reportPathForExecutablePath(const std::string &binaryPath) const {
+		auto path = std::string(binaryPath);
+		size_t lastPoint = path.find_last_of(".");
+		if (lastPoint != std::string::npos) {
+			path.erase(lastPoint);
+		}
+		path.append("_report_");
+		path.append(matcherName);
+		path.append(".json");
+		return path;
+	}
+}
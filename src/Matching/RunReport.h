@@ -0,0 +1,103 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_RUNREPORT_H
+#define IDIOMMATCHER_RUNREPORT_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <Model/Pattern.h>
+
+namespace IdiomMatcher {
+
+	// Timings and identity of one matching run, written as JSON next to the matches
+	// so runs can be compared across releases and hosts.
+	//
+	// cpuTime of a phase is the CPU time of the whole process, threadCPUTimes the
+	// CPU time of each thread working in the phase.
+	class RunReport {
+	public:
+		struct Phase {
+			std::string name;
+			double realTime = 0;
+			double cpuTime = 0;
+			std::vector<double> threadCPUTimes;
+		};
+
+		// a range of EAs matched by one task
+		struct Chunk {
+			EA startEA = InvalidEA;
+			EA endEA = InvalidEA;
+			uint64_t instructionCount = 0;
+			double realTime = 0;
+			double cpuTime = 0;
+		};
+
+		// graph matcher attempts abandoned for exceeding the search budget
+		struct SearchBudget {
+			uint64_t maxStates = 0;
+			uint64_t maxMicroseconds = 0;
+			uint64_t exhaustedAttempts = 0;
+			// of the first exhausted attempts
+			std::vector<EA> exhaustedStartEAs;
+		};
+
+		struct FileIdentity {
+			bool valid = false;
+			uint64_t size = 0;
+			int64_t modificationTime = 0;
+			// FNV-1a of the content
+			uint64_t hash = 0;
+		};
+
+		// Measures a phase from construction until finish or destruction and adds it
+		// to the report. The CPU time of the calling thread is the only thread time
+		// unless threadCPUTimes of phase() are set.
+		class PhaseTimer {
+		public:
+			PhaseTimer(RunReport &report, const std::string &name);
+			~PhaseTimer() { finish(); }
+
+			PhaseTimer(const PhaseTimer &) = delete;
+			PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+			Phase &phase() { return _phase; }
+			void finish();
+
+		private:
+			RunReport *_report;
+			Phase _phase;
+			std::chrono::steady_clock::time_point _start;
+			double _processCPUStart;
+			double _threadCPUStart;
+		};
+
+		std::string executableName;
+		std::string executableArchitecture;
+		std::string matcherName;
+		std::string dumpPath;
+		FileIdentity dumpIdentity;
+		size_t patternCount = 0;
+		uint64_t patternsHash = 0;
+		unsigned threadCount = 1;
+		uint64_t matchCount = 0;
+		SearchBudget searchBudget;
+		std::vector<Phase> phases;
+		std::vector<Chunk> chunks;
+
+		static double threadCPUTime();
+		static double processCPUTime();
+		// highest resident set size of the process so far
+		static uint64_t peakResidentBytes();
+		// FNV-1a of the serialized patterns, equal for equal pattern files
+		static uint64_t hashForPatterns(const Patterns &patterns);
+		static FileIdentity identityForFilePath(const std::string &path);
+
+		bool writeToFilePath(const std::string &path) const;
+		std::string reportPathForExecutablePath(const std::string &path) const;
+	};
+}
+
+#endif //IDIOMMATCHER_RUNREPORT_H
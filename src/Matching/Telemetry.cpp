@@ -0,0 +1,112 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "Telemetry.h"
+
+#ifdef IDIOMMATCHER_TELEMETRY
+
+#include <memory>
+#include <mutex>
+
+namespace IdiomMatcher {
+	namespace Telemetry {
+
+		static std::mutex registryMutex;
+		static std::vector<std::shared_ptr<ThreadRecord> > registry;
+		static std::atomic<uint64_t> registryGeneration(0);
+
+		const char *counterName(const Counter counter) {
+			switch (counter) {
+				case InstructionsDecoded: return "instructions decoded";
+				case GraphsBuilt: return "graphs built";
+				case GraphVertices: return "graph vertices";
+				case GraphEdges: return "graph edges";
+				case RegexEvaluations: return "regex evaluations";
+				case VF2States: return "VF2 states";
+				case WindowMemoHits: return "window memo hits";
+				case CascadeRejectedCandidates: return "cascade rejected candidates";
+				default: return "unknown";
+			}
+		}
+
+		ThreadRecord::ThreadRecord() : busyNanoseconds(0), idleNanoseconds(0) {
+			for (auto &counter : counters) {
+				counter.store(0);
+			}
+		}
+
+		ThreadRecord &threadRecord() {
+			// the record stays alive for snapshots after the thread exited
+			static thread_local std::shared_ptr<ThreadRecord> record;
+			static thread_local uint64_t generation = 0;
+			uint64_t currentGeneration = registryGeneration.load(std::memory_order_relaxed);
+			if (!record || generation != currentGeneration) {
+				record = std::make_shared<ThreadRecord>();
+				generation = currentGeneration;
+				std::lock_guard<std::mutex> lock(registryMutex);
+				record->name = "thread " + std::to_string(registry.size());
+				registry.push_back(record);
+			}
+			return *record;
+		}
+
+		void setThreadName(const std::string &name) {
+			auto &record = threadRecord();
+			std::lock_guard<std::mutex> lock(registryMutex);
+			record.name = name;
+		}
+
+		static ThreadSnapshot snapshotOfRecord(const ThreadRecord &record) {
+			ThreadSnapshot snapshot;
+			snapshot.name = record.name;
+			for (int i = 0; i < CounterCount; ++i) {
+				snapshot.counters[i] = record.counters[i].load(std::memory_order_relaxed);
+			}
+			snapshot.busyTime = record.busyNanoseconds.load(std::memory_order_relaxed) / 1e9;
+			snapshot.idleTime = record.idleNanoseconds.load(std::memory_order_relaxed) / 1e9;
+			return snapshot;
+		}
+
+		std::vector<ThreadSnapshot> snapshot() {
+			std::lock_guard<std::mutex> lock(registryMutex);
+			std::vector<ThreadSnapshot> snapshots;
+			for (auto &record : registry) {
+				snapshots.push_back(snapshotOfRecord(*record));
+			}
+			return snapshots;
+		}
+
+		ThreadSnapshot total() {
+			ThreadSnapshot sum;
+			sum.name = "total";
+			for (auto &counter : sum.counters) {
+				counter = 0;
+			}
+			sum.busyTime = sum.idleTime = 0;
+			for (auto &thread : snapshot()) {
+				for (int i = 0; i < CounterCount; ++i) {
+					sum.counters[i] += thread.counters[i];
+				}
+				sum.busyTime += thread.busyTime;
+				sum.idleTime += thread.idleTime;
+			}
+			return sum;
+		}
+
+		void reset() {
+			std::lock_guard<std::mutex> lock(registryMutex);
+			registry.clear();
+			registryGeneration.fetch_add(1);
+		}
+
+		TimeScope::~TimeScope() {
+			auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+			auto &record = threadRecord();
+			auto &time = _busy ? record.busyNanoseconds : record.idleNanoseconds;
+			time.store(time.load(std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+		}
+	}
+}
+
+#endif
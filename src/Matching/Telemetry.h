@@ -0,0 +1,101 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_TELEMETRY_H
+#define IDIOMMATCHER_TELEMETRY_H
+
+// Hot path counters and busy/idle time per thread. Only compiled in when
+// IDIOMMATCHER_TELEMETRY is defined (cmake -D IDIOMMATCHER_TELEMETRY=ON),
+// otherwise the macros below expand to nothing.
+
+#ifdef IDIOMMATCHER_TELEMETRY
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace IdiomMatcher {
+	namespace Telemetry {
+
+		enum Counter {
+			InstructionsDecoded,
+			GraphsBuilt,
+			GraphVertices,
+			GraphEdges,
+			RegexEvaluations,
+			// candidate vertex pairs VF2 tested while extending a partial mapping
+			VF2States,
+			// pattern tests answered by the window memo of the graph matchers
+			WindowMemoHits,
+			// candidates a cascade prefilter dropped before their instruction graph was built
+			CascadeRejectedCandidates,
+			CounterCount
+		};
+		const char *counterName(const Counter counter);
+
+		// Counters of one thread. Only the owning thread writes, so increments are
+		// relaxed load and store without a locked instruction.
+		struct ThreadRecord {
+			std::string name;
+			std::atomic<uint64_t> counters[CounterCount];
+			std::atomic<uint64_t> busyNanoseconds;
+			std::atomic<uint64_t> idleNanoseconds;
+
+			ThreadRecord();
+		};
+
+		struct ThreadSnapshot {
+			std::string name;
+			uint64_t counters[CounterCount];
+			double busyTime;
+			double idleTime;
+		};
+
+		// record of the calling thread, registered on first use
+		ThreadRecord &threadRecord();
+
+		inline void add(const Counter counter, const uint64_t value) {
+			auto &count = threadRecord().counters[counter];
+			count.store(count.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+
+		void setThreadName(const std::string &name);
+
+		// all threads that recorded anything since the last reset
+		std::vector<ThreadSnapshot> snapshot();
+		// sum over all threads
+		ThreadSnapshot total();
+		// forgets all records, threads get a new record on their next use
+		void reset();
+
+		// Adds the time until destruction to the busy or idle time of the calling thread.
+		class TimeScope {
+		public:
+			TimeScope(const bool busy) : _busy(busy), _start(std::chrono::steady_clock::now()) { }
+			~TimeScope();
+		private:
+			const bool _busy;
+			const std::chrono::steady_clock::time_point _start;
+		};
+	}
+}
+
+#define IDIOMMATCHER_COUNT(counter, value) ::IdiomMatcher::Telemetry::add(::IdiomMatcher::Telemetry::counter, (value))
+#define IDIOMMATCHER_THREAD_NAME(name) ::IdiomMatcher::Telemetry::setThreadName(name)
+#define IDIOMMATCHER_TELEMETRY_RESET() ::IdiomMatcher::Telemetry::reset()
+#define IDIOMMATCHER_BUSY_SCOPE() ::IdiomMatcher::Telemetry::TimeScope telemetryBusyScope(true)
+#define IDIOMMATCHER_IDLE_SCOPE() ::IdiomMatcher::Telemetry::TimeScope telemetryIdleScope(false)
+
+#else
+
+#define IDIOMMATCHER_COUNT(counter, value) do { } while (0)
+#define IDIOMMATCHER_THREAD_NAME(name) do { } while (0)
+#define IDIOMMATCHER_TELEMETRY_RESET() do { } while (0)
+#define IDIOMMATCHER_BUSY_SCOPE() do { } while (0)
+#define IDIOMMATCHER_IDLE_SCOPE() do { } while (0)
+
+#endif
+
+#endif //IDIOMMATCHER_TELEMETRY_H
@@ -0,0 +1,64 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_ALLOCATIONHOOKS_H
+#define IDIOMMATCHER_ALLOCATIONHOOKS_H
+
+// Replaces the global operator new and delete to report to AllocationTracker.
+// Include in exactly one source file of an executable. While tracking is
+// disabled the hooks only add a relaxed atomic load and the block header,
+// see AllocationTracker::BlockHeader, to malloc and free.
+
+#include <cstdlib>
+#include <new>
+#include <Model/AllocationTracker.h>
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	void *block = malloc(size + IdiomMatcher::AllocationTracker::blockHeaderSize);
+	if (block == nullptr)
+		return nullptr;
+	if (IdiomMatcher::AllocationTracker::isEnabled())
+		IdiomMatcher::AllocationTracker::recordAllocation(block);
+	else
+		IdiomMatcher::AllocationTracker::markUntracked(block);
+	return static_cast<char *>(block) + IdiomMatcher::AllocationTracker::blockHeaderSize;
+}
+
+void *operator new(size_t size) {
+	void *pointer = operator new(size, std::nothrow);
+	if (pointer == nullptr)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &nothrow) noexcept {
+	return operator new(size, nothrow);
+}
+
+void operator delete(void *pointer) noexcept {
+	if (pointer == nullptr)
+		return;
+	void *block = static_cast<char *>(pointer) - IdiomMatcher::AllocationTracker::blockHeaderSize;
+	if (IdiomMatcher::AllocationTracker::isEnabled())
+		IdiomMatcher::AllocationTracker::recordFree(block);
+	free(block);
+}
+
+void operator delete[](void *pointer) noexcept {
+	operator delete(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept {
+	operator delete(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept {
+	operator delete(pointer);
+}
+
+#endif //IDIOMMATCHER_ALLOCATIONHOOKS_H
@@ -0,0 +1,225 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "AllocationTracker.h"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+namespace IdiomMatcher {
+	namespace AllocationTracker {
+
+		std::atomic<bool> enabled(false);
+
+		// The hooks run inside operator new, so the counters live in static storage
+		// and recording neither allocates nor locks.
+		static const unsigned maximumTagCount = 64;
+		static const unsigned untaggedTag = 0;
+		// used when all other tags are taken
+		static const unsigned overflowTag = maximumTagCount - 1;
+
+		struct TagCounters {
+			std::atomic<uint64_t> allocationCount;
+			std::atomic<uint64_t> allocatedBytes;
+			std::atomic<uint64_t> freeCount;
+			std::atomic<uint64_t> freedBytes;
+			std::atomic<int64_t> liveBytes;
+			std::atomic<uint64_t> peakBytes;
+			char name[64];
+		};
+
+		static_assert(sizeof(BlockHeader) <= blockHeaderSize, "blockHeaderSize too small");
+
+		static TagCounters tags[maximumTagCount];
+		static std::atomic<unsigned> tagCount(1);
+		static std::mutex tagMutex;
+		static std::atomic<int64_t> currentLiveBytes(0);
+		static std::atomic<uint64_t> processPeakBytes(0);
+		// blocks of earlier generations were allocated before the last reset
+		static std::atomic<uint32_t> currentGeneration(1);
+		static thread_local unsigned currentTag = untaggedTag;
+
+		static size_t usableSize(void *block) {
+#ifdef __APPLE__
+			return malloc_size(block) - blockHeaderSize;
+#else
+			return malloc_usable_size(block) - blockHeaderSize;
+#endif
+		}
+
+		static void updateMaximum(std::atomic<uint64_t> &maximum, uint64_t value) {
+			uint64_t current = maximum.load(std::memory_order_relaxed);
+			while (current < value && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed)) { }
+		}
+
+		void setEnabled(bool enable) {
+			enabled.store(enable);
+		}
+
+		void recordAllocation(void *block) {
+			auto header = static_cast<BlockHeader *>(block);
+			header->tag = currentTag;
+			header->generation = currentGeneration.load(std::memory_order_relaxed);
+			size_t size = usableSize(block);
+			int64_t live = currentLiveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+			auto &counters = tags[currentTag];
+			counters.allocationCount.fetch_add(1, std::memory_order_relaxed);
+			counters.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+			int64_t tagLive = counters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+			updateMaximum(counters.peakBytes, tagLive);
+			updateMaximum(processPeakBytes, live);
+		}
+
+		void recordFree(void *block) {
+			auto header = static_cast<BlockHeader *>(block);
+			if (header->generation != currentGeneration.load(std::memory_order_relaxed))
+				return;
+			size_t size = usableSize(block);
+			currentLiveBytes.fetch_sub(size, std::memory_order_relaxed);
+			auto &counters = tags[header->tag];
+			counters.freeCount.fetch_add(1, std::memory_order_relaxed);
+			counters.freedBytes.fetch_add(size, std::memory_order_relaxed);
+			counters.liveBytes.fetch_sub(size, std::memory_order_relaxed);
+		}
+
+		static unsigned tagForName(const std::string &name) {
+			std::lock_guard<std::mutex> lock(tagMutex);
+			unsigned count = tagCount.load();
+			for (unsigned tag = 1; tag < count; ++tag) {
+				if (strncmp(tags[tag].name, name.c_str(), sizeof(tags[tag].name) - 1) == 0)
+					return tag;
+			}
+			if (count == overflowTag) {
+				snprintf(tags[overflowTag].name, sizeof(tags[overflowTag].name), "%s", "other tags");
+				return overflowTag;
+			}
+			snprintf(tags[count].name, sizeof(tags[count].name), "%s", name.c_str());
+			tagCount.store(count + 1);
+			return count;
+		}
+
+		Scope::Scope(const std::string &tag) : _previousTag(currentTag) {
+			currentTag = tagForName(tag);
+		}
+
+		Scope::~Scope() {
+			currentTag = _previousTag;
+		}
+
+		static Statistics statisticsForIndex(unsigned tag) {
+			Statistics statistics;
+			statistics.tag = tag == untaggedTag ? "untagged" : tags[tag].name;
+			statistics.allocationCount = tags[tag].allocationCount.load();
+			statistics.allocatedBytes = tags[tag].allocatedBytes.load();
+			statistics.freeCount = tags[tag].freeCount.load();
+			statistics.freedBytes = tags[tag].freedBytes.load();
+			statistics.peakBytes = tags[tag].peakBytes.load();
+			return statistics;
+		}
+
+		static unsigned usedTagCount() {
+			return tagCount.load() == overflowTag && tags[overflowTag].name[0] != '\0' ? maximumTagCount : tagCount.load();
+		}
+
+		std::vector<Statistics> statistics() {
+			std::vector<Statistics> result;
+			for (unsigned tag = 0; tag < usedTagCount(); ++tag) {
+				auto statistics = statisticsForIndex(tag);
+				if (statistics.allocationCount != 0 || statistics.freeCount != 0) {
+					result.push_back(statistics);
+				}
+			}
+			return result;
+		}
+
+		Statistics statisticsForTag(const std::string &tag) {
+			for (auto &statistics : statistics()) {
+				if (statistics.tag == tag)
+					return statistics;
+			}
+			Statistics empty;
+			empty.tag = tag;
+			return empty;
+		}
+
+		Statistics total() {
+			Statistics sum;
+			sum.tag = "total";
+			for (auto &statistics : statistics()) {
+				sum.allocationCount += statistics.allocationCount;
+				sum.allocatedBytes += statistics.allocatedBytes;
+				sum.freeCount += statistics.freeCount;
+				sum.freedBytes += statistics.freedBytes;
+			}
+			sum.peakBytes = processPeakBytes.load();
+			return sum;
+		}
+
+		uint64_t allocationCount() {
+			uint64_t count = 0;
+			for (unsigned tag = 0; tag < usedTagCount(); ++tag) {
+				count += tags[tag].allocationCount.load();
+			}
+			return count;
+		}
+
+		int64_t liveBytes() {
+			return currentLiveBytes.load();
+		}
+
+		void reset() {
+			for (auto &counters : tags) {
+				counters.allocationCount.store(0);
+				counters.allocatedBytes.store(0);
+				counters.freeCount.store(0);
+				counters.freedBytes.store(0);
+				counters.liveBytes.store(0);
+				counters.peakBytes.store(0);
+			}
+			currentLiveBytes.store(0);
+			processPeakBytes.store(0);
+			// generation 0 marks untracked blocks
+			if (currentGeneration.fetch_add(1) + 1 == 0)
+				currentGeneration.store(1);
+		}
+
+		std::string reportTable() {
+			std::string table;
+			char line[512];
+			snprintf(line, sizeof(line), "%-40s %12s %14s %12s %14s %14s\n", "tag", "allocations", "allocated", "frees", "freed", "peak live");
+			table.append(line);
+			auto rows = statistics();
+			rows.push_back(total());
+			for (auto &row : rows) {
+				snprintf(line, sizeof(line), "%-40.40s %12ju %14ju %12ju %14ju %14ju\n", row.tag.c_str(),
+						 (uintmax_t)row.allocationCount, (uintmax_t)row.allocatedBytes, (uintmax_t)row.freeCount,
+						 (uintmax_t)row.freedBytes, (uintmax_t)row.peakBytes);
+				table.append(line);
+			}
+			return table;
+		}
+
+		Statistics measure(const std::string &tag, const std::function<void()> &function) {
+			bool wasEnabled = isEnabled();
+			Statistics before = statisticsForTag(tag);
+			setEnabled(true);
+			{
+				Scope scope(tag);
+				function();
+			}
+			setEnabled(wasEnabled);
+			Statistics after = statisticsForTag(tag);
+			after.allocationCount -= before.allocationCount;
+			after.allocatedBytes -= before.allocatedBytes;
+			after.freeCount -= before.freeCount;
+			after.freedBytes -= before.freedBytes;
+			return after;
+		}
+	}
+}
@@ -0,0 +1,88 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_ALLOCATIONTRACKER_H
+#define IDIOMMATCHER_ALLOCATIONTRACKER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace IdiomMatcher {
+
+	// Counts heap allocations per tag, the tag of a thread is set with Scope.
+	// Allocations are only seen in executables that include AllocationHooks.h
+	// and only counted while tracking is enabled. Sizes are the usable sizes
+	// malloc reports. A free is charged to the tag of its allocation, frees of
+	// allocations made before tracking was enabled or the counters were reset
+	// are not counted, so live bytes never drop below zero.
+	namespace AllocationTracker {
+
+		struct Statistics {
+			std::string tag;
+			uint64_t allocationCount = 0;
+			uint64_t allocatedBytes = 0;
+			uint64_t freeCount = 0;
+			uint64_t freedBytes = 0;
+			// highest live bytes of the allocations of this tag, of the whole process for total()
+			uint64_t peakBytes = 0;
+		};
+
+		// The hooks put a header before every block they allocate, so a free finds
+		// the tag its allocation was charged to. Keeps the alignment of malloc.
+		struct BlockHeader {
+			uint32_t tag;
+			// the generation of the counters, see reset, 0 for blocks allocated while not tracking
+			uint32_t generation;
+		};
+		static const size_t blockHeaderSize = 16;
+
+		extern std::atomic<bool> enabled;
+
+		inline bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+		void setEnabled(bool enable);
+
+		// called by the hooks with the block malloc returned, for every allocation
+		// while enabled and every free while enabled
+		void recordAllocation(void *block);
+		void recordFree(void *block);
+		// called by the hooks for allocations while disabled
+		inline void markUntracked(void *block) { static_cast<BlockHeader *>(block)->generation = 0; }
+
+		// Tags the allocations and frees of the calling thread until destruction,
+		// the previous tag is restored. Threads start untagged.
+		class Scope {
+		public:
+			Scope(const std::string &tag);
+			~Scope();
+
+			Scope(const Scope &) = delete;
+			Scope &operator=(const Scope &) = delete;
+
+		private:
+			const unsigned _previousTag;
+		};
+
+		// tags that recorded anything, in the order they were first used
+		std::vector<Statistics> statistics();
+		Statistics statisticsForTag(const std::string &tag);
+		// sum of all tags, peakBytes is the peak of the process
+		Statistics total();
+		// allocations of all tags, doesn't allocate, so it can be read while tracking
+		uint64_t allocationCount();
+		int64_t liveBytes();
+		// clears the counters, tags stay registered
+		void reset();
+		// table of statistics() and total() for the log
+		std::string reportTable();
+
+		// Test helper: runs function with tracking enabled under tag and returns
+		// the allocations it made.
+		Statistics measure(const std::string &tag, const std::function<void()> &function);
+	}
+}
+
+#endif //IDIOMMATCHER_ALLOCATIONTRACKER_H
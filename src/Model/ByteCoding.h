@@ -0,0 +1,118 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_BYTECODING_H
+#define IDIOMMATCHER_BYTECODING_H
+
+#include <cstdint>
+#include <string>
+
+namespace IdiomMatcher {
+
+	// Little endian varint and fixed size encoding used by the binary file formats.
+	struct ByteWriter {
+		std::string bytes;
+
+		void putVarint(uint64_t value) {
+			while (value >= 0x80) {
+				bytes.push_back((char)((value & 0x7F) | 0x80));
+				value >>= 7;
+			}
+			bytes.push_back((char)value);
+		}
+
+		void putSigned(int64_t value) {
+			putVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+		}
+
+		void putFixed64(uint64_t value) {
+			for (int i = 0; i < 8; ++i) {
+				bytes.push_back((char)((value >> (i*8)) & 0xFF));
+			}
+		}
+
+		void putString(const std::string &string) {
+			putVarint(string.size());
+			bytes.append(string);
+		}
+
+		static size_t varintLength(uint64_t value) {
+			size_t length = 1;
+			while (value >= 0x80) {
+				value >>= 7;
+				++length;
+			}
+			return length;
+		}
+
+		static uint64_t zigzag(int64_t value) {
+			return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+		}
+	};
+
+	struct ByteReader {
+		const unsigned char *position;
+		const unsigned char *end;
+		bool valid = true;
+
+		ByteReader(const char *data, size_t length) : position((const unsigned char *)data), end((const unsigned char *)data + length) { }
+
+		uint64_t getVarint() {
+			uint64_t value = 0;
+			int shift = 0;
+			while (position < end && shift < 64) {
+				unsigned char byte = *position++;
+				value |= (uint64_t)(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0)
+					return value;
+				shift += 7;
+			}
+			valid = false;
+			return 0;
+		}
+
+		int64_t getSigned() {
+			uint64_t value = getVarint();
+			return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+		}
+
+		uint64_t getFixed64() {
+			if (end - position < 8) {
+				valid = false;
+				return 0;
+			}
+			uint64_t value = 0;
+			for (int i = 0; i < 8; ++i) {
+				value |= (uint64_t)position[i] << (i*8);
+			}
+			position += 8;
+			return value;
+		}
+
+		std::string getString() {
+			uint64_t length = getVarint();
+			if (!valid || (uint64_t)(end - position) < length) {
+				valid = false;
+				return "";
+			}
+			std::string string((const char *)position, length);
+			position += length;
+			return string;
+		}
+	};
+
+	static const uint64_t fnv1aOffsetBasis = 14695981039346656037ull;
+
+	// 64 bit FNV-1a, pass the previous hash to continue hashing
+	inline uint64_t fnv1aHash(const void *bytes, size_t length, uint64_t hash = fnv1aOffsetBasis) {
+		const uint8_t *byte = (const uint8_t *)bytes;
+		for (size_t i = 0; i < length; ++i) {
+			hash ^= byte[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+}
+
+#endif //IDIOMMATCHER_BYTECODING_H
@@ -0,0 +1,463 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "CompressedDisassemblyPersistence.h"
+#include "Logging.h"
+#include "ByteCoding.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace IdiomMatcher {
+
+	static const char compressedDocumentMagic[4] = {'I','M','C','D'};
+	static const char compressedTrailerMagic[4] = {'I','M','C','E'};
+	static const uint32_t compressedDocumentVersion = 1;
+	// dictionary offset, index offset, trailer magic
+	static const size_t compressedTrailerSize = 8 + 8 + 4;
+
+	enum CompressedLineFlags {
+		LineHasComment = 1 << 0,
+		LineHasInstructionEA = 1 << 1,
+		LineIsRegex = 1 << 2
+	};
+
+	enum CompressedOperandFlags {
+		OperandUsed = 1 << 0,
+		OperandModified = 1 << 1,
+		OperandNameIsTemplate = 1 << 2,
+		OperandHasAddress = 1 << 3,
+		OperandAddressIsRelative = 1 << 4,
+		OperandHasExtractAs = 1 << 5,
+		OperandHasRegex = 1 << 6
+	};
+
+#pragma mark - Encoding
+
+	class StringDictionary {
+		std::unordered_map<std::string, uint64_t> _ids;
+		std::vector<const std::string *> _strings;
+	public:
+		uint64_t idForString(const std::string &string) {
+			auto it = _ids.find(string);
+			if (it != _ids.end())
+				return it->second;
+			auto inserted = _ids.emplace(string, _strings.size());
+			_strings.push_back(&inserted.first->first);
+			return inserted.first->second;
+		}
+
+		void serialize(ByteWriter &writer) const {
+			writer.putVarint(_strings.size());
+			for (auto string : _strings) {
+				writer.putString(*string);
+			}
+		}
+	};
+
+	static void encodeOperand(ByteWriter &writer, StringDictionary &dictionary, const Operand &operand, const EA &lineEA) {
+		writer.putVarint(dictionary.idForString(operand.getText()));
+		auto registers = operand.getRegisters();
+		writer.putVarint(registers.size());
+		for (auto &reg : registers) {
+			writer.putVarint(dictionary.idForString(reg));
+		}
+
+		uint64_t flags = 0;
+		if (operand.getUsed()) flags |= OperandUsed;
+		if (operand.getModified()) flags |= OperandModified;
+		if (operand.getNameIsTemplate()) flags |= OperandNameIsTemplate;
+		if (!operand.getExtractAs().empty()) flags |= OperandHasExtractAs;
+		if (!operand.getRegex().empty()) flags |= OperandHasRegex;
+
+		// addresses are either small constants or EAs close to the instruction, store the shorter form
+		uint64_t address = operand.getAddress();
+		int64_t relativeAddress = (int64_t)(address - lineEA.getValue());
+		bool useRelative = ByteWriter::varintLength(ByteWriter::zigzag(relativeAddress)) < ByteWriter::varintLength(address);
+		if (address != 0) {
+			flags |= OperandHasAddress;
+			if (useRelative) flags |= OperandAddressIsRelative;
+		}
+		writer.putVarint(flags);
+
+		if (address != 0) {
+			if (useRelative)
+				writer.putSigned(relativeAddress);
+			else
+				writer.putVarint(address);
+		}
+		if (flags & OperandHasExtractAs)
+			writer.putVarint(dictionary.idForString(operand.getExtractAs()));
+		if (flags & OperandHasRegex)
+			writer.putVarint(dictionary.idForString(operand.getRegex()));
+	}
+
+	static void encodeLine(ByteWriter &writer, StringDictionary &dictionary, const DisassemblyLine &line, const EA &previousEA) {
+		auto &instruction = *line.getInstruction();
+		const EA ea = line.getEA();
+
+		writer.putVarint(ea.getValue() - previousEA.getValue());
+		writer.putVarint(dictionary.idForString(instruction.getMnemonic()));
+		writer.putVarint(instruction.getSize());
+
+		uint64_t flags = 0;
+		auto comment = line.getComment();
+		if (!comment.empty()) flags |= LineHasComment;
+		if (!(instruction.getEA() == ea)) flags |= LineHasInstructionEA;
+		if (instruction.getIsRegex()) flags |= LineIsRegex;
+		writer.putVarint(flags);
+
+		if (flags & LineHasComment)
+			writer.putVarint(dictionary.idForString(comment));
+		if (flags & LineHasInstructionEA)
+			writer.putVarint(instruction.getEA().getValue());
+
+		auto &operands = instruction.getOperands();
+		writer.putVarint(operands.size());
+		for (auto &operand : operands) {
+			encodeOperand(writer, dictionary, *operand, ea);
+		}
+
+		auto &xrefs = instruction.getXrefs();
+		writer.putVarint(xrefs.size());
+		for (auto &xref : xrefs) {
+			int64_t delta = (int64_t)(xref->getTarget().getValue() - ea.getValue());
+			uint64_t xrefFlags = (xref->isData() ? 1 : 0) | (xref->isUnordinaryFlow() ? 2 : 0);
+			writer.putVarint((ByteWriter::zigzag(delta) << 2) | xrefFlags);
+		}
+	}
+
+#pragma mark - Decoding
+
+	static bool decodeOperand(ByteReader &reader, const std::vector<std::string> &dictionary, const EA &lineEA, Operand_Ref *operand) {
+		auto stringForId = [&reader, &dictionary](uint64_t stringId) -> std::string {
+			if (stringId >= dictionary.size()) {
+				reader.valid = false;
+				return "";
+			}
+			return dictionary[stringId];
+		};
+
+		auto text = stringForId(reader.getVarint());
+		auto registerCount = reader.getVarint();
+		std::vector<std::string> registers;
+		for (uint64_t i = 0; i < registerCount && reader.valid; ++i) {
+			registers.push_back(stringForId(reader.getVarint()));
+		}
+		auto flags = reader.getVarint();
+
+		uintmax_t address = 0;
+		if (flags & OperandHasAddress) {
+			if (flags & OperandAddressIsRelative)
+				address = lineEA.getValue() + reader.getSigned();
+			else
+				address = reader.getVarint();
+		}
+		std::string extractAs;
+		if (flags & OperandHasExtractAs)
+			extractAs = stringForId(reader.getVarint());
+		std::string regex;
+		if (flags & OperandHasRegex)
+			regex = stringForId(reader.getVarint());
+
+		*operand = std::make_shared<Operand>(text, registers, extractAs, regex,
+											 (flags & OperandNameIsTemplate) != 0,
+											 (flags & OperandUsed) != 0,
+											 (flags & OperandModified) != 0,
+											 address);
+		return reader.valid;
+	}
+
+	static DisassemblyLine_Ref decodeLine(ByteReader &reader, const std::vector<std::string> &dictionary, EA *previousEA) {
+		EA ea(previousEA->getValue() + reader.getVarint());
+		*previousEA = ea;
+
+		auto mnemonicId = reader.getVarint();
+		if (!reader.valid || mnemonicId >= dictionary.size())
+			return nullptr;
+		auto &mnemonic = dictionary[mnemonicId];
+		uint16_t size = (uint16_t)reader.getVarint();
+		auto flags = reader.getVarint();
+
+		std::string comment;
+		if (flags & LineHasComment) {
+			auto commentId = reader.getVarint();
+			if (commentId >= dictionary.size())
+				return nullptr;
+			comment = dictionary[commentId];
+		}
+		EA instructionEA = ea;
+		if (flags & LineHasInstructionEA)
+			instructionEA = EA(reader.getVarint());
+
+		Operands operands;
+		auto operandCount = reader.getVarint();
+		for (uint64_t i = 0; i < operandCount && reader.valid; ++i) {
+			Operand_Ref operand;
+			if (decodeOperand(reader, dictionary, ea, &operand))
+				operands.push_back(operand);
+		}
+
+		XRefs xrefs;
+		auto xrefCount = reader.getVarint();
+		for (uint64_t i = 0; i < xrefCount && reader.valid; ++i) {
+			auto value = reader.getVarint();
+			auto zigzagDelta = value >> 2;
+			int64_t delta = (int64_t)(zigzagDelta >> 1) ^ -(int64_t)(zigzagDelta & 1);
+			xrefs.push_back(std::make_shared<XRef>(EA(ea.getValue() + delta), (value & 1) != 0, (value & 2) != 0));
+		}
+
+		if (!reader.valid)
+			return nullptr;
+
+		auto instruction = std::make_shared<Instruction>(mnemonic, operands, xrefs, size, instructionEA, (flags & LineIsRegex) != 0);
+		return std::make_shared<DisassemblyLine>(ea, instruction, comment);
+	}
+
+#pragma mark - Writing
+
+	bool writeCompressedDocumentToFilePath(const std::string &path, const DisassemblyDocument &document, const size_t linesPerBlock) {
+		auto fh = fopen(path.c_str(), "wb");
+		if (fh == NULL)
+			return false;
+
+		ByteWriter head;
+		head.bytes.append(compressedDocumentMagic, sizeof(compressedDocumentMagic));
+		head.putVarint(compressedDocumentVersion);
+		head.putString(document.getBinaryName());
+		head.putString(document.getArchitectureName());
+		head.putString(document.getDissassembler());
+		head.putVarint(document.getMinEA().getValue());
+		head.putVarint(document.getMaxEA().getValue());
+		bool success = fwrite(head.bytes.data(), 1, head.bytes.size(), fh) == head.bytes.size();
+		uint64_t offset = head.bytes.size();
+
+		StringDictionary dictionary;
+		CompressedBlockIndex index;
+
+		// EAs are stored as unsigned deltas, so the lines have to be ordered
+		DisassemblyLines lines = document.getDisassemblyLines();
+		auto lineOrder = [](const DisassemblyLine_Ref &a, const DisassemblyLine_Ref &b) { return a->getEA() < b->getEA(); };
+		if (!std::is_sorted(lines.begin(), lines.end(), lineOrder)) {
+			std::stable_sort(lines.begin(), lines.end(), lineOrder);
+		}
+		// like the EA map of the dump API, the first line for an EA wins
+		lines.erase(std::unique(lines.begin(), lines.end(), [](const DisassemblyLine_Ref &a, const DisassemblyLine_Ref &b) {
+			return a->getEA() == b->getEA();
+		}), lines.end());
+		const size_t blockSize = std::max(linesPerBlock, (size_t)1);
+
+		for (size_t blockStart = 0; blockStart < lines.size() && success; blockStart += blockSize) {
+			size_t blockEnd = std::min(blockStart + blockSize, lines.size());
+			ByteWriter block;
+			EA previousEA(0);
+			for (size_t i = blockStart; i < blockEnd; ++i) {
+				encodeLine(block, dictionary, *lines[i], previousEA);
+				previousEA = lines[i]->getEA();
+			}
+
+			CompressedBlockIndexEntry entry;
+			entry.firstEA = lines[blockStart]->getEA();
+			entry.lastEA = lines[blockEnd-1]->getEA();
+			entry.offset = offset;
+			entry.length = block.bytes.size();
+			entry.lineCount = blockEnd - blockStart;
+			index.push_back(entry);
+
+			success = fwrite(block.bytes.data(), 1, block.bytes.size(), fh) == block.bytes.size();
+			offset += block.bytes.size();
+		}
+
+		ByteWriter tail;
+		uint64_t dictionaryOffset = offset;
+		dictionary.serialize(tail);
+		uint64_t indexOffset = offset + tail.bytes.size();
+		tail.putVarint(index.size());
+		for (auto &entry : index) {
+			tail.putVarint(entry.firstEA.getValue());
+			tail.putVarint(entry.lastEA.getValue() - entry.firstEA.getValue());
+			tail.putVarint(entry.offset);
+			tail.putVarint(entry.length);
+			tail.putVarint(entry.lineCount);
+		}
+		tail.putFixed64(dictionaryOffset);
+		tail.putFixed64(indexOffset);
+		tail.bytes.append(compressedTrailerMagic, sizeof(compressedTrailerMagic));
+
+		if (success)
+			success = fwrite(tail.bytes.data(), 1, tail.bytes.size(), fh) == tail.bytes.size();
+		fclose(fh);
+		return success;
+	}
+
+#pragma mark - Reading
+
+	static bool readFully(int fileDescriptor, char *buffer, size_t length, uint64_t offset) {
+		while (length > 0) {
+			auto readBytes = pread(fileDescriptor, buffer, length, (off_t)offset);
+			if (readBytes <= 0)
+				return false;
+			buffer += readBytes;
+			length -= readBytes;
+			offset += readBytes;
+		}
+		return true;
+	}
+
+	CompressedDisassemblyReader::~CompressedDisassemblyReader() {
+		if (_fileDescriptor >= 0)
+			close(_fileDescriptor);
+	}
+
+	bool CompressedDisassemblyReader::openFilePath(const std::string &path) {
+		if (_fileDescriptor >= 0) {
+			close(_fileDescriptor);
+			_fileDescriptor = -1;
+		}
+		_dictionary.clear();
+		_index.clear();
+
+		_fileDescriptor = open(path.c_str(), O_RDONLY);
+		if (_fileDescriptor < 0) {
+			warning("failed to open compressed document %s\n", path.c_str());
+			return false;
+		}
+
+		off_t fileSize = lseek(_fileDescriptor, 0, SEEK_END);
+		if (fileSize < (off_t)(sizeof(compressedDocumentMagic) + compressedTrailerSize)) {
+			warning("compressed document %s is too small\n", path.c_str());
+			return false;
+		}
+
+		char trailer[compressedTrailerSize];
+		if (!readFully(_fileDescriptor, trailer, sizeof(trailer), fileSize - compressedTrailerSize)
+			|| memcmp(trailer + 16, compressedTrailerMagic, sizeof(compressedTrailerMagic)) != 0) {
+			warning("compressed document %s has no valid trailer\n", path.c_str());
+			return false;
+		}
+		ByteReader trailerReader(trailer, sizeof(trailer));
+		uint64_t dictionaryOffset = trailerReader.getFixed64();
+		uint64_t indexOffset = trailerReader.getFixed64();
+		uint64_t tailEnd = fileSize - compressedTrailerSize;
+		if (dictionaryOffset > indexOffset || indexOffset > tailEnd) {
+			warning("compressed document %s has invalid offsets\n", path.c_str());
+			return false;
+		}
+
+		// the head is small, 64KB is plenty for names and EAs
+		std::string headBytes(std::min<uint64_t>(dictionaryOffset, 65536), '\0');
+		if (!readFully(_fileDescriptor, &headBytes[0], headBytes.size(), 0)
+			|| memcmp(headBytes.data(), compressedDocumentMagic, sizeof(compressedDocumentMagic)) != 0) {
+			warning("%s is not a compressed document\n", path.c_str());
+			return false;
+		}
+		ByteReader headReader(headBytes.data() + sizeof(compressedDocumentMagic), headBytes.size() - sizeof(compressedDocumentMagic));
+		if (headReader.getVarint() != compressedDocumentVersion) {
+			warning("compressed document %s has unsupported version\n", path.c_str());
+			return false;
+		}
+		auto binaryName = headReader.getString();
+		auto architecture = headReader.getString();
+		auto disassembler = headReader.getString();
+		auto minEA = headReader.getVarint();
+		auto maxEA = headReader.getVarint();
+		if (!headReader.valid) {
+			warning("compressed document %s has invalid head\n", path.c_str());
+			return false;
+		}
+		_head = DisassemblyDocument(binaryName, architecture, disassembler, EA(minEA), EA(maxEA), DisassemblyLines());
+
+		std::string tailBytes(tailEnd - dictionaryOffset, '\0');
+		if (!tailBytes.empty() && !readFully(_fileDescriptor, &tailBytes[0], tailBytes.size(), dictionaryOffset)) {
+			warning("failed to read dictionary of %s\n", path.c_str());
+			return false;
+		}
+		ByteReader tailReader(tailBytes.data(), tailBytes.size());
+		auto stringCount = tailReader.getVarint();
+		for (uint64_t i = 0; i < stringCount && tailReader.valid; ++i) {
+			_dictionary.push_back(tailReader.getString());
+		}
+		auto blockCount = tailReader.getVarint();
+		for (uint64_t i = 0; i < blockCount && tailReader.valid; ++i) {
+			CompressedBlockIndexEntry entry;
+			auto firstEA = tailReader.getVarint();
+			entry.firstEA = EA(firstEA);
+			entry.lastEA = EA(firstEA + tailReader.getVarint());
+			entry.offset = tailReader.getVarint();
+			entry.length = tailReader.getVarint();
+			entry.lineCount = tailReader.getVarint();
+			_index.push_back(entry);
+		}
+		if (!tailReader.valid) {
+			warning("compressed document %s has invalid block index\n", path.c_str());
+			_dictionary.clear();
+			_index.clear();
+			return false;
+		}
+		return true;
+	}
+
+	size_t CompressedDisassemblyReader::blockIndexForEA(const EA &ea) const {
+		auto it = std::upper_bound(_index.begin(), _index.end(), ea, [](const EA &value, const CompressedBlockIndexEntry &entry) {
+			return value < entry.firstEA;
+		});
+		if (it == _index.begin())
+			return _index.size();
+		return (it - _index.begin()) - 1;
+	}
+
+	DisassemblyLines CompressedDisassemblyReader::readBlock(size_t blockIndex) const {
+		DisassemblyLines lines;
+		if (blockIndex >= _index.size() || _fileDescriptor < 0)
+			return lines;
+
+		auto &entry = _index[blockIndex];
+		std::string bytes(entry.length, '\0');
+		if (!bytes.empty() && !readFully(_fileDescriptor, &bytes[0], bytes.size(), entry.offset)) {
+			warning("failed to read compressed block %zu\n", blockIndex);
+			return lines;
+		}
+
+		ByteReader reader(bytes.data(), bytes.size());
+		EA previousEA(0);
+		lines.reserve(entry.lineCount);
+		for (uint64_t i = 0; i < entry.lineCount; ++i) {
+			auto line = decodeLine(reader, _dictionary, &previousEA);
+			if (!line) {
+				warning("failed to decode compressed block %zu\n", blockIndex);
+				break;
+			}
+			lines.push_back(line);
+		}
+		return lines;
+	}
+
+	bool isCompressedDocumentFilePath(const std::string &path) {
+		auto fh = fopen(path.c_str(), "rb");
+		if (fh == NULL)
+			return false;
+		char magic[sizeof(compressedDocumentMagic)];
+		bool isCompressed = fread(magic, 1, sizeof(magic), fh) == sizeof(magic)
+							&& memcmp(magic, compressedDocumentMagic, sizeof(magic)) == 0;
+		fclose(fh);
+		return isCompressed;
+	}
+
+	DisassemblyDocument readCompressedDocumentFromFilePath(const std::string &path) {
+		CompressedDisassemblyReader reader;
+		if (!reader.openFilePath(path))
+			return invalidDocument;
+
+		DisassemblyLines lines;
+		for (size_t i = 0; i < reader.getBlockIndex().size(); ++i) {
+			auto blockLines = reader.readBlock(i);
+			lines.insert(lines.end(), blockLines.begin(), blockLines.end());
+		}
+		auto &head = reader.getDocumentHead();
+		return DisassemblyDocument(head.getBinaryName(), head.getArchitectureName(), head.getDissassembler(), head.getMinEA(), head.getMaxEA(), lines);
+	}
+}
@@ -0,0 +1,69 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_COMPRESSEDDISASSEMBLYPERSISTENCE_H
+#define IDIOMMATCHER_COMPRESSEDDISASSEMBLYPERSISTENCE_H
+
+#include <Model/DisassemblyPersistence.h>
+
+namespace IdiomMatcher {
+
+	// Block compressed storage of a DisassemblyDocument.
+	//
+	// Layout: file head (magic, version, document head), instruction blocks,
+	// string dictionary, block index and a fixed size trailer pointing to
+	// dictionary and index. EAs are delta encoded, all strings (mnemonics,
+	// operand texts, registers, comments) are replaced by dictionary ids.
+	// Each block only depends on the dictionary, so blocks can be decoded
+	// independently and on demand.
+	struct CompressedBlockIndexEntry {
+		EA firstEA = InvalidEA;
+		EA lastEA = InvalidEA;
+		uint64_t offset = 0;
+		uint64_t length = 0;
+		uint64_t lineCount = 0;
+	};
+	typedef std::vector<CompressedBlockIndexEntry> CompressedBlockIndex;
+
+	class CompressedDisassemblyReader {
+	public:
+		CompressedDisassemblyReader() { }
+		~CompressedDisassemblyReader();
+
+		CompressedDisassemblyReader(const CompressedDisassemblyReader &) = delete;
+		CompressedDisassemblyReader &operator=(const CompressedDisassemblyReader &) = delete;
+
+		// Opens the file and reads head, dictionary and block index.
+		// Returns false if the file is not a valid compressed document.
+		bool openFilePath(const std::string &path);
+
+		// Document head only, the disassembly lines are empty.
+		const DisassemblyDocument &getDocumentHead() const { return _head; }
+		const CompressedBlockIndex &getBlockIndex() const { return _index; }
+
+		// Index of the block containing ea or the last block starting before ea.
+		// Returns getBlockIndex().size() if ea is smaller than the first EA.
+		size_t blockIndexForEA(const EA &ea) const;
+
+		// Reads and decodes a single block, thread safe.
+		DisassemblyLines readBlock(size_t blockIndex) const;
+
+	private:
+		int _fileDescriptor = -1;
+		DisassemblyDocument _head;
+		std::vector<std::string> _dictionary;
+		CompressedBlockIndex _index;
+	};
+	typedef std::shared_ptr<CompressedDisassemblyReader> CompressedDisassemblyReader_Ref;
+
+	// true if the file at path starts with the compressed document magic
+	bool isCompressedDocumentFilePath(const std::string &path);
+
+	bool writeCompressedDocumentToFilePath(const std::string &path, const DisassemblyDocument &document, const size_t linesPerBlock = 4096);
+
+	// Reads all blocks of a compressed file into a regular document.
+	DisassemblyDocument readCompressedDocumentFromFilePath(const std::string &path);
+}
+
+#endif //IDIOMMATCHER_COMPRESSEDDISASSEMBLYPERSISTENCE_H
@@ -4,6 +4,8 @@
 
 #include "DisassemblyPersistence.h"
 #include "Logging.h"
+#include "TraceRecorder.h"
+#include "AllocationTracker.h"
 
 #include <boost/property_tree/json_parser.hpp>
 #define RAPIDJSON_HAS_STDSTRING 1
@@ -14,6 +16,10 @@
 #include <rapidjson/document.h>
 #include <rapidjson/filereadstream.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 namespace IdiomMatcher {
 
@@ -357,7 +363,10 @@ namespace IdiomMatcher {
         }
         FileReadStream is(file, readBuffer, sizeof(readBuffer));
 		clock_t start = clock();
-		d.ParseStream(is);
+		{
+			TraceSpan span("load", "parse json");
+			d.ParseStream(is);
+		}
 		clock_t end = clock();
 		msg("reading json %lus\n",(end-start)/CLOCKS_PER_SEC);
         fclose(file);
@@ -367,9 +376,370 @@ namespace IdiomMatcher {
             return invalidDocument;
         }
 		start = clock();
+		TraceSpan span("load", "documentFromJSON");
         auto doc = documentFromJSON(d);
 		end = clock();
 		msg("building object tree %lus\n",(end-start)/CLOCKS_PER_SEC);
 		return doc;
     }
-}
\ No newline at end of file
+
+#pragma mark - Concurrent JSON reading
+
+    typedef rapidjson::GenericDocument<rapidjson::ASCII<>, rapidjson::MemoryPoolAllocator<>, rapidjson::MemoryPoolAllocator<>> JSONDocument;
+
+    // returns the position after the closing quote of the string starting at position
+    static size_t skipJSONString(const std::string &text, size_t position) {
+        ++position;
+        while (position < text.size()) {
+            char c = text[position++];
+            if (c == '\\') {
+                ++position;
+            } else if (c == '"') {
+                return position;
+            }
+        }
+        return std::string::npos;
+    }
+
+    // returns the position after the object or array starting at position
+    static size_t skipJSONContainer(const std::string &text, size_t position) {
+        int depth = 0;
+        while (position < text.size()) {
+            char c = text[position];
+            if (c == '"') {
+                position = skipJSONString(text, position);
+                if (position == std::string::npos)
+                    return position;
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                ++depth;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0)
+                    return position + 1;
+            }
+            ++position;
+        }
+        return std::string::npos;
+    }
+
+    static size_t skipJSONWhitespace(const std::string &text, size_t position) {
+        while (position < text.size() && isspace((unsigned char)text[position])) {
+            ++position;
+        }
+        return position;
+    }
+
+    // position of '[' of the array value for key in the top level object or npos
+    static size_t findTopLevelArray(const std::string &text, const std::string &key) {
+        int depth = 0;
+        size_t position = 0;
+        while (position < text.size()) {
+            char c = text[position];
+            if (c == '"') {
+                size_t stringEnd = skipJSONString(text, position);
+                if (stringEnd == std::string::npos)
+                    return stringEnd;
+                if (depth == 1 && text.compare(position + 1, stringEnd - position - 2, key) == 0) {
+                    size_t valuePosition = skipJSONWhitespace(text, stringEnd);
+                    if (valuePosition < text.size() && text[valuePosition] == ':') {
+                        valuePosition = skipJSONWhitespace(text, valuePosition + 1);
+                        if (valuePosition < text.size() && text[valuePosition] == '[')
+                            return valuePosition;
+                    }
+                }
+                position = stringEnd;
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                ++depth;
+            } else if (c == '}' || c == ']') {
+                --depth;
+            }
+            ++position;
+        }
+        return std::string::npos;
+    }
+
+    bool DisassemblyJSONChunks::readFromFilePath(const std::string &path, const size_t chunkCount, const size_t maximumChunkBytes) {
+        _text.clear();
+        _chunks.clear();
+
+        auto file = fopen(path.c_str(),"r");
+        if (file == nullptr) {
+            return false;
+        }
+        char readBuffer[65536];
+        size_t readBytes;
+        while ((readBytes = fread(readBuffer, 1, sizeof(readBuffer), file)) > 0) {
+            _text.append(readBuffer, readBytes);
+        }
+        fclose(file);
+
+        _arrayBegin = findTopLevelArray(_text, "disassembly");
+        if (_arrayBegin == std::string::npos) {
+            warning("failed to find disassembly in document json %s\n", path.c_str());
+            return false;
+        }
+
+        // split the array at object boundaries, chunks get roughly the same number of bytes
+        size_t bytesPerChunk = std::max((size_t)1, (_text.size() - _arrayBegin) / std::max(chunkCount, (size_t)1));
+        if (maximumChunkBytes > 0) {
+            bytesPerChunk = std::min(bytesPerChunk, maximumChunkBytes);
+        }
+        size_t position = _arrayBegin + 1;
+        size_t chunkBegin = std::string::npos;
+        size_t lastElementEnd = std::string::npos;
+        _arrayEnd = std::string::npos;
+        while (position < _text.size()) {
+            position = skipJSONWhitespace(_text, position);
+            if (position >= _text.size())
+                break;
+            char c = _text[position];
+            if (c == ',') {
+                ++position;
+                continue;
+            }
+            if (c == ']') {
+                _arrayEnd = position;
+                break;
+            }
+
+            size_t elementEnd = skipJSONContainer(_text, position);
+            if (elementEnd == std::string::npos)
+                break;
+            if (chunkBegin == std::string::npos)
+                chunkBegin = position;
+            lastElementEnd = elementEnd;
+            if (elementEnd - chunkBegin >= bytesPerChunk) {
+                _chunks.push_back(std::make_pair(chunkBegin, elementEnd));
+                chunkBegin = std::string::npos;
+            }
+            position = elementEnd;
+        }
+
+        if (_arrayEnd == std::string::npos) {
+            warning("failed to parse disassembly array in document json %s\n", path.c_str());
+            _chunks.clear();
+            return false;
+        }
+        if (chunkBegin != std::string::npos) {
+            _chunks.push_back(std::make_pair(chunkBegin, lastElementEnd));
+        }
+
+        // parse everything except the lines for the document head
+        std::string headJSON = _text.substr(0, _arrayBegin + 1);
+        headJSON.append(_text, _arrayEnd, std::string::npos);
+        JSONDocument d;
+        d.Parse(headJSON.c_str());
+        if (d.HasParseError() || !d.HasMember("version") || d["version"].GetUint() != DisassemblyDocument::documentVersion) {
+            warning("failed to parse document json %s\n", path.c_str());
+            _chunks.clear();
+            return false;
+        }
+        _head = documentFromJSON(d);
+        return true;
+    }
+
+    bool DisassemblyJSONChunks::linesForChunk(const size_t chunkIndex, DisassemblyLines &lines) const {
+        if (chunkIndex >= _chunks.size())
+            return false;
+
+        auto &chunk = _chunks[chunkIndex];
+        std::string json;
+        json.reserve(chunk.second - chunk.first + 2);
+        json.push_back('[');
+        json.append(_text, chunk.first, chunk.second - chunk.first);
+        json.push_back(']');
+
+        JSONDocument d;
+        d.Parse(json.c_str());
+        if (d.HasParseError()) {
+            warning("failed to parse disassembly chunk %zu, error code %d, offset %zu\n", chunkIndex, d.GetParseError(), chunk.first + d.GetErrorOffset());
+            return false;
+        }
+        lines.reserve(lines.size() + d.Size());
+        for (rapidjson::SizeType i = 0; i < d.Size(); ++i) {
+            auto line = disassemblyLineFromJSON(d[i]);
+            if (line) {
+                lines.push_back(line);
+            }
+        }
+        return true;
+    }
+
+    bool DisassemblyJSONStream::openFilePath(const std::string &path) {
+        close();
+        _buffer.clear();
+        _position = 0;
+        _finished = false;
+        _failed = false;
+
+        _file = fopen(path.c_str(),"r");
+        if (_file == nullptr) {
+            return false;
+        }
+        fseek(_file, 0, SEEK_END);
+        _fileSize = (uint64_t)ftell(_file);
+        fseek(_file, 0, SEEK_SET);
+
+        size_t arrayBegin;
+        while ((arrayBegin = findTopLevelArray(_buffer, "disassembly")) == std::string::npos) {
+            if (!readBlock()) {
+                warning("failed to find disassembly in document json %s\n", path.c_str());
+                close();
+                return false;
+            }
+        }
+
+        // the values before the lines, the lines are the last value
+        std::string headJSON = _buffer.substr(0, arrayBegin + 1);
+        headJSON.append("]}");
+        JSONDocument d;
+        d.Parse(headJSON.c_str());
+        if (d.HasParseError() || !d.HasMember("version") || d["version"].GetUint() != DisassemblyDocument::documentVersion) {
+            warning("failed to parse document json %s\n", path.c_str());
+            close();
+            return false;
+        }
+        _head = documentFromJSON(d);
+        _position = arrayBegin + 1;
+        return true;
+    }
+
+    void DisassemblyJSONStream::close() {
+        if (_file != nullptr) {
+            fclose(_file);
+            _file = nullptr;
+        }
+    }
+
+    bool DisassemblyJSONStream::readBlock() {
+        if (_file == nullptr)
+            return false;
+        char readBuffer[65536];
+        size_t readBytes = fread(readBuffer, 1, sizeof(readBuffer), _file);
+        _buffer.append(readBuffer, readBytes);
+        return readBytes > 0;
+    }
+
+    bool DisassemblyJSONStream::readChunk(const size_t chunkBytes, std::string &chunk) {
+        chunk.assign(1, '[');
+        while (!_finished && !_failed) {
+            _position = skipJSONWhitespace(_buffer, _position);
+            // an element continuing after the buffer is read again once the next block is in
+            size_t elementEnd = _position < _buffer.size() && _buffer[_position] != ',' && _buffer[_position] != ']' ? skipJSONContainer(_buffer, _position) : _position;
+            if (_position >= _buffer.size() || elementEnd == std::string::npos) {
+                if (!readBlock()) {
+                    warning("failed to parse disassembly array, the dump ends within it\n");
+                    _failed = true;
+                }
+                continue;
+            }
+            char c = _buffer[_position];
+            if (c == ',') {
+                ++_position;
+                continue;
+            }
+            if (c == ']') {
+                _finished = true;
+                close();
+                break;
+            }
+
+            if (chunk.size() > 1)
+                chunk.push_back(',');
+            chunk.append(_buffer, _position, elementEnd - _position);
+            _position = elementEnd;
+            if (chunk.size() - 1 >= chunkBytes)
+                break;
+        }
+        _buffer.erase(0, _position);
+        _position = 0;
+        chunk.push_back(']');
+        return chunk.size() > 2 && !_failed;
+    }
+
+    bool DisassemblyJSONStream::linesForChunk(const std::string &chunk, DisassemblyLines &lines) {
+        JSONDocument d;
+        d.Parse(chunk.c_str());
+        if (d.HasParseError() || !d.IsArray()) {
+            warning("failed to parse disassembly chunk, error code %d, offset %zu\n", d.GetParseError(), d.GetErrorOffset());
+            return false;
+        }
+        lines.reserve(lines.size() + d.Size());
+        for (rapidjson::SizeType i = 0; i < d.Size(); ++i) {
+            auto line = disassemblyLineFromJSON(d[i]);
+            if (line) {
+                lines.push_back(line);
+            }
+        }
+        return true;
+    }
+
+    DisassemblyDocument readDocumentFromFilePathConcurrently(const std::string &path, unsigned threadCount) {
+        if (threadCount == 0) {
+            threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        auto t1 = std::chrono::steady_clock::now();
+        DisassemblyJSONChunks chunks;
+        // more chunks than threads to even out differences in parsing time
+        {
+            TraceSpan span("load", "split json");
+            if (!chunks.readFromFilePath(path, threadCount * 4)) {
+                return invalidDocument;
+            }
+        }
+        auto t2 = std::chrono::steady_clock::now();
+
+        std::vector<DisassemblyLines> chunkLines(chunks.getChunkCount());
+        std::atomic<size_t> nextChunk(0);
+        std::atomic<bool> failed(false);
+        auto worker = [&chunks, &chunkLines, &nextChunk, &failed]() {
+            AllocationTracker::Scope allocationScope("load");
+            for (size_t index = nextChunk++; index < chunkLines.size() && !failed; index = nextChunk++) {
+                TraceSpan span("load", "parse chunk " + std::to_string(index));
+                if (!chunks.linesForChunk(index, chunkLines[index])) {
+                    failed = true;
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < threadCount; ++i) {
+            threads.push_back(std::thread(worker));
+        }
+        worker();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        if (failed) {
+            warning("failed to parse document json %s\n", path.c_str());
+            return invalidDocument;
+        }
+
+        TraceSpan mergeSpan("load", "merge chunks");
+        size_t lineCount = 0;
+        for (auto &lines : chunkLines) {
+            lineCount += lines.size();
+        }
+        DisassemblyLines lines;
+        lines.reserve(lineCount);
+        for (auto &chunk : chunkLines) {
+            lines.insert(lines.end(), chunk.begin(), chunk.end());
+            DisassemblyLines().swap(chunk);
+        }
+        auto lineOrder = [](const DisassemblyLine_Ref &a, const DisassemblyLine_Ref &b) { return a->getEA() < b->getEA(); };
+        if (!std::is_sorted(lines.begin(), lines.end(), lineOrder)) {
+            std::stable_sort(lines.begin(), lines.end(), lineOrder);
+        }
+        auto t3 = std::chrono::steady_clock::now();
+
+        std::chrono::duration<double> splitTime = t2 - t1;
+        std::chrono::duration<double> parseTime = t3 - t2;
+        msg("split json into %zu chunks in %fs, parsed on %u threads in %fs\n", chunks.getChunkCount(), splitTime.count(), threadCount, parseTime.count());
+
+        auto &head = chunks.getDocumentHead();
+        return DisassemblyDocument(head.getBinaryName(), head.getArchitectureName(), head.getDissassembler(), head.getMinEA(), head.getMaxEA(), lines);
+    }
+}
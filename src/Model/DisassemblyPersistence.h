@@ -76,6 +76,78 @@ namespace IdiomMatcher {
     bool dumpDisassemblyToFilePath(const std::string &path, DisassemblerAPI &api);
     DisassemblyDocument readDocumentFromFilePath(const std::string &path);
 
+    // Raw JSON text of a disassembly document with the "disassembly" array split
+    // into chunks of complete line objects, so the chunks can be parsed independently.
+    class DisassemblyJSONChunks {
+    public:
+        // Reads the file and splits the lines into about chunkCount chunks of similar byte size.
+        // If maximumChunkBytes is set, more chunks are created to keep each chunk below that size.
+        bool readFromFilePath(const std::string &path, const size_t chunkCount, const size_t maximumChunkBytes = 0);
+
+        size_t getChunkCount() const { return _chunks.size(); }
+        size_t getTextSize() const { return _text.size(); }
+
+        // document with all values except the disassembly lines
+        const DisassemblyDocument &getDocumentHead() const { return _head; }
+
+        // Parses the line objects of a chunk, thread safe. Returns false if the chunk failed to parse.
+        bool linesForChunk(const size_t chunkIndex, DisassemblyLines &lines) const;
+
+    private:
+        DisassemblyDocument _head;
+        std::string _text;
+        size_t _arrayBegin = 0; // position of '['
+        size_t _arrayEnd = 0;   // position of ']'
+        std::vector<std::pair<size_t, size_t> > _chunks; // begin and end of the line objects of each chunk
+    };
+
+    // Disassembly lines of a JSON dump read chunk by chunk, only the text of the
+    // chunk being read is held. The values of the document have to come before the
+    // "disassembly" array, which is how dumpDisassemblyToFilePath writes them.
+    class DisassemblyJSONStream {
+    public:
+        DisassemblyJSONStream() { }
+        ~DisassemblyJSONStream() { close(); }
+
+        DisassemblyJSONStream(const DisassemblyJSONStream &) = delete;
+        DisassemblyJSONStream &operator=(const DisassemblyJSONStream &) = delete;
+
+        // Reads the document up to the disassembly lines.
+        bool openFilePath(const std::string &path);
+        void close();
+
+        // document with all values except the disassembly lines
+        const DisassemblyDocument &getDocumentHead() const { return _head; }
+        uint64_t getFileSize() const { return _fileSize; }
+
+        // Reads the next line objects until they have chunkBytes bytes, as the text of a
+        // JSON array. Returns false after the last line or if the text is broken, see hasFailed.
+        bool readChunk(const size_t chunkBytes, std::string &chunk);
+        bool hasFailed() const { return _failed; }
+
+        // Parses the text of a chunk, thread safe. Returns false if the chunk failed to parse.
+        static bool linesForChunk(const std::string &chunk, DisassemblyLines &lines);
+
+    private:
+        // appends the next block of the file to the buffer, false at the end of the file
+        bool readBlock();
+
+        FILE *_file = nullptr;
+        uint64_t _fileSize = 0;
+        DisassemblyDocument _head;
+        // text read but not handed out yet
+        std::string _buffer;
+        size_t _position = 0;
+        bool _finished = false;
+        bool _failed = false;
+    };
+
+    // Reads the same document as readDocumentFromFilePath, but parses the disassembly lines
+    // concurrently using threadCount threads (0 = hardware concurrency). The lines are
+    // stable sorted by EA, readDocumentFromFilePath keeps them in file order, so both only
+    // agree for dumps ordered by EA, which is how the plugin writes them.
+    DisassemblyDocument readDocumentFromFilePathConcurrently(const std::string &path, unsigned threadCount = 0);
+
 
 	template<typename JSONWriter>
 	void dumpDisassemblyToWithWriter(JSONWriter &writer, DisassemblerAPI &api);
@@ -0,0 +1,222 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "PatternAnalysis.h"
+#include <algorithm>
+#include <map>
+#include <regex>
+#include <unordered_map>
+
+namespace IdiomMatcher {
+
+	// xrefs, actions, extracted names and the shape of the pattern, which must be
+	// equal for one pattern to subsume another
+	static std::string structureKey(const Pattern &pattern) {
+		auto &instructions = pattern.getInstructions();
+		std::map<EA::EAValue_t, size_t> indexForEA;
+		for (size_t i = 0; i < instructions.size(); ++i) {
+			indexForEA.emplace(instructions[i]->getEA().getValue(), i);
+		}
+
+		std::string key = pattern.getArchitecture() + "\n" + std::to_string(instructions.size()) + "\n";
+		for (size_t i = 0; i < instructions.size(); ++i) {
+			std::vector<std::string> xrefs;
+			for (auto &xref : instructions[i]->getXrefs()) {
+				auto it = indexForEA.find(xref->getTarget().getValue());
+				std::string target = it != indexForEA.end() ? "@" + std::to_string(it->second) : "external";
+				xrefs.push_back(std::string(xref->isData() ? "d" : "c") + (xref->isUnordinaryFlow() ? "u" : "f") + target);
+			}
+			std::sort(xrefs.begin(), xrefs.end());
+			key += std::to_string(i) + ":";
+			for (auto &xref : xrefs) {
+				key += " " + xref;
+			}
+			auto &operands = instructions[i]->getOperands();
+			for (size_t j = 0; j < operands.size(); ++j) {
+				if (!operands[j]->getExtractAs().empty())
+					key += " extract" + std::to_string(j) + "=" + operands[j]->getExtractAs();
+			}
+			key += "\n";
+		}
+		for (auto &action : pattern.getActions()) {
+			key += "action " + action->getScript() + "\n";
+		}
+		return key;
+	}
+
+	std::string PatternAnalysis::canonicalForm(const Pattern &pattern) {
+		std::string form = structureKey(pattern);
+		form += pattern.getAnchorTop() ? "anchored\n" : "\n";
+		std::unordered_map<std::string, std::string> templateNames;
+		for (auto &instruction : pattern.getInstructions()) {
+			form += (instruction->getIsRegex() ? "regex " : "") + instruction->getMnemonic();
+			for (auto &operand : instruction->getOperands()) {
+				form += " (";
+				if (!operand->getRegex().empty())
+					form += "regex " + operand->getRegex() + " ";
+				for (auto &reg : operand->getRegisters()) {
+					if (operand->getNameIsTemplate()) {
+						auto it = templateNames.emplace(reg, "$" + std::to_string(templateNames.size())).first;
+						form += it->second + " ";
+					} else {
+						form += "=" + reg + " ";
+					}
+				}
+				form += ")";
+			}
+			form += "\n";
+		}
+		return form;
+	}
+
+	bool PatternAnalysis::subsumes(const Pattern &general, const Pattern &specific) {
+		if (general.getAnchorTop() && !specific.getAnchorTop())
+			return false;
+		if (structureKey(general) != structureKey(specific))
+			return false;
+
+		// a template name of general stands for one name or template name of specific
+		std::unordered_map<std::string, std::string> templateBindings;
+		auto &generalInstructions = general.getInstructions();
+		auto &specificInstructions = specific.getInstructions();
+		for (size_t i = 0; i < generalInstructions.size(); ++i) {
+			auto &generalInstruction = *generalInstructions[i];
+			auto &specificInstruction = *specificInstructions[i];
+			if (generalInstruction.getIsRegex()) {
+				if (specificInstruction.getIsRegex()) {
+					if (generalInstruction.getMnemonic() != specificInstruction.getMnemonic())
+						return false;
+				} else if (!std::regex_match(specificInstruction.getMnemonic(), std::regex(generalInstruction.getMnemonic()))) {
+					return false;
+				}
+			} else if (specificInstruction.getIsRegex() || generalInstruction.getMnemonic() != specificInstruction.getMnemonic()) {
+				return false;
+			}
+
+			// operands general doesn't have are not tested
+			auto &generalOperands = generalInstruction.getOperands();
+			auto &specificOperands = specificInstruction.getOperands();
+			if (generalOperands.size() > specificOperands.size())
+				return false;
+			for (size_t j = 0; j < generalOperands.size(); ++j) {
+				auto &generalOperand = *generalOperands[j];
+				auto &specificOperand = *specificOperands[j];
+				if (!generalOperand.getRegex().empty() && generalOperand.getRegex() != specificOperand.getRegex())
+					return false;
+				auto generalRegisters = generalOperand.getRegisters();
+				auto specificRegisters = specificOperand.getRegisters();
+				for (size_t k = 0; k < generalRegisters.size(); ++k) {
+					if (!generalOperand.getNameIsTemplate() && generalRegisters[k].empty())
+						continue;
+					// specific must constrain the register at least as much as general
+					if (k >= specificRegisters.size() || (!specificOperand.getNameIsTemplate() && specificRegisters[k].empty()))
+						return false;
+					std::string specificName = (specificOperand.getNameIsTemplate() ? "$" : "=") + specificRegisters[k];
+					if (generalOperand.getNameIsTemplate()) {
+						auto binding = templateBindings.emplace(generalRegisters[k], specificName).first;
+						if (binding->second != specificName)
+							return false;
+					} else if (specificName != "=" + generalRegisters[k]) {
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	std::string PatternAnalysis::deadReason(const Pattern &pattern) {
+		if (pattern.getInstructions().empty())
+			return "has no instructions";
+		for (auto &instruction : pattern.getInstructions()) {
+			try {
+				if (instruction->getIsRegex())
+					std::regex(instruction->getMnemonic());
+				for (auto &operand : instruction->getOperands()) {
+					if (!operand->getRegex().empty())
+						std::regex(operand->getRegex());
+				}
+			} catch (const std::regex_error &error) {
+				return "has an invalid regex in " + instruction->getMnemonic() + ": " + error.what();
+			}
+		}
+		return "";
+	}
+
+	PatternAnalysis::PatternAnalysis(const Patterns &patterns) {
+		// the first of equal canonical forms is kept
+		Patterns uniquePatterns;
+		std::unordered_map<std::string, Pattern_ref> patternForForm;
+		std::vector<bool> isFinding(patterns.size(), false);
+		std::vector<size_t> uniqueIndices;
+		for (size_t i = 0; i < patterns.size(); ++i) {
+			auto &pattern = patterns[i];
+			auto reason = deadReason(*pattern);
+			if (!reason.empty()) {
+				_findings.push_back({Dead, pattern, nullptr, reason});
+				isFinding[i] = true;
+				continue;
+			}
+			auto inserted = patternForForm.emplace(canonicalForm(*pattern), pattern);
+			if (!inserted.second) {
+				_findings.push_back({Duplicate, pattern, inserted.first->second, "same canonical form"});
+				isFinding[i] = true;
+				continue;
+			}
+			uniquePatterns.push_back(pattern);
+			uniqueIndices.push_back(i);
+		}
+
+		// only patterns of the same shape can subsume each other
+		std::unordered_map<std::string, std::vector<size_t> > candidatesForStructure;
+		for (size_t u = 0; u < uniquePatterns.size(); ++u) {
+			candidatesForStructure[structureKey(*uniquePatterns[u])].push_back(u);
+		}
+		std::vector<std::vector<size_t> > subsumedBy(uniquePatterns.size());
+		for (auto &entry : candidatesForStructure) {
+			auto &candidates = entry.second;
+			for (auto specific : candidates) {
+				for (auto general : candidates) {
+					if (general == specific || !subsumes(*uniquePatterns[general], *uniquePatterns[specific]))
+						continue;
+					// of equivalent patterns the first one is kept
+					if (subsumes(*uniquePatterns[specific], *uniquePatterns[general]) && specific < general)
+						continue;
+					subsumedBy[specific].push_back(general);
+				}
+			}
+		}
+		for (size_t u = 0; u < uniquePatterns.size(); ++u) {
+			if (subsumedBy[u].empty())
+				continue;
+			// subsumption is transitive, one of the general patterns is kept
+			Pattern_ref keptPattern = uniquePatterns[subsumedBy[u].front()];
+			for (auto general : subsumedBy[u]) {
+				if (subsumedBy[general].empty()) {
+					keptPattern = uniquePatterns[general];
+					break;
+				}
+			}
+			_findings.push_back({Subsumed, uniquePatterns[u], keptPattern, "matches a subset of"});
+			isFinding[uniqueIndices[u]] = true;
+		}
+
+		for (size_t i = 0; i < patterns.size(); ++i) {
+			if (!isFinding[i])
+				_prunedPatterns.push_back(patterns[i]);
+		}
+	}
+
+	std::string PatternAnalysis::report() const {
+		static const char *kindNames[] = {"duplicate", "subsumed", "dead"};
+		std::string report;
+		for (auto &finding : _findings) {
+			report += std::string(kindNames[finding.kind]) + ": " + finding.pattern->getName() + " " + finding.reason;
+			if (finding.keptPattern)
+				report += " " + finding.keptPattern->getName();
+			report += "\n";
+		}
+		return report;
+	}
+}
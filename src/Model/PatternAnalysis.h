@@ -0,0 +1,56 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_PATTERNANALYSIS_H
+#define IDIOMMATCHER_PATTERNANALYSIS_H
+
+#include <Model/Pattern.h>
+
+namespace IdiomMatcher {
+
+	// Finds patterns that only add matching cost: duplicates, patterns subsumed
+	// by a more general one and patterns that can never match.
+	//
+	// Patterns are compared in a canonical form that keeps what the matchers test:
+	// mnemonics, operand registers and regexes, template names renamed in order
+	// of appearance, and xrefs as flags plus the index of the target instruction
+	// inside the pattern. EAs, sizes and operand texts are ignored.
+	class PatternAnalysis {
+	public:
+		enum FindingKind {
+			Duplicate,
+			Subsumed,
+			Dead
+		};
+
+		struct Finding {
+			FindingKind kind;
+			Pattern_ref pattern;
+			// the pattern kept instead, nullptr for dead patterns
+			Pattern_ref keptPattern;
+			std::string reason;
+		};
+
+		PatternAnalysis(const Patterns &patterns);
+
+		const std::vector<Finding> &getFindings() const { return _findings; }
+		// the patterns without findings, in their original order
+		const Patterns &getPrunedPatterns() const { return _prunedPatterns; }
+		// a line per finding for the log
+		std::string report() const;
+
+		static std::string canonicalForm(const Pattern &pattern);
+		// true if general matches everything specific matches, at the same EAs,
+		// the regexes of both must be valid
+		static bool subsumes(const Pattern &general, const Pattern &specific);
+		// empty if pattern can match, otherwise why it can't
+		static std::string deadReason(const Pattern &pattern);
+
+	private:
+		std::vector<Finding> _findings;
+		Patterns _prunedPatterns;
+	};
+}
+
+#endif //IDIOMMATCHER_PATTERNANALYSIS_H
@@ -4,11 +4,14 @@
 
 #include "PatternPersistence.h"
 #include "Logging.h"
+#include "TraceRecorder.h"
 #include <boost/property_tree/json_parser.hpp>
+#include <rapidjson/stringbuffer.h>
 
 namespace IdiomMatcher {
 
     Patterns PatternPersistence::readFromFilePath(const std::string &path) {
+        TraceSpan span("patterns", "read patterns " + path);
         Patterns patterns;
 
 
@@ -91,6 +94,13 @@ namespace IdiomMatcher {
 
 	}
 
+	std::string PatternPersistence::jsonForPatterns(const Patterns &patterns) {
+		rapidjson::StringBuffer buffer;
+		rapidjson::Writer<rapidjson::StringBuffer, rapidjson::ASCII<>, rapidjson::ASCII<> > writer(buffer);
+		writePatternsToWriter(writer,patterns);
+		return std::string(buffer.GetString(), buffer.GetSize());
+	}
+
 	template<typename JSONWriter>
 	void SerializeAction(JSONWriter &writer, const Action &action) {
 		writer.StartObject();
@@ -15,6 +15,8 @@ namespace IdiomMatcher {
     public:
         static Patterns readFromFilePath(const std::string &path);
         static bool writeToFilePath(const std::string &path, const Patterns &patterns);
+        // the JSON writeToFilePath writes, without the file
+        static std::string jsonForPatterns(const Patterns &patterns);
 
         static const int documentVersion = 2;
     };
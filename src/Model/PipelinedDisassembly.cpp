@@ -0,0 +1,280 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "PipelinedDisassembly.h"
+#include <algorithm>
+#include <Model/Logging.h>
+#include <Model/TraceRecorder.h>
+#include <Model/AllocationTracker.h>
+
+namespace IdiomMatcher {
+
+	const size_t PipelinedDisassembly::noChunk;
+
+	bool PipelinedDisassembly::openFilePath(const std::string &path, const size_t chunkCount, const size_t maximumChunkBytes) {
+		if (!_stream.openFilePath(path)) {
+			return false;
+		}
+		const uint64_t fileSize = _stream.getFileSize();
+		_chunkBytes = std::max((size_t)1, (size_t)(fileSize / std::max(chunkCount, (size_t)1)));
+		if (maximumChunkBytes > 0) {
+			_chunkBytes = std::min(_chunkBytes, maximumChunkBytes);
+		}
+		_maximumChunkCount = (size_t)(fileSize / _chunkBytes) + 1;
+		_lines.assign(_maximumChunkCount, DisassemblyLines());
+		_firstEAs.assign(_maximumChunkCount, InvalidEA);
+		_lastEAs.assign(_maximumChunkCount, InvalidEA);
+		_parsed.assign(_maximumChunkCount, false);
+		_chunkCount = 0;
+		_nextChunkToMatch = 0;
+		_releasedChunkCount = 0;
+		_residentChunkCount = 0;
+		_peakResidentChunkCount = 0;
+		_publishedChunkCount = 0;
+		_failed = false;
+		_readingFinished = false;
+		return true;
+	}
+
+	size_t PipelinedDisassembly::getChunkCount() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _chunkCount;
+	}
+
+	size_t PipelinedDisassembly::getPeakResidentChunkCount() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _peakResidentChunkCount;
+	}
+
+	bool PipelinedDisassembly::parseNextChunk() {
+		size_t chunkIndex = 0;
+		std::string text;
+		bool claimed = false;
+		{
+			// the chunks are claimed in the order they are read
+			std::lock_guard<std::mutex> readLock(_readMutex);
+			if (_failed || _readingFinished) {
+				return false;
+			}
+			bool read;
+			{
+				TraceSpan span("load", "read chunk");
+				AllocationTracker::Scope allocationScope("load");
+				read = _stream.readChunk(_chunkBytes, text);
+			}
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!read) {
+				_failed = _stream.hasFailed();
+				_readingFinished = true;
+			} else if (_chunkCount == _maximumChunkCount) {
+				// chunks but the last one have _chunkBytes bytes, the file has more lines than it had bytes
+				warning("the dump grew while reading it\n");
+				_failed = true;
+			} else {
+				chunkIndex = _chunkCount++;
+				_peakResidentChunkCount = std::max(_peakResidentChunkCount, ++_residentChunkCount);
+				claimed = true;
+			}
+		}
+		if (!claimed) {
+			_condition.notify_all();
+			return false;
+		}
+
+		DisassemblyLines lines;
+		bool success;
+		{
+			TraceSpan span("load", "parse chunk " + std::to_string(chunkIndex));
+			AllocationTracker::Scope allocationScope("load");
+			success = DisassemblyJSONStream::linesForChunk(text, lines);
+			std::string().swap(text);
+			auto lineOrder = [](const DisassemblyLine_Ref &a, const DisassemblyLine_Ref &b) { return a->getEA() < b->getEA(); };
+			if (!std::is_sorted(lines.begin(), lines.end(), lineOrder)) {
+				std::stable_sort(lines.begin(), lines.end(), lineOrder);
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!lines.empty()) {
+				_firstEAs[chunkIndex] = lines.front()->getEA();
+				_lastEAs[chunkIndex] = lines.back()->getEA();
+			}
+			_lines[chunkIndex].swap(lines);
+			_parsed[chunkIndex] = true;
+			if (!success) {
+				_failed = true;
+			}
+
+			size_t published = _publishedChunkCount.load();
+			while (!_failed && published < _chunkCount && _parsed[published]) {
+				if (_lines[published].empty()) {
+					// keeps the EAs of the chunks ordered for the binary search
+					_firstEAs[published] = _lastEAs[published] = published > 0 ? _lastEAs[published-1] : EA(0);
+				} else if (published > 0 && _firstEAs[published] < _lastEAs[published-1]) {
+					warning("disassembly lines are not ordered by EA at %jX, the pipeline needs an ordered dump\n", _firstEAs[published].getValue());
+					_failed = true;
+					break;
+				}
+				++published;
+			}
+			_publishedChunkCount.store(published, std::memory_order_release);
+		}
+		_condition.notify_all();
+		return true;
+	}
+
+	size_t PipelinedDisassembly::nextChunkToMatch(const size_t parseWindow) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		while (true) {
+			if (_failed) {
+				return noChunk;
+			}
+			if (_nextChunkToMatch < _publishedChunkCount.load()) {
+				return _nextChunkToMatch++;
+			}
+			if (_readingFinished && _nextChunkToMatch >= _chunkCount) {
+				return noChunk;
+			}
+			if (!_readingFinished && _chunkCount < _releasedChunkCount + std::max(parseWindow, (size_t)1)) {
+				lock.unlock();
+				parseNextChunk();
+				lock.lock();
+				continue;
+			}
+			// chunks being parsed or released by other threads will notify
+			_condition.wait(lock);
+		}
+	}
+
+	void PipelinedDisassembly::releaseChunksBefore(const size_t chunkIndex) {
+		// the lines are freed outside the lock
+		std::vector<DisassemblyLines> released;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			const size_t end = std::min(chunkIndex, _publishedChunkCount.load());
+			for (; _releasedChunkCount < end; ++_releasedChunkCount) {
+				released.emplace_back();
+				released.back().swap(_lines[_releasedChunkCount]);
+				--_residentChunkCount;
+			}
+		}
+		if (!released.empty()) {
+			_condition.notify_all();
+		}
+	}
+
+	void PipelinedDisassembly::waitForChunk(const size_t chunkIndex) {
+		while (getPublishedChunkCount() <= chunkIndex && !_failed) {
+			size_t published = getPublishedChunkCount();
+			if (!parseNextChunk()) {
+				// all chunks are read, wait for the threads parsing them
+				std::unique_lock<std::mutex> lock(_mutex);
+				_condition.wait(lock, [this, published, chunkIndex]() {
+					return _publishedChunkCount.load() != published || _failed || (_readingFinished && chunkIndex >= _chunkCount);
+				});
+				if (_readingFinished && chunkIndex >= _chunkCount) {
+					return;
+				}
+			}
+		}
+	}
+
+	void PipelinedDisassembly::waitForEA(const EA &ea) {
+		while (!_failed) {
+			size_t published = getPublishedChunkCount();
+			if (published > 0 && !(_lastEAs[published-1] < ea)) {
+				return;
+			}
+			if (isReadingFinished() && published == getChunkCount()) {
+				return;
+			}
+			waitForChunk(published);
+		}
+	}
+
+	size_t PipelinedDisassembly::chunkIndexForEA(const EA &ea, const size_t publishedChunkCount) const {
+		auto end = _firstEAs.begin() + publishedChunkCount;
+		auto it = std::upper_bound(_firstEAs.begin(), end, ea);
+		if (it == _firstEAs.begin()) {
+			return publishedChunkCount;
+		}
+		size_t chunkIndex = (it - _firstEAs.begin()) - 1;
+		while (chunkIndex > 0 && _lines[chunkIndex].empty()) {
+			--chunkIndex;
+		}
+		return chunkIndex;
+	}
+
+	DisassemblyLine_Ref PipelinedDisassembly::lineForEA(const EA &ea) {
+		waitForEA(ea);
+		const size_t published = getPublishedChunkCount();
+		size_t chunkIndex = chunkIndexForEA(ea, published);
+		if (chunkIndex == published) {
+			return nullptr;
+		}
+		auto &lines = _lines[chunkIndex];
+		auto it = std::lower_bound(lines.begin(), lines.end(), ea, [](const DisassemblyLine_Ref &line, const EA &value) {
+			return line->getEA() < value;
+		});
+		return (it != lines.end() && (*it)->getEA() == ea) ? *it : nullptr;
+	}
+
+	EA PipelinedDisassembly::nextEA(const EA &ea) {
+		waitForEA(ea);
+		size_t published = getPublishedChunkCount();
+		size_t chunkIndex = chunkIndexForEA(ea, published);
+		if (chunkIndex == published) {
+			// ea is before the first line
+			return minInstructionEA();
+		}
+		auto &lines = _lines[chunkIndex];
+		auto it = std::upper_bound(lines.begin(), lines.end(), ea, [](const EA &value, const DisassemblyLine_Ref &line) {
+			return value < line->getEA();
+		});
+		if (it != lines.end()) {
+			return (*it)->getEA();
+		}
+		// the following line is the first one of a later chunk
+		for (size_t index = chunkIndex + 1; ; ++index) {
+			waitForChunk(index);
+			if (getPublishedChunkCount() <= index) {
+				break;
+			}
+			if (!_lines[index].empty()) {
+				return _lines[index].front()->getEA();
+			}
+		}
+		return InvalidEA;
+	}
+
+	EA PipelinedDisassembly::minInstructionEA() {
+		for (size_t index = 0; ; ++index) {
+			waitForChunk(index);
+			if (getPublishedChunkCount() <= index) {
+				break;
+			}
+			if (!_lines[index].empty()) {
+				return _lines[index].front()->getEA();
+			}
+		}
+		return InvalidEA;
+	}
+
+	EA PipelinedDisassembly::maxInstructionEA() {
+		size_t index = 0;
+		for (; ; ++index) {
+			waitForChunk(index);
+			if (getPublishedChunkCount() <= index) {
+				break;
+			}
+		}
+		for (; index > 0; --index) {
+			if (!_lines[index-1].empty()) {
+				return _lines[index-1].back()->getEA();
+			}
+		}
+		return InvalidEA;
+	}
+}
@@ -0,0 +1,115 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_PIPELINEDDISASSEMBLY_H
+#define IDIOMMATCHER_PIPELINEDDISASSEMBLY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <Model/DisassemblyPersistence.h>
+
+namespace IdiomMatcher {
+
+	// Disassembly lines of a JSON dump that become available chunk by chunk while
+	// the dump is still being read, with a bounded number of chunks in memory.
+	//
+	// The dump is read as a stream, see DisassemblyJSONStream, and split into chunks
+	// of about chunkBytes bytes. Chunks are parsed by the threads asking for work
+	// (nextChunkToMatch) or for lines that are not parsed yet (lineForEA, nextEA), so
+	// a lookup never waits for a thread that is itself waiting. A chunk is published
+	// once it and all chunks before it are parsed; published chunks are immutable and
+	// can be read without locking until they are released.
+	//
+	// releaseChunksBefore frees the lines of the chunks the matching is done with.
+	// Lookups must not reach back into released chunks, so only matchers reading the
+	// instructions after their start EA can be pipelined, e.g. NaiveMatching, not the
+	// graph matchers following xrefs to any EA. No more than parseWindow chunks are
+	// parsed ahead of the released ones for matching, lookups parse further chunks
+	// when the instructions after a start EA reach into them. The dump has to be
+	// ordered by EA, which is how the plugin writes it.
+	class PipelinedDisassembly {
+	public:
+		// returned by nextChunkToMatch when all chunks were handed out
+		static const size_t noChunk = SIZE_MAX;
+
+		PipelinedDisassembly() : _publishedChunkCount(0), _failed(false), _readingFinished(false) { }
+
+		PipelinedDisassembly(const PipelinedDisassembly &) = delete;
+		PipelinedDisassembly &operator=(const PipelinedDisassembly &) = delete;
+
+		// Reads the values of the dump before the lines, the chunks get about
+		// 1/chunkCount of the dump and at most maximumChunkBytes bytes.
+		bool openFilePath(const std::string &path, const size_t chunkCount, const size_t maximumChunkBytes = 0);
+
+		// document with all values except the disassembly lines
+		const DisassemblyDocument &getDocumentHead() const { return _stream.getDocumentHead(); }
+
+		// number of chunks parsed without gap from the first chunk
+		size_t getPublishedChunkCount() const { return _publishedChunkCount.load(std::memory_order_acquire); }
+		// true once the end of the lines was read
+		bool isReadingFinished() const { return _readingFinished.load(std::memory_order_acquire); }
+		// chunks read so far, all chunks once reading finished
+		size_t getChunkCount() const;
+		// true if a chunk failed to parse or the dump is not ordered by EA
+		bool hasFailed() const { return _failed.load(); }
+		// most chunks parsed and not released at the same time
+		size_t getPeakResidentChunkCount() const;
+
+		// Returns the next published chunk that wasn't handed out for matching yet,
+		// noChunk if all chunks were handed out or parsing failed.
+		// While no chunk is ready the calling thread parses chunks itself, as long as
+		// less than parseWindow chunks are parsed ahead of the released chunks.
+		size_t nextChunkToMatch(const size_t parseWindow);
+		// Frees the lines of the chunks before chunkIndex, they are not looked up anymore.
+		void releaseChunksBefore(const size_t chunkIndex);
+
+		// lines of a published chunk, sorted by EA
+		const DisassemblyLines &linesForChunk(const size_t chunkIndex) const { return _lines[chunkIndex]; }
+		EA firstEAForChunk(const size_t chunkIndex) const { return _firstEAs[chunkIndex]; }
+		EA lastEAForChunk(const size_t chunkIndex) const { return _lastEAs[chunkIndex]; }
+
+		// Lookups parse and wait for chunks until ea is covered, thread safe.
+		DisassemblyLine_Ref lineForEA(const EA &ea);
+		EA nextEA(const EA &ea);
+		EA minInstructionEA();
+		// reads the whole dump
+		EA maxInstructionEA();
+
+	private:
+		// Reads and parses the next chunk nobody claimed yet, returns false if there is none.
+		bool parseNextChunk();
+		// returns when chunkIndex is published or doesn't exist
+		void waitForChunk(const size_t chunkIndex);
+		void waitForEA(const EA &ea);
+		// index of the published chunk containing ea or the last one starting before it,
+		// getPublishedChunkCount() if ea is before the first chunk
+		size_t chunkIndexForEA(const EA &ea, const size_t publishedChunkCount) const;
+
+		DisassemblyJSONStream _stream;
+		size_t _chunkBytes = 0;
+		// chunks are at least _chunkBytes bytes except the last one, which bounds their number
+		size_t _maximumChunkCount = 0;
+		std::vector<DisassemblyLines> _lines;
+		std::vector<EA> _firstEAs;
+		std::vector<EA> _lastEAs;
+
+		// reads the stream and claims the next chunk in the order of the dump
+		std::mutex _readMutex;
+		mutable std::mutex _mutex;
+		std::condition_variable _condition;
+		std::vector<bool> _parsed;
+		size_t _chunkCount = 0;
+		size_t _nextChunkToMatch = 0;
+		size_t _releasedChunkCount = 0;
+		size_t _residentChunkCount = 0;
+		size_t _peakResidentChunkCount = 0;
+		std::atomic<size_t> _publishedChunkCount;
+		std::atomic<bool> _failed;
+		std::atomic<bool> _readingFinished;
+	};
+	typedef std::shared_ptr<PipelinedDisassembly> PipelinedDisassembly_Ref;
+}
+
+#endif //IDIOMMATCHER_PIPELINEDDISASSEMBLY_H
@@ -0,0 +1,137 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#include "TraceRecorder.h"
+#include <cstdio>
+
+#define RAPIDJSON_HAS_STDSTRING 1
+#include <rapidjson/writer.h>
+#include <rapidjson/filewritestream.h>
+#include <rapidjson/encodedstream.h>
+
+namespace IdiomMatcher {
+
+	TraceRecorder &TraceRecorder::shared() {
+		static TraceRecorder recorder;
+		return recorder;
+	}
+
+	void TraceRecorder::start() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_spans.clear();
+		_threadNames.clear();
+		_origin = Clock::now();
+		_recording.store(true);
+	}
+
+	void TraceRecorder::stop() {
+		_recording.store(false);
+	}
+
+	unsigned TraceRecorder::threadId() {
+		static thread_local unsigned id = _nextThreadId.fetch_add(1);
+		return id;
+	}
+
+	void TraceRecorder::addSpan(const std::string &name, const char *category, const Clock::time_point &start, const Clock::time_point &end) {
+		unsigned thread = threadId();
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!isRecording())
+			return;
+		std::chrono::duration<double, std::micro> startOffset = start - _origin;
+		std::chrono::duration<double, std::micro> duration = end - start;
+		_spans.push_back(Span{name, category, thread, startOffset.count(), duration.count()});
+	}
+
+	void TraceRecorder::setThreadName(const std::string &name) {
+		unsigned thread = threadId();
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (auto &threadName : _threadNames) {
+			if (threadName.first == thread) {
+				threadName.second = name;
+				return;
+			}
+		}
+		_threadNames.push_back(std::make_pair(thread, name));
+	}
+
+	size_t TraceRecorder::getSpanCount() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _spans.size();
+	}
+
+	bool TraceRecorder::writeToFilePath(const std::string &path) const {
+		using namespace rapidjson;
+
+		char writeBuffer[65536];
+		auto fh = fopen(path.c_str(),"w");
+		if (fh == NULL)
+			return false;
+
+		FileWriteStream os(fh, writeBuffer, sizeof(writeBuffer));
+		typedef EncodedOutputStream<ASCII<>,FileWriteStream> OutputStream;
+		OutputStream eos(os, true);
+		Writer<OutputStream, ASCII<>, ASCII<> > writer(eos);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		writer.StartObject();
+		writer.Key("displayTimeUnit");
+		writer.String("ms");
+		writer.Key("traceEvents");
+		writer.StartArray();
+		for (auto &threadName : _threadNames) {
+			writer.StartObject();
+			writer.Key("name");
+			writer.String("thread_name");
+			writer.Key("ph");
+			writer.String("M");
+			writer.Key("pid");
+			writer.Uint(1);
+			writer.Key("tid");
+			writer.Uint(threadName.first);
+			writer.Key("args");
+			writer.StartObject();
+			writer.Key("name");
+			writer.String(threadName.second);
+			writer.EndObject();
+			writer.EndObject();
+		}
+		// complete events, ts and dur are in microseconds
+		for (auto &span : _spans) {
+			writer.StartObject();
+			writer.Key("name");
+			writer.String(span.name);
+			writer.Key("cat");
+			writer.String(span.category);
+			writer.Key("ph");
+			writer.String("X");
+			writer.Key("pid");
+			writer.Uint(1);
+			writer.Key("tid");
+			writer.Uint(span.threadId);
+			writer.Key("ts");
+			writer.Double(span.start);
+			writer.Key("dur");
+			writer.Double(span.duration);
+			writer.EndObject();
+		}
+		writer.EndArray();
+		writer.EndObject();
+
+		eos.Flush();
+		os.Flush();
+		bool success = !ferror(fh);
+		return fclose(fh) == 0 && success;
+	}
+
+	std::string TraceRecorder::tracePathForExecutablePath(const std::string &binaryPath) {
+		auto path = std::string(binaryPath);
+		size_t lastPoint = path.find_last_of(".");
+		if (lastPoint != std::string::npos) {
+			path.erase(lastPoint);
+		}
+		path.append("_trace.json");
+		return path;
+	}
+}
@@ -0,0 +1,86 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+#ifndef IDIOMMATCHER_TRACERECORDER_H
+#define IDIOMMATCHER_TRACERECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace IdiomMatcher {
+
+	// Collects spans of a run and writes them in the trace event format of
+	// chrome://tracing and Perfetto. Spans are only recorded between start and
+	// stop, otherwise TraceSpan costs one atomic load.
+	class TraceRecorder {
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		static TraceRecorder &shared();
+
+		// forgets previous spans and starts recording
+		void start();
+		void stop();
+		bool isRecording() const { return _recording.load(std::memory_order_relaxed); }
+
+		void addSpan(const std::string &name, const char *category, const Clock::time_point &start, const Clock::time_point &end);
+		// name of the calling thread in the trace viewer
+		void setThreadName(const std::string &name);
+
+		size_t getSpanCount() const;
+		bool writeToFilePath(const std::string &path) const;
+		// <executable>_trace.json
+		static std::string tracePathForExecutablePath(const std::string &path);
+
+	private:
+		struct Span {
+			std::string name;
+			const char *category;
+			unsigned threadId;
+			double start;
+			double duration;
+		};
+
+		// small number of the calling thread, the trace viewer shows one row per thread
+		unsigned threadId();
+
+		std::atomic<bool> _recording{false};
+		mutable std::mutex _mutex;
+		Clock::time_point _origin;
+		std::vector<Span> _spans;
+		std::vector<std::pair<unsigned, std::string> > _threadNames;
+		std::atomic<unsigned> _nextThreadId{0};
+	};
+
+	// Records a span from construction to destruction if the shared recorder is recording.
+	class TraceSpan {
+	public:
+		TraceSpan(const char *category, const std::string &name)
+				: _recording(TraceRecorder::shared().isRecording()), _category(category) {
+			if (_recording) {
+				_name = name;
+				_start = TraceRecorder::Clock::now();
+			}
+		}
+		~TraceSpan() {
+			if (_recording) {
+				TraceRecorder::shared().addSpan(_name, _category, _start, TraceRecorder::Clock::now());
+			}
+		}
+
+		TraceSpan(const TraceSpan &) = delete;
+		TraceSpan &operator=(const TraceSpan &) = delete;
+
+	private:
+		const bool _recording;
+		const char *_category;
+		std::string _name;
+		TraceRecorder::Clock::time_point _start;
+	};
+}
+
+#endif //IDIOMMATCHER_TRACERECORDER_H
@@ -6,30 +6,85 @@
 #include <memory>
 #include <iosfwd>
 #include <bitset>
+#include <algorithm>
 #include "DumpDisassemblerAPI.h"
+#include <Matching/Telemetry.h>
+#include <Model/TraceRecorder.h>
+#include <Model/AllocationTracker.h>
 
 using namespace IdiomMatcher;
 
-DumpDisassemblerAPI::DumpDisassemblerAPI(const std::string &path) : DumpDisassemblerAPI(readDocumentFromFilePath(path),path) { }
+DumpDisassemblerAPI::DumpDisassemblerAPI(const std::string &path, const unsigned loadThreadCount) : DisassemblerAPI(InvalidEA, InvalidInstruction), _path(path), _eaToLineMap(std::make_shared<EAToLineMap>()), _document(std::make_shared<DisassemblyDocument>()) {
+    if (isCompressedDocumentFilePath(path)) {
+        TraceSpan span("load", "open compressed dump");
+        auto reader = std::make_shared<CompressedDisassemblyReader>();
+        if (reader->openFilePath(path)) {
+            _compressedReader = reader;
+            _document = std::make_shared<DisassemblyDocument>(reader->getDocumentHead());
+        }
+        return;
+    }
+    std::shared_ptr<DisassemblyDocument> document;
+    {
+        AllocationTracker::Scope allocationScope("load");
+        document = std::make_shared<DisassemblyDocument>(loadThreadCount == 1 ? readDocumentFromFilePath(path) : readDocumentFromFilePathConcurrently(path, loadThreadCount));
+    }
+    TraceSpan span("load", "index lines");
+    AllocationTracker::Scope allocationScope("index");
+    auto eaToLineMap = std::make_shared<EAToLineMap>();
+    for (auto line : document->getDisassemblyLines()) {
+        // lines are usually sorted, inserting at the end is then constant time
+        eaToLineMap->emplace_hint(eaToLineMap->end(),line->getEA(),line);
+    }
+    _document = document;
+    _eaToLineMap = eaToLineMap;
+}
 
-DumpDisassemblerAPI::DumpDisassemblerAPI(const IdiomMatcher::DisassemblyDocument &document, const std::string &documentPath) : DisassemblerAPI(InvalidEA, InvalidInstruction), _path(documentPath), _document(document) {
-    for (auto line : _document.getDisassemblyLines()) {
-        _eaToLineMap.emplace(line->getEA(),line);
+DumpDisassemblerAPI::DumpDisassemblerAPI(const IdiomMatcher::DisassemblyDocument &document, const std::string &documentPath) : DisassemblerAPI(InvalidEA, InvalidInstruction), _path(documentPath), _document(std::make_shared<DisassemblyDocument>(document)) {
+    auto eaToLineMap = std::make_shared<EAToLineMap>();
+    for (auto line : document.getDisassemblyLines()) {
+        eaToLineMap->emplace(line->getEA(),line);
     }
+    _eaToLineMap = eaToLineMap;
 }
 
+DumpDisassemblerAPI::DumpDisassemblerAPI(const CompressedDisassemblyReader_Ref &reader, const std::string &documentPath) : DisassemblerAPI(InvalidEA, InvalidInstruction), _path(documentPath), _eaToLineMap(std::make_shared<EAToLineMap>()), _document(std::make_shared<DisassemblyDocument>(reader->getDocumentHead())), _compressedReader(reader) { }
+
+DumpDisassemblerAPI::DumpDisassemblerAPI(const PipelinedDisassembly_Ref &disassembly, const std::string &documentPath) : DisassemblerAPI(InvalidEA, InvalidInstruction), _path(documentPath), _eaToLineMap(std::make_shared<EAToLineMap>()), _document(std::make_shared<DisassemblyDocument>(disassembly->getDocumentHead())), _pipelinedDisassembly(disassembly) { }
+
 EA DumpDisassemblerAPI::minEA() const {
-    return _document.getMinEA();
+    return _document->getMinEA();
 }
 
 EA DumpDisassemblerAPI::maxEA() const {
-    return _document.getMaxEA();
+    return _document->getMaxEA();
 }
 
 EA DumpDisassemblerAPI::nextEA(const EA &ea) const {
+	if (_pipelinedDisassembly) {
+		return _pipelinedDisassembly->nextEA(ea);
+	}
+	if (_compressedReader) {
+		auto &index = _compressedReader->getBlockIndex();
+		size_t blockIndex = _compressedReader->blockIndexForEA(ea);
+		if (blockIndex == index.size()) {
+			return index.empty() ? InvalidEA : index.front().firstEA;
+		}
+		if (ea < index[blockIndex].lastEA) {
+			auto lines = linesForBlock(blockIndex);
+			auto it = std::upper_bound(lines->begin(), lines->end(), ea, [](const EA &value, const DisassemblyLine_Ref &line) {
+				return value < line->getEA();
+			});
+			if (it != lines->end()) {
+				return (*it)->getEA();
+			}
+		}
+		return blockIndex+1 < index.size() ? index[blockIndex+1].firstEA : InvalidEA;
+	}
+
 	// returns the first ea that is bigger then ea
-	auto iterator = _eaToLineMap.upper_bound(ea);
-	if (iterator != _eaToLineMap.end()) {
+	auto iterator = _eaToLineMap->upper_bound(ea);
+	if (iterator != _eaToLineMap->end()) {
 		return iterator->first;
 	}
 	return InvalidEA;
@@ -37,24 +92,39 @@ EA DumpDisassemblerAPI::nextEA(const EA &ea) const {
 
 
 IdiomMatcher::EA DumpDisassemblerAPI::minInstructionEA() const {
-	if (_eaToLineMap.begin() == _eaToLineMap.end()) {
+	if (_pipelinedDisassembly) {
+		return _pipelinedDisassembly->minInstructionEA();
+	}
+	if (_compressedReader) {
+		auto &index = _compressedReader->getBlockIndex();
+		return index.empty() ? InvalidEA : index.front().firstEA;
+	}
+	if (_eaToLineMap->begin() == _eaToLineMap->end()) {
 		return InvalidEA;
 	} else {
-		auto it = _eaToLineMap.begin();
+		auto it = _eaToLineMap->begin();
 		return it->first;
 	}
 }
 
 IdiomMatcher::EA DumpDisassemblerAPI::maxInstructionEA() const {
-	if (_eaToLineMap.rbegin() == _eaToLineMap.rend()) {
+	if (_pipelinedDisassembly) {
+		return _pipelinedDisassembly->maxInstructionEA();
+	}
+	if (_compressedReader) {
+		auto &index = _compressedReader->getBlockIndex();
+		return index.empty() ? InvalidEA : index.back().lastEA;
+	}
+	if (_eaToLineMap->rbegin() == _eaToLineMap->rend()) {
 		return InvalidEA;
 	} else {
-		auto it = _eaToLineMap.rbegin();
+		auto it = _eaToLineMap->rbegin();
 		return it->first;
 	}
 }
 
 Instruction DumpDisassemblerAPI::instructionForEA(const EA &instructionEA) const {
+    IDIOMMATCHER_COUNT(InstructionsDecoded, 1);
     auto line = lineForEA(instructionEA);
     return line ? *(line->getInstruction()) : InvalidInstruction;
 }
@@ -65,7 +135,7 @@ std::string DumpDisassemblerAPI::commentForEA(const EA &instructionEA) const {
 }
 
 std::string DumpDisassemblerAPI::executableName() const {
-    return _document.getBinaryName();
+    return _document->getBinaryName();
 }
 
 std::string DumpDisassemblerAPI::executablePath() const {
@@ -73,17 +143,32 @@ std::string DumpDisassemblerAPI::executablePath() const {
 }
 
 std::string DumpDisassemblerAPI::executableArchitecture() const {
-    return _document.getArchitectureName();
+    return _document->getArchitectureName();
 }
 
 std::string DumpDisassemblerAPI::getDisassemblerName() const {
-    return _document.getDissassembler();
+    return _document->getDissassembler();
 }
 
 DisassemblyLine_Ref DumpDisassemblerAPI::lineForEA(const EA &ea) const {
-    auto iterator = _eaToLineMap.find(ea);
+    if (_pipelinedDisassembly) {
+        return _pipelinedDisassembly->lineForEA(ea);
+    }
+    if (_compressedReader) {
+        size_t blockIndex = _compressedReader->blockIndexForEA(ea);
+        if (blockIndex == _compressedReader->getBlockIndex().size() || _compressedReader->getBlockIndex()[blockIndex].lastEA < ea) {
+            return nullptr;
+        }
+        auto lines = linesForBlock(blockIndex);
+        auto it = std::lower_bound(lines->begin(), lines->end(), ea, [](const DisassemblyLine_Ref &line, const EA &value) {
+            return line->getEA() < value;
+        });
+        return (it != lines->end() && (*it)->getEA() == ea) ? *it : nullptr;
+    }
+
+    auto iterator = _eaToLineMap->find(ea);
     DisassemblyLine_Ref lineRef = nullptr;
-    if (iterator != _eaToLineMap.end()) {
+    if (iterator != _eaToLineMap->end()) {
         return iterator->second;
     }
     return lineRef;
@@ -95,3 +180,50 @@ void DumpDisassemblerAPI::setCurrentEAAndDecodeInstruction(const IdiomMatcher::E
     _currentInstruction = line ? *(line->getInstruction()) : InvalidInstruction;
     _currentComment = line ? line->getComment() : "";
 }
+
+size_t DumpDisassemblerAPI::instructionCountInRange(const EA &startEA, const EA &endEA) const {
+    if (_pipelinedDisassembly || !(startEA < endEA)) {
+        return 0;
+    }
+    if (_compressedReader) {
+        size_t count = 0;
+        auto &index = _compressedReader->getBlockIndex();
+        for (size_t blockIndex = 0; blockIndex < index.size(); ++blockIndex) {
+            auto &block = index[blockIndex];
+            if (!(block.firstEA < endEA) || block.lastEA < startEA) {
+                continue;
+            }
+            if (!(block.firstEA < startEA) && block.lastEA < endEA) {
+                count += block.lineCount;
+                continue;
+            }
+            // only blocks crossing a border of the range are decoded
+            auto lines = linesForBlock(blockIndex);
+            count += std::count_if(lines->begin(), lines->end(), [&startEA, &endEA](const DisassemblyLine_Ref &line) {
+                return !(line->getEA() < startEA) && line->getEA() < endEA;
+            });
+        }
+        return count;
+    }
+    return std::distance(_eaToLineMap->lower_bound(startEA), _eaToLineMap->lower_bound(endEA));
+}
+
+DumpDisassemblerAPI::DisassemblyLines_Ref DumpDisassemblerAPI::linesForBlock(size_t blockIndex) const {
+    for (auto it = _blockCache.begin(); it != _blockCache.end(); ++it) {
+        if (it->first == blockIndex) {
+            if (it != _blockCache.begin()) {
+                auto entry = *it;
+                _blockCache.erase(it);
+                _blockCache.push_front(entry);
+            }
+            return _blockCache.front().second;
+        }
+    }
+
+    auto lines = std::make_shared<const DisassemblyLines>(_compressedReader->readBlock(blockIndex));
+    _blockCache.push_front(std::make_pair(blockIndex, lines));
+    while (_blockCache.size() > std::max(blockCacheSize, (size_t)1)) {
+        _blockCache.pop_back();
+    }
+    return lines;
+}
@@ -6,12 +6,20 @@
 #define IDIOMMATCHER_DUMPDISASSEMBLERAPI_H
 #include <Matching/DisassemblerAPI.h>
 #include <Model/DisassemblyPersistence.h>
+#include <Model/CompressedDisassemblyPersistence.h>
+#include <Model/PipelinedDisassembly.h>
 #include <map>
+#include <deque>
 
 class DumpDisassemblerAPI : public IdiomMatcher::DisassemblerAPI {
 public:
-    DumpDisassemblerAPI(const std::string &path);
+    // JSON dumps are parsed with loadThreadCount threads, 0 uses all cores.
+    DumpDisassemblerAPI(const std::string &path, const unsigned loadThreadCount = 1);
     DumpDisassemblerAPI(const IdiomMatcher::DisassemblyDocument &document, const std::string &documentPath= "");
+    // Reads blocks of a compressed document on demand instead of keeping all lines in memory.
+    DumpDisassemblerAPI(const IdiomMatcher::CompressedDisassemblyReader_Ref &reader, const std::string &documentPath= "");
+    // Reads lines of a dump that is still being parsed, lookups wait until the lines are available.
+    DumpDisassemblerAPI(const IdiomMatcher::PipelinedDisassembly_Ref &disassembly, const std::string &documentPath= "");
 
     virtual IdiomMatcher::EA minEA() const override;
 
@@ -37,13 +45,33 @@ public:
 
     virtual std::string getDisassemblerName() const override;
 
+    const IdiomMatcher::DisassemblyDocument &getDocument() const { return *_document; }
+
+    bool isCompressed() const { return _compressedReader != nullptr; }
+
+    // lines in [startEA, endEA), 0 for pipelined dumps
+    size_t instructionCountInRange(const IdiomMatcher::EA &startEA, const IdiomMatcher::EA &endEA) const;
+
+    // number of decoded blocks kept per API instance in compressed mode
+    size_t blockCacheSize = 4;
+
 private:
 
     IdiomMatcher::DisassemblyLine_Ref lineForEA(const IdiomMatcher::EA &ea) const;
 
     const std::string _path;
-    std::map<IdiomMatcher::EA, IdiomMatcher::DisassemblyLine_Ref> _eaToLineMap;
-    IdiomMatcher::DisassemblyDocument _document;
+    // shared between copies, so every thread can cheaply copy the API for its own current EA
+    typedef std::map<IdiomMatcher::EA, IdiomMatcher::DisassemblyLine_Ref> EAToLineMap;
+    std::shared_ptr<const EAToLineMap> _eaToLineMap;
+    std::shared_ptr<const IdiomMatcher::DisassemblyDocument> _document;
+
+    typedef std::shared_ptr<const IdiomMatcher::DisassemblyLines> DisassemblyLines_Ref;
+    DisassemblyLines_Ref linesForBlock(size_t blockIndex) const;
+
+    IdiomMatcher::CompressedDisassemblyReader_Ref _compressedReader;
+    mutable std::deque<std::pair<size_t, DisassemblyLines_Ref> > _blockCache;
+
+    IdiomMatcher::PipelinedDisassembly_Ref _pipelinedDisassembly;
 };
 
 
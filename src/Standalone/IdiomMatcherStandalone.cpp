@@ -8,16 +8,209 @@
 #include <future>
 #include <regex>
 #include <sysexits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <unordered_map>
 
 #include "IdiomMatcherStandalone.h"
 #include <Model/PatternPersistence.h>
+#include <Model/PatternAnalysis.h>
 #include <Model/Logging.h>
 #include <Matching/Matcher/NaiveMatching.h>
 #include <Matching/Matcher/ControlFlowGraphMatching.h>
 #include <Matching/Matcher/DependenceGraphMatching.h>
+#include <Matching/Matcher/CombinedMatching.h>
+#include <Matching/Matcher/CascadeMatching.h>
 #include <Matching/MatchPersistence.h>
+#include <Matching/MatchStreamWriter.h>
+#include <Matching/RunReport.h>
+#include <Matching/Evaluation.h>
+#include <Matching/DumpDiff.h>
+#include <Matching/FunctionMatchCache.h>
+#include <Matching/Graph/CFGBuilder.h>
+#include <Model/PipelinedDisassembly.h>
+#include <Matching/Telemetry.h>
+#include <Model/TraceRecorder.h>
+#include <Model/AllocationTracker.h>
+
+namespace {
+	// Logs EAs matched per second, the done percentage and the remaining time
+	// while tasks match their ranges in slices.
+	class MatchProgress {
+	public:
+		typedef std::function<void(const IdiomMatcher::EA &startEA, const IdiomMatcher::EA &endEA)> MatchRangeFunction;
+
+		MatchProgress(const std::vector<std::pair<IdiomMatcher::EA, IdiomMatcher::EA> > &ranges, unsigned interval) : _interval(interval) {
+			for (auto &range : ranges) {
+				_totalEAs += range.second.getValue() - range.first.getValue();
+			}
+			if (_interval > 0) {
+				_thread = std::thread([this]() { run(); });
+			}
+		}
+
+		~MatchProgress() { stop(); }
+
+		// Calls match for consecutive slices of [startEA, endEA), a range
+		// matched at once would only show progress when it is finished.
+		void matchInSlices(const IdiomMatcher::EA &startEA, const IdiomMatcher::EA &endEA, const MatchRangeFunction &match) {
+			const uint64_t sliceSize = std::max<uint64_t>((endEA.getValue() - startEA.getValue()) / 100, 1 << 12);
+			for (auto sliceStart = startEA.getValue(); sliceStart < endEA.getValue(); sliceStart += sliceSize) {
+				auto sliceEnd = std::min<uint64_t>(sliceStart + sliceSize, endEA.getValue());
+				match(IdiomMatcher::EA(sliceStart), IdiomMatcher::EA(sliceEnd));
+				_doneEAs.fetch_add(sliceEnd - sliceStart, std::memory_order_relaxed);
+			}
+		}
+
+		void stop() {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stopped = true;
+			}
+			_condition.notify_all();
+			if (_thread.joinable()) {
+				_thread.join();
+			}
+		}
+
+		// EAs per second of the whole run
+		double rate() const {
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+			return elapsed.count() > 0 ? _doneEAs.load() / elapsed.count() : 0;
+		}
+
+	private:
+		void run() {
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (!_condition.wait_for(lock, std::chrono::seconds(_interval), [this]() { return _stopped; })) {
+				uint64_t done = _doneEAs.load(std::memory_order_relaxed);
+				double rate = this->rate();
+				double percent = _totalEAs > 0 ? done * 100.0 / _totalEAs : 100;
+				double remaining = rate > 0 ? (_totalEAs - done) / rate : 0;
+				IdiomMatcher::msg("progress: %.1f%% of %ju EAs, %.0f EAs/s, ETA %.0f s\n",percent,(uintmax_t)_totalEAs,rate,remaining);
+			}
+		}
+
+		const unsigned _interval;
+		uint64_t _totalEAs = 0;
+		std::atomic<uint64_t> _doneEAs{0};
+		const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+		std::mutex _mutex;
+		std::condition_variable _condition;
+		bool _stopped = false;
+		std::thread _thread;
+	};
+
+	// Measures the real and thread CPU time of a task matching one range.
+	class ChunkTimer {
+	public:
+		ChunkTimer(IdiomMatcher::RunReport::Chunk &chunk, const IdiomMatcher::EA &startEA, const IdiomMatcher::EA &endEA)
+				: _chunk(chunk), _start(std::chrono::steady_clock::now()), _cpuStart(IdiomMatcher::RunReport::threadCPUTime()) {
+			_chunk.startEA = startEA;
+			_chunk.endEA = endEA;
+		}
+
+		void finish() {
+			std::chrono::duration<double> realTime = std::chrono::steady_clock::now() - _start;
+			_chunk.realTime = realTime.count();
+			_chunk.cpuTime = IdiomMatcher::RunReport::threadCPUTime() - _cpuStart;
+		}
+
+	private:
+		IdiomMatcher::RunReport::Chunk &_chunk;
+		const std::chrono::steady_clock::time_point _start;
+		const double _cpuStart;
+	};
+
+	// the graph matcher matching for matcher, the verifier of a cascade, nullptr for other matchers
+	IdiomMatcher::ControlFlowGraphMatching *graphMatcherOf(IdiomMatcher::Matching &matcher) {
+		auto cascadeMatcher = dynamic_cast<IdiomMatcher::CascadeMatching *>(&matcher);
+		if (cascadeMatcher)
+			return &cascadeMatcher->getVerifier();
+		return dynamic_cast<IdiomMatcher::ControlFlowGraphMatching *>(&matcher);
+	}
+
+	// Adds the start EAs of api outside ranges to ranges whose CFG window, see fillCFGWindow,
+	// differs from the one of their instruction in previousAPI. Graph matchers follow xrefs
+	// beyond any linear margin, so an unchanged start EA can reach a changed instruction.
+	void addChangedWindows(std::vector<std::pair<IdiomMatcher::EA, IdiomMatcher::EA> > &ranges, const IdiomMatcher::DumpDiff &diff,
+						   const IdiomMatcher::ControlFlowGraphMatching &graphMatcher, const IdiomMatcher::Patterns &patterns,
+						   DumpDisassemblerAPI &previousAPI, DumpDisassemblerAPI &api) {
+		using namespace IdiomMatcher;
+		auto instructionForEAOf = [](DisassemblerAPI &api) {
+			return [&api](const EA &ea) -> Instruction_ref {
+				return std::make_shared<Instruction>(api.instructionForEA(ea));
+			};
+		};
+		const bool rawOperandTexts = DumpDiff::patternsTestOperandTexts(patterns);
+		auto sameWindows = [&diff, rawOperandTexts](const CFGWindow &previous, const CFGWindow &current) {
+			if (previous.instructions.size() != current.instructions.size() || previous.edges != current.edges || previous.distances != current.distances)
+				return false;
+			// addresses are numbered within the windows, templates compare them across instructions
+			DumpDiff::AddressNumbers previousAddressNumbers;
+			DumpDiff::AddressNumbers currentAddressNumbers;
+			for (size_t i = 0; i < current.instructions.size(); ++i) {
+				// summary vertices have no EA
+				bool previousSummary = previous.eas[i] == InvalidEA;
+				if (previousSummary != (current.eas[i] == InvalidEA) || (!previousSummary && !(diff.translate(previous.eas[i]) == current.eas[i])))
+					return false;
+				if (DumpDiff::hashForInstruction(*previous.instructions[i], previousAddressNumbers, rawOperandTexts) != DumpDiff::hashForInstruction(*current.instructions[i], currentAddressNumbers, rawOperandTexts))
+					return false;
+			}
+			return true;
+		};
+
+		std::vector<std::pair<EA, EA> > changed;
+		auto range = ranges.begin();
+		for (EA ea = api.minInstructionEA(); !(ea == InvalidEA); ea = api.nextEA(ea)) {
+			while (range != ranges.end() && !(ea < range->second)) {
+				++range;
+			}
+			if (range != ranges.end() && !(ea < range->first))
+				continue;
+			size_t maxDepth = 0;
+			if (graphMatcher.candidatePatterns(patterns, api.instructionForEA(ea).getMnemonic(), maxDepth).empty())
+				continue;
+			int depth = graphMatcher.instructionGraphDepth(maxDepth);
+			EA previousEA = diff.originalEA(ea);
+			CFGWindow window;
+			CFGWindow previousWindow;
+			fillCFGWindow(window, ea, depth, instructionForEAOf(api), graphMatcher.maxXrefFanOut);
+			if (!(previousEA == InvalidEA))
+				fillCFGWindow(previousWindow, previousEA, depth, instructionForEAOf(previousAPI), graphMatcher.maxXrefFanOut);
+			if (previousEA == InvalidEA || !sameWindows(previousWindow, window))
+				changed.push_back(std::make_pair(ea, api.nextEA(ea) == InvalidEA ? EA(ea.getValue() + 1) : api.nextEA(ea)));
+		}
+
+		changed.insert(changed.end(), ranges.begin(), ranges.end());
+		std::sort(changed.begin(), changed.end());
+		ranges.clear();
+		for (auto &change : changed) {
+			if (!ranges.empty() && !(ranges.back().second < change.first))
+				ranges.back().second = std::max(ranges.back().second, change.second);
+			else
+				ranges.push_back(change);
+		}
+	}
+
+	// the threads of the match phase are the tasks, not the thread waiting for them
+	void finishMatchPhase(IdiomMatcher::RunReport::PhaseTimer &matchTimer, const IdiomMatcher::RunReport &report) {
+		for (auto &chunk : report.chunks) {
+			matchTimer.phase().threadCPUTimes.push_back(chunk.cpuTime);
+		}
+		matchTimer.finish();
+	}
+}
 
 bool IdiomMatcherStandalone::readPatterns() {
+	IdiomMatcher::RunReport::PhaseTimer phaseTimer(baseReport, "patterns");
 	IdiomMatcher::Patterns allPatterns;
 	for (auto &path : patternFilePaths) {
 		auto filePatterns = IdiomMatcher::PatternPersistence::readFromFilePath(path);
@@ -33,15 +226,46 @@ bool IdiomMatcherStandalone::readPatterns() {
 	}
 
 	patterns = allPatterns;
+	phaseTimer.finish();
+	return true;
+}
+
+bool IdiomMatcherStandalone::analyzePatternSet() {
+	using namespace IdiomMatcher;
+	auto t1 = std::chrono::steady_clock::now();
+	PatternAnalysis analysis(patterns);
+	std::chrono::duration<double> diff = std::chrono::steady_clock::now() - t1;
+
+	msg("%s", analysis.report().c_str());
+	size_t counts[3] = {0, 0, 0};
+	for (auto &finding : analysis.getFindings()) {
+		++counts[finding.kind];
+	}
+	msg("Analyzed %zu patterns in %f s: %zu duplicate, %zu subsumed, %zu dead, %zu remain.\n", patterns.size(), diff.count(),
+		counts[PatternAnalysis::Duplicate], counts[PatternAnalysis::Subsumed], counts[PatternAnalysis::Dead], analysis.getPrunedPatterns().size());
+
+	if (prunedPatternsPath.empty())
+		return true;
+	if (!PatternPersistence::writeToFilePath(prunedPatternsPath, analysis.getPrunedPatterns())) {
+		msg("Failed to save pruned patterns to %s\n", prunedPatternsPath.c_str());
+		return false;
+	}
+	msg("Saved %zu pruned patterns to %s\n", analysis.getPrunedPatterns().size(), prunedPatternsPath.c_str());
 	return true;
 }
 
 DumpDisassemblerAPI IdiomMatcherStandalone::readDisassembly() {
 	IdiomMatcher::msg("Read diassembly file: %s\n",disassemblyFilePath.c_str());
 	clock_t start = clock();
-	DumpDisassemblerAPI api(disassemblyFilePath);
+	auto t1 = std::chrono::steady_clock::now();
+	IdiomMatcher::TraceSpan span("load", "read dump");
+	IdiomMatcher::RunReport::PhaseTimer phaseTimer(baseReport, "load");
+	DumpDisassemblerAPI api(disassemblyFilePath, loadThreadCount);
+	phaseTimer.finish();
 	clock_t end = clock();
-	IdiomMatcher::msg("finnished reading diassembly file in %us\n",(end-start)/CLOCKS_PER_SEC);
+	auto t2 = std::chrono::steady_clock::now();
+	std::chrono::duration<double> diff = t2 - t1;
+	IdiomMatcher::msg("finnished reading diassembly file in %f s real time, %us CPU time\n",diff.count(),(end-start)/CLOCKS_PER_SEC);
 	return api;
 }
 
@@ -51,52 +275,104 @@ void IdiomMatcherStandalone::matchAll(DumpDisassemblerAPI &api) {
 		matcherQueue.push_back("Naive");
 	}
 	for (auto name : matcherQueue) {
-		IdiomMatcher::Matching *matcher;
-		if (name == "SimpleGraph") {
-			matcher = new IdiomMatcher::ControlFlowGraphMatching();
-		} else if (name == "DependenceGraph") {
-			matcher = new IdiomMatcher::DependenceGraphMatching();
-		} else {
-			matcher = new IdiomMatcher::NaiveMatching();
-		}
-
+		IdiomMatcher::Matching *matcher = matcherForName(name);
 		match(api, matcher);
 		delete matcher;
 	}
 }
 
-void IdiomMatcherStandalone::match(DumpDisassemblerAPI &api, IdiomMatcher::Matching* matcher) {
-
-    IdiomMatcher::Matches matches;
-
-	std::mutex callbackMutex;
-    IdiomMatcher::Matching::FoundMatchFunctionCallback callback =  [&matches, &api, &callbackMutex] (const IdiomMatcher::Pattern &pattern, const IdiomMatcher::EA &startEA, const IdiomMatcher::EA &endEA, const std::map<std::string,std::string>& extractedValues) -> bool {
-		callbackMutex.lock();
-        auto comment = api.commentForEA(endEA);
-        IdiomMatcher::msg("matched pattern %s for from: %jX to: %jX cmt: %s\n",pattern.getName().c_str(), startEA.getValue(),endEA.getValue(),comment.c_str());
+bool IdiomMatcherStandalone::isGraphMatcherName(const std::string &name) {
+	return name == "SimpleGraph" || name == "ControlFlowGraph" || name == "DependenceGraph";
+}
 
-        auto match = std::make_shared<IdiomMatcher::Match>(startEA,endEA,pattern.getName());
-        matches.push_back(match);
+IdiomMatcher::Matching *IdiomMatcherStandalone::matcherForName(const std::string &name) const {
+	// CascadeDependenceGraph runs the DependenceGraph matcher behind the mnemonic prefilter
+	static const std::string cascadePrefix = "Cascade";
+	if (name.compare(0, cascadePrefix.size(), cascadePrefix) == 0) {
+		const std::string verifierName = name.substr(cascadePrefix.size());
+		if (!isGraphMatcherName(verifierName)) {
+			IdiomMatcher::msg("Cascade needs a graph matcher, %s is not one.\n",name.c_str());
+			exit(EX_USAGE);
+		}
+		// owned until the cascade takes it
+		std::unique_ptr<IdiomMatcher::ControlFlowGraphMatching> verifier(static_cast<IdiomMatcher::ControlFlowGraphMatching *>(matcherForName(verifierName)));
+		return new IdiomMatcher::CascadeMatching(verifier.release());
+	}
+	IdiomMatcher::ControlFlowGraphMatching *graphMatcher;
+	if (name == "SimpleGraph" || name == "ControlFlowGraph") {
+		graphMatcher = new IdiomMatcher::ControlFlowGraphMatching();
+	} else if (name == "DependenceGraph") {
+		graphMatcher = new IdiomMatcher::DependenceGraphMatching();
+	} else {
+		return new IdiomMatcher::NaiveMatching();
+	}
+	graphMatcher->maxStatesPerAttempt = maxStatesPerAttempt;
+	graphMatcher->maxMicrosecondsPerAttempt = maxMicrosecondsPerAttempt;
+	graphMatcher->maxXrefFanOut = maxXrefFanOut;
+	return graphMatcher;
+}
 
-        for (auto &value : extractedValues) {
-            IdiomMatcher::msg("extracted %s : %s\n",value.first.c_str(), value.second.c_str());
-        }
-		callbackMutex.unlock();
-        return true;
-    };
+uint64_t IdiomMatcherStandalone::reportSearchBudget(IdiomMatcher::RunReport &report, const std::vector<IdiomMatcher::Matching *> &matchers) const {
+	report.searchBudget.maxStates = maxStatesPerAttempt;
+	report.searchBudget.maxMicroseconds = maxMicrosecondsPerAttempt;
+	for (auto matcher : matchers) {
+		auto graphMatcher = graphMatcherOf(*matcher);
+		if (graphMatcher == nullptr || graphMatcher->getExhaustedAttemptCount() == 0)
+			continue;
+		IdiomMatcher::msg("%s abandoned %ju attempts exceeding the search budget.\n",graphMatcher->getName().c_str(),(uintmax_t)graphMatcher->getExhaustedAttemptCount());
+		report.searchBudget.exhaustedAttempts += graphMatcher->getExhaustedAttemptCount();
+		auto startEAs = graphMatcher->getExhaustedStartEAs();
+		report.searchBudget.exhaustedStartEAs.insert(report.searchBudget.exhaustedStartEAs.end(), startEAs.begin(), startEAs.end());
+	}
+	return report.searchBudget.exhaustedAttempts;
+}
 
+IdiomMatcher::Patterns IdiomMatcherStandalone::patternsForArchitecture(const std::string &architecture) const {
 	IdiomMatcher::Patterns patternsToTest;
-	const std::string &architecture = api.executableArchitecture();
 	std::copy_if(patterns.begin(), patterns.end(), std::back_inserter(patternsToTest),
 				 [&architecture](const IdiomMatcher::Pattern_ref &pattern) {
 					 return pattern->getArchitecture() == architecture;
 				 });
+	return patternsToTest;
+}
+
+void IdiomMatcherStandalone::match(DumpDisassemblerAPI &api, IdiomMatcher::Matching* matcher) {
 
+	auto streamWriter = openMatchStream(api, matcher->getName());
 
+	IdiomMatcher::Patterns patternsToTest = patternsForArchitecture(api.executableArchitecture());
 	if (patternsToTest.empty()) {
 		IdiomMatcher::msg("No patterns for %s found.\n",api.executableArchitecture().c_str());
 		exit(EX_DATAERR);
 	}
+	IdiomMatcher::RunReport report = baseReport;
+	report.matcherName = matcher->getName();
+
+	// patterns with cached matches are not matched again, streamed matches are
+	// not collected, so they aren't cached
+	auto matchCache = streamWriter ? nullptr : matchCacheForMatcher(api, matcher->getName());
+	IdiomMatcher::Patterns patternsToMatch;
+	IdiomMatcher::Matches cachedMatches;
+	{
+		IdiomMatcher::RunReport::PhaseTimer phaseTimer(report, "cache");
+		for (auto &pattern : patternsToTest) {
+			if (!matchCache || !matchCache->readMatches(*pattern, cachedMatches))
+				patternsToMatch.push_back(pattern);
+		}
+	}
+	if (matchCache) {
+		IdiomMatcher::msg("Match cache has %zu of %zu patterns, matching %zu.\n",patternsToTest.size()-patternsToMatch.size(),patternsToTest.size(),patternsToMatch.size());
+	}
+	{
+		IdiomMatcher::RunReport::PhaseTimer phaseTimer(report, "prepare");
+		IdiomMatcher::AllocationTracker::Scope allocationScope("match " + matcher->getName());
+		matcher->prepareForPatterns(patternsToMatch);
+	}
+
+	IdiomMatcher::PatternProfiler profiler;
+	if (profileMode) {
+		matcher->setProfiler(&profiler);
+	}
 
     IdiomMatcher::msg("Start matching with %s algorithm.\n",matcher->getName().c_str());
     clock_t start = clock();
@@ -109,41 +385,1250 @@ void IdiomMatcherStandalone::match(DumpDisassemblerAPI &api, IdiomMatcher::Match
 	} else {
 		concurrencyCount = 1;
 	}
+	IDIOMMATCHER_TELEMETRY_RESET();
+	auto ranges = patternsToMatch.empty() ? std::vector<std::pair<IdiomMatcher::EA, IdiomMatcher::EA> >() : matchRanges(api, concurrencyCount);
+	MatchProgress progress(ranges, progressInterval);
+	IdiomMatcher::RunReport::PhaseTimer matchTimer(report, "match");
+	report.chunks.resize(ranges.size());
+	// every task collects its own matches, no locking while matching
+	std::vector<std::future<FoundMatches> > futures;
+	for (size_t rangeIndex = 0; rangeIndex < ranges.size(); ++rangeIndex) {
+		auto startEA = ranges[rangeIndex].first;
+		auto chunkEndEA = ranges[rangeIndex].second;
+		auto fut = std::async([&, rangeIndex, startEA, chunkEndEA]() -> FoundMatches {
+			IDIOMMATCHER_THREAD_NAME("range " + std::to_string(rangeIndex));
+			IDIOMMATCHER_BUSY_SCOPE();
+			IdiomMatcher::TraceRecorder::shared().setThreadName("range " + std::to_string(rangeIndex));
+			IdiomMatcher::TraceSpan span("match", "match range " + std::to_string(rangeIndex));
+			IdiomMatcher::AllocationTracker::Scope allocationScope("match " + matcher->getName());
+			DumpDisassemblerAPI myAPI = api;
+			FoundMatches found;
+			std::unique_ptr<IdiomMatcher::MatchStreamWriter::Buffer> buffer(streamWriter ? new IdiomMatcher::MatchStreamWriter::Buffer(*streamWriter) : nullptr);
+			IdiomMatcher::Matching::FoundMatchFunctionCallback callback = [&found, &buffer] (const IdiomMatcher::Pattern &pattern, const IdiomMatcher::EA &startEA, const IdiomMatcher::EA &endEA, const std::map<std::string,std::string>& extractedValues) -> bool {
+				// streamed matches are only written, so memory doesn't grow with the matches
+				if (buffer) {
+					buffer->addMatch(IdiomMatcher::Match(startEA,endEA,pattern.getName()));
+				} else {
+					found.push_back(std::make_pair(std::make_shared<IdiomMatcher::Match>(startEA,endEA,pattern.getName()), extractedValues));
+				}
+				return true;
+			};
+
+			ChunkTimer chunkTimer(report.chunks[rangeIndex], startEA, chunkEndEA);
+			progress.matchInSlices(startEA, chunkEndEA, [&](const IdiomMatcher::EA &sliceStartEA, const IdiomMatcher::EA &sliceEndEA) {
+				matcher->searchForPatterns(patternsToMatch, myAPI,callback,sliceStartEA,sliceEndEA);
+			});
+			chunkTimer.finish();
+			if (writeRunReport) {
+				report.chunks[rangeIndex].instructionCount = myAPI.instructionCountInRange(startEA, chunkEndEA);
+			}
+			return found;
+		});
+		futures.push_back(std::move(fut));
+	}
+	// the tasks cover ascending EA ranges, merging in task order keeps the matches ordered by EA
+	FoundMatches found;
+	for (auto &fut : futures) {
+		FoundMatches taskFound = fut.get();
+		found.insert(found.end(), std::make_move_iterator(taskFound.begin()), std::make_move_iterator(taskFound.end()));
+	}
+
+	progress.stop();
+	auto t2 = std::chrono::high_resolution_clock::now();
+
+	std::chrono::duration<double> diff = t2 - t1;
+
+    clock_t end = clock();
+	finishMatchPhase(matchTimer, report);
+
+    double cpuTime = (end-start)/(CLOCKS_PER_SEC*1.0);
+    double realtime = diff.count();
+
+	// abandoned attempts can miss matches, these are not cached as complete
+	bool budgetExceeded = reportSearchBudget(report, {matcher}) > 0;
+	if (budgetExceeded && matchCache) {
+		IdiomMatcher::msg("Not caching the matches, the search budget was exceeded.\n");
+	}
+
+	IdiomMatcher::RunReport::PhaseTimer persistTimer(report, "persist");
+	if (matchCache) {
+		// every matched pattern gets an entry, also those without matches
+		std::unordered_map<std::string, IdiomMatcher::Matches> matchesForPattern;
+		for (auto &entry : found) {
+			matchesForPattern[entry.first->getPatternName()].push_back(entry.first);
+		}
+		for (auto &pattern : patternsToMatch) {
+			if (!budgetExceeded && !matchCache->writeMatches(*pattern, matchesForPattern[pattern->getName()]))
+				IdiomMatcher::msg("Failed to cache matches of %s\n",pattern->getName().c_str());
+		}
+		for (auto &cachedMatch : cachedMatches) {
+			found.push_back(std::make_pair(cachedMatch, IdiomMatcher::Matching::ExtractedValuesMap()));
+		}
+		std::stable_sort(found.begin(), found.end(), [](const FoundMatches::value_type &a, const FoundMatches::value_type &b) {
+			return a.first->getStartEA() < b.first->getStartEA();
+		});
+	}
+	IdiomMatcher::Matches matches;
+	matches.reserve(found.size());
+	for (auto &entry : found) {
+		logMatch(api, *entry.first, entry.second);
+		matches.push_back(entry.first);
+	}
+    IdiomMatcher::msg("Matching finished in %f s CPU time, %f s real time, %.0f EAs/s.\n",cpuTime,realtime,progress.rate());
+	logTelemetry(realtime);
+	report.matchCount = streamWriter ? streamWriter->getMatchCount() : matches.size();
+	if (streamWriter)
+		finishMatchStream(*streamWriter, api, realtime, cpuTime);
+	else
+		saveMatches(api, matcher->getName(), realtime, cpuTime, matches);
+	persistTimer.finish();
+	saveRunReport(api, report, patternsToTest, concurrencyCount);
+
+	if (profileMode) {
+		matcher->setProfiler(nullptr);
+		reportProfile(api, matcher->getName(), profiler);
+	}
+}
+
+std::vector<std::pair<IdiomMatcher::EA, IdiomMatcher::EA> > IdiomMatcherStandalone::matchRanges(DumpDisassemblerAPI &api, unsigned concurrencyCount) const {
+	std::vector<std::pair<IdiomMatcher::EA, IdiomMatcher::EA> > ranges;
 	IdiomMatcher::EA startEA = startMatch != 0 ? IdiomMatcher::EA(startMatch) : api.minInstructionEA();
 	IdiomMatcher::EA endEA = endMatch != 0 ? IdiomMatcher::EA(endMatch) : api.maxInstructionEA();
 	uint offset = ceil((endEA.getValue()-startEA.getValue())*1.0/(concurrencyCount*1.0));
 	offset = std::max(offset,(uint)1000);
 	IdiomMatcher::EA chunkEndEA = IdiomMatcher::EA(std::min(startEA.getValue()+offset,endEA.getValue()));
-	std::vector<std::shared_future<void> > futures;
 	for (;startEA < endEA; chunkEndEA = IdiomMatcher::EA(std::min(chunkEndEA.getValue()+offset,endEA.getValue()))) {
-		auto fut = std::async([&, startEA, chunkEndEA](){
+		ranges.push_back(std::make_pair(startEA, chunkEndEA));
+		startEA = chunkEndEA;
+	}
+	return ranges;
+}
+
+void IdiomMatcherStandalone::combinedMatchAll(DumpDisassemblerAPI &api) {
+	using namespace IdiomMatcher;
+
+	if (matcherQueue.size() == 0) {
+		matcherQueue.push_back("Naive");
+	}
+	std::vector<std::unique_ptr<Matching> > ownedMatchers;
+	std::vector<Matching *> matchers;
+	for (auto &name : matcherQueue) {
+		ownedMatchers.emplace_back(matcherForName(name));
+		matchers.push_back(ownedMatchers.back().get());
+	}
+	CombinedMatching combinedMatching(matchers);
+
+	std::vector<std::unique_ptr<PatternProfiler> > profilers;
+	if (profileMode) {
+		for (auto matcher : matchers) {
+			profilers.emplace_back(new PatternProfiler());
+			matcher->setProfiler(profilers.back().get());
+		}
+	}
+
+	Patterns patternsToTest = patternsForArchitecture(api.executableArchitecture());
+	if (patternsToTest.empty()) {
+		msg("No patterns for %s found.\n",api.executableArchitecture().c_str());
+		exit(EX_DATAERR);
+	}
+	RunReport report = baseReport;
+	report.matcherName = "Combined";
+	{
+		RunReport::PhaseTimer phaseTimer(report, "prepare");
+		AllocationTracker::Scope allocationScope("match combined");
+		combinedMatching.prepareForPatterns(patternsToTest);
+	}
+
+	std::vector<std::unique_ptr<MatchStreamWriter> > streamWriters;
+	for (auto matcher : matchers) {
+		streamWriters.push_back(openMatchStream(api, matcher->getName()));
+	}
+
+	msg("Start combined matching with %zu algorithms.\n",matchers.size());
+	clock_t start = clock();
+	auto t1 = std::chrono::high_resolution_clock::now();
+
+	auto concurrencyCount = std::thread::hardware_concurrency();
+	if (combinedMatching.getConcurrencyAllowed()) {
+		concurrencyCount = 1<concurrencyCount ? concurrencyCount-1 : 1;
+	} else {
+		concurrencyCount = 1;
+	}
+	IDIOMMATCHER_TELEMETRY_RESET();
+	auto ranges = matchRanges(api, concurrencyCount);
+	MatchProgress progress(ranges, progressInterval);
+	RunReport::PhaseTimer matchTimer(report, "match");
+	report.chunks.resize(ranges.size());
+	// every task collects the matches of each matcher on its own
+	std::vector<std::future<std::vector<FoundMatches> > > futures;
+	for (size_t rangeIndex = 0; rangeIndex < ranges.size(); ++rangeIndex) {
+		auto startEA = ranges[rangeIndex].first;
+		auto chunkEndEA = ranges[rangeIndex].second;
+		auto fut = std::async([&, rangeIndex, startEA, chunkEndEA]() -> std::vector<FoundMatches> {
+			IDIOMMATCHER_THREAD_NAME("range " + std::to_string(rangeIndex));
+			IDIOMMATCHER_BUSY_SCOPE();
+			TraceRecorder::shared().setThreadName("range " + std::to_string(rangeIndex));
+			TraceSpan span("match", "match range " + std::to_string(rangeIndex));
+			AllocationTracker::Scope allocationScope("match combined");
 			DumpDisassemblerAPI myAPI = api;
-			
-			matcher->searchForPatterns(patternsToTest, myAPI,callback,startEA,chunkEndEA);
+			std::vector<FoundMatches> found(matchers.size());
+			std::vector<std::unique_ptr<MatchStreamWriter::Buffer> > buffers;
+			for (auto &writer : streamWriters) {
+				buffers.emplace_back(writer ? new MatchStreamWriter::Buffer(*writer) : nullptr);
+			}
+			CombinedMatching::FoundMatchFunctionCallback callback = [&found, &buffers] (size_t matcherIndex, const Pattern &pattern, const EA &startEA, const EA &endEA, const Matching::ExtractedValuesMap& extractedValues) -> bool {
+				if (buffers[matcherIndex]) {
+					buffers[matcherIndex]->addMatch(Match(startEA,endEA,pattern.getName()));
+				} else {
+					found[matcherIndex].push_back(std::make_pair(std::make_shared<Match>(startEA,endEA,pattern.getName()), extractedValues));
+				}
+				return true;
+			};
+
+			ChunkTimer chunkTimer(report.chunks[rangeIndex], startEA, chunkEndEA);
+			progress.matchInSlices(startEA, chunkEndEA, [&](const EA &sliceStartEA, const EA &sliceEndEA) {
+				combinedMatching.searchForPatterns(patternsToTest, myAPI, callback, sliceStartEA, sliceEndEA);
+			});
+			chunkTimer.finish();
+			if (writeRunReport) {
+				report.chunks[rangeIndex].instructionCount = myAPI.instructionCountInRange(startEA, chunkEndEA);
+			}
+			return found;
 		});
-		futures.push_back(fut.share());
-		startEA = chunkEndEA;
+		futures.push_back(std::move(fut));
 	}
+	std::vector<FoundMatches> found(matchers.size());
 	for (auto &fut : futures) {
-		fut.wait();
+		auto taskFound = fut.get();
+		for (size_t i = 0; i < matchers.size(); ++i) {
+			found[i].insert(found[i].end(), std::make_move_iterator(taskFound[i].begin()), std::make_move_iterator(taskFound[i].end()));
+		}
 	}
 
+	progress.stop();
 	auto t2 = std::chrono::high_resolution_clock::now();
-
 	std::chrono::duration<double> diff = t2 - t1;
+	clock_t end = clock();
+	finishMatchPhase(matchTimer, report);
+	reportSearchBudget(report, matchers);
 
-    clock_t end = clock();
+	// the times are those of the combined pass, the same for every matcher
+	double cpuTime = (end-start)/(CLOCKS_PER_SEC*1.0);
+	double realtime = diff.count();
+	RunReport::PhaseTimer persistTimer(report, "persist");
+	for (size_t i = 0; i < matchers.size(); ++i) {
+		Matches matches;
+		matches.reserve(found[i].size());
+		for (auto &entry : found[i]) {
+			logMatch(api, *entry.first, entry.second);
+			matches.push_back(entry.first);
+		}
+		report.matchCount += streamWriters[i] ? streamWriters[i]->getMatchCount() : matches.size();
+		if (streamWriters[i])
+			finishMatchStream(*streamWriters[i], api, realtime, cpuTime);
+		else
+			saveMatches(api, matchers[i]->getName(), realtime, cpuTime, matches);
+	}
+	persistTimer.finish();
+	saveRunReport(api, report, patternsToTest, concurrencyCount);
+	msg("Combined matching finished in %f s CPU time, %f s real time, %.0f EAs/s.\n",cpuTime,realtime,progress.rate());
+	logTelemetry(realtime);
+	for (size_t i = 0; i < profilers.size(); ++i) {
+		reportProfile(api, matchers[i]->getName(), *profilers[i]);
+	}
+}
 
-    double cpuTime = (end-start)/(CLOCKS_PER_SEC*1.0);
-    double realtime = diff.count();
-    IdiomMatcher::msg("Matching finished in %f s CPU time, %f s real time.\n",cpuTime,realtime);
-    IdiomMatcher::MatchPersistence persistence(api.executableName(),matcher->getName(),api.executableArchitecture(),realtime,cpuTime,matches);
+bool IdiomMatcherStandalone::incrementalMatch(DumpDisassemblerAPI &api) {
+	using namespace IdiomMatcher;
+
+	auto previous = readMatchesFromFilePath(previousMatchesPath);
+	if (previous.getMatcherName().empty()) {
+		msg("Failed to read matches %s\n",previousMatchesPath.c_str());
+		return false;
+	}
+	msg("Read previous diassembly file: %s\n",previousDumpPath.c_str());
+	DumpDisassemblerAPI previousAPI(previousDumpPath, loadThreadCount);
+	if (previousAPI.executableArchitecture() != api.executableArchitecture()) {
+		msg("%s is %s, not %s\n",previousDumpPath.c_str(),previousAPI.executableArchitecture().c_str(),api.executableArchitecture().c_str());
+		return false;
+	}
+	Patterns patternsToTest = patternsForArchitecture(api.executableArchitecture());
+	if (patternsToTest.empty()) {
+		msg("No patterns for %s found.\n",api.executableArchitecture().c_str());
+		return false;
+	}
+	std::unique_ptr<Matching> matcher(matcherForName(previous.getMatcherName()));
+	RunReport report = baseReport;
+	report.matcherName = matcher->getName();
+
+	clock_t start = clock();
+	auto t1 = std::chrono::high_resolution_clock::now();
+	std::unique_ptr<DumpDiff> diff;
+	{
+		RunReport::PhaseTimer phaseTimer(report, "diff");
+		TraceSpan span("diff", "diff " + previousDumpPath);
+		// regexes test the operand texts the diff masks otherwise
+		diff.reset(new DumpDiff(previousAPI, previousAPI.minInstructionEA(), EA(previousAPI.maxInstructionEA().getValue() + 1),
+								api, api.minInstructionEA(), EA(api.maxInstructionEA().getValue() + 1), 8, DumpDiff::patternsTestOperandTexts(patternsToTest)));
+	}
+	// a match starting before a change can reach into it
+	size_t margin = 0;
+	for (auto &pattern : patternsToTest) {
+		margin = std::max(margin, pattern->getInstructions().size());
+	}
+	auto ranges = diff->changedRanges(margin);
+	auto graphMatcher = graphMatcherOf(*matcher);
+	if (graphMatcher) {
+		RunReport::PhaseTimer phaseTimer(report, "diff windows");
+		TraceSpan span("diff", "diff windows " + previousDumpPath);
+		addChangedWindows(ranges, *diff, *graphMatcher, patternsToTest, previousAPI, api);
+	}
+	size_t rangeInstructionCount = 0;
+	for (auto &range : ranges) {
+		rangeInstructionCount += api.instructionCountInRange(range.first, range.second);
+	}
+	msg("%zu of %zu instructions unchanged, rematching %zu ranges with %zu instructions with %s algorithm.\n",
+		diff->getUnchangedInstructionCount(),diff->getNewInstructionCount(),ranges.size(),rangeInstructionCount,matcher->getName().c_str());
+
+	{
+		RunReport::PhaseTimer phaseTimer(report, "prepare");
+		AllocationTracker::Scope allocationScope("match " + matcher->getName());
+		matcher->prepareForPatterns(patternsToTest);
+	}
+	// the ranges are split between the threads, each takes consecutive ranges
+	unsigned concurrencyCount = std::thread::hardware_concurrency();
+	concurrencyCount = matcher->getConcurrencyAllowed() && 1<concurrencyCount ? concurrencyCount-1 : 1;
+	concurrencyCount = (unsigned)std::max<size_t>(std::min<size_t>(concurrencyCount, ranges.size()), 1);
+	RunReport::PhaseTimer matchTimer(report, "match");
+	report.chunks.resize(concurrencyCount);
+	std::vector<std::future<FoundMatches> > futures;
+	for (unsigned taskIndex = 0; taskIndex < concurrencyCount; ++taskIndex) {
+		size_t firstRange = ranges.size() * taskIndex / concurrencyCount;
+		size_t endRange = ranges.size() * (taskIndex + 1) / concurrencyCount;
+		futures.push_back(std::async([&, taskIndex, firstRange, endRange]() -> FoundMatches {
+			TraceRecorder::shared().setThreadName("range " + std::to_string(taskIndex));
+			TraceSpan span("match", "match changed ranges " + std::to_string(taskIndex));
+			AllocationTracker::Scope allocationScope("match " + matcher->getName());
+			DumpDisassemblerAPI myAPI = api;
+			FoundMatches found;
+			Matching::FoundMatchFunctionCallback callback = [&found] (const Pattern &pattern, const EA &startEA, const EA &endEA, const Matching::ExtractedValuesMap &extractedValues) -> bool {
+				found.push_back(std::make_pair(std::make_shared<Match>(startEA,endEA,pattern.getName()), extractedValues));
+				return true;
+			};
+			if (firstRange == endRange)
+				return found;
+			ChunkTimer chunkTimer(report.chunks[taskIndex], ranges[firstRange].first, ranges[endRange - 1].second);
+			for (size_t rangeIndex = firstRange; rangeIndex < endRange; ++rangeIndex) {
+				matcher->searchForPatterns(patternsToTest, myAPI, callback, ranges[rangeIndex].first, ranges[rangeIndex].second);
+			}
+			chunkTimer.finish();
+			return found;
+		}));
+	}
+	FoundMatches found;
+	for (auto &fut : futures) {
+		FoundMatches taskFound = fut.get();
+		found.insert(found.end(), std::make_move_iterator(taskFound.begin()), std::make_move_iterator(taskFound.end()));
+	}
+	finishMatchPhase(matchTimer, report);
+	reportSearchBudget(report, {matcher.get()});
+	size_t rematchedCount = found.size();
+
+	// matches starting in a rematched range were found again if they still match
+	size_t carriedCount = 0;
+	for (auto &previousMatch : previous.getMatches()) {
+		EA startEA = diff->translate(previousMatch->getStartEA());
+		EA endEA = diff->translate(previousMatch->getEndEA());
+		if (startEA == InvalidEA || endEA == InvalidEA)
+			continue;
+		auto range = std::upper_bound(ranges.begin(), ranges.end(), startEA, [](const EA &ea, const std::pair<EA, EA> &range) {
+			return ea < range.first;
+		});
+		if (range != ranges.begin() && startEA < (range - 1)->second)
+			continue;
+		found.push_back(std::make_pair(std::make_shared<Match>(startEA,endEA,previousMatch->getPatternName()), Matching::ExtractedValuesMap()));
+		++carriedCount;
+	}
+	std::stable_sort(found.begin(), found.end(), [](const FoundMatches::value_type &a, const FoundMatches::value_type &b) {
+		return a.first->getStartEA() < b.first->getStartEA();
+	});
+
+	auto t2 = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> diffTime = t2 - t1;
+	double cpuTime = (clock()-start)/(CLOCKS_PER_SEC*1.0);
+	double realtime = diffTime.count();
+	msg("Incremental matching finished in %f s CPU time, %f s real time, %zu matches rematched, %zu of %zu carried over.\n",
+		cpuTime,realtime,rematchedCount,carriedCount,previous.getMatches().size());
+
+	RunReport::PhaseTimer persistTimer(report, "persist");
+	auto streamWriter = openMatchStream(api, matcher->getName());
+	Matches matches;
+	matches.reserve(found.size());
+	{
+		std::unique_ptr<MatchStreamWriter::Buffer> buffer(streamWriter ? new MatchStreamWriter::Buffer(*streamWriter) : nullptr);
+		for (auto &entry : found) {
+			logMatch(api, *entry.first, entry.second);
+			if (buffer)
+				buffer->addMatch(*entry.first);
+			else
+				matches.push_back(entry.first);
+		}
+	}
+	report.matchCount = found.size();
+	if (streamWriter)
+		finishMatchStream(*streamWriter, api, realtime, cpuTime);
+	else
+		saveMatches(api, matcher->getName(), realtime, cpuTime, matches);
+	persistTimer.finish();
+	saveRunReport(api, report, patternsToTest, concurrencyCount);
+	return true;
+}
+
+std::unique_ptr<IdiomMatcher::MatchCache> IdiomMatcherStandalone::matchCacheForMatcher(DumpDisassemblerAPI &api, const std::string &matcherName) {
+	if (matchCachePath.empty())
+		return nullptr;
+	if (!IdiomMatcher::MatchCache::createDirectory(matchCachePath)) {
+		IdiomMatcher::msg("Failed to create match cache %s, matching all patterns\n",matchCachePath.c_str());
+		return nullptr;
+	}
+	if (!dumpIdentity.valid) {
+		dumpIdentity = IdiomMatcher::RunReport::identityForFilePath(disassemblyFilePath);
+		if (!dumpIdentity.valid) {
+			IdiomMatcher::msg("Failed to hash %s, matching all patterns\n",disassemblyFilePath.c_str());
+			return nullptr;
+		}
+	}
+	// the same range as matchRanges
+	IdiomMatcher::EA startEA = startMatch != 0 ? IdiomMatcher::EA(startMatch) : api.minInstructionEA();
+	IdiomMatcher::EA endEA = endMatch != 0 ? IdiomMatcher::EA(endMatch) : api.maxInstructionEA();
+	auto dumpKey = IdiomMatcher::MatchCache::dumpKeyForRange(dumpIdentity.hash, startEA, endEA);
+	return std::unique_ptr<IdiomMatcher::MatchCache>(new IdiomMatcher::MatchCache(matchCachePath, cacheMatcherName(matcherName), dumpKey));
+}
+
+std::string IdiomMatcherStandalone::cacheMatcherName(const std::string &matcherName) const {
+	return maxXrefFanOut != 0 ? matcherName + "_fanout" + std::to_string(maxXrefFanOut) : matcherName;
+}
+
+void IdiomMatcherStandalone::saveRunReport(DumpDisassemblerAPI &api, IdiomMatcher::RunReport &report, const IdiomMatcher::Patterns &patternsToTest, unsigned threadCount) {
+	if (!writeRunReport)
+		return;
+	report.executableName = api.executableName();
+	report.executableArchitecture = api.executableArchitecture();
+	// the batch sets the dump of each binary
+	if (report.dumpPath.empty()) {
+		report.dumpPath = disassemblyFilePath;
+		if (!dumpIdentity.valid)
+			dumpIdentity = IdiomMatcher::RunReport::identityForFilePath(disassemblyFilePath);
+		report.dumpIdentity = dumpIdentity;
+	}
+	report.patternCount = patternsToTest.size();
+	report.patternsHash = IdiomMatcher::RunReport::hashForPatterns(patternsToTest);
+	report.threadCount = threadCount;
+	auto path = report.reportPathForExecutablePath(api.executablePath());
+	if (report.writeToFilePath(path))
+		IdiomMatcher::msg("Saved run report to %s\n",path.c_str());
+	else
+		IdiomMatcher::msg("Failed to save run report to %s\n",path.c_str());
+}
+
+void IdiomMatcherStandalone::reportProfile(DumpDisassemblerAPI &api, const std::string &matcherName, const IdiomMatcher::PatternProfiler &profiler) {
+	IdiomMatcher::msg("Pattern profile of %s:\n%s",matcherName.c_str(),profiler.reportTable().c_str());
+	auto path = profiler.reportPathForExecutablePath(api.executablePath(), matcherName);
+	if (profiler.writeReportToFilePath(path, matcherName))
+		IdiomMatcher::msg("Saved pattern profile to %s\n",path.c_str());
+	else
+		IdiomMatcher::msg("Failed to save pattern profile to %s\n",path.c_str());
+}
+
+void IdiomMatcherStandalone::logTelemetry(double realtime) {
+#ifdef IDIOMMATCHER_TELEMETRY
+	using namespace IdiomMatcher;
+	auto logCounters = [](const Telemetry::ThreadSnapshot &thread) {
+		std::string counters;
+		for (int i = 0; i < Telemetry::CounterCount; ++i) {
+			counters += std::string(i > 0 ? ", " : "") + Telemetry::counterName((Telemetry::Counter)i) + " " + std::to_string(thread.counters[i]);
+		}
+		msg("  %s: %s\n",thread.name.c_str(),counters.c_str());
+	};
+	msg("Telemetry:\n");
+	auto threads = Telemetry::snapshot();
+	for (auto &thread : threads) {
+		// a thread that finished before the others was idle for the rest of the run
+		double idleTime = std::max(realtime - thread.busyTime, thread.idleTime);
+		msg("  %s: busy %f s, idle %f s (%.0f%% busy)\n",thread.name.c_str(),thread.busyTime,idleTime,realtime > 0 ? thread.busyTime * 100 / realtime : 0);
+	}
+	for (auto &thread : threads) {
+		logCounters(thread);
+	}
+	logCounters(Telemetry::total());
+#endif
+}
+
+std::unique_ptr<IdiomMatcher::MatchStreamWriter> IdiomMatcherStandalone::openMatchStream(DumpDisassemblerAPI &api, const std::string &matcherName) {
+	if (outputFormat == "json") {
+		return nullptr;
+	}
+	auto format = outputFormat == "binary" ? IdiomMatcher::MatchStreamWriter::FormatBinary : IdiomMatcher::MatchStreamWriter::FormatNDJSON;
+	std::unique_ptr<IdiomMatcher::MatchStreamWriter> writer(new IdiomMatcher::MatchStreamWriter(api.executableName(), matcherName, api.executableArchitecture(), format));
+	auto path = writer->matchPathForExecutablePath(api.executablePath());
+	if (!writer->openFilePath(path)) {
+		IdiomMatcher::msg("Failed to create %s, saving matches as json\n",path.c_str());
+		return nullptr;
+	}
+	IdiomMatcher::msg("Streaming matches to %s\n",path.c_str());
+	return writer;
+}
+
+void IdiomMatcherStandalone::finishMatchStream(IdiomMatcher::MatchStreamWriter &writer, DumpDisassemblerAPI &api, double realtime, double cpuTime) {
+	IdiomMatcher::TraceSpan span("persist", "finish match stream");
+	IdiomMatcher::AllocationTracker::Scope allocationScope("persist");
+	auto path = writer.matchPathForExecutablePath(api.executablePath());
+	if (writer.finish(realtime, cpuTime))
+		IdiomMatcher::msg("Saved %zu matches to %s\n",writer.getMatchCount(),path.c_str());
+	else
+		IdiomMatcher::msg("Failed to save matches to %s\n",path.c_str());
+}
+
+void IdiomMatcherStandalone::logMatch(DumpDisassemblerAPI &api, const IdiomMatcher::Match &match, const IdiomMatcher::Matching::ExtractedValuesMap &extractedValues) {
+	auto comment = api.commentForEA(match.getEndEA());
+	IdiomMatcher::msg("matched pattern %s for from: %jX to: %jX cmt: %s\n",match.getPatternName().c_str(), match.getStartEA().getValue(),match.getEndEA().getValue(),comment.c_str());
+	for (auto &value : extractedValues) {
+		IdiomMatcher::msg("extracted %s : %s\n",value.first.c_str(), value.second.c_str());
+	}
+}
+
+void IdiomMatcherStandalone::saveMatches(DumpDisassemblerAPI &api, const std::string &matcherName, double realtime, double cpuTime, const IdiomMatcher::Matches &matches) {
+	IdiomMatcher::TraceSpan span("persist", "save matches " + matcherName);
+	IdiomMatcher::AllocationTracker::Scope allocationScope("persist");
+    IdiomMatcher::MatchPersistence persistence(api.executableName(),matcherName,api.executableArchitecture(),realtime,cpuTime,matches);
 	auto path = persistence.matchPathForExecutablePath(api.executablePath());
     if (persistence.saveToFilePath(path))
 		IdiomMatcher::msg("Saved matches to %s\n",path.c_str());
 	else
 		IdiomMatcher::msg("Failed to save matches to %s\n",path.c_str());
+}
+
+bool IdiomMatcherStandalone::pipelineMatchAll() {
+	using namespace IdiomMatcher;
+
+	if (matcherQueue.size() == 0) {
+		matcherQueue.push_back("Naive");
+	}
+
+	IDIOMMATCHER_TELEMETRY_RESET();
+	clock_t start = clock();
+	auto t1 = std::chrono::steady_clock::now();
+
+	// parsing and matching share the threads, so all cores are used
+	unsigned threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<std::unique_ptr<Matching> > matchers;
+	for (auto &name : matcherQueue) {
+		matchers.emplace_back(matcherForName(name));
+		// matched chunks are freed, the graph matchers follow xrefs back into them
+		if (dynamic_cast<NaiveMatching *>(matchers.back().get()) == nullptr) {
+			msg("--pipeline frees the matched chunks, the %s matcher can't be pipelined\n",matchers.back()->getName().c_str());
+			return false;
+		}
+		if (!matchers.back()->getConcurrencyAllowed()) {
+			threadCount = 1;
+		}
+	}
+	const size_t window = pipelineWindow != 0 ? pipelineWindow : threadCount * 2;
+
+	msg("Read diassembly file: %s\n",disassemblyFilePath.c_str());
+	auto disassembly = std::make_shared<PipelinedDisassembly>();
+	if (!disassembly->openFilePath(disassemblyFilePath, threadCount * 4, pipelineChunkBytes)) {
+		msg("Failed to read diassembly file %s\n",disassemblyFilePath.c_str());
+		return false;
+	}
+	DumpDisassemblerAPI api(disassembly, disassemblyFilePath);
+
+	Patterns patternsToTest = patternsForArchitecture(api.executableArchitecture());
+	if (patternsToTest.empty()) {
+		msg("No patterns for %s found.\n",api.executableArchitecture().c_str());
+		exit(EX_DATAERR);
+	}
+	for (auto &matcher : matchers) {
+		matcher->prepareForPatterns(patternsToTest);
+	}
+
+	msg("Start pipelined matching on %u threads, parsing up to %zu chunks ahead.\n",threadCount,window);
+
+	const EA rangeStartEA = startMatch != 0 ? EA(startMatch) : EA(0);
+	const EA rangeEndEA = endMatch != 0 ? EA(endMatch) : InvalidEA;
+
+	// Matches of each chunk and matcher, handed on in chunk order once all earlier chunks
+	// are done. The chunks in flight are bounded by the window, the entries of delivered
+	// chunks are emptied.
+	std::deque<std::vector<FoundMatches> > chunkMatches;
+	std::deque<bool> chunkFinished;
+	size_t deliveredChunkCount = 0;
+	std::vector<Matches> matches(matchers.size());
+	std::vector<std::unique_ptr<MatchStreamWriter> > streamWriters;
+	std::vector<std::unique_ptr<MatchStreamWriter::Buffer> > streamBuffers;
+	for (auto &matcher : matchers) {
+		streamWriters.push_back(openMatchStream(api, matcher->getName()));
+		streamBuffers.emplace_back(streamWriters.back() ? new MatchStreamWriter::Buffer(*streamWriters.back()) : nullptr);
+	}
+	std::mutex deliveryMutex;
+
+	auto deliverFinishedChunks = [&](const size_t finishedChunkIndex, std::vector<FoundMatches> &found, DumpDisassemblerAPI &myAPI) {
+		std::lock_guard<std::mutex> lock(deliveryMutex);
+		const size_t offset = finishedChunkIndex - deliveredChunkCount;
+		if (chunkMatches.size() <= offset) {
+			chunkMatches.resize(offset + 1);
+			chunkFinished.resize(offset + 1, false);
+		}
+		chunkMatches[offset].swap(found);
+		chunkFinished[offset] = true;
+		while (!chunkFinished.empty() && chunkFinished.front()) {
+			auto &chunkFound = chunkMatches.front();
+			for (size_t i = 0; i < chunkFound.size(); ++i) {
+				for (auto &entry : chunkFound[i]) {
+					auto &match = entry.first;
+					logMatch(myAPI, *match, entry.second);
+					if (streamBuffers[i])
+						streamBuffers[i]->addMatch(*match);
+					else
+						matches[i].push_back(match);
+				}
+			}
+			chunkMatches.pop_front();
+			chunkFinished.pop_front();
+			++deliveredChunkCount;
+		}
+		// chunks still matched or logged start at deliveredChunkCount and only read forward
+		disassembly->releaseChunksBefore(deliveredChunkCount);
+	};
+
+	auto nextChunkToMatch = [&]() {
+		// waiting for chunks being parsed, or parsing one, is idle time of the matching
+		IDIOMMATCHER_IDLE_SCOPE();
+		return disassembly->nextChunkToMatch(window);
+	};
+
+	auto worker = [&]() {
+		DumpDisassemblerAPI myAPI = api;
+		for (size_t chunkIndex = nextChunkToMatch(); chunkIndex != PipelinedDisassembly::noChunk; chunkIndex = nextChunkToMatch()) {
+			IDIOMMATCHER_BUSY_SCOPE();
+			TraceSpan span("match", "match chunk " + std::to_string(chunkIndex));
+			AllocationTracker::Scope allocationScope("match pipeline");
+			std::vector<FoundMatches> found(matchers.size());
+			if (!disassembly->linesForChunk(chunkIndex).empty()) {
+				// like match() the last instruction of the dump is not used as start
+				EA chunkStartEA = disassembly->firstEAForChunk(chunkIndex);
+				EA chunkEndEA = disassembly->lastEAForChunk(chunkIndex);
+				if (!(disassembly->nextEA(chunkEndEA) == InvalidEA)) {
+					chunkEndEA = EA(chunkEndEA.getValue() + 1);
+				}
+				chunkStartEA = chunkStartEA < rangeStartEA ? rangeStartEA : chunkStartEA;
+				chunkEndEA = rangeEndEA < chunkEndEA ? rangeEndEA : chunkEndEA;
+
+				for (size_t i = 0; i < matchers.size() && chunkStartEA < chunkEndEA; ++i) {
+					FoundMatches &matcherFound = found[i];
+					Matching::FoundMatchFunctionCallback callback = [&matcherFound] (const Pattern &pattern, const EA &startEA, const EA &endEA, const Matching::ExtractedValuesMap& extractedValues) -> bool {
+						matcherFound.push_back(std::make_pair(std::make_shared<Match>(startEA,endEA,pattern.getName()), extractedValues));
+						return true;
+					};
+					matchers[i]->searchForPatterns(patternsToTest, myAPI, callback, chunkStartEA, chunkEndEA);
+				}
+			}
+			deliverFinishedChunks(chunkIndex, found, myAPI);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i < threadCount; ++i) {
+		threads.push_back(std::thread(worker));
+	}
+	worker();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	if (disassembly->hasFailed()) {
+		msg("Failed to parse diassembly file %s\n",disassemblyFilePath.c_str());
+		return false;
+	}
+
+	auto t2 = std::chrono::steady_clock::now();
+	std::chrono::duration<double> diff = t2 - t1;
+	clock_t end = clock();
+
+	// the times include parsing the dump, it overlaps with matching
+	double cpuTime = (end-start)/(CLOCKS_PER_SEC*1.0);
+	double realtime = diff.count();
+	msg("Pipelined parsing and matching finished in %f s CPU time, %f s real time.\n",cpuTime,realtime);
+	logTelemetry(realtime);
+	for (size_t i = 0; i < matchers.size(); ++i) {
+		if (streamWriters[i]) {
+			streamBuffers[i]->flush();
+			finishMatchStream(*streamWriters[i], api, realtime, cpuTime);
+		} else {
+			saveMatches(api, matchers[i]->getName(), realtime, cpuTime, matches[i]);
+		}
+	}
+	return true;
+}
+
+namespace {
+	// matchers of one architecture, prepared once and shared by all binaries of it
+	struct BatchArchitecture {
+		IdiomMatcher::Patterns patterns;
+		std::vector<std::unique_ptr<IdiomMatcher::Matching> > matchers;
+		std::unique_ptr<IdiomMatcher::CombinedMatching> combinedMatching;
+	};
+
+	struct BatchBinary {
+		std::string path;
+		std::unique_ptr<DumpDisassemblerAPI> api;
+		BatchArchitecture *architecture = nullptr;
+		std::vector<std::pair<IdiomMatcher::EA, IdiomMatcher::EA> > ranges;
+		// matches of each range and matcher
+		std::vector<std::vector<IdiomMatcher::Matches> > rangeMatches;
+		std::vector<std::unique_ptr<IdiomMatcher::MatchStreamWriter> > streamWriters;
+		size_t nextRange = 0;
+		size_t finishedRangeCount = 0;
+		double cpuTime = 0;
+		std::chrono::steady_clock::time_point startTime;
+		// phases of the binary with the CPU time of the threads working on it, a chunk per range
+		IdiomMatcher::RunReport report;
+	};
+
+	// adds a phase measured on the threads of a batch, the CPU time of the process includes other binaries
+	void addBatchPhase(IdiomMatcher::RunReport &report, const std::string &name, double realTime, const std::vector<double> &threadCPUTimes) {
+		IdiomMatcher::RunReport::Phase phase;
+		phase.name = name;
+		phase.realTime = realTime;
+		phase.threadCPUTimes = threadCPUTimes;
+		for (auto cpuTime : threadCPUTimes) {
+			phase.cpuTime += cpuTime;
+		}
+		report.phases.push_back(phase);
+	}
+
+	// compressed dumps are recognized by their content, path must be openable
+	bool isDumpFilePath(const std::string &path) {
+		static const std::string dumpSuffix = "_dump.json";
+		if (path.size() >= dumpSuffix.size() && path.compare(path.size() - dumpSuffix.size(), dumpSuffix.size(), dumpSuffix) == 0)
+			return true;
+		return IdiomMatcher::isCompressedDocumentFilePath(path);
+	}
+
+	// adds the files below directoryPath for whose path isWanted returns true
+	void findFilePaths(const std::string &directoryPath, std::vector<std::string> &paths, const std::function<bool(const std::string &path)> &isWanted) {
+		DIR *directory = opendir(directoryPath.c_str());
+		if (directory == nullptr) {
+			IdiomMatcher::warning("failed to open directory %s\n", directoryPath.c_str());
+			return;
+		}
+		while (struct dirent *entry = readdir(directory)) {
+			std::string name(entry->d_name);
+			if (name == "." || name == "..")
+				continue;
+			std::string path = directoryPath + "/" + name;
+			struct stat status;
+			if (stat(path.c_str(), &status) != 0)
+				continue;
+			if (S_ISDIR(status.st_mode))
+				findFilePaths(path, paths, isWanted);
+			else if (S_ISREG(status.st_mode) && isWanted(path))
+				paths.push_back(path);
+		}
+		closedir(directory);
+	}
+}
 
+std::vector<std::string> IdiomMatcherStandalone::batchFilePaths() const {
+	std::vector<std::string> paths;
+	struct stat status;
+	if (stat(batchPath.c_str(), &status) != 0) {
+		IdiomMatcher::msg("Failed to open batch %s\n",batchPath.c_str());
+		return paths;
+	}
+	if (S_ISDIR(status.st_mode)) {
+		findFilePaths(batchPath, paths, isDumpFilePath);
+		std::sort(paths.begin(), paths.end());
+		return paths;
+	}
+
+	// relative paths in the manifest are relative to the manifest
+	std::string baseDirectory;
+	size_t lastSlash = batchPath.find_last_of("/");
+	if (lastSlash != std::string::npos) {
+		baseDirectory = batchPath.substr(0, lastSlash + 1);
+	}
+	std::ifstream manifest(batchPath);
+	std::string line;
+	while (std::getline(manifest, line)) {
+		line.erase(0, line.find_first_not_of(" \t"));
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (line.empty() || line[0] == '#')
+			continue;
+		paths.push_back(line[0] == '/' ? line : baseDirectory + line);
+	}
+	return paths;
+}
+
+bool IdiomMatcherStandalone::batchMatchAll() {
+	using namespace IdiomMatcher;
+
+	if (matcherQueue.size() == 0) {
+		matcherQueue.push_back("Naive");
+	}
+	auto paths = batchFilePaths();
+	if (paths.empty()) {
+		msg("No disassembly files found in %s\n",batchPath.c_str());
+		return false;
+	}
+
+	unsigned threadCount = threadBudget != 0 ? threadBudget : std::max(std::thread::hardware_concurrency(), 1u);
+	for (auto &name : matcherQueue) {
+		std::unique_ptr<Matching> matcher(matcherForName(name));
+		if (!matcher->getConcurrencyAllowed()) {
+			threadCount = 1;
+		}
+	}
+	const size_t maximumLoadedCount = batchBinaryCount != 0 ? batchBinaryCount : threadCount;
+
+	// code repeated in many binaries is matched once, combined mode matches without cache
+	std::unique_ptr<FunctionMatchCache> functionCache;
+	size_t functionContextLength = 0;
+	if (!functionCachePath.empty() && combinedMode) {
+		msg("--functionCache is not used with --combined\n");
+	} else if (!functionCachePath.empty()) {
+		functionCache.reset(new FunctionMatchCache(RunReport::hashForPatterns(patterns)));
+		if (functionCache->readFromFilePath(functionCachePath))
+			msg("Read %zu functions from %s\n",functionCache->getEntryCount(),functionCachePath.c_str());
+		// the naive matcher reads the longest pattern linearly, graph matchers are keyed on their windows
+		for (auto &pattern : patterns) {
+			functionContextLength = std::max(functionContextLength, pattern->getInstructions().size());
+		}
+	}
+
+	IDIOMMATCHER_TELEMETRY_RESET();
+	clock_t start = clock();
+	auto t1 = std::chrono::steady_clock::now();
+	msg("Start batch matching of %zu files on %u threads.\n",paths.size(),threadCount);
+
+	std::mutex architecturesMutex;
+	std::map<std::string, std::unique_ptr<BatchArchitecture> > architectures;
+	// patterns are filtered and compiled once per architecture, when its first binary is loaded
+	auto architectureForName = [&](const std::string &name) -> BatchArchitecture * {
+		std::lock_guard<std::mutex> lock(architecturesMutex);
+		auto it = architectures.find(name);
+		if (it != architectures.end())
+			return it->second.get();
+
+		std::unique_ptr<BatchArchitecture> architecture(new BatchArchitecture());
+		architecture->patterns = patternsForArchitecture(name);
+		if (!architecture->patterns.empty()) {
+			std::vector<Matching *> matcherPointers;
+			for (auto &matcherName : matcherQueue) {
+				architecture->matchers.emplace_back(matcherForName(matcherName));
+				matcherPointers.push_back(architecture->matchers.back().get());
+			}
+			architecture->combinedMatching.reset(new CombinedMatching(matcherPointers));
+			if (combinedMode)
+				architecture->combinedMatching->prepareForPatterns(architecture->patterns);
+			else
+				for (auto matcher : matcherPointers)
+					matcher->prepareForPatterns(architecture->patterns);
+			msg("Prepared %zu patterns for %s.\n",architecture->patterns.size(),name.c_str());
+		}
+		BatchArchitecture *result = architecture.get();
+		architectures.emplace(name, std::move(architecture));
+		return result;
+	};
+
+	std::vector<BatchBinary> binaries(paths.size());
+	size_t failedCount = 0;
+
+	auto loadBinary = [&](BatchBinary &binary) -> bool {
+		TraceSpan span("load", "load " + binary.path);
+		auto loadStart = std::chrono::steady_clock::now();
+		double loadCPUStart = RunReport::threadCPUTime();
+		// the batch threads already run concurrently, one thread parses each dump
+		binary.api.reset(new DumpDisassemblerAPI(binary.path, 1));
+		auto &api = *binary.api;
+		if (writeRunReport) {
+			std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - loadStart;
+			binary.report = baseReport;
+			binary.report.phases.clear();
+			addBatchPhase(binary.report, "load", loadTime.count(), {RunReport::threadCPUTime() - loadCPUStart});
+		}
+		if (api.minInstructionEA() == InvalidEA) {
+			msg("Failed to read diassembly file %s\n",binary.path.c_str());
+			return false;
+		}
+		binary.architecture = architectureForName(api.executableArchitecture());
+		if (binary.architecture->patterns.empty()) {
+			msg("No patterns for %s found, skipping %s\n",api.executableArchitecture().c_str(),binary.path.c_str());
+			return false;
+		}
+		binary.ranges = matchRanges(api, threadCount);
+		if (binary.ranges.empty()) {
+			return false;
+		}
+		const size_t matcherCount = binary.architecture->matchers.size();
+		binary.rangeMatches.assign(binary.ranges.size(), std::vector<Matches>(matcherCount));
+		binary.report.chunks.resize(binary.ranges.size());
+		for (auto &matcher : binary.architecture->matchers) {
+			binary.streamWriters.push_back(openMatchStream(api, matcher->getName()));
+		}
+		binary.startTime = std::chrono::steady_clock::now();
+		return true;
+	};
+
+	auto matchRange = [&](BatchBinary &binary, const size_t rangeIndex) {
+		TraceSpan span("match", "match range " + std::to_string(rangeIndex) + " of " + binary.path);
+		AllocationTracker::Scope allocationScope("match batch");
+		DumpDisassemblerAPI myAPI = *binary.api;
+		auto &architecture = *binary.architecture;
+		auto &found = binary.rangeMatches[rangeIndex];
+		std::vector<std::unique_ptr<MatchStreamWriter::Buffer> > buffers;
+		for (auto &writer : binary.streamWriters) {
+			buffers.emplace_back(writer ? new MatchStreamWriter::Buffer(*writer) : nullptr);
+		}
+		auto addMatch = [&found, &buffers] (size_t matcherIndex, const Pattern &pattern, const EA &startEA, const EA &endEA) {
+			if (buffers[matcherIndex])
+				buffers[matcherIndex]->addMatch(Match(startEA,endEA,pattern.getName()));
+			else
+				found[matcherIndex].push_back(std::make_shared<Match>(startEA,endEA,pattern.getName()));
+		};
+
+		auto startEA = binary.ranges[rangeIndex].first;
+		auto endEA = binary.ranges[rangeIndex].second;
+		if (combinedMode) {
+			CombinedMatching::FoundMatchFunctionCallback callback = [&addMatch] (size_t matcherIndex, const Pattern &pattern, const EA &startEA, const EA &endEA, const Matching::ExtractedValuesMap&) -> bool {
+				addMatch(matcherIndex, pattern, startEA, endEA);
+				return true;
+			};
+			architecture.combinedMatching->searchForPatterns(architecture.patterns, myAPI, callback, startEA, endEA);
+			return;
+		}
+		if (functionCache) {
+			// regexes test the operand texts the keys mask otherwise
+			const bool rawOperandTexts = DumpDiff::patternsTestOperandTexts(architecture.patterns);
+			auto functions = FunctionMatchCache::functionsInRange(myAPI, startEA, endEA, functionContextLength, nullptr, rawOperandTexts);
+			for (size_t i = 0; i < architecture.matchers.size(); ++i) {
+				auto &matcher = *architecture.matchers[i];
+				auto graphMatcher = graphMatcherOf(matcher);
+				auto matcherName = cacheMatcherName(matcher.getName());
+				auto matcherFunctions = graphMatcher ? FunctionMatchCache::functionsInRange(myAPI, startEA, endEA, functionContextLength, FunctionMatchCache::graphWindowKey(*graphMatcher, architecture.patterns), rawOperandTexts) : functions;
+				for (auto &function : matcherFunctions) {
+					Matches functionMatches;
+					if (!functionCache->lookup(function, matcherName, functionMatches)) {
+						Matching::FoundMatchFunctionCallback callback = [&functionMatches] (const Pattern &pattern, const EA &startEA, const EA &endEA, const Matching::ExtractedValuesMap&) -> bool {
+							functionMatches.push_back(std::make_shared<Match>(startEA,endEA,pattern.getName()));
+							return true;
+						};
+						uint64_t exhaustedCount = graphMatcher ? graphMatcher->getExhaustedAttemptCount() : 0;
+						matcher.searchForPatterns(architecture.patterns, myAPI, callback, function.startEA, function.endEA);
+						// matches missing an abandoned attempt aren't cached, the count also grows
+						// for other threads, which only costs a match of the function later
+						if (!graphMatcher || graphMatcher->getExhaustedAttemptCount() == exhaustedCount)
+							functionCache->insert(function, matcherName, functionMatches);
+					}
+					for (auto &match : functionMatches) {
+						if (buffers[i])
+							buffers[i]->addMatch(*match);
+						else
+							found[i].push_back(match);
+					}
+				}
+			}
+			return;
+		}
+		for (size_t i = 0; i < architecture.matchers.size(); ++i) {
+			Matching::FoundMatchFunctionCallback callback = [&addMatch, i] (const Pattern &pattern, const EA &startEA, const EA &endEA, const Matching::ExtractedValuesMap&) -> bool {
+				addMatch(i, pattern, startEA, endEA);
+				return true;
+			};
+			architecture.matchers[i]->searchForPatterns(architecture.patterns, myAPI, callback, startEA, endEA);
+		}
+	};
+
+	// the per match log of the single binary modes would be unreadable for a batch, only the files and a summary are written
+	auto finishBinary = [&](BatchBinary &binary) {
+		auto &api = *binary.api;
+		auto persistStart = std::chrono::steady_clock::now();
+		double persistCPUStart = RunReport::threadCPUTime();
+		std::chrono::duration<double> diff = persistStart - binary.startTime;
+		double realtime = diff.count();
+		size_t matchCount = 0;
+		for (size_t i = 0; i < binary.architecture->matchers.size(); ++i) {
+			if (binary.streamWriters[i]) {
+				matchCount += binary.streamWriters[i]->getMatchCount();
+				finishMatchStream(*binary.streamWriters[i], api, realtime, binary.cpuTime);
+				continue;
+			}
+			Matches matches;
+			for (auto &found : binary.rangeMatches) {
+				matches.insert(matches.end(), found[i].begin(), found[i].end());
+			}
+			matchCount += matches.size();
+			saveMatches(api, binary.architecture->matchers[i]->getName(), realtime, binary.cpuTime, matches);
+		}
+		msg("Matched %s (%s): %zu matches in %f s CPU time, %f s real time.\n",binary.path.c_str(),api.executableArchitecture().c_str(),matchCount,binary.cpuTime,realtime);
+		if (writeRunReport) {
+			auto &report = binary.report;
+			std::vector<double> threadCPUTimes;
+			for (auto &chunk : report.chunks) {
+				threadCPUTimes.push_back(chunk.cpuTime);
+			}
+			addBatchPhase(report, "match", realtime, threadCPUTimes);
+			std::chrono::duration<double> persistTime = std::chrono::steady_clock::now() - persistStart;
+			addBatchPhase(report, "persist", persistTime.count(), {RunReport::threadCPUTime() - persistCPUStart});
+			std::string matcherName;
+			for (auto &matcher : binary.architecture->matchers) {
+				matcherName += (matcherName.empty() ? "" : "+") + matcher->getName();
+			}
+			report.matcherName = combinedMode ? "Combined" : matcherName;
+			report.matchCount = matchCount;
+			report.dumpPath = binary.path;
+			report.dumpIdentity = RunReport::identityForFilePath(binary.path);
+			saveRunReport(api, report, binary.architecture->patterns, threadCount);
+		}
+		binary.streamWriters.clear();
+		std::vector<std::vector<Matches> >().swap(binary.rangeMatches);
+		binary.api.reset();
+	};
+
+	// Threads take ranges of loaded binaries first, so binaries finish and free their
+	// memory early, and load the next binary when there is nothing to match.
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<size_t> matchableBinaries;
+	size_t nextBinaryToLoad = 0;
+	size_t loadedCount = 0;
+
+	auto worker = [&]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			if (!matchableBinaries.empty()) {
+				auto &binary = binaries[matchableBinaries.front()];
+				size_t rangeIndex = binary.nextRange++;
+				if (binary.nextRange == binary.ranges.size()) {
+					matchableBinaries.pop_front();
+				}
+				lock.unlock();
+				auto &chunk = binary.report.chunks[rangeIndex];
+				{
+					IDIOMMATCHER_BUSY_SCOPE();
+					ChunkTimer chunkTimer(chunk, binary.ranges[rangeIndex].first, binary.ranges[rangeIndex].second);
+					matchRange(binary, rangeIndex);
+					chunkTimer.finish();
+					if (writeRunReport) {
+						chunk.instructionCount = binary.api->instructionCountInRange(chunk.startEA, chunk.endEA);
+					}
+				}
+				lock.lock();
+				binary.cpuTime += chunk.cpuTime;
+				if (++binary.finishedRangeCount == binary.ranges.size()) {
+					lock.unlock();
+					finishBinary(binary);
+					lock.lock();
+					--loadedCount;
+					condition.notify_all();
+				}
+				continue;
+			}
+			if (nextBinaryToLoad < binaries.size() && loadedCount < maximumLoadedCount) {
+				auto &binary = binaries[nextBinaryToLoad++];
+				++loadedCount;
+				lock.unlock();
+				bool loaded = loadBinary(binary);
+				lock.lock();
+				if (loaded) {
+					matchableBinaries.push_back(&binary - &binaries[0]);
+				} else {
+					binary.api.reset();
+					--loadedCount;
+					++failedCount;
+				}
+				condition.notify_all();
+				continue;
+			}
+			if (nextBinaryToLoad == binaries.size() && loadedCount == 0) {
+				return;
+			}
+			IDIOMMATCHER_IDLE_SCOPE();
+			condition.wait(lock);
+		}
+	};
+
+	for (size_t i = 0; i < paths.size(); ++i) {
+		binaries[i].path = paths[i];
+	}
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i < threadCount; ++i) {
+		threads.push_back(std::thread(worker));
+	}
+	worker();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	auto t2 = std::chrono::steady_clock::now();
+	std::chrono::duration<double> diff = t2 - t1;
+	clock_t end = clock();
+	msg("Batch matching of %zu files finished in %f s CPU time, %f s real time, %zu files failed.\n",paths.size(),(end-start)/(CLOCKS_PER_SEC*1.0),diff.count(),failedCount);
+	logTelemetry(diff.count());
+	if (functionCache) {
+		size_t lookupCount = functionCache->getHitCount() + functionCache->getMissCount();
+		msg("Function cache: %zu of %zu functions reused, %zu cached.\n",functionCache->getHitCount(),lookupCount,functionCache->getEntryCount());
+		if (!functionCache->writeToFilePath(functionCachePath))
+			msg("Failed to save function cache to %s\n",functionCachePath.c_str());
+	}
+	return failedCount < paths.size();
+}
+
+namespace {
+	struct EvaluationRow {
+		std::string path;
+		std::string executableName;
+		std::string matcherName;
+		std::string architecture;
+		double realTime = 0;
+		double cpuTime = 0;
+		size_t matchCount = 0;
+		size_t correct = 0;
+		size_t missing = 0;
+		size_t wrong = 0;
+		size_t usedPatternCount = 0;
+		bool failed = false;
+	};
+
+	// the names eval/Eval.sh shortened for the table of the thesis
+	std::string shortEvaluationName(const std::string &name) {
+		static const std::pair<const char *, const char *> shortNames[] = {
+			{"ELF for PowerPC (Executable); CPU-ID: 15", "PPC"},
+			{"ELF for ARM (Executable); CPU-ID: 13", "ARM"},
+			{"ELF for MIPS (Executable); CPU-ID: 12", "MIPS"},
+			{"ELF for Intel 386 (Executable); CPU-ID: 0", "x86"},
+			{"DependenceGraph", "PDG"},
+			{"ControlFlowGraph", "CFG"},
+			{".elf", ""}
+		};
+		std::string shortName = name;
+		for (auto &shortened : shortNames) {
+			size_t position = shortName.find(shortened.first);
+			if (position != std::string::npos)
+				shortName.replace(position, strlen(shortened.first), shortened.second);
+		}
+		return shortName;
+	}
+
+	// at most 5 fraction digits and a decimal comma like the table of eval/Eval.swift
+	std::string evaluationNumber(double value) {
+		char buffer[64];
+		snprintf(buffer, sizeof(buffer), "%.5f", value);
+		std::string number(buffer);
+		number.erase(number.find_last_not_of('0') + 1);
+		if (number.back() == '.')
+			number.pop_back();
+		std::replace(number.begin(), number.end(), '.', ',');
+		return number;
+	}
+}
+
+bool IdiomMatcherStandalone::evaluateAll() {
+	using namespace IdiomMatcher;
+	auto t1 = std::chrono::steady_clock::now();
+
+	// match files grouped by reference, so every reference is read once
+	std::vector<std::string> matchPaths;
+	findFilePaths(evaluatePath, matchPaths, [](const std::string &path) {
+		return !referencePathForMatchPath(path).empty();
+	});
+	std::sort(matchPaths.begin(), matchPaths.end());
+	std::map<std::string, std::vector<size_t> > rowsByReference;
+	std::vector<EvaluationRow> rows(matchPaths.size());
+	for (size_t i = 0; i < matchPaths.size(); ++i) {
+		rows[i].path = matchPaths[i];
+		rowsByReference[referencePathForMatchPath(matchPaths[i])].push_back(i);
+	}
+	std::vector<std::pair<std::string, std::vector<size_t> > > groups(rowsByReference.begin(), rowsByReference.end());
+
+	std::atomic<size_t> nextGroup(0);
+	std::atomic<size_t> referenceMatchCount(0);
+	auto evaluateGroups = [&]() {
+		for (size_t groupIndex = nextGroup++; groupIndex < groups.size(); groupIndex = nextGroup++) {
+			auto &group = groups[groupIndex];
+			struct stat status;
+			if (stat(group.first.c_str(), &status) != 0) {
+				warning("missing reference %s\n", group.first.c_str());
+				for (auto rowIndex : group.second)
+					rows[rowIndex].failed = true;
+				continue;
+			}
+			auto references = MatchPersistence::readFromFilePath(group.first).getMatches();
+			referenceMatchCount += references.size();
+			for (auto rowIndex : group.second) {
+				auto &row = rows[rowIndex];
+				auto matchPersistence = readMatchesFromFilePath(row.path);
+				auto evaluation = evaluateMatches(matchPersistence.getMatches(), references);
+				row.executableName = matchPersistence.getExectuableName();
+				row.matcherName = matchPersistence.getMatcherName();
+				row.architecture = matchPersistence.getExecutableArchitecture();
+				row.realTime = matchPersistence.getRealTime();
+				row.cpuTime = matchPersistence.getCpuTime();
+				row.matchCount = matchPersistence.getMatches().size();
+				row.correct = evaluation.correctMatches.size();
+				row.missing = evaluation.missingMatches.size();
+				row.wrong = evaluation.wrongMatches.size();
+				row.usedPatternCount = evaluation.usedPatternCount;
+				row.failed = row.matcherName.empty();
+			}
+		}
+	};
+	unsigned threadCount = threadBudget != 0 ? threadBudget : std::max(std::thread::hardware_concurrency(), 1u);
+	threadCount = std::max<unsigned>(std::min<size_t>(threadCount, groups.size()), 1);
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i < threadCount; ++i) {
+		threads.emplace_back(evaluateGroups);
+	}
+	evaluateGroups();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	std::chrono::duration<double> diff = std::chrono::steady_clock::now() - t1;
+
+	// same columns as eval/Eval.sh with tab separated output
+	msg("name\tcorrect\tmissing\twrong\trealtime\tcputime\tmatcher\tarchitecture\tnumpatterns\n");
+	std::map<std::string, EvaluationRow> matcherTotals;
+	size_t matchCount = 0;
+	size_t failedCount = 0;
+	for (auto &row : rows) {
+		if (row.failed) {
+			++failedCount;
+			continue;
+		}
+		matchCount += row.matchCount;
+		auto &total = matcherTotals[row.matcherName];
+		total.correct += row.correct;
+		total.missing += row.missing;
+		total.wrong += row.wrong;
+		total.realTime += row.realTime;
+		total.cpuTime += row.cpuTime;
+		++total.matchCount;
+		if (row.correct + row.missing + row.wrong == 0)
+			continue;
+		msg("%s\t%zu\t%zu\t%zu\t%s\t%s\t%s\t%s\t%zu\n", shortEvaluationName(row.executableName).c_str(), row.correct, row.missing, row.wrong,
+			evaluationNumber(row.realTime).c_str(), evaluationNumber(row.cpuTime).c_str(), shortEvaluationName(row.matcherName).c_str(),
+			shortEvaluationName(row.architecture).c_str(), row.usedPatternCount);
+	}
+
+	msg("\nmatcher\tfiles\tcorrect\tmissing\twrong\trealtime\tcputime\n");
+	for (auto &entry : matcherTotals) {
+		auto &total = entry.second;
+		msg("%s\t%zu\t%zu\t%zu\t%zu\t%s\t%s\n", shortEvaluationName(entry.first).c_str(), total.matchCount, total.correct, total.missing, total.wrong,
+			evaluationNumber(total.realTime).c_str(), evaluationNumber(total.cpuTime).c_str());
+	}
+	msg("Evaluated %zu match files against %zu references on %u threads in %f s, %.0f matches/s, %zu files failed.\n",
+		rows.size() - failedCount, groups.size(), threadCount, diff.count(), diff.count() > 0 ? (matchCount + referenceMatchCount) / diff.count() : 0.0, failedCount);
+	return failedCount < rows.size();
 }
 
 void IdiomMatcherStandalone::dumpSwitches(DumpDisassemblerAPI &api) {
@@ -172,3 +1657,17 @@ void IdiomMatcherStandalone::dumpSwitches(DumpDisassemblerAPI &api) {
 	}
 }
 
+bool IdiomMatcherStandalone::writeCompressedDisassembly(DumpDisassemblerAPI &api) {
+	if (api.isCompressed()) {
+		IdiomMatcher::msg("%s is already compressed\n",disassemblyFilePath.c_str());
+		return false;
+	}
+	clock_t start = clock();
+	bool success = IdiomMatcher::writeCompressedDocumentToFilePath(compressedFilePath, api.getDocument());
+	clock_t end = clock();
+	if (success)
+		IdiomMatcher::msg("Saved compressed disassembly to %s in %us\n",compressedFilePath.c_str(),(end-start)/CLOCKS_PER_SEC);
+	else
+		IdiomMatcher::msg("Failed to save compressed disassembly to %s\n",compressedFilePath.c_str());
+	return success;
+}
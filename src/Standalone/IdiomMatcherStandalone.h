@@ -10,6 +10,10 @@
 
 #include "DumpDisassemblerAPI.h"
 #include <Matching/Matcher/Matching.h>
+#include <Matching/MatchPersistence.h>
+#include <Matching/MatchStreamWriter.h>
+#include <Matching/RunReport.h>
+#include <Matching/MatchCache.h>
 
 int main(int argc, char* argv[]);
 
@@ -25,14 +29,136 @@ public:
 	std::vector<std::string> patternFilePaths;
 
 	bool shouldDumpSwitches = false;
+	unsigned loadThreadCount = 0;
+	std::string compressedFilePath;
+
+	bool pipelineMode = false;
+	// chunks parsed ahead of the released chunks, 0 uses twice the thread count
+	unsigned pipelineWindow = 0;
+	size_t pipelineChunkBytes = 4 << 20;
+
+	// json collects the matches and saves them at the end, ndjson and binary stream them
+	std::string outputFormat = "json";
+
+	// run all matchers in one pass sharing the decoded instructions
+	bool combinedMode = false;
+
+	// record the cost of every pattern and report it after matching
+	bool profileMode = false;
+
+	// seconds between progress lines of match and combinedMatchAll, 0 disables them
+	unsigned progressInterval = 5;
+
+	// trace event file of the run, empty doesn't record a trace
+	std::string tracePath;
+
+	// count heap allocations per phase and matcher and report them at the end
+	bool trackAllocations = false;
+
+	// write a JSON report with phase timings, chunk statistics, peak RSS and the
+	// identity of dump and patterns next to the matches of match, combinedMatchAll,
+	// incrementalMatch and of every binary of batchMatchAll
+	bool writeRunReport = false;
+
+	// manifest file with one dump path per line or directory searched for dumps
+	std::string batchPath;
+	// threads shared by all binaries of a batch, 0 uses all cores
+	unsigned threadBudget = 0;
+	// binaries loaded at the same time, 0 uses the thread budget
+	unsigned batchBinaryCount = 0;
+	// file of a FunctionMatchCache shared by the binaries of a batch and kept for
+	// later batches, empty doesn't cache
+	std::string functionCachePath;
+
+	// directory searched for match files to compare with their _matched_comments.json
+	std::string evaluatePath;
+
+	// report duplicate, subsumed and dead patterns instead of matching
+	bool analyzePatterns = false;
+	// file the patterns without findings are written to, empty doesn't write them
+	std::string prunedPatternsPath;
+
+	// directory caching the matches of every pattern per dump and matcher, match
+	// only matches the patterns without entry, empty doesn't cache. Not used with
+	// ndjson or binary output, the cached and fresh matches are merged in memory
+	std::string matchCachePath;
+
+	// dump of the previous version and its match file, incrementalMatch carries
+	// the matches of unchanged regions over instead of matching them again
+	std::string previousDumpPath;
+	std::string previousMatchesPath;
+
+	// VF2 states and microseconds the graph matchers may spend on one pattern at one
+	// EA before abandoning it, 0 for no limit
+	uint64_t maxStatesPerAttempt = 0;
+	uint64_t maxMicrosecondsPerAttempt = 0;
+	// xref targets of one instruction the graph matchers follow before summarizing the
+	// others, e.g. the cases of large jump tables, 0 follows all
+	size_t maxXrefFanOut = 0;
 
 
     bool readPatterns();
 	DumpDisassemblerAPI readDisassembly();
 	void matchAll(DumpDisassemblerAPI &api);
 	void match(DumpDisassemblerAPI &api, IdiomMatcher::Matching* matcher);
+	// Runs all matchers of matcherQueue in one pass, writes the same files as matchAll.
+	void combinedMatchAll(DumpDisassemblerAPI &api);
+	// Rematches the regions that changed since previousDumpPath with the matcher of
+	// previousMatchesPath and carries the other matches over with translated EAs.
+	// Graph matchers also rematch the start EAs whose window reaches a change.
+	bool incrementalMatch(DumpDisassemblerAPI &api);
+	// Parses the dump in chunks and matches all matchers on each chunk as soon as it is parsed.
+	// Only the chunks in the window and the lines after them the matching reads are kept,
+	// so only the Naive matcher, reading forward from its start EA, can be pipelined.
+	bool pipelineMatchAll();
+	// Matches all dumps of batchPath with patterns and matchers shared between the binaries.
+	bool batchMatchAll();
+	// The dumps of batchPath, the paths of the manifest or the _dump.json and compressed
+	// files below the directory sorted by path.
+	std::vector<std::string> batchFilePaths() const;
+	// Compares all match files below evaluatePath to their references on threadBudget threads
+	// and logs the table of eval/Eval.sh with totals per matcher.
+	bool evaluateAll();
+	// Logs the findings of PatternAnalysis for the patterns and writes the pruned patterns.
+	bool analyzePatternSet();
 
 	void dumpSwitches(DumpDisassemblerAPI &api);
+	bool writeCompressedDisassembly(DumpDisassemblerAPI &api);
+
+	// true for the --matcher names of graph matchers, Cascade matchers prefix one of them
+	static bool isGraphMatcherName(const std::string &name);
+
+private:
+	typedef std::vector<std::pair<IdiomMatcher::Match_Ref, IdiomMatcher::Matching::ExtractedValuesMap> > FoundMatches;
+
+	// graph matchers get the search budget
+	IdiomMatcher::Matching *matcherForName(const std::string &name) const;
+	// adds the budget and the attempts the matchers abandoned to report, logs and returns their count
+	uint64_t reportSearchBudget(IdiomMatcher::RunReport &report, const std::vector<IdiomMatcher::Matching *> &matchers) const;
+	IdiomMatcher::Patterns patternsForArchitecture(const std::string &architecture) const;
+	// splits the EAs to match into ranges for concurrencyCount threads
+	std::vector<std::pair<IdiomMatcher::EA, IdiomMatcher::EA> > matchRanges(DumpDisassemblerAPI &api, unsigned concurrencyCount) const;
+	void logMatch(DumpDisassemblerAPI &api, const IdiomMatcher::Match &match, const IdiomMatcher::Matching::ExtractedValuesMap &extractedValues);
+	void saveMatches(DumpDisassemblerAPI &api, const std::string &matcherName, double realtime, double cpuTime, const IdiomMatcher::Matches &matches);
+	// nullptr if the matches are saved as json
+	std::unique_ptr<IdiomMatcher::MatchStreamWriter> openMatchStream(DumpDisassemblerAPI &api, const std::string &matcherName);
+	void finishMatchStream(IdiomMatcher::MatchStreamWriter &writer, DumpDisassemblerAPI &api, double realtime, double cpuTime);
+	// writes the JSON report next to the matches and logs the table
+	void reportProfile(DumpDisassemblerAPI &api, const std::string &matcherName, const IdiomMatcher::PatternProfiler &profiler);
+	// logs the telemetry counters and busy/idle time of each thread if compiled with IDIOMMATCHER_TELEMETRY
+	void logTelemetry(double realtime);
+	// completes the report with pattern identity, dump identity unless set, and writes it if writeRunReport is set
+	void saveRunReport(DumpDisassemblerAPI &api, IdiomMatcher::RunReport &report, const IdiomMatcher::Patterns &patternsToTest, unsigned threadCount);
+
+	// the name of matcherName in match and function caches, summarized xref targets can change its matches
+	std::string cacheMatcherName(const std::string &matcherName) const;
+	// nullptr if matchCachePath is empty or can't be created
+	std::unique_ptr<IdiomMatcher::MatchCache> matchCacheForMatcher(DumpDisassemblerAPI &api, const std::string &matcherName);
+
+	// content hash of disassemblyFilePath, read once for all matchers
+	IdiomMatcher::RunReport::FileIdentity dumpIdentity;
+	// load and patterns phases, the start of the report of every matcher
+	IdiomMatcher::RunReport baseReport;
 	
 };
 
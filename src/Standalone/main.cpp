@@ -7,10 +7,14 @@
 #include <sysexits.h>
 #include <Standalone/IdiomMatcherStandalone.h>
 #include <Model/Logging.h>
+#include <Model/TraceRecorder.h>
+#include <Model/AllocationTracker.h>
+#include <Model/AllocationHooks.h>
 
 void mylogging(const char *format, ...);
 void printUsage(char *name);
 bool parseArgumens(IdiomMatcherStandalone &standalone, int argc, char *argv[]);
+int run(IdiomMatcherStandalone &matcher);
 
 int main(int argc, char* argv[]) {
 
@@ -25,6 +29,61 @@ int main(int argc, char* argv[]) {
         return EX_USAGE;
     }
 
+    IdiomMatcher::TraceRecorder &recorder = IdiomMatcher::TraceRecorder::shared();
+    if (!matcher.tracePath.empty()) {
+        recorder.start();
+        recorder.setThreadName("main");
+    }
+    if (matcher.trackAllocations) {
+        IdiomMatcher::AllocationTracker::setEnabled(true);
+    }
+
+    int result = run(matcher);
+
+    if (matcher.trackAllocations) {
+        IdiomMatcher::AllocationTracker::setEnabled(false);
+        printf("Allocations:\n%s", IdiomMatcher::AllocationTracker::reportTable().c_str());
+    }
+    if (!matcher.tracePath.empty()) {
+        recorder.stop();
+        if (recorder.writeToFilePath(matcher.tracePath))
+            printf("Saved trace with %zu spans to %s\n", recorder.getSpanCount(), matcher.tracePath.c_str());
+        else
+            printf("Failed to save trace to %s\n", matcher.tracePath.c_str());
+    }
+    return result;
+}
+
+int run(IdiomMatcherStandalone &matcher) {
+    if (!matcher.evaluatePath.empty()) {
+        return matcher.evaluateAll() ? EXIT_SUCCESS : EX_DATAERR;
+    }
+
+    if (matcher.analyzePatterns || !matcher.prunedPatternsPath.empty()) {
+        if (!matcher.readPatterns()) {
+            exit(EX_DATAERR);
+        }
+        return matcher.analyzePatternSet() ? EXIT_SUCCESS : EX_CANTCREAT;
+    }
+
+    if (!matcher.batchPath.empty()) {
+        if (!matcher.readPatterns()) {
+            exit(EX_DATAERR);
+        }
+        return matcher.batchMatchAll() ? EXIT_SUCCESS : EX_DATAERR;
+    }
+
+    if (matcher.pipelineMode) {
+        if (IdiomMatcher::isCompressedDocumentFilePath(matcher.disassemblyFilePath)) {
+            printf("--pipeline reads JSON dumps only, matching %s without pipeline\n", matcher.disassemblyFilePath.c_str());
+        } else if (!matcher.shouldDumpSwitches && matcher.compressedFilePath.empty()) {
+            if (!matcher.readPatterns()) {
+                exit(EX_DATAERR);
+            }
+            return matcher.pipelineMatchAll() ? EXIT_SUCCESS : EX_DATAERR;
+        }
+    }
+
     auto api = matcher.readDisassembly();
 
     if (matcher.shouldDumpSwitches) {
@@ -32,11 +91,28 @@ int main(int argc, char* argv[]) {
         return EXIT_SUCCESS;
     }
 
+    if (!matcher.compressedFilePath.empty()) {
+        return matcher.writeCompressedDisassembly(api) ? EXIT_SUCCESS : EX_CANTCREAT;
+    }
+
     if (!matcher.readPatterns()) {
         exit(EX_DATAERR);
     }
 
-    matcher.matchAll(api);
+    if (!matcher.previousDumpPath.empty() || !matcher.previousMatchesPath.empty()) {
+        if (matcher.previousDumpPath.empty() || matcher.previousMatchesPath.empty()) {
+            printf("--previousDump and --previousMatches are needed both\n");
+            return EX_USAGE;
+        }
+        return matcher.incrementalMatch(api) ? EXIT_SUCCESS : EX_DATAERR;
+    }
+
+    if (matcher.combinedMode && !matcher.matchCachePath.empty())
+        printf("--matchCache caches the matchers one by one, matching without --combined\n");
+    if (matcher.combinedMode && matcher.matchCachePath.empty())
+        matcher.combinedMatchAll(api);
+    else
+        matcher.matchAll(api);
     return EXIT_SUCCESS;
 }
 
@@ -48,7 +124,29 @@ void mylogging(const char *format, ...) {
 }
 
 void printUsage(char *name) {
-    printf("usage: %s --file DisassemblyFilePath.json --patterns PatternFilePath.json [--matcher Naive | SimpleGraph | DependenceGraph] [--start 0x0a0 | 016] [--end 0xb0 | 32] [--dumpSwitches]",name);
+    printf("usage: %s --file DisassemblyFilePath.json --patterns PatternFilePath.json [--matcher Naive | SimpleGraph | DependenceGraph | CascadeSimpleGraph | CascadeDependenceGraph] [--start 0x0a0 | 016] [--end 0xb0 | 32] [--dumpSwitches] [--compress CompressedFilePath.imcd] [--loadThreads 0 | 1 | N] [--pipeline] [--pipelineWindow N] [--output json | ndjson | binary] [--combined] [--batch ManifestOrDirectory] [--threads N] [--batchBinaries N] [--functionCache FunctionCachePath.imfc] [--profile] [--progress SECONDS] [--trace TracePath.json] [--allocations] [--report] [--evaluate Directory] [--analyzePatterns] [--prunedPatterns PrunedPatternFilePath.json] [--matchCache Directory] [--previousDump PreviousDisassemblyFilePath.json --previousMatches PreviousMatchFilePath.json] [--maxStates N] [--maxMicros N] [--maxXrefFanOut N]\n"
+           "--file also accepts compressed disassembly files created with --compress.\n"
+           "--loadThreads sets the number of threads parsing the JSON dump, default 0 uses all cores.\n"
+           "--pipeline matches chunks of the JSON dump while later chunks are still read and frees the matched chunks, with the Naive matcher only.\n"
+           "--pipelineWindow limits how many chunks are kept for the matching, default is twice the core count.\n"
+           "--output ndjson and binary write matches while matching instead of at the end, default is json.\n"
+           "--matcher CascadeSimpleGraph and CascadeDependenceGraph run the graph matcher only where the mnemonics of a pattern are all in the window of a start EA, with the same matches.\n"
+           "--combined runs all matchers in one pass sharing decoded instructions and CFG windows.\n"
+           "--batch matches every dump listed in a manifest, one path per line, or found in a directory, instead of --file.\n"
+           "--threads sets the threads shared by all binaries of a batch, default uses all cores.\n"
+           "--batchBinaries limits how many binaries of a batch are loaded at the same time, default is the thread count.\n"
+           "--functionCache reuses the matches of code found in earlier binaries of a batch and keeps them in a file for later batches.\n"
+           "--profile reports per pattern how often it was tested and how long matching it took, the most expensive first.\n"
+           "--progress sets the seconds between progress lines while matching, default 5, 0 disables them.\n"
+           "--trace writes spans of loading, matching and saving as trace events for chrome://tracing or Perfetto.\n"
+           "--allocations reports heap allocations, bytes and peak live bytes per phase and matcher.\n"
+           "--report writes phase timings, per thread CPU time, chunk statistics and peak RSS to <executable>_report_<matcher>.json.\n"
+           "--evaluate compares every match file in a directory with its _matched_comments.json reference created by --dumpSwitches, using --threads threads.\n"
+           "--analyzePatterns reports duplicate patterns, patterns subsumed by more general ones and patterns that can't match, --prunedPatterns writes the patterns without them.\n"
+           "--matchCache keeps the matches of every pattern per dump and matcher in a directory and only matches patterns that changed since the last run, with --output json only.\n"
+           "--previousDump and --previousMatches rematch only the regions of --file that changed since the previous version with the matcher of the previous matches and carry the other matches over.\n"
+           "--maxStates and --maxMicros abandon a graph matcher attempt of one pattern at one EA after N VF2 states or microseconds, --report lists the abandoned attempts.\n"
+           "--maxXrefFanOut follows at most N xref targets of an instruction into the graph matcher windows and summarizes the others, e.g. the cases of large jump tables.\n",name);
 }
 
 bool parseArgumens(IdiomMatcherStandalone &standalone, int argc, char *argv[]) {
@@ -64,6 +162,30 @@ bool parseArgumens(IdiomMatcherStandalone &standalone, int argc, char *argv[]) {
                         {"start",	 required_argument, 0, 's'},
                         {"end",		 required_argument, 0, 'e'},
                         {"dumpSwitches", no_argument, 0, 'd'},
+                        {"compress", required_argument, 0, 'c'},
+                        {"loadThreads", required_argument, 0, 'l'},
+                        {"pipeline", no_argument, 0, 'P'},
+                        {"pipelineWindow", required_argument, 0, 'w'},
+                        {"output", required_argument, 0, 'o'},
+                        {"combined", no_argument, 0, 'C'},
+                        {"batch", required_argument, 0, 'b'},
+                        {"threads", required_argument, 0, 't'},
+                        {"batchBinaries", required_argument, 0, 'B'},
+                        {"profile", no_argument, 0, 'R'},
+                        {"progress", required_argument, 0, 'g'},
+                        {"trace", required_argument, 0, 'T'},
+                        {"allocations", no_argument, 0, 'A'},
+                        {"report", no_argument, 0, 'r'},
+                        {"evaluate", required_argument, 0, 'E'},
+                        {"analyzePatterns", no_argument, 0, 'a'},
+                        {"prunedPatterns", required_argument, 0, 'n'},
+                        {"matchCache", required_argument, 0, 'k'},
+                        {"functionCache", required_argument, 0, 'F'},
+                        {"previousDump", required_argument, 0, 'v'},
+                        {"previousMatches", required_argument, 0, 'M'},
+                        {"maxStates", required_argument, 0, 'S'},
+                        {"maxMicros", required_argument, 0, 'u'},
+                        {"maxXrefFanOut", required_argument, 0, 'X'},
                         {0,			 0,                 0,  0}
                 };
         /* getopt_long stores the option index here. */
@@ -106,6 +228,82 @@ bool parseArgumens(IdiomMatcherStandalone &standalone, int argc, char *argv[]) {
             case 'd':
                 standalone.shouldDumpSwitches = true;
                 break;
+            case 'c':
+                standalone.compressedFilePath = std::string(optarg);
+                break;
+            case 'l':
+                standalone.loadThreadCount = std::stoul(optarg,nullptr,0);
+                break;
+            case 'P':
+                standalone.pipelineMode = true;
+                break;
+            case 'w':
+                standalone.pipelineWindow = std::stoul(optarg,nullptr,0);
+                break;
+            case 'C':
+                standalone.combinedMode = true;
+                break;
+            case 'b':
+                standalone.batchPath = std::string(optarg);
+                break;
+            case 't':
+                standalone.threadBudget = std::stoul(optarg,nullptr,0);
+                break;
+            case 'B':
+                standalone.batchBinaryCount = std::stoul(optarg,nullptr,0);
+                break;
+            case 'R':
+                standalone.profileMode = true;
+                break;
+            case 'g':
+                standalone.progressInterval = std::stoul(optarg,nullptr,0);
+                break;
+            case 'T':
+                standalone.tracePath = std::string(optarg);
+                break;
+            case 'A':
+                standalone.trackAllocations = true;
+                break;
+            case 'r':
+                standalone.writeRunReport = true;
+                break;
+            case 'E':
+                standalone.evaluatePath = std::string(optarg);
+                break;
+            case 'a':
+                standalone.analyzePatterns = true;
+                break;
+            case 'n':
+                standalone.prunedPatternsPath = std::string(optarg);
+                break;
+            case 'k':
+                standalone.matchCachePath = std::string(optarg);
+                break;
+            case 'F':
+                standalone.functionCachePath = std::string(optarg);
+                break;
+            case 'v':
+                standalone.previousDumpPath = std::string(optarg);
+                break;
+            case 'M':
+                standalone.previousMatchesPath = std::string(optarg);
+                break;
+            case 'S':
+                standalone.maxStatesPerAttempt = std::stoull(optarg,nullptr,0);
+                break;
+            case 'u':
+                standalone.maxMicrosecondsPerAttempt = std::stoull(optarg,nullptr,0);
+                break;
+            case 'X':
+                standalone.maxXrefFanOut = std::stoul(optarg,nullptr,0);
+                break;
+            case 'o':
+                standalone.outputFormat = std::string(optarg);
+                if (standalone.outputFormat != "json" && standalone.outputFormat != "ndjson" && standalone.outputFormat != "binary") {
+                    printf("unknown output format %s\n", optarg);
+                    success = false;
+                }
+                break;
             case '?':
                 /* getopt_long already printed an error message. */
                 success = false;
@@ -114,6 +312,36 @@ bool parseArgumens(IdiomMatcherStandalone &standalone, int argc, char *argv[]) {
                 abort();
         }
     }
+    if (!standalone.matchCachePath.empty() && standalone.outputFormat != "json") {
+        printf("--matchCache merges the cached matches in memory, it needs --output json\n");
+        success = false;
+    }
+    if (standalone.pipelineMode) {
+        // the pipeline frees the matched chunks and writes nothing but the matches
+        for (auto &name : standalone.matcherQueue) {
+            if (IdiomMatcherStandalone::isGraphMatcherName(name) || name.compare(0, 7, "Cascade") == 0) {
+                printf("--pipeline frees the matched chunks, the graph matchers follow xrefs back into them, use --matcher Naive\n");
+                success = false;
+                break;
+            }
+        }
+        if (!standalone.previousDumpPath.empty() || !standalone.previousMatchesPath.empty()) {
+            printf("--pipeline can't be combined with --previousDump and --previousMatches\n");
+            success = false;
+        }
+        if (!standalone.matchCachePath.empty()) {
+            printf("--pipeline can't be combined with --matchCache\n");
+            success = false;
+        }
+        if (standalone.combinedMode) {
+            printf("--pipeline can't be combined with --combined\n");
+            success = false;
+        }
+        if (standalone.writeRunReport) {
+            printf("--pipeline can't be combined with --report\n");
+            success = false;
+        }
+    }
     if (argc < 2)
         success = false;
     return success;
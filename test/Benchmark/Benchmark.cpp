@@ -0,0 +1,276 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+// Microbenchmarks for the hot paths of the matchers.
+//
+// usage: Benchmark [--filter substring] [--minTime seconds] [--lines N]
+//
+// Every benchmark runs until it took at least minTime and reports the time and
+// the heap allocations per operation, counted by AllocationTracker.
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include <Standalone/DumpDisassemblerAPI.h>
+#include <Generator/SyntheticDisassembly.h>
+#include <Model/PatternPersistence.h>
+#include <Model/Logging.h>
+#include <Matching/Matcher/ControlFlowGraphMatching.h>
+#include <Matching/Matcher/NaiveMatching.h>
+#include <Matching/Graph/CFGBuilder.h>
+#include <Matching/Graph/PDGTransform.h>
+#include <Model/AllocationTracker.h>
+#include <Model/AllocationHooks.h>
+
+namespace {
+	using namespace IdiomMatcher;
+
+	std::string filter;
+	double minimumTime = 0.5;
+
+	// Calls operation with growing iteration counts until the run took minimumTime.
+	void runBenchmark(const std::string &name, const std::function<void(size_t iterations)> &operation) {
+		if (!filter.empty() && name.find(filter) == std::string::npos)
+			return;
+
+		operation(1);
+		size_t iterations = 1;
+		while (true) {
+			auto allocationsBefore = AllocationTracker::allocationCount();
+			auto start = std::chrono::steady_clock::now();
+			operation(iterations);
+			std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+			auto allocations = AllocationTracker::allocationCount() - allocationsBefore;
+
+			if (duration.count() >= minimumTime || iterations >= (1u << 30)) {
+				printf("%-58s %14.1f ns/op %12.2f allocs/op %12zu ops\n", name.c_str(), duration.count() * 1e9 / iterations, allocations * 1.0 / iterations, iterations);
+				return;
+			}
+			// aim a bit above minimumTime, at most 100 times as many iterations
+			double factor = duration.count() > 0 ? minimumTime * 1.2 / duration.count() : 100;
+			iterations = (size_t)(iterations * std::min(std::max(factor, 2.0), 100.0));
+		}
+	}
+
+	// keeps results alive, so the compiler doesn't remove the benchmarked code
+	template <typename T>
+	void doNotOptimize(const T &value) {
+		static volatile const void *sink;
+		sink = &value;
+	}
+
+	// exposes the graph matching of the CFG matcher
+	class BenchmarkGraphMatching : public ControlFlowGraphMatching {
+	public:
+		using ControlFlowGraphMatching::matchGraphs;
+		using ControlFlowGraphMatching::fillPatternGraph;
+	};
+}
+
+void logging(const char *format, ...) {
+	va_list vaargs;
+	va_start(vaargs, format);
+	vprintf(format, vaargs);
+	va_end(vaargs);
+}
+
+int main(int argc, char *argv[]) {
+	IdiomMatcher::warning = logging;
+	IdiomMatcher::info = logging;
+	IdiomMatcher::msg = printf;
+	IdiomMatcher::AllocationTracker::setEnabled(true);
+
+	size_t lineCount = 1 << 16;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		} else if (strcmp(argv[i], "--minTime") == 0 && i + 1 < argc) {
+			minimumTime = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+			lineCount = std::max(strtoul(argv[++i], nullptr, 0), 16ul);
+		} else {
+			printf("usage: %s [--filter substring] [--minTime seconds] [--lines N]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// x86 code with switch idioms, loaded like the standalone loads a dump
+	SyntheticDisassemblyOptions options;
+	options.instructionCount = lineCount;
+	SyntheticDisassemblerAPI syntheticAPI(options);
+	const std::string dumpPath = "Benchmark_dump.json";
+	if (!dumpDisassemblyToFilePath(dumpPath, syntheticAPI)) {
+		printf("failed to write %s\n", dumpPath.c_str());
+		return EXIT_FAILURE;
+	}
+	DumpDisassemblerAPI api(dumpPath);
+	auto pattern = syntheticAPI.patterns().front();
+	EA switchEA = InvalidEA;
+	syntheticAPI.forEachPlantedIdiom([&switchEA](const Match &match) {
+		if (switchEA == InvalidEA)
+			switchEA = match.getStartEA();
+	});
+	if (switchEA == InvalidEA) {
+		printf("no switch idiom in %zu lines\n", lineCount);
+		return EXIT_FAILURE;
+	}
+	// filler code, the switch pattern doesn't start there
+	const EA missEA = api.nextEA(switchEA);
+	auto instructionForEA = [&api](const EA &ea) -> Instruction_ref {
+		return std::make_shared<Instruction>(api.instructionForEA(ea));
+	};
+
+#pragma mark - Instructions
+
+	{
+		NaiveMatching matching;
+		auto dissInstruction = api.instructionForEA(switchEA);
+		auto plain = std::make_shared<Instruction>(dissInstruction.getMnemonic(), dissInstruction.getOperands(), XRefs(), 4, InvalidEA);
+		auto templated = pattern->getInstructions()[0];
+		Operands regexOperands;
+		for (auto &operand : dissInstruction.getOperands()) {
+			regexOperands.push_back(std::make_shared<Operand>(operand->getText(), operand->getRegisters(), "", ".+", false));
+		}
+		auto regex = std::make_shared<Instruction>(dissInstruction.getMnemonic().substr(0, 1) + ".*", regexOperands, XRefs(), 4, InvalidEA, true);
+
+		runBenchmark("Matching::testInstructionsMatch/plain", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				bool matched = matching.testInstructionsMatch(*plain, dissInstruction);
+				doNotOptimize(matched);
+			}
+		});
+		runBenchmark("Matching::testInstructionsMatch/template", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				Matching::ExtractedValuesMap extractedValues;
+				Matching::PatternNameMap patternNameMap;
+				bool matched = matching.testInstructionsMatch(*templated, dissInstruction, &extractedValues, &patternNameMap);
+				doNotOptimize(matched);
+			}
+		});
+		runBenchmark("Matching::testInstructionsMatch/regex", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				bool matched = matching.testInstructionsMatch(*regex, dissInstruction);
+				doNotOptimize(matched);
+			}
+		});
+	}
+
+#pragma mark - Graphs
+
+	{
+		const int depth = (int)pattern->getInstructions().size();
+		runBenchmark("CFGBuilder::fillCFG/depth4", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				Graph graph;
+				fillCFG(graph, switchEA, depth, instructionForEA);
+				doNotOptimize(graph);
+			}
+		});
+		runBenchmark("CFGBuilder::fillCFG/depth10", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				Graph graph;
+				fillCFG(graph, switchEA, 2 * depth + 2, instructionForEA);
+				doNotOptimize(graph);
+			}
+		});
+
+		// graphs can't be copied, the PDG benchmark builds its CFG from a decoded window
+		CFGWindow window;
+		fillCFGWindow(window, switchEA, 2 * depth + 2, instructionForEA);
+		runBenchmark("CFGBuilder::fillCFGFromWindow/depth10 (baseline for PDG)", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				Graph graph;
+				fillCFGFromWindow(graph, window, window.depth);
+				doNotOptimize(graph);
+			}
+		});
+		runBenchmark("transformGraphToProgramDependenceGraph/depth10", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				Graph graph;
+				fillCFGFromWindow(graph, window, window.depth);
+				transformGraphToProgramDependenceGraph(graph, false);
+				doNotOptimize(graph);
+			}
+		});
+
+		BenchmarkGraphMatching matching;
+		Graph patternGraph;
+		auto lastPatternVertex = matching.fillPatternGraph(patternGraph, *pattern);
+		Graph instructionGraph;
+		fillCFG(instructionGraph, switchEA, depth, instructionForEA);
+		Graph missGraph;
+		fillCFG(missGraph, missEA, depth, instructionForEA);
+		runBenchmark("ControlFlowGraphMatching::matchGraphs/match", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				EA matchedEndEA = InvalidEA;
+				Matching::ExtractedValuesMap extractedValues;
+				bool matched = matching.matchGraphs(patternGraph, instructionGraph, lastPatternVertex, &matchedEndEA, extractedValues);
+				doNotOptimize(matched);
+			}
+		});
+		runBenchmark("ControlFlowGraphMatching::matchGraphs/miss", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				EA matchedEndEA = InvalidEA;
+				Matching::ExtractedValuesMap extractedValues;
+				bool matched = matching.matchGraphs(patternGraph, missGraph, lastPatternVertex, &matchedEndEA, extractedValues);
+				doNotOptimize(matched);
+			}
+		});
+	}
+
+#pragma mark - Disassembly
+
+	{
+		const EA minEA = api.minInstructionEA();
+		EA ea = minEA;
+		runBenchmark("DumpDisassemblerAPI::nextEA", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				ea = api.nextEA(ea);
+				if (ea == InvalidEA)
+					ea = minEA;
+			}
+		});
+		ea = minEA;
+		runBenchmark("DumpDisassemblerAPI::instructionForEA", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				auto decoded = api.instructionForEA(ea);
+				doNotOptimize(decoded);
+				ea = EA(ea.getValue() + 4);
+				if (!(ea <= api.maxInstructionEA()))
+					ea = minEA;
+			}
+		});
+	}
+
+#pragma mark - JSON loading
+
+	{
+		const std::string patternPath = "Benchmark_patterns.json";
+		Patterns manyPatterns(256, pattern);
+		PatternPersistence::writeToFilePath(patternPath, manyPatterns);
+		runBenchmark("PatternPersistence::readFromFilePath/256 patterns", [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				auto read = PatternPersistence::readFromFilePath(patternPath);
+				doNotOptimize(read);
+			}
+		});
+		std::remove(patternPath.c_str());
+
+		const std::string dumpName = "readDocumentFromFilePath/" + std::to_string(lineCount) + " lines";
+		runBenchmark(dumpName, [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				auto read = readDocumentFromFilePath(dumpPath);
+				doNotOptimize(read);
+			}
+		});
+		std::remove(dumpPath.c_str());
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -7,6 +7,25 @@
 #include <Matching/Matcher/DependenceGraphMatching.h>
 #include <Model/PatternPersistence.h>
 #include <Standalone/DumpDisassemblerAPI.h>
+#include <Standalone/IdiomMatcherStandalone.h>
+#include <Generator/SyntheticDisassembly.h>
+#include <Matching/MatchStreamWriter.h>
+#include <Matching/Evaluation.h>
+#include <Matching/MatchCache.h>
+#include <Matching/RunReport.h>
+#include <Matching/DumpDiff.h>
+#include <Matching/FunctionMatchCache.h>
+#include <Matching/Matcher/CombinedMatching.h>
+#include <Matching/Matcher/CascadeMatching.h>
+#include <Matching/Matcher/NaiveMatching.h>
+#include <Model/Logging.h>
+#include <Model/AllocationTracker.h>
+#include <Model/AllocationHooks.h>
+#include <fstream>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <dirent.h>
 
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/directed_graph.hpp>
@@ -40,6 +59,42 @@ BOOST_AUTO_TEST_CASE(TestSpecificMatchFailure) {
     BOOST_CHECK(matched);
 }
 
+BOOST_AUTO_TEST_CASE(TestCompressedDumpRoundTrip) {
+	using namespace IdiomMatcher;
+
+	auto document = documentFromJSON(*disassemblyJSON());
+	const std::string path = "MatchingTest_compressed.imcd";
+	BOOST_REQUIRE(writeCompressedDocumentToFilePath(path, document, 2));
+	BOOST_CHECK(isCompressedDocumentFilePath(path));
+
+	DumpDisassemblerAPI api(document,"");
+	DumpDisassemblerAPI compressedAPI(path);
+	BOOST_CHECK(compressedAPI.isCompressed());
+	BOOST_CHECK_EQUAL(compressedAPI.executableArchitecture(), api.executableArchitecture());
+	BOOST_CHECK(compressedAPI.minInstructionEA() == api.minInstructionEA());
+	BOOST_CHECK(compressedAPI.maxInstructionEA() == api.maxInstructionEA());
+
+	for (EA ea = api.minInstructionEA(); !(ea == InvalidEA); ea = api.nextEA(ea)) {
+		BOOST_CHECK(compressedAPI.nextEA(ea) == api.nextEA(ea));
+		auto instruction = api.instructionForEA(ea);
+		auto compressedInstruction = compressedAPI.instructionForEA(ea);
+		BOOST_CHECK_EQUAL(compressedInstruction.description(), instruction.description());
+		BOOST_CHECK_EQUAL(compressedInstruction.getXrefs().size(), instruction.getXrefs().size());
+		BOOST_CHECK_EQUAL(compressedAPI.commentForEA(ea), api.commentForEA(ea));
+	}
+
+	DependenceGraphMatching matching;
+	Patterns patterns;
+	patterns.push_back(patternFromJSON(*patternJSON()));
+	bool matched = false;
+	matching.testForPatternsStartingAtEA(patterns, compressedAPI.minInstructionEA(), compressedAPI, [&matched](const Pattern &, const EA &, const EA &, const Matching::ExtractedValuesMap &) -> bool {
+		matched = true;
+		return true;
+	});
+	BOOST_CHECK(matched);
+	std::remove(path.c_str());
+}
+
 std::shared_ptr<IdiomMatcher::JSONValue> patternJSON() {
     using namespace rapidjson;
     const char* json = "{\"instructions\": [{\"mnem\": \"movzx\",\"ops\": [{\"modified\": true,\"nameIsTemplate\": true,\"regs\": [\"edx\"],\"text\": \"edx\",\"used\": false},{\"nameIsTemplate\": true,\"regs\": [\"ax\"],\"text\": \"ax\"}],\"size\": 3,\"xrefs\": [{\"target\": 135234381}]},{\"mnem\": \"cmp\",\"ops\": [{\"regs\": [\"ax\"],\"nameIsTemplate\": true,\"text\": \"ax\"},{\"text\": \"1Ah\"}],\"size\": 4,\"xrefs\": [{\"target\": 135234385}]},{\"mnem\": \"ja\",\"ops\": [{\"address\": 135234381,\"text\": \"loc_80F834D\"}],\"size\": 2,\"xrefs\": [{\"target\": 135234387},{\"target\": 135234381}]},{\"mnem\": \"jmp\",\"ops\": [{\"address\": 137237980,\"regs\": [\"edx\"],\"nameIsTemplate\": true,\"text\": \"ds:off_82E15DC[edx*4]\"}],\"size\": 7,\"xrefs\": [{\"target\": 135234381},{\"target\": 135234448},{\"target\": 135234512},{\"target\": 135234568},{\"target\": 135234632},{\"target\": 135234744},{\"target\": 135234800},{\"target\": 135234824},{\"target\": 135234848},{\"target\": 135234912},{\"target\": 135234952},{\"target\": 135235072},{\"target\": 135235128},{\"target\": 135235192},{\"target\": 135235240},{\"target\": 135235328},{\"target\": 135235392},{\"target\": 135235504},{\"isData\": true,\"target\": 137237980}]}],\"name\": \"switch movzx before\"}";
@@ -85,6 +140,1158 @@ void writeGraphToGraphViz(StringGraph &graph) {
 	write_graphviz(std::cout,graph,vertex_writer(graph));
 }
 
+BOOST_AUTO_TEST_CASE(TestGeneratedDumpRoundTrip) {
+	using namespace IdiomMatcher;
+	msg = printf;
+
+	for (auto &architecture : SyntheticDisassemblerAPI::architectureNames()) {
+		SyntheticDisassemblyOptions options;
+		options.architecture = architecture;
+		options.instructionCount = 1 << 12;
+		options.switchDensity = 8;
+		const std::string path = "MatchingTestGenerated_dump.json";
+		SyntheticDisassemblerAPI syntheticAPI(options, path);
+		BOOST_REQUIRE(syntheticAPI.isValid());
+		BOOST_REQUIRE(dumpDisassemblyToFilePath(path, syntheticAPI));
+		DumpDisassemblerAPI api(path);
+		std::remove(path.c_str());
+
+		BOOST_CHECK_EQUAL(api.executableArchitecture(), syntheticAPI.executableArchitecture());
+		size_t instructionCount = 0;
+		for (EA ea = api.minInstructionEA(); !(ea == InvalidEA); ea = api.nextEA(ea), ++instructionCount) {
+			auto instruction = api.instructionForEA(ea);
+			auto syntheticInstruction = syntheticAPI.instructionForEA(ea);
+			BOOST_CHECK_EQUAL(instruction.description(), syntheticInstruction.description());
+			BOOST_CHECK_EQUAL(instruction.getXrefs().size(), syntheticInstruction.getXrefs().size());
+		}
+		BOOST_CHECK_EQUAL(instructionCount, options.instructionCount);
+
+		// the switch pattern finds the planted idioms, the decoys nothing
+		std::vector<std::pair<uintmax_t, uintmax_t> > planted;
+		syntheticAPI.forEachPlantedIdiom([&planted](const Match &match) {
+			planted.push_back(std::make_pair(match.getStartEA().getValue(), match.getEndEA().getValue()));
+		});
+		BOOST_CHECK(!planted.empty());
+		auto patterns = syntheticAPI.patterns();
+		for (int dependence = 0; dependence < 2; ++dependence) {
+			std::unique_ptr<ControlFlowGraphMatching> matcher(dependence ? new DependenceGraphMatching() : new ControlFlowGraphMatching());
+			std::vector<std::pair<uintmax_t, uintmax_t> > found;
+			matcher->prepareForPatterns(patterns);
+			matcher->searchForPatterns(patterns, api, [&found, &patterns](const Pattern &pattern, const EA &start, const EA &end, const Matching::ExtractedValuesMap &) -> bool {
+				BOOST_CHECK_EQUAL(pattern.getName(), patterns.front()->getName());
+				found.push_back(std::make_pair(start.getValue(), end.getValue()));
+				return true;
+			});
+			std::sort(found.begin(), found.end());
+			BOOST_CHECK(found == planted);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(TestPipelineSameAsMatchAll) {
+	using namespace IdiomMatcher;
+	msg = printf;
+
+	SyntheticDisassemblyOptions options;
+	options.instructionCount = 1 << 12;
+	options.switchDensity = 8;
+	const std::string path = "MatchingTestPipeline_dump.json";
+	SyntheticDisassemblerAPI syntheticAPI(options, path);
+	BOOST_REQUIRE(dumpDisassemblyToFilePath(path, syntheticAPI));
+
+	// lookups read the dump as far as they need it
+	EA firstEA = syntheticAPI.minEA();
+	EA lastEA = syntheticAPI.maxEA();
+	{
+		PipelinedDisassembly disassembly;
+		BOOST_REQUIRE(disassembly.openFilePath(path, 1, 4096));
+		BOOST_CHECK_EQUAL(disassembly.getChunkCount(), 0);
+		BOOST_CHECK(disassembly.minInstructionEA() == firstEA);
+		BOOST_CHECK(disassembly.lineForEA(firstEA) != nullptr);
+		BOOST_CHECK(!disassembly.isReadingFinished());
+		BOOST_CHECK(disassembly.nextEA(lastEA) == InvalidEA);
+		BOOST_CHECK(disassembly.lineForEA(EA(lastEA.getValue() + 0x1000)) == nullptr);
+		BOOST_CHECK(disassembly.isReadingFinished());
+		BOOST_CHECK(disassembly.maxInstructionEA() == lastEA);
+		BOOST_CHECK_GT(disassembly.getChunkCount(), 2);
+	}
+
+	// matched chunks are freed, at most the window and the chunk after the last matched one are kept
+	{
+		PipelinedDisassembly disassembly;
+		BOOST_REQUIRE(disassembly.openFilePath(path, 1, 4096));
+		const size_t window = 2;
+		size_t matchedChunkCount = 0;
+		for (size_t chunkIndex = disassembly.nextChunkToMatch(window); chunkIndex != PipelinedDisassembly::noChunk; chunkIndex = disassembly.nextChunkToMatch(window)) {
+			BOOST_REQUIRE_EQUAL(chunkIndex, matchedChunkCount++);
+			BOOST_REQUIRE(!disassembly.linesForChunk(chunkIndex).empty());
+			disassembly.nextEA(disassembly.lastEAForChunk(chunkIndex));
+			disassembly.releaseChunksBefore(chunkIndex);
+			BOOST_CHECK(chunkIndex == 0 || disassembly.linesForChunk(chunkIndex - 1).empty());
+		}
+		BOOST_CHECK(!disassembly.hasFailed());
+		BOOST_CHECK_EQUAL(matchedChunkCount, disassembly.getChunkCount());
+		BOOST_CHECK_GT(matchedChunkCount, 2 * window);
+		BOOST_CHECK_LE(disassembly.getPeakResidentChunkCount(), window + 1);
+	}
+
+	IdiomMatcherStandalone standalone;
+	standalone.patterns = syntheticAPI.patterns();
+	standalone.disassemblyFilePath = path;
+	standalone.matcherQueue = {"Naive"};
+	standalone.pipelineChunkBytes = 4096;
+	auto matchesForMatcher = [&path](const std::string &matcherName) {
+		auto matchPath = MatchPersistence("", matcherName, "", 0, 0, Matches()).matchPathForExecutablePath(path);
+		auto matches = readMatchesFromFilePath(matchPath).getMatches();
+		std::remove(matchPath.c_str());
+		std::vector<std::tuple<uintmax_t, uintmax_t, std::string> > result;
+		for (auto &match : matches) {
+			result.push_back(std::make_tuple(match->getStartEA().getValue(), match->getEndEA().getValue(), match->getPatternName()));
+		}
+		std::sort(result.begin(), result.end());
+		return result;
+	};
+
+	DumpDisassemblerAPI api(path);
+	standalone.matchAll(api);
+	auto naive = matchesForMatcher("Naive");
+	BOOST_CHECK_EQUAL(naive.size(), syntheticAPI.plantedIdiomCount());
+	BOOST_REQUIRE(standalone.pipelineMatchAll());
+	BOOST_CHECK(matchesForMatcher("Naive") == naive);
+
+	// the graph matchers follow xrefs back into freed chunks
+	standalone.matcherQueue = {"ControlFlowGraph"};
+	BOOST_CHECK(!standalone.pipelineMatchAll());
+	std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestRunReport) {
+	using namespace IdiomMatcher;
+	msg = printf;
+	typedef rapidjson::GenericDocument<rapidjson::ASCII<>, rapidjson::MemoryPoolAllocator<>, rapidjson::MemoryPoolAllocator<>> DocumentType;
+	auto readReport = [](const std::string &path, DocumentType &d) {
+		std::ifstream file(path);
+		std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		d.Parse(json.c_str());
+		std::remove(path.c_str());
+		return !d.HasParseError() && d.IsObject();
+	};
+
+	// a phase measures the time between construction and finish
+	RunReport report;
+	report.executableName = "binary";
+	report.matcherName = "Naive";
+	report.threadCount = 3;
+	report.matchCount = 7;
+	{
+		RunReport::PhaseTimer timer(report, "work");
+		auto start = std::chrono::steady_clock::now();
+		volatile uint64_t sum = 0;
+		while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20)) {
+			sum = sum + 1;
+		}
+	}
+	BOOST_REQUIRE_EQUAL(report.phases.size(), 1);
+	BOOST_CHECK_EQUAL(report.phases[0].name, "work");
+	BOOST_CHECK_GE(report.phases[0].realTime, 0.02);
+	BOOST_CHECK_GT(report.phases[0].cpuTime, 0);
+	BOOST_REQUIRE_EQUAL(report.phases[0].threadCPUTimes.size(), 1);
+	BOOST_CHECK_GT(report.phases[0].threadCPUTimes[0], 0);
+
+	const std::string path = report.reportPathForExecutablePath("MatchingTestReport.json");
+	BOOST_CHECK_EQUAL(path, "MatchingTestReport_report_Naive.json");
+	BOOST_REQUIRE(report.writeToFilePath(path));
+	DocumentType d;
+	BOOST_REQUIRE(readReport(path, d));
+	BOOST_CHECK_EQUAL(std::string(d["executableName"].GetString()), "binary");
+	BOOST_CHECK_EQUAL(std::string(d["matcherName"].GetString()), "Naive");
+	BOOST_CHECK_EQUAL(d["threadCount"].GetUint(), 3);
+	BOOST_CHECK_EQUAL(d["matchCount"].GetUint64(), 7);
+	BOOST_REQUIRE(d["phases"].IsArray() && d["phases"].Size() == 1);
+	BOOST_CHECK_EQUAL(std::string(d["phases"][0]["name"].GetString()), "work");
+	BOOST_CHECK_EQUAL(d["phases"][0]["realTime"].GetDouble(), report.phases[0].realTime);
+	BOOST_CHECK_EQUAL(d["phases"][0]["threadCount"].GetUint(), 1);
+	BOOST_CHECK(d.HasMember("hardwareConcurrency") && d.HasMember("peakResidentBytes") && d.HasMember("chunks"));
+
+	// the thread count is the concurrency of the matcher, also when all matches are cached
+	SyntheticDisassemblyOptions options;
+	options.instructionCount = 1 << 12;
+	const std::string dumpPath = "MatchingTestReport_dump.json";
+	SyntheticDisassemblerAPI syntheticAPI(options, dumpPath);
+	BOOST_REQUIRE(dumpDisassemblyToFilePath(dumpPath, syntheticAPI));
+	const std::string cachePath = "MatchingTestReportCache";
+	BOOST_REQUIRE(MatchCache::createDirectory(cachePath));
+	IdiomMatcherStandalone standalone;
+	standalone.patterns = syntheticAPI.patterns();
+	standalone.disassemblyFilePath = dumpPath;
+	standalone.matcherQueue = {"Naive"};
+	standalone.writeRunReport = true;
+	standalone.matchCachePath = cachePath;
+	DumpDisassemblerAPI api(dumpPath);
+	unsigned hardwareConcurrency = std::thread::hardware_concurrency();
+	const unsigned expectedThreadCount = 1 < hardwareConcurrency ? hardwareConcurrency - 1 : 1;
+	const std::string reportPath = "MatchingTestReport_dump_report_Naive.json";
+	for (int run = 0; run < 2; ++run) {
+		standalone.matchAll(api);
+		DocumentType runReport;
+		BOOST_REQUIRE(readReport(reportPath, runReport));
+		BOOST_CHECK_EQUAL(runReport["threadCount"].GetUint(), expectedThreadCount);
+		BOOST_CHECK_EQUAL(runReport["matchCount"].GetUint64(), syntheticAPI.plantedIdiomCount());
+		bool hasMatchPhase = false;
+		for (rapidjson::SizeType i = 0; i < runReport["phases"].Size(); ++i) {
+			hasMatchPhase |= std::string(runReport["phases"][i]["name"].GetString()) == "match";
+		}
+		BOOST_CHECK(hasMatchPhase);
+	}
+
+	// every binary of a batch gets its report with the dump of the binary
+	const std::string manifestPath = "MatchingTestReport_manifest.txt";
+	std::ofstream(manifestPath) << dumpPath << "\n";
+	IdiomMatcherStandalone batch;
+	batch.patterns = syntheticAPI.patterns();
+	batch.matcherQueue = {"Naive"};
+	batch.writeRunReport = true;
+	batch.threadBudget = 2;
+	batch.batchPath = manifestPath;
+	BOOST_REQUIRE(batch.batchMatchAll());
+	DocumentType batchReport;
+	BOOST_REQUIRE(readReport(reportPath, batchReport));
+	BOOST_CHECK_EQUAL(std::string(batchReport["dump"]["path"].GetString()), dumpPath);
+	BOOST_CHECK_EQUAL(batchReport["threadCount"].GetUint(), 2);
+	BOOST_CHECK_EQUAL(batchReport["matchCount"].GetUint64(), syntheticAPI.plantedIdiomCount());
+	BOOST_CHECK_EQUAL(batchReport["chunks"]["count"].GetUint64(), 2);
+	std::vector<std::string> phaseNames;
+	for (rapidjson::SizeType i = 0; i < batchReport["phases"].Size(); ++i) {
+		phaseNames.push_back(batchReport["phases"][i]["name"].GetString());
+	}
+	BOOST_CHECK(phaseNames == std::vector<std::string>({"load", "match", "persist"}));
+	std::remove(manifestPath.c_str());
+
+	std::remove(MatchPersistence("", "Naive", "", 0, 0, Matches()).matchPathForExecutablePath(dumpPath).c_str());
+	std::remove(dumpPath.c_str());
+	if (DIR *directory = opendir(cachePath.c_str())) {
+		while (struct dirent *entry = readdir(directory)) {
+			std::remove((cachePath + "/" + entry->d_name).c_str());
+		}
+		closedir(directory);
+	}
+	rmdir(cachePath.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestCombinedMatchingSameAsSingle) {
+	using namespace IdiomMatcher;
+
+	auto document = documentFromJSON(*disassemblyJSON());
+	DumpDisassemblerAPI api(document,"");
+	Patterns patterns;
+	patterns.push_back(patternFromJSON(*patternJSON()));
+
+	NaiveMatching naive;
+	ControlFlowGraphMatching controlFlow;
+	DependenceGraphMatching dependence;
+	std::vector<Matching *> matchers = {&naive, &controlFlow, &dependence};
+	const EA endEA(api.maxInstructionEA().getValue() + 1);
+
+	typedef std::vector<std::pair<uintmax_t, uintmax_t> > Found;
+	std::vector<Found> single(matchers.size());
+	for (size_t i = 0; i < matchers.size(); ++i) {
+		matchers[i]->prepareForPatterns(patterns);
+		matchers[i]->searchForPatterns(patterns, api, [&single, i](const Pattern &, const EA &start, const EA &end, const Matching::ExtractedValuesMap &) -> bool {
+			single[i].push_back(std::make_pair(start.getValue(), end.getValue()));
+			return true;
+		}, api.minInstructionEA(), endEA);
+	}
+
+	CombinedMatching combined(matchers);
+	combined.prepareForPatterns(patterns);
+	std::vector<Found> together(matchers.size());
+	combined.searchForPatterns(patterns, api, [&together](size_t matcherIndex, const Pattern &, const EA &start, const EA &end, const Matching::ExtractedValuesMap &) -> bool {
+		together[matcherIndex].push_back(std::make_pair(start.getValue(), end.getValue()));
+		return true;
+	}, api.minInstructionEA(), endEA);
+
+	BOOST_CHECK(!single[2].empty());
+	for (size_t i = 0; i < matchers.size(); ++i) {
+		BOOST_CHECK(single[i] == together[i]);
+	}
+}
+
+// The pattern of patternJSON with the EAs of the instructions it was made of. Without EAs
+// the pattern graph only has the first instruction, the xrefs don't reach the others.
+IdiomMatcher::Pattern_ref connectedPattern() {
+	using namespace IdiomMatcher;
+	auto pattern = patternFromJSON(*patternJSON());
+	const EA::EAValue_t eas[] = {134519104, 135234381, 135234385, 135234387};
+	Instructions instructions;
+	for (size_t i = 0; i < pattern->getInstructions().size(); ++i) {
+		auto &instruction = *pattern->getInstructions()[i];
+		instructions.push_back(std::make_shared<Instruction>(instruction.getMnemonic(), instruction.getOperands(), instruction.getXrefs(), instruction.getSize(), EA(eas[i]), instruction.getIsRegex()));
+	}
+	return std::make_shared<Pattern>(pattern->getName(), instructions, pattern->getArchitecture());
+}
+
+BOOST_AUTO_TEST_CASE(TestSharedPatternPrefixesSameMatches) {
+	using namespace IdiomMatcher;
+
+	auto document = documentFromJSON(*disassemblyJSON());
+	DumpDisassemblerAPI api(document,"");
+	auto pattern = connectedPattern();
+	// variants sharing all but the last instruction, one of them still matches
+	Patterns patterns(1, pattern);
+	for (int variant = 0; variant < 4; ++variant) {
+		Instructions instructions = pattern->getInstructions();
+		auto &last = *instructions.back();
+		auto mnemonic = variant == 0 ? last.getMnemonic() : last.getMnemonic() + "_variant";
+		instructions.back() = std::make_shared<Instruction>(mnemonic, last.getOperands(), last.getXrefs(), last.getSize(), last.getEA(), last.getIsRegex());
+		patterns.push_back(std::make_shared<Pattern>("variant" + std::to_string(variant), instructions, pattern->getArchitecture()));
+	}
+	const EA endEA(api.maxInstructionEA().getValue() + 1);
+
+	typedef std::vector<std::tuple<std::string, uintmax_t, uintmax_t> > Found;
+	for (int dependence = 0; dependence < 2; ++dependence) {
+		Found found[2];
+		for (int share = 0; share < 2; ++share) {
+			std::unique_ptr<ControlFlowGraphMatching> matcher(dependence ? new DependenceGraphMatching() : new ControlFlowGraphMatching());
+			matcher->sharePatternPrefixes = share != 0;
+			matcher->prepareForPatterns(patterns);
+			matcher->searchForPatterns(patterns, api, [&found, share](const Pattern &matched, const EA &start, const EA &end, const Matching::ExtractedValuesMap &) -> bool {
+				found[share].push_back(std::make_tuple(matched.getName(), start.getValue(), end.getValue()));
+				return true;
+			}, api.minInstructionEA(), endEA);
+		}
+		BOOST_CHECK(found[0] == found[1]);
+		BOOST_CHECK(std::any_of(found[1].begin(), found[1].end(), [](const Found::value_type &match) { return std::get<0>(match) == "variant0"; }));
+		BOOST_CHECK(std::none_of(found[1].begin(), found[1].end(), [](const Found::value_type &match) { return std::get<0>(match) == "variant1"; }));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(TestWindowMemoSameMatches) {
+	using namespace IdiomMatcher;
+
+	auto document = documentFromJSON(*disassemblyJSON());
+	DumpDisassemblerAPI api(document,"");
+	Patterns patterns(1, patternFromJSON(*patternJSON()));
+	const EA endEA(api.maxInstructionEA().getValue() + 1);
+
+	typedef std::vector<std::tuple<uintmax_t, uintmax_t, std::string> > Found;
+	for (int dependence = 0; dependence < 2; ++dependence) {
+		std::unique_ptr<ControlFlowGraphMatching> matcher(dependence ? new DependenceGraphMatching() : new ControlFlowGraphMatching());
+		matcher->memoizeWindows = false;
+		matcher->prepareForPatterns(patterns);
+		// the second memoized search only sees windows of the first one
+		Found found[3];
+		uint64_t vf2Calls[3];
+		for (int search = 0; search < 3; ++search) {
+			if (search == 1) {
+				matcher->memoizeWindows = true;
+				matcher->prepareForPatterns(patterns);
+			}
+			PatternProfiler profiler;
+			matcher->setProfiler(&profiler);
+			matcher->searchForPatterns(patterns, api, [&found, search](const Pattern &, const EA &start, const EA &end, const Matching::ExtractedValuesMap &extractedValues) -> bool {
+				std::string values;
+				for (auto &value : extractedValues) {
+					values += value.first + "=" + value.second + " ";
+				}
+				found[search].push_back(std::make_tuple(start.getValue(), end.getValue(), values));
+				return true;
+			}, api.minInstructionEA(), endEA);
+			matcher->setProfiler(nullptr);
+			vf2Calls[search] = profiler.profileForPattern(patterns.front().get()).vf2Calls;
+		}
+		BOOST_CHECK(!found[0].empty());
+		BOOST_CHECK(found[0] == found[1]);
+		BOOST_CHECK(found[0] == found[2]);
+		BOOST_CHECK(vf2Calls[1] > 0);
+		BOOST_CHECK_EQUAL(vf2Calls[2], 0);
+	}
+}
+
+// replays the mapping VF2 finds in an instruction graph in another graph
+struct ReplayingMatching : public IdiomMatcher::ControlFlowGraphMatching {
+	bool replays(const IdiomMatcher::Pattern_ref &pattern, const IdiomMatcher::Graph &instructionGraph, const IdiomMatcher::Graph &replayGraph) {
+		using namespace IdiomMatcher;
+		prepareForPatterns(Patterns(1, pattern));
+		auto &container = patternGraphForPattern(pattern);
+		EA endEA = InvalidEA;
+		Matching::ExtractedValuesMap values;
+		std::vector<GraphVertexDescriptor> mapping;
+		if (!matchGraphs(*container.graph, instructionGraph, container.lastPatternVertexDescriptor, &endEA, values, &mapping))
+			return false;
+		std::vector<GraphVertexDescriptor> windowVertices;
+		windowFingerprint(instructionGraph, windowVertices);
+		WindowMatch windowMatch;
+		windowMatch.matched = true;
+		for (auto &vertex : mapping) {
+			windowMatch.mapping.push_back((uint32_t)(std::find(windowVertices.begin(), windowVertices.end(), vertex) - windowVertices.begin()));
+		}
+		std::vector<GraphVertexDescriptor> replayVertices;
+		windowFingerprint(replayGraph, replayVertices);
+		return replayWindowMatch(*container.graph, replayVertices, replayGraph, windowMatch, container.lastPatternVertexDescriptor, &endEA, values);
+	}
+};
+
+BOOST_AUTO_TEST_CASE(TestWindowMemoReplayChecksEdges) {
+	using namespace IdiomMatcher;
+
+	auto document = documentFromJSON(*disassemblyJSON());
+	DumpDisassemblerAPI api(document,"");
+	auto pattern = connectedPattern();
+	EA startEA = InvalidEA;
+	ControlFlowGraphMatching matcher;
+	matcher.prepareForPatterns(Patterns(1, pattern));
+	matcher.searchForPatterns(Patterns(1, pattern), api, [&startEA](const Pattern &, const EA &start, const EA &, const Matching::ExtractedValuesMap &) -> bool {
+		startEA = start;
+		return false;
+	}, api.minInstructionEA(), EA(api.maxInstructionEA().getValue() + 1));
+	BOOST_REQUIRE(!(startEA == InvalidEA));
+
+	Graph instructionGraph;
+	fillCFG(instructionGraph, startEA, (int)pattern->getInstructions().size(), [&api](const EA &ea) -> Instruction_ref {
+		return std::make_shared<Instruction>(api.instructionForEA(ea));
+	});
+	// the same vertices without edges, as a window with a colliding fingerprint could have
+	Graph edgelessGraph;
+	BGL_FORALL_VERTICES (vertex, instructionGraph, Graph) {
+		edgelessGraph.add_vertex(instructionGraph[vertex]);
+	}
+	ReplayingMatching replaying;
+	BOOST_CHECK(replaying.replays(pattern, instructionGraph, instructionGraph));
+	BOOST_CHECK(!replaying.replays(pattern, instructionGraph, edgelessGraph));
+}
+
+BOOST_AUTO_TEST_CASE(TestSearchBudgetAbandonsAttempts) {
+	using namespace IdiomMatcher;
+
+	auto document = documentFromJSON(*disassemblyJSON());
+	DumpDisassemblerAPI api(document,"");
+	Patterns patterns(1, patternFromJSON(*patternJSON()));
+	const EA endEA(api.maxInstructionEA().getValue() + 1);
+
+	typedef std::vector<std::pair<uintmax_t, uintmax_t> > Found;
+	Found found[3];
+	const uint64_t maxStates[3] = {0, 1000000, 1};
+	for (int budget = 0; budget < 3; ++budget) {
+		DependenceGraphMatching matcher;
+		matcher.maxStatesPerAttempt = maxStates[budget];
+		matcher.prepareForPatterns(patterns);
+		PatternProfiler profiler;
+		matcher.setProfiler(&profiler);
+		matcher.searchForPatterns(patterns, api, [&found, budget](const Pattern &, const EA &start, const EA &end, const Matching::ExtractedValuesMap &) -> bool {
+			found[budget].push_back(std::make_pair(start.getValue(), end.getValue()));
+			return true;
+		}, api.minInstructionEA(), endEA);
+		matcher.setProfiler(nullptr);
+
+		auto &profile = profiler.profileForPattern(patterns.front().get());
+		BOOST_CHECK_EQUAL(profile.budgetExhausted, matcher.getExhaustedAttemptCount());
+		if (budget < 2) {
+			BOOST_CHECK_EQUAL(matcher.getExhaustedAttemptCount(), 0);
+		} else {
+			// a match needs a state per pattern instruction
+			BOOST_CHECK(matcher.getExhaustedAttemptCount() > 0);
+			BOOST_CHECK(matcher.getExhaustedAttemptCount() <= profile.vf2Calls);
+			BOOST_CHECK(!matcher.getExhaustedStartEAs().empty());
+		}
+	}
+	BOOST_CHECK(!found[0].empty());
+	BOOST_CHECK(found[0] == found[1]);
+	BOOST_CHECK(found[2].empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestXrefFanOutSummary) {
+	using namespace IdiomMatcher;
+
+	auto document = documentFromJSON(*disassemblyJSON());
+	DumpDisassemblerAPI api(document,"");
+	auto instructionForEA = [&api](const EA &ea) -> Instruction_ref {
+		return std::make_shared<Instruction>(api.instructionForEA(ea));
+	};
+	const EA switchEA(135234387);
+
+	// the jmp has 18 code xrefs, 4 are followed, the cmp is the only one in the dump
+	Graph graph;
+	fillCFG(graph, switchEA, 1, instructionForEA, 4);
+	size_t summaryCount = 0;
+	BGL_FORALL_VERTICES (vertex, graph, Graph) {
+		auto &instruction = *graph[vertex];
+		if (instruction.getMnemonic() != XrefSummaryMnemonic)
+			continue;
+		++summaryCount;
+		BOOST_REQUIRE_EQUAL(instruction.getOperands().size(), 1);
+		BOOST_CHECK_EQUAL(instruction.getOperands().front()->getText(), "14");
+	}
+	BOOST_CHECK_EQUAL(summaryCount, 1);
+	BOOST_CHECK_EQUAL(boost::num_vertices(graph), 3);
+
+	CFGWindow window;
+	fillCFGWindow(window, switchEA, 1, instructionForEA, 4);
+	Graph windowGraph;
+	fillCFGFromWindow(windowGraph, window, 1);
+	BOOST_CHECK_EQUAL(boost::num_vertices(windowGraph), boost::num_vertices(graph));
+	BOOST_CHECK_EQUAL(boost::num_edges(windowGraph), boost::num_edges(graph));
+
+	// the switch idiom is still matched with a single case followed
+	Patterns patterns(1, patternFromJSON(*patternJSON()));
+	DependenceGraphMatching matching;
+	matching.maxXrefFanOut = 1;
+	matching.prepareForPatterns(patterns);
+	bool matched = false;
+	matching.testForPatternsStartingAtEA(patterns, api.minEA(), api, [&matched](const Pattern &, const EA &, const EA &, const Matching::ExtractedValuesMap &) -> bool {
+		matched = true;
+		return true;
+	});
+	BOOST_CHECK(matched);
+}
+
+BOOST_AUTO_TEST_CASE(TestCascadeSameMatches) {
+	using namespace IdiomMatcher;
+
+	auto document = documentFromJSON(*disassemblyJSON());
+	DumpDisassemblerAPI api(document,"");
+	auto pattern = connectedPattern();
+	// shares the first instruction, the last one has a mnemonic the dump doesn't have
+	Instructions decoyInstructions(pattern->getInstructions());
+	auto &last = *decoyInstructions.back();
+	decoyInstructions.back() = std::make_shared<Instruction>("decoy", last.getOperands(), last.getXrefs(), last.getSize(), last.getEA());
+	auto decoy = std::make_shared<Pattern>("decoy", decoyInstructions, pattern->getArchitecture());
+	Patterns patterns = {pattern, decoy};
+	const EA endEA(api.maxInstructionEA().getValue() + 1);
+
+	typedef std::vector<std::tuple<std::string, uintmax_t, uintmax_t, std::string> > Found;
+	auto search = [&](Matching &matcher, Found &found) {
+		matcher.prepareForPatterns(patterns);
+		matcher.searchForPatterns(patterns, api, [&found](const Pattern &pattern, const EA &start, const EA &end, const Matching::ExtractedValuesMap &extractedValues) -> bool {
+			std::string values;
+			for (auto &value : extractedValues) {
+				values += value.first + "=" + value.second + " ";
+			}
+			found.push_back(std::make_tuple(pattern.getName(), start.getValue(), end.getValue(), values));
+			return true;
+		}, api.minInstructionEA(), endEA);
+	};
+
+	for (int dependence = 0; dependence < 2; ++dependence) {
+		std::unique_ptr<ControlFlowGraphMatching> matcher(dependence ? new DependenceGraphMatching() : new ControlFlowGraphMatching());
+		Found found;
+		search(*matcher, found);
+
+		CascadeMatching cascade(dependence ? new DependenceGraphMatching() : new ControlFlowGraphMatching());
+		BOOST_CHECK_EQUAL(cascade.getName(), "Cascade" + matcher->getName());
+		PatternProfiler profiler;
+		cascade.setProfiler(&profiler);
+		Found cascadeFound;
+		search(cascade, cascadeFound);
+		cascade.setProfiler(nullptr);
+
+		BOOST_CHECK(!found.empty());
+		BOOST_CHECK(found == cascadeFound);
+		// the decoy passes the first instruction filter wherever the pattern does, but never gets to VF2
+		auto &decoyProfile = profiler.profileForPattern(decoy.get());
+		BOOST_CHECK_EQUAL(decoyProfile.passedFirstInstruction, profiler.profileForPattern(pattern.get()).passedFirstInstruction);
+		BOOST_CHECK_EQUAL(decoyProfile.vf2Calls, 0);
+		BOOST_CHECK_EQUAL(cascade.getRejectedCandidateCount(), decoyProfile.passedFirstInstruction);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(TestCascadeUnreachablePatternInstructions) {
+	using namespace IdiomMatcher;
+
+	auto document = documentFromJSON(*disassemblyJSON());
+	DumpDisassemblerAPI api(document,"");
+	// the instructions of the fixture pattern have no EAs, its graph only has the first one,
+	// a mnemonic the dump doesn't have in the others doesn't change the matches
+	auto pattern = patternFromJSON(*patternJSON());
+	Instructions unreachableInstructions(pattern->getInstructions());
+	auto &last = *unreachableInstructions.back();
+	unreachableInstructions.back() = std::make_shared<Instruction>("decoy", last.getOperands(), last.getXrefs(), last.getSize(), last.getEA());
+	Patterns patterns = {std::make_shared<Pattern>("unreachable", unreachableInstructions, pattern->getArchitecture())};
+	const EA endEA(api.maxInstructionEA().getValue() + 1);
+
+	auto search = [&](Matching &matcher) {
+		std::vector<std::pair<uintmax_t, uintmax_t> > found;
+		matcher.prepareForPatterns(patterns);
+		matcher.searchForPatterns(patterns, api, [&found](const Pattern &, const EA &start, const EA &end, const Matching::ExtractedValuesMap &) -> bool {
+			found.push_back(std::make_pair(start.getValue(), end.getValue()));
+			return true;
+		}, api.minInstructionEA(), endEA);
+		return found;
+	};
+
+	for (int dependence = 0; dependence < 2; ++dependence) {
+		std::unique_ptr<ControlFlowGraphMatching> matcher(dependence ? new DependenceGraphMatching() : new ControlFlowGraphMatching());
+		CascadeMatching cascade(dependence ? new DependenceGraphMatching() : new ControlFlowGraphMatching());
+		auto found = search(*matcher);
+		BOOST_CHECK(!found.empty());
+		BOOST_CHECK(found == search(cascade));
+		BOOST_CHECK_EQUAL(cascade.getRejectedCandidateCount(), 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(TestPatternProfilerCounts) {
+	using namespace IdiomMatcher;
+
+	auto document = documentFromJSON(*disassemblyJSON());
+	DumpDisassemblerAPI api(document,"");
+	Patterns patterns;
+	patterns.push_back(patternFromJSON(*patternJSON()));
+	const EA endEA(api.maxInstructionEA().getValue() + 1);
+	const size_t lineCount = document.getDisassemblyLines().size();
+
+	NaiveMatching naive;
+	DependenceGraphMatching dependence;
+	for (Matching *matcher : std::vector<Matching *>{&naive, &dependence}) {
+		PatternProfiler profiler;
+		matcher->prepareForPatterns(patterns);
+		matcher->setProfiler(&profiler);
+		size_t matchCount = 0;
+		matcher->searchForPatterns(patterns, api, [&matchCount](const Pattern &, const EA &, const EA &, const Matching::ExtractedValuesMap &) -> bool {
+			matchCount++;
+			return true;
+		}, api.minInstructionEA(), endEA);
+		matcher->setProfiler(nullptr);
+
+		auto report = profiler.report();
+		auto it = std::find_if(report.begin(), report.end(), [&patterns](const PatternProfiler::Report::value_type &entry) { return entry.first == patterns.front()->getName(); });
+		BOOST_REQUIRE(it != report.end());
+		auto &profile = it->second;
+		BOOST_CHECK_EQUAL(profile.testedStartEAs, lineCount);
+		BOOST_CHECK(profile.passedFirstInstruction >= profile.matches);
+		BOOST_CHECK_EQUAL(profile.matches, matchCount);
+		BOOST_CHECK(profile.instructionTests > 0);
+		BOOST_CHECK_EQUAL(profile.vf2Calls, matcher == &naive ? 0 : profile.passedFirstInstruction);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(TestAllocationTrackerScopes) {
+	using namespace IdiomMatcher;
+
+	auto document = documentFromJSON(*disassemblyJSON());
+	EA minEA = InvalidEA;
+	auto indexing = AllocationTracker::measure("test index", [&document, &minEA]() {
+		DumpDisassemblerAPI api(document,"");
+		minEA = api.minInstructionEA();
+	});
+	BOOST_CHECK(!(minEA == InvalidEA));
+	// everything the API allocated is freed with it
+	BOOST_CHECK(indexing.allocationCount >= document.getDisassemblyLines().size());
+	BOOST_CHECK_EQUAL(indexing.freeCount, indexing.allocationCount);
+	BOOST_CHECK_EQUAL(indexing.freedBytes, indexing.allocatedBytes);
+	BOOST_CHECK(indexing.peakBytes > 0);
+
+	std::vector<int> *kept = nullptr;
+	auto outer = AllocationTracker::measure("test outer", [&kept]() {
+		AllocationTracker::Scope inner("test inner");
+		kept = new std::vector<int>(100);
+	});
+	BOOST_CHECK_EQUAL(outer.allocationCount, 0);
+	auto inner = AllocationTracker::statisticsForTag("test inner");
+	BOOST_CHECK_EQUAL(inner.allocationCount, 2);
+	BOOST_CHECK(inner.allocatedBytes >= sizeof(std::vector<int>) + 100 * sizeof(int));
+	BOOST_CHECK_EQUAL(inner.freeCount, 0);
+	// not counted while disabled
+	delete kept;
+	BOOST_CHECK_EQUAL(AllocationTracker::statisticsForTag("test inner").freeCount, 0);
+
+	// a free is charged to the tag of the allocation
+	auto allocating = AllocationTracker::measure("test allocating", [&kept]() {
+		kept = new std::vector<int>(100);
+	});
+	auto freeing = AllocationTracker::measure("test freeing", [&kept]() {
+		delete kept;
+	});
+	BOOST_CHECK_EQUAL(freeing.freeCount, 0);
+	auto allocated = AllocationTracker::statisticsForTag("test allocating");
+	BOOST_CHECK_EQUAL(allocated.freeCount, allocating.allocationCount);
+	BOOST_CHECK_EQUAL(allocated.freedBytes, allocating.allocatedBytes);
+	BOOST_CHECK(allocated.peakBytes >= sizeof(std::vector<int>) + 100 * sizeof(int));
+}
+
+BOOST_AUTO_TEST_CASE(TestMatchStreamRoundTrip) {
+	using namespace IdiomMatcher;
+
+	for (auto format : {MatchStreamWriter::FormatNDJSON, MatchStreamWriter::FormatBinary}) {
+		MatchStreamWriter writer("binary", "DependenceGraph", "metapc", format);
+		writer.bufferSize = 16;
+		const std::string path = writer.matchPathForExecutablePath("MatchingTest.json");
+		BOOST_REQUIRE(writer.openFilePath(path));
+		{
+			MatchStreamWriter::Buffer buffer(writer);
+			for (int i = 0; i < 100; ++i) {
+				buffer.addMatch(Match(EA(0x1000 + i*4), EA(0x1000 + i*4 + 8), i % 2 ? "switch" : "modulo"));
+			}
+		}
+
+		bool complete = true;
+		auto unfinished = readMatchStreamFromFilePath(path, &complete);
+		BOOST_CHECK(!complete);
+		BOOST_CHECK_EQUAL(unfinished.getMatches().size(), 100);
+
+		BOOST_REQUIRE(writer.finish(1.5, 3.0));
+		auto persistence = readMatchStreamFromFilePath(path, &complete);
+		BOOST_CHECK(complete);
+		BOOST_CHECK_EQUAL(persistence.getMatcherName(), "DependenceGraph");
+		BOOST_CHECK_EQUAL(persistence.getExecutableArchitecture(), "metapc");
+		BOOST_CHECK_EQUAL(persistence.getRealTime(), 1.5);
+		BOOST_CHECK_EQUAL(persistence.getCpuTime(), 3.0);
+		BOOST_REQUIRE_EQUAL(persistence.getMatches().size(), 100);
+		auto &match = persistence.getMatches()[3];
+		BOOST_CHECK(match->getStartEA() == EA(0x100c));
+		BOOST_CHECK(match->getEndEA() == EA(0x1014));
+		BOOST_CHECK_EQUAL(match->getPatternName(), "switch");
+		std::remove(path.c_str());
+	}
+
+	// a value of the wrong type ends the matches like a truncated line
+	const std::string path = "MatchingTestMistyped_matches.ndjson";
+	std::ofstream(path) << "{\"executableName\":\"binary\",\"matcherName\":\"Naive\",\"executableArchitecture\":\"metapc\"}\n"
+		<< "{\"startEA\":4096,\"endEA\":4104,\"patternName\":\"switch\"}\n"
+		<< "{\"startEA\":\"4112\",\"endEA\":4120,\"patternName\":\"switch\"}\n"
+		<< "{\"startEA\":4128,\"endEA\":4136,\"patternName\":\"switch\"}\n"
+		<< "{\"realTime\":1.5,\"cpuTime\":3.0}\n";
+	bool complete = true;
+	auto mistyped = readMatchStreamFromFilePath(path, &complete);
+	BOOST_CHECK(!complete);
+	BOOST_CHECK_EQUAL(mistyped.getMatches().size(), 1);
+	std::ofstream(path) << "{\"executableName\":\"binary\",\"matcherName\":7,\"executableArchitecture\":\"metapc\"}\n"
+		<< "{\"realTime\":\"1.5\",\"cpuTime\":3.0}\n";
+	auto mistypedHead = readMatchStreamFromFilePath(path, &complete);
+	BOOST_CHECK(!complete);
+	BOOST_CHECK(mistypedHead.getMatcherName().empty());
+	std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestBatchDirectoryFindsCompressedDumps) {
+	using namespace IdiomMatcher;
+
+	// the compressed dump is only recognized by its content, it has no suffix of its own
+	const std::string directory = "MatchingTestBatch";
+	BOOST_REQUIRE(MatchCache::createDirectory(directory));
+	const std::string compressedPath = directory + "/binary.imcd";
+	const std::string jsonPath = directory + "/other_dump.json";
+	const std::string otherPath = directory + "/notes.txt";
+	BOOST_REQUIRE(writeCompressedDocumentToFilePath(compressedPath, documentFromJSON(*disassemblyJSON()), 2));
+	std::ofstream(jsonPath) << "{}";
+	std::ofstream(otherPath) << "notes";
+
+	IdiomMatcherStandalone standalone;
+	standalone.batchPath = directory;
+	auto paths = standalone.batchFilePaths();
+	BOOST_REQUIRE_EQUAL(paths.size(), 2);
+	BOOST_CHECK_EQUAL(paths[0], compressedPath);
+	BOOST_CHECK_EQUAL(paths[1], jsonPath);
+
+	std::remove(compressedPath.c_str());
+	std::remove(jsonPath.c_str());
+	std::remove(otherPath.c_str());
+	rmdir(directory.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestMatchCacheEntries) {
+	using namespace IdiomMatcher;
+
+	const std::string directory = "MatchingTestCache";
+	BOOST_REQUIRE(MatchCache::createDirectory(directory));
+	auto pattern = patternFromJSON(*patternJSON());
+	const uint64_t dumpKey = MatchCache::dumpKeyForRange(42, EA(0x1000), EA(0x2000));
+	MatchCache cache(directory, "DependenceGraph", dumpKey);
+	Matches matches;
+	for (int i = 3; i >= 0; --i) {
+		matches.push_back(std::make_shared<Match>(EA(0x1000 + i*16), EA(0x1000 + i*16 + 8), pattern->getName()));
+	}
+	BOOST_REQUIRE(cache.writeMatches(*pattern, matches));
+
+	Matches cachedMatches;
+	BOOST_REQUIRE(cache.readMatches(*pattern, cachedMatches));
+	BOOST_REQUIRE_EQUAL(cachedMatches.size(), 4);
+	BOOST_CHECK(cachedMatches[1]->getStartEA() == EA(0x1010));
+	BOOST_CHECK(cachedMatches[1]->getEndEA() == EA(0x1018));
+	BOOST_CHECK_EQUAL(cachedMatches[1]->getPatternName(), pattern->getName());
+
+	// other matcher, other range and a changed pattern have no entry
+	Matches missed;
+	BOOST_CHECK(!MatchCache(directory, "Naive", dumpKey).readMatches(*pattern, missed));
+	BOOST_CHECK(!MatchCache(directory, "DependenceGraph", MatchCache::dumpKeyForRange(42, EA(0x1000), EA(0x3000))).readMatches(*pattern, missed));
+	Instructions instructions(pattern->getInstructions().begin(), pattern->getInstructions().end() - 1);
+	Pattern changed(pattern->getName(), instructions, pattern->getArchitecture());
+	BOOST_CHECK(!cache.readMatches(changed, missed));
+	BOOST_CHECK(missed.empty());
+
+	// patterns without matches are cached too
+	BOOST_REQUIRE(cache.writeMatches(changed, Matches()));
+	BOOST_CHECK(cache.readMatches(changed, missed));
+	BOOST_CHECK(missed.empty());
+
+	std::remove(cache.pathForPattern(*pattern).c_str());
+	std::remove(cache.pathForPattern(changed).c_str());
+	std::remove(directory.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestDumpDiffShiftedCode) {
+	using namespace IdiomMatcher;
+
+	// the new version has two instructions inserted before old instruction 20 and old instruction 30 changed
+	DisassemblyLines oldLines;
+	DisassemblyLines newLines;
+	for (int i = 0; i < 40; ++i) {
+		EA oldEA(0x1000 + i*4);
+		oldLines.push_back(std::make_shared<DisassemblyLine>(oldEA, std::make_shared<Instruction>("op" + std::to_string(i), Operands(), XRefs(), 4, oldEA), ""));
+		if (i == 20) {
+			for (int j = 0; j < 2; ++j) {
+				EA insertedEA(0x1000 + (i + j)*4);
+				newLines.push_back(std::make_shared<DisassemblyLine>(insertedEA, std::make_shared<Instruction>("nop", Operands(), XRefs(), 4, insertedEA), ""));
+			}
+		}
+		EA newEA(oldEA.getValue() + (i < 20 ? 0 : 8));
+		newLines.push_back(std::make_shared<DisassemblyLine>(newEA, std::make_shared<Instruction>(i == 30 ? "changed" : "op" + std::to_string(i), Operands(), XRefs(), 4, newEA), ""));
+	}
+	DumpDisassemblerAPI oldAPI(DisassemblyDocument("binary", "metapc", "test", EA(0x1000), EA(0x10a0), oldLines));
+	DumpDisassemblerAPI newAPI(DisassemblyDocument("binary", "metapc", "test", EA(0x1000), EA(0x10a8), newLines));
+	DumpDiff diff(oldAPI, EA(0x1000), EA(0x10a0), newAPI, EA(0x1000), EA(0x10a8));
+
+	BOOST_CHECK_EQUAL(diff.getNewInstructionCount(), 42);
+	BOOST_CHECK_EQUAL(diff.getUnchangedInstructionCount(), 39);
+	BOOST_CHECK(diff.translate(EA(0x1000 + 5*4)) == EA(0x1000 + 5*4));
+	BOOST_CHECK(diff.translate(EA(0x1000 + 25*4)) == EA(0x1000 + 27*4));
+	BOOST_CHECK(diff.translate(EA(0x1000 + 30*4)) == InvalidEA);
+
+	auto ranges = diff.changedRanges(0);
+	BOOST_REQUIRE_EQUAL(ranges.size(), 2);
+	BOOST_CHECK(ranges[0].first == EA(0x1000 + 20*4) && ranges[0].second == EA(0x1000 + 22*4));
+	BOOST_CHECK(ranges[1].first == EA(0x1000 + 32*4) && ranges[1].second == EA(0x1000 + 33*4));
+	auto widened = diff.changedRanges(2);
+	BOOST_REQUIRE_EQUAL(widened.size(), 2);
+	BOOST_CHECK(widened[0].first == EA(0x1000 + 18*4) && widened[0].second == EA(0x1000 + 24*4));
+	BOOST_CHECK(widened[1].first == EA(0x1000 + 30*4) && widened[1].second == EA(0x1000 + 35*4));
+}
+
+BOOST_AUTO_TEST_CASE(TestIncrementalMatchGraphWindows) {
+	using namespace IdiomMatcher;
+	msg = printf;
+
+	// two copies of jumps to a jump to a push, the first one is a pop in the previous version
+	auto documentWithTarget = [](const std::string &targetMnemonic) {
+		DisassemblyLines lines;
+		auto addLine = [&lines](EA::EAValue_t value, const std::string &mnemonic, EA::EAValue_t target) {
+			EA ea(value);
+			XRefs xrefs;
+			if (target != 0)
+				xrefs.push_back(std::make_shared<XRef>(EA(target), false, true));
+			lines.push_back(std::make_shared<DisassemblyLine>(ea, std::make_shared<Instruction>(mnemonic, Operands(), xrefs, 4, ea), ""));
+		};
+		for (EA::EAValue_t base = 0x1000; base < 0x4000; base += 0x1000) {
+			for (EA::EAValue_t copy = 0; copy < 0x200; copy += 0x100) {
+				for (int i = 0; i < 16; ++i) {
+					EA::EAValue_t ea = base + copy + i*4;
+					if (i == 0 && base < 0x3000)
+						addLine(ea, "jmp", ea + 0x1000);
+					else if (i == 0)
+						addLine(ea, copy == 0 ? targetMnemonic : "push", 0);
+					else
+						addLine(ea, "op" + std::to_string(base + copy + i % 5), 0);
+				}
+			}
+		}
+		return DisassemblyDocument("binary", "metapc", "test", EA(0x1000), EA(0x3140), lines);
+	};
+	Instructions instructions;
+	instructions.push_back(std::make_shared<Instruction>("jmp", Operands(), XRefs(1, std::make_shared<XRef>(EA(0x20), false, true)), 4, EA(0x10)));
+	instructions.push_back(std::make_shared<Instruction>("jmp", Operands(), XRefs(1, std::make_shared<XRef>(EA(0x30), false, true)), 4, EA(0x20)));
+	instructions.push_back(std::make_shared<Instruction>("push", Operands(), XRefs(), 4, EA(0x30)));
+	Patterns patterns(1, std::make_shared<Pattern>("jumps", instructions, "metapc"));
+
+	auto search = [&patterns](DumpDisassemblerAPI &api) {
+		Matches matches;
+		ControlFlowGraphMatching matcher;
+		matcher.prepareForPatterns(patterns);
+		matcher.searchForPatterns(patterns, api, [&matches](const Pattern &pattern, const EA &start, const EA &end, const Matching::ExtractedValuesMap &) -> bool {
+			matches.push_back(std::make_shared<Match>(start, end, pattern.getName()));
+			return true;
+		}, api.minInstructionEA(), EA(api.maxInstructionEA().getValue() + 1));
+		return matches;
+	};
+
+	const std::string previousDumpPath = "MatchingTestPrevious.imcd";
+	const std::string previousMatchesPath = "MatchingTestPrevious_matched_ControlFlowGraph.json";
+	auto previousDocument = documentWithTarget("pop");
+	BOOST_REQUIRE(writeCompressedDocumentToFilePath(previousDumpPath, previousDocument, 1));
+	DumpDisassemblerAPI previousAPI(previousDocument, previousDumpPath);
+	auto previousMatches = search(previousAPI);
+	BOOST_REQUIRE_EQUAL(previousMatches.size(), 1);
+	BOOST_REQUIRE(MatchPersistence("binary", "ControlFlowGraph", "metapc", 0, 0, previousMatches).saveToFilePath(previousMatchesPath));
+
+	// the new match is out of the linear margin of the change, but its window reaches it
+	DumpDisassemblerAPI api(documentWithTarget("push"), "MatchingTestCurrent_dump.json");
+	auto expected = search(api);
+	BOOST_REQUIRE_EQUAL(expected.size(), 2);
+	IdiomMatcherStandalone standalone;
+	standalone.patterns = patterns;
+	standalone.previousDumpPath = previousDumpPath;
+	standalone.previousMatchesPath = previousMatchesPath;
+	BOOST_REQUIRE(standalone.incrementalMatch(api));
+	const std::string matchesPath = "MatchingTestCurrent_dump_matched_ControlFlowGraph.json";
+	auto matches = readMatchesFromFilePath(matchesPath).getMatches();
+	BOOST_REQUIRE_EQUAL(matches.size(), expected.size());
+	for (size_t i = 0; i < matches.size(); ++i) {
+		BOOST_CHECK(matches[i]->getStartEA() == expected[i]->getStartEA());
+		BOOST_CHECK(matches[i]->getEndEA() == expected[i]->getEndEA());
+	}
+
+	std::remove(previousDumpPath.c_str());
+	std::remove(previousMatchesPath.c_str());
+	std::remove(matchesPath.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestIncrementalMatchDisplacementChange) {
+	using namespace IdiomMatcher;
+	msg = printf;
+
+	// distinct filler around a load, only its displacement differs between the versions
+	auto documentWithLoad = [](const std::string &load, uintmax_t displacement) {
+		DisassemblyLines lines;
+		for (int i = 0; i < 64; ++i) {
+			EA ea(0x1000 + i*4);
+			Operands operands;
+			std::string mnemonic = "op" + std::to_string(i);
+			if (i == 30) {
+				mnemonic = "mov";
+				operands = {std::make_shared<Operand>("eax", std::vector<std::string>{"eax"}, true, true, 0),
+							std::make_shared<Operand>(load, std::vector<std::string>{"ebp"}, true, false, displacement)};
+			}
+			lines.push_back(std::make_shared<DisassemblyLine>(ea, std::make_shared<Instruction>(mnemonic, operands, XRefs(), 4, ea), ""));
+		}
+		return DisassemblyDocument("binary", "metapc", "test", EA(0x1000), EA(0x1000 + 63*4), lines);
+	};
+	Operands patternOperands = {std::make_shared<Operand>("eax", std::vector<std::string>{"eax"}),
+								std::make_shared<Operand>("", std::vector<std::string>(), "", "dword ptr \\[ebp\\+8\\]")};
+	Patterns patterns(1, std::make_shared<Pattern>("load", Instructions(1, std::make_shared<Instruction>("mov", patternOperands, XRefs(), 4, InvalidEA)), "metapc"));
+	auto search = [&patterns](DumpDisassemblerAPI &api) {
+		Matches found;
+		NaiveMatching matcher;
+		matcher.searchForPatterns(patterns, api, [&found](const Pattern &pattern, const EA &start, const EA &end, const Matching::ExtractedValuesMap &) -> bool {
+			found.push_back(std::make_shared<Match>(start, end, pattern.getName()));
+			return true;
+		});
+		return found;
+	};
+
+	const std::string previousDumpPath = "MatchingTestPreviousLoad.imcd";
+	const std::string previousMatchesPath = "MatchingTestPreviousLoad_matched_Naive.json";
+	auto previousDocument = documentWithLoad("dword ptr [ebp+8]", 8);
+	BOOST_REQUIRE(writeCompressedDocumentToFilePath(previousDumpPath, previousDocument, 1));
+	DumpDisassemblerAPI previousAPI(previousDocument, previousDumpPath);
+	auto previousMatches = search(previousAPI);
+	BOOST_REQUIRE_EQUAL(previousMatches.size(), 1);
+	BOOST_REQUIRE(MatchPersistence("binary", "Naive", "metapc", 0, 0, previousMatches).saveToFilePath(previousMatchesPath));
+
+	// the changed displacement is a change, the match is not carried over
+	DumpDisassemblerAPI api(documentWithLoad("dword ptr [ebp+0Ch]", 12), "MatchingTestCurrentLoad_dump.json");
+	BOOST_REQUIRE(search(api).empty());
+	DumpDiff diff(previousAPI, EA(0x1000), EA(0x1100), api, EA(0x1000), EA(0x1100));
+	BOOST_CHECK_EQUAL(diff.getUnchangedInstructionCount(), 63);
+	IdiomMatcherStandalone standalone;
+	standalone.patterns = patterns;
+	standalone.previousDumpPath = previousDumpPath;
+	standalone.previousMatchesPath = previousMatchesPath;
+	BOOST_REQUIRE(standalone.incrementalMatch(api));
+	const std::string matchesPath = "MatchingTestCurrentLoad_dump_matched_Naive.json";
+	BOOST_CHECK(readMatchesFromFilePath(matchesPath).getMatches().empty());
+
+	std::remove(previousDumpPath.c_str());
+	std::remove(previousMatchesPath.c_str());
+	std::remove(matchesPath.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestFunctionMatchCacheRebases) {
+	using namespace IdiomMatcher;
+
+	// the same code at two base EAs, with a jump inside the code and a call to its start
+	auto linesAtEA = [](EA::EAValue_t baseEA) {
+		DisassemblyLines lines;
+		for (int i = 0; i < 200; ++i) {
+			EA ea(baseEA + i*4);
+			XRefs xrefs;
+			if (i % 10 == 9)
+				xrefs.push_back(std::make_shared<XRef>(EA(baseEA + (i % 50)*4), false, true));
+			lines.push_back(std::make_shared<DisassemblyLine>(ea, std::make_shared<Instruction>("op" + std::to_string(i*7 % 13), Operands(), xrefs, 4, ea), ""));
+		}
+		return lines;
+	};
+	DumpDisassemblerAPI firstAPI(DisassemblyDocument("first", "metapc", "test", EA(0x1000), EA(0x1320), linesAtEA(0x1000)));
+	DumpDisassemblerAPI secondAPI(DisassemblyDocument("second", "metapc", "test", EA(0x8000), EA(0x8320), linesAtEA(0x8000)));
+	auto firstFunctions = FunctionMatchCache::functionsInRange(firstAPI, EA(0x1000), EA(0x1320), 8);
+	auto secondFunctions = FunctionMatchCache::functionsInRange(secondAPI, EA(0x8000), EA(0x8320), 8);
+	BOOST_REQUIRE_EQUAL(firstFunctions.size(), secondFunctions.size());
+	BOOST_REQUIRE(!firstFunctions.empty());
+	BOOST_CHECK(firstFunctions.front().startEA == EA(0x1000));
+	BOOST_CHECK(firstFunctions.back().endEA == EA(0x1320));
+	for (size_t i = 0; i < firstFunctions.size(); ++i) {
+		BOOST_CHECK_EQUAL(firstFunctions[i].key, secondFunctions[i].key);
+	}
+
+	FunctionMatchCache cache(7);
+	auto &function = firstFunctions.front();
+	Matches matches(1, std::make_shared<Match>(EA(0x1008), EA(0x1010), "switch"));
+	Matches found;
+	BOOST_CHECK(!cache.lookup(function, "Naive", found));
+	cache.insert(function, "Naive", matches);
+	BOOST_CHECK(!cache.lookup(secondFunctions.front(), "DependenceGraph", found));
+	BOOST_REQUIRE(cache.lookup(secondFunctions.front(), "Naive", found));
+	BOOST_REQUIRE_EQUAL(found.size(), 1);
+	BOOST_CHECK(found[0]->getStartEA() == EA(0x8008));
+	BOOST_CHECK(found[0]->getEndEA() == EA(0x8010));
+	BOOST_CHECK_EQUAL(found[0]->getPatternName(), "switch");
+
+	// entries are only read for the patterns they were matched with
+	const std::string path = "MatchingTest.imfc";
+	BOOST_REQUIRE(cache.writeToFilePath(path));
+	FunctionMatchCache samePatterns(7);
+	BOOST_REQUIRE(samePatterns.readFromFilePath(path));
+	BOOST_CHECK_EQUAL(samePatterns.getEntryCount(), 1);
+	FunctionMatchCache otherPatterns(8);
+	BOOST_CHECK(otherPatterns.readFromFilePath(path));
+	BOOST_CHECK_EQUAL(otherPatterns.getEntryCount(), 0);
+	std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestFunctionMatchCacheGraphWindows) {
+	using namespace IdiomMatcher;
+
+	// code jumping to 0x2000, which jumps to 0x3000, the dumps only differ there
+	auto linesWithTarget = [](const std::string &targetMnemonic) {
+		DisassemblyLines lines;
+		auto addLine = [&lines](EA::EAValue_t value, const std::string &mnemonic, EA::EAValue_t target) {
+			EA ea(value);
+			XRefs xrefs;
+			if (target != 0)
+				xrefs.push_back(std::make_shared<XRef>(EA(target), false, true));
+			lines.push_back(std::make_shared<DisassemblyLine>(ea, std::make_shared<Instruction>(mnemonic, Operands(), xrefs, 4, ea), ""));
+		};
+		for (int i = 0; i < 48; ++i) {
+			addLine(0x1000 + i*4, i == 0 ? "jmp" : "op" + std::to_string(i % 7), i == 0 ? 0x2000 : 0);
+		}
+		addLine(0x2000, "jmp", 0x3000);
+		for (int i = 1; i < 8; ++i) {
+			addLine(0x2000 + i*4, "nop", 0);
+		}
+		addLine(0x3000, targetMnemonic, 0);
+		return lines;
+	};
+	DumpDisassemblerAPI firstAPI(DisassemblyDocument("first", "metapc", "test", EA(0x1000), EA(0x3004), linesWithTarget("push")));
+	DumpDisassemblerAPI secondAPI(DisassemblyDocument("second", "metapc", "test", EA(0x1000), EA(0x3004), linesWithTarget("pop")));
+	Instructions instructions;
+	for (auto mnemonic : {"jmp", "jmp", "push"}) {
+		instructions.push_back(std::make_shared<Instruction>(mnemonic, Operands(), XRefs(), 4, InvalidEA));
+	}
+	Patterns patterns(1, std::make_shared<Pattern>("jumps", instructions, "metapc"));
+
+	// the naive matcher only reads the first instructions at direct targets
+	auto firstFunctions = FunctionMatchCache::functionsInRange(firstAPI, EA(0x1000), EA(0x10a0), 3);
+	auto secondFunctions = FunctionMatchCache::functionsInRange(secondAPI, EA(0x1000), EA(0x10a0), 3);
+	BOOST_REQUIRE_EQUAL(firstFunctions.size(), secondFunctions.size());
+	BOOST_CHECK_EQUAL(firstFunctions.front().key, secondFunctions.front().key);
+
+	// the window of the graph matcher reaches the second level target
+	ControlFlowGraphMatching matcher;
+	auto firstGraphFunctions = FunctionMatchCache::functionsInRange(firstAPI, EA(0x1000), EA(0x10a0), 3, FunctionMatchCache::graphWindowKey(matcher, patterns));
+	auto secondGraphFunctions = FunctionMatchCache::functionsInRange(secondAPI, EA(0x1000), EA(0x10a0), 3, FunctionMatchCache::graphWindowKey(matcher, patterns));
+	BOOST_REQUIRE_EQUAL(firstGraphFunctions.size(), secondGraphFunctions.size());
+	BOOST_CHECK(firstGraphFunctions.front().startEA == firstFunctions.front().startEA);
+	BOOST_CHECK_NE(firstGraphFunctions.front().key, secondGraphFunctions.front().key);
+	BOOST_CHECK_NE(firstGraphFunctions.front().key, firstFunctions.front().key);
+}
+
+BOOST_AUTO_TEST_CASE(TestFunctionMatchCacheOperandAddresses) {
+	using namespace IdiomMatcher;
+
+	// code at baseEA with a load at 0x28 and a jump through a table
+	auto document = [](EA::EAValue_t baseEA, const std::string &load, uintmax_t displacement, const std::string &table, uintmax_t tableAddress) {
+		DisassemblyLines lines;
+		for (int i = 0; i < 48; ++i) {
+			EA ea(baseEA + i*4);
+			Operands operands;
+			std::string mnemonic = "op" + std::to_string(i % 7);
+			if (i == 10) {
+				mnemonic = "mov";
+				operands = {std::make_shared<Operand>("eax", std::vector<std::string>{"eax"}, true, true, 0),
+							std::make_shared<Operand>(load, std::vector<std::string>{"ebp"}, true, false, displacement)};
+			} else if (i == 11) {
+				mnemonic = "jmp";
+				operands = {std::make_shared<Operand>(table, std::vector<std::string>{"eax"}, true, false, tableAddress)};
+			}
+			lines.push_back(std::make_shared<DisassemblyLine>(ea, std::make_shared<Instruction>(mnemonic, operands, XRefs(), 4, ea), ""));
+		}
+		return DisassemblyDocument("binary", "metapc", "test", EA(baseEA), EA(baseEA + 47*4), lines);
+	};
+	auto key = [](const DisassemblyDocument &document, bool rawOperandTexts) {
+		DumpDisassemblerAPI api(document);
+		auto functions = FunctionMatchCache::functionsInRange(api, api.minInstructionEA(), EA(api.maxInstructionEA().getValue() + 1), 4, nullptr, rawOperandTexts);
+		BOOST_REQUIRE_EQUAL(functions.size(), 1);
+		return functions.front().key;
+	};
+	auto original = document(0x1000, "dword ptr [ebp+8]", 8, "ds:off_2000[eax*4]", 0x2000);
+
+	// moved code with a moved table is the same function
+	BOOST_CHECK_EQUAL(key(original, false), key(document(0x8000, "dword ptr [ebp+8]", 8, "ds:off_9000[eax*4]", 0x9000), false));
+	// other displacements and scales are other code
+	auto otherDisplacement = document(0x1000, "dword ptr [ebp+0Ch]", 12, "ds:off_2000[eax*4]", 0x2000);
+	BOOST_CHECK_NE(key(original, false), key(otherDisplacement, false));
+	BOOST_CHECK_NE(key(original, false), key(document(0x1000, "dword ptr [ebp+8]", 8, "ds:off_2000[eax*2]", 0x2000), false));
+	// a table at the address of the load is other code, templates compare the addresses
+	BOOST_CHECK_NE(key(original, false), key(document(0x1000, "dword ptr [ebp+8]", 8, "ds:off_8[eax*4]", 8), false));
+
+	// a regex tests the whole text, the code only matches with one displacement
+	Operands patternOperands = {std::make_shared<Operand>("eax", std::vector<std::string>{"eax"}),
+								std::make_shared<Operand>("", std::vector<std::string>(), "", "dword ptr \\[ebp\\+8\\]")};
+	Instructions instructions(1, std::make_shared<Instruction>("mov", patternOperands, XRefs(), 4, InvalidEA));
+	Patterns patterns(1, std::make_shared<Pattern>("load", instructions, "metapc"));
+	BOOST_CHECK(DumpDiff::patternsTestOperandTexts(patterns));
+	auto matchCount = [&patterns](const DisassemblyDocument &document) {
+		DumpDisassemblerAPI api(document);
+		NaiveMatching matcher;
+		size_t count = 0;
+		matcher.searchForPatterns(patterns, api, [&count](const Pattern &, const EA &, const EA &, const Matching::ExtractedValuesMap &) -> bool {
+			++count;
+			return true;
+		});
+		return count;
+	};
+	BOOST_CHECK_EQUAL(matchCount(original), 1);
+	BOOST_CHECK_EQUAL(matchCount(otherDisplacement), 0);
+	BOOST_CHECK_NE(key(original, true), key(otherDisplacement, true));
+	BOOST_CHECK_NE(key(original, true), key(document(0x8000, "dword ptr [ebp+8]", 8, "ds:off_9000[eax*4]", 0x9000), true));
+}
+
+BOOST_AUTO_TEST_CASE(TestEvaluationJoin) {
+	using namespace IdiomMatcher;
+
+	Matches references;
+	for (EA::EAValue_t endEA : {0x1010, 0x1020, 0x1030, 0x1030}) {
+		references.push_back(std::make_shared<Match>(EA(endEA - 8), EA(endEA), "switch"));
+	}
+	Matches matches;
+	matches.push_back(std::make_shared<Match>(EA(0x1028), EA(0x1030), "switch"));
+	matches.push_back(std::make_shared<Match>(EA(0x1000), EA(0x1008), "switch"));
+	// same end as the switch match, the less frequent pattern is kept
+	matches.push_back(std::make_shared<Match>(EA(0x1024), EA(0x1030), "jumptable"));
+	matches.push_back(std::make_shared<Match>(EA(0x1008), EA(0x1010), "switch"));
+
+	auto evaluation = evaluateMatches(matches, references);
+	BOOST_REQUIRE_EQUAL(evaluation.correctMatches.size(), 2);
+	BOOST_CHECK(evaluation.correctMatches[0]->getEndEA() == EA(0x1010));
+	BOOST_CHECK_EQUAL(evaluation.correctMatches[1]->getPatternName(), "jumptable");
+	BOOST_REQUIRE_EQUAL(evaluation.wrongMatches.size(), 1);
+	BOOST_CHECK(evaluation.wrongMatches[0]->getEndEA() == EA(0x1008));
+	BOOST_REQUIRE_EQUAL(evaluation.missingMatches.size(), 1);
+	BOOST_CHECK(evaluation.missingMatches[0]->getEndEA() == EA(0x1020));
+	BOOST_CHECK_EQUAL(evaluation.usedPatternCount, 2);
+
+	BOOST_CHECK_EQUAL(referencePathForMatchPath("dir/a_dump_matched_Naive.json"), "dir/a_dump_matched_comments.json");
+	BOOST_CHECK_EQUAL(referencePathForMatchPath("a_dump_matched_DependenceGraph.imm"), "a_dump_matched_comments.json");
+	BOOST_CHECK(referencePathForMatchPath("a_dump_matched_comments.json").empty());
+	BOOST_CHECK(referencePathForMatchPath("a_dump_report_Naive.json").empty());
+}
+
 BOOST_AUTO_TEST_CASE(TestSpecificVF2Failure) {
 
 	using namespace boost;
@@ -5,6 +5,10 @@
 #include <Model/Pattern.h>
 #include <Model/DisassemblyPersistence.cpp>
 #include <Model/PatternPersistence.cpp>
+#include <Model/TraceRecorder.h>
+#include <Model/PatternAnalysis.h>
+#include <fstream>
+#include <thread>
 
 #include "rapidjson/stringbuffer.h"
 
@@ -380,3 +384,136 @@ BOOST_AUTO_TEST_CASE(PatternSerialization)
     BOOST_CHECK_EQUAL(instruction2->getOperands().size(),1);
     BOOST_CHECK(instruction2->getOperands().front()->getText() == "testOP");
 }
+
+BOOST_AUTO_TEST_CASE(DocumentConcurrentReading)
+{
+    using namespace IdiomMatcher;
+    // readDocumentFromFilePath logs its timings
+    msg = printf;
+
+    DisassemblyLines lines;
+    for (uintmax_t i = 0; i < 500; ++i) {
+        EA ea(0x1000 + i*4);
+        Operands operands;
+        operands.push_back(std::make_shared<Operand>("r" + std::to_string(i%8), std::vector<std::string>{"r" + std::to_string(i%8)}, true, i%2 == 0, 0));
+        XRefs refs;
+        refs.push_back(std::make_shared<XRef>(EA(ea.getValue()+4)));
+        auto instruction = std::make_shared<Instruction>(i%3 ? "mov" : "cmp", operands, refs, 4, ea);
+        lines.push_back(std::make_shared<DisassemblyLine>(ea, instruction, i%50 ? "" : "comment with \"}],[{\""));
+    }
+    DisassemblyDocument document("binary", "arch", "disassembler", EA(0x1000), EA(0x2000), lines);
+
+    StringBuffer buffer;
+    Writer<StringBuffer, ASCII<>, ASCII<> > writer(buffer);
+    SerializeDisassemblyDocument(writer, document);
+    const std::string path = "ModelTest_document.json";
+    auto fh = fopen(path.c_str(), "w");
+    BOOST_REQUIRE(fh != NULL);
+    fwrite(buffer.GetString(), 1, buffer.GetSize(), fh);
+    fclose(fh);
+
+    auto serialDocument = readDocumentFromFilePath(path);
+    auto concurrentDocument = readDocumentFromFilePathConcurrently(path, 3);
+    std::remove(path.c_str());
+
+    BOOST_CHECK_EQUAL(concurrentDocument.getBinaryName(), "binary");
+    BOOST_CHECK_EQUAL(concurrentDocument.getArchitectureName(), serialDocument.getArchitectureName());
+    BOOST_CHECK(concurrentDocument.getMaxEA() == serialDocument.getMaxEA());
+    BOOST_REQUIRE_EQUAL(concurrentDocument.getDisassemblyLines().size(), lines.size());
+    for (size_t i = 0; i < lines.size(); ++i) {
+        auto &line = concurrentDocument.getDisassemblyLines()[i];
+        BOOST_CHECK(line->getEA() == serialDocument.getDisassemblyLines()[i]->getEA());
+        BOOST_CHECK_EQUAL(line->getComment(), lines[i]->getComment());
+        BOOST_CHECK_EQUAL(line->getInstruction()->description(), lines[i]->getInstruction()->description());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TraceRecorderWritesEvents)
+{
+    using namespace IdiomMatcher;
+
+    auto &recorder = TraceRecorder::shared();
+    {
+        TraceSpan span("test", "not recording");
+    }
+    recorder.start();
+    recorder.setThreadName("main");
+    {
+        TraceSpan span("test", "outer");
+        std::thread thread([]() {
+            TraceSpan span("test", "worker");
+        });
+        thread.join();
+    }
+    recorder.stop();
+    {
+        TraceSpan span("test", "after stop");
+    }
+    BOOST_CHECK_EQUAL(recorder.getSpanCount(), 2);
+
+    const std::string path = "ModelTest_trace.json";
+    BOOST_REQUIRE(recorder.writeToFilePath(path));
+    std::ifstream file(path);
+    std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::remove(path.c_str());
+
+    Document d;
+    d.Parse(json.c_str());
+    BOOST_REQUIRE(!d.HasParseError() && d.HasMember("traceEvents"));
+    auto &events = d["traceEvents"];
+    BOOST_REQUIRE_EQUAL(events.Size(), 3);
+    BOOST_CHECK_EQUAL(std::string(events[0u]["ph"].GetString()), "M");
+    BOOST_CHECK_EQUAL(std::string(events[0u]["args"]["name"].GetString()), "main");
+    // the worker span ends first, both are complete events on different threads
+    BOOST_CHECK_EQUAL(std::string(events[1u]["name"].GetString()), "worker");
+    BOOST_CHECK_EQUAL(std::string(events[2u]["name"].GetString()), "outer");
+    BOOST_CHECK(events[1u]["tid"].GetUint() != events[2u]["tid"].GetUint());
+    BOOST_CHECK(events[2u]["ts"].GetDouble() <= events[1u]["ts"].GetDouble());
+    BOOST_CHECK(events[2u]["dur"].GetDouble() >= events[1u]["dur"].GetDouble());
+}
+
+BOOST_AUTO_TEST_CASE(PatternAnalysisFindings)
+{
+    using namespace IdiomMatcher;
+    // cmp reg, 5 followed by a jump back to the cmp, at baseEA
+    auto pattern = [](const std::string &name, EA::EAValue_t baseEA, const Operand_Ref &compared, const std::string &mnemonic = "cmp", bool isRegex = false) {
+        Instructions instructions;
+        instructions.push_back(std::make_shared<Instruction>(mnemonic, Operands{compared, std::make_shared<Operand>("5")},
+                                                             XRefs{std::make_shared<XRef>(EA(baseEA + 4))}, 4, EA(baseEA), isRegex));
+        instructions.push_back(std::make_shared<Instruction>("jnz", Operands{std::make_shared<Operand>("loc")},
+                                                             XRefs{std::make_shared<XRef>(EA(baseEA), false, true), std::make_shared<XRef>(EA(0x9000), false, true)}, 4, EA(baseEA + 4)));
+        return std::make_shared<Pattern>(name, instructions, "metapc");
+    };
+    auto templateOperand = [](const std::string &name) {
+        return std::make_shared<Operand>(name, std::vector<std::string>{name}, std::string(), std::string(), true);
+    };
+    auto fixedOperand = std::make_shared<Operand>("eax", std::vector<std::string>{"eax"});
+
+    Patterns patterns{
+        pattern("general", 0x1000, templateOperand("r1")),
+        // other EAs and template names, same canonical form
+        pattern("copy", 0x2000, templateOperand("r7")),
+        // a fixed register is more specific than a template
+        pattern("eax", 0x3000, fixedOperand),
+        pattern("regex", 0x4000, templateOperand("r1"), "cmp.*", true),
+        pattern("broken", 0x5000, templateOperand("r1"), "cmp(", true)
+    };
+
+    PatternAnalysis analysis(patterns);
+    BOOST_CHECK_EQUAL(PatternAnalysis::canonicalForm(*patterns[0]), PatternAnalysis::canonicalForm(*patterns[1]));
+    BOOST_CHECK(PatternAnalysis::subsumes(*patterns[0], *patterns[2]));
+    BOOST_CHECK(!PatternAnalysis::subsumes(*patterns[2], *patterns[0]));
+    BOOST_CHECK(PatternAnalysis::subsumes(*patterns[3], *patterns[0]));
+
+    std::map<std::string, std::pair<PatternAnalysis::FindingKind, std::string> > findings;
+    for (auto &finding : analysis.getFindings()) {
+        findings[finding.pattern->getName()] = std::make_pair(finding.kind, finding.keptPattern ? finding.keptPattern->getName() : "");
+    }
+    BOOST_REQUIRE_EQUAL(findings.size(), 4);
+    BOOST_CHECK(findings["copy"] == std::make_pair(PatternAnalysis::Duplicate, std::string("general")));
+    BOOST_CHECK(findings["general"] == std::make_pair(PatternAnalysis::Subsumed, std::string("regex")));
+    BOOST_CHECK(findings["eax"] == std::make_pair(PatternAnalysis::Subsumed, std::string("regex")));
+    BOOST_CHECK(findings["broken"].first == PatternAnalysis::Dead);
+    BOOST_REQUIRE_EQUAL(analysis.getPrunedPatterns().size(), 1);
+    BOOST_CHECK_EQUAL(analysis.getPrunedPatterns()[0]->getName(), "regex");
+}
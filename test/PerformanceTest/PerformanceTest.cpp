@@ -0,0 +1,308 @@
+//
+// Created on 19.10.26.
+// Licensed under MIT License, see LICENSE for full text.
+
+// Performance regression gate for the matchers.
+//
+// usage: PerformanceTest [--baseline path] [--writeBaseline path] [--throughputTolerance fraction]
+//                        [--memoryTolerance fraction] [--repetitions N]
+//
+// Matches a fixed synthetic dump with the Naive, ControlFlowGraph and
+// DependenceGraph matchers on one thread and compares the results to the
+// baseline. Fails if a matcher got slower or needs more heap than the baseline
+// allows.
+//
+// Throughput is relative to decoding the same dump with instructionForEA, so the
+// baseline holds on other machines. The best of the repetitions is used to
+// take out noise. Peak memory is the highest live heap of the allocations made
+// while matching, counted by AllocationTracker under a tag of the matcher.
+// A matcher finding another number of matches than the baseline fails as well.
+//
+// To update the baseline after an intended change run
+//   PerformanceTest --writeBaseline test/PerformanceTest/baseline.json
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <Standalone/DumpDisassemblerAPI.h>
+#include <Generator/SyntheticDisassembly.h>
+#include <Model/Logging.h>
+#include <Matching/Matcher/NaiveMatching.h>
+#include <Matching/Matcher/ControlFlowGraphMatching.h>
+#include <Matching/Matcher/DependenceGraphMatching.h>
+#include <Matching/RunReport.h>
+#include <Model/AllocationTracker.h>
+#include <Model/AllocationHooks.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/filereadstream.h>
+#include <rapidjson/filewritestream.h>
+#include <rapidjson/encodedstream.h>
+#include <rapidjson/prettywriter.h>
+
+namespace {
+	using namespace IdiomMatcher;
+
+	struct Measurement {
+		double instructionsPerSecond = 0;
+		// instructionsPerSecond divided by the decoding throughput
+		double relativeThroughput = 0;
+		uint64_t peakBytes = 0;
+		size_t matchCount = 0;
+	};
+
+	struct Baseline {
+		// a relative throughput below (1 - throughputTolerance) * baseline fails
+		double throughputTolerance = 0.3;
+		// peak bytes above (1 + memoryTolerance) * baseline fail
+		double memoryTolerance = 0.25;
+		std::map<std::string, Measurement> matchers;
+	};
+
+	// the workload the baseline was measured with, changing it needs a new baseline
+	SyntheticDisassemblyOptions workloadOptions() {
+		SyntheticDisassemblyOptions options;
+		options.architecture = "x86";
+		options.instructionCount = 1 << 18;
+		options.seed = 1;
+		return options;
+	}
+
+	// the dump as the standalone has it in memory after loading
+	DisassemblyDocument documentForAPI(const DisassemblerAPI &api) {
+		DisassemblyLines lines;
+		for (EA ea = api.minEA(); !(ea == InvalidEA); ea = api.nextEA(ea)) {
+			lines.push_back(std::make_shared<DisassemblyLine>(ea, std::make_shared<Instruction>(api.instructionForEA(ea)), api.commentForEA(ea)));
+		}
+		return DisassemblyDocument(api.executableName(), api.executableArchitecture(), api.getDisassemblerName(), api.minEA(), api.maxEA(), lines);
+	}
+
+	// instructions per second of decoding every instruction, the unit of the relative throughput
+	double decodingThroughput(DumpDisassemblerAPI &api, size_t instructionCount, unsigned repetitions) {
+		double best = 0;
+		for (unsigned repetition = 0; repetition < repetitions; ++repetition) {
+			auto start = std::chrono::steady_clock::now();
+			size_t mnemonicBytes = 0;
+			for (EA ea = api.minInstructionEA(); !(ea == InvalidEA); ea = api.nextEA(ea)) {
+				mnemonicBytes += api.instructionForEA(ea).getMnemonic().size();
+			}
+			std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+			if (mnemonicBytes > 0 && duration.count() > 0) {
+				best = std::max(best, instructionCount / duration.count());
+			}
+		}
+		return best;
+	}
+
+	Measurement measureMatcher(Matching &matcher, const Patterns &patterns, DumpDisassemblerAPI &api, size_t instructionCount, unsigned repetitions) {
+		Measurement measurement;
+		matcher.prepareForPatterns(patterns);
+		// the tag is only used here, its peak is the one of the matcher alone
+		const std::string tag = "match " + matcher.getName();
+		for (unsigned repetition = 0; repetition < repetitions; ++repetition) {
+			size_t matchCount = 0;
+			auto start = std::chrono::steady_clock::now();
+			{
+				AllocationTracker::Scope allocationScope(tag);
+				matcher.searchForPatterns(patterns, api, [&matchCount](const Pattern &, const EA &, const EA &, const Matching::ExtractedValuesMap &) {
+					++matchCount;
+					return true;
+				});
+			}
+			std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+			measurement.instructionsPerSecond = std::max(measurement.instructionsPerSecond, instructionCount / duration.count());
+			// the first repetition has the least reuse of earlier allocations
+			if (repetition == 0) {
+				measurement.peakBytes = AllocationTracker::statisticsForTag(tag).peakBytes;
+			}
+			measurement.matchCount = matchCount;
+		}
+		return measurement;
+	}
+
+	bool readBaseline(const std::string &path, Baseline &baseline) {
+		using namespace rapidjson;
+		auto file = fopen(path.c_str(), "r");
+		if (file == nullptr) {
+			printf("failed to open baseline %s\n", path.c_str());
+			return false;
+		}
+		char readBuffer[65536];
+		FileReadStream is(file, readBuffer, sizeof(readBuffer));
+		GenericDocument<ASCII<> > d;
+		d.ParseStream(is);
+		fclose(file);
+		if (d.HasParseError() || !d.IsObject() || !d.HasMember("matchers") || !d["matchers"].IsObject()) {
+			printf("failed to parse baseline %s\n", path.c_str());
+			return false;
+		}
+		if (d.HasMember("throughputTolerance"))
+			baseline.throughputTolerance = d["throughputTolerance"].GetDouble();
+		if (d.HasMember("memoryTolerance"))
+			baseline.memoryTolerance = d["memoryTolerance"].GetDouble();
+		auto &matchers = d["matchers"];
+		for (auto it = matchers.MemberBegin(); it != matchers.MemberEnd(); ++it) {
+			Measurement measurement;
+			measurement.relativeThroughput = it->value["relativeThroughput"].GetDouble();
+			measurement.peakBytes = it->value["peakBytes"].GetUint64();
+			measurement.matchCount = it->value["matchCount"].GetUint64();
+			baseline.matchers[it->name.GetString()] = measurement;
+		}
+		return true;
+	}
+
+	bool writeBaseline(const std::string &path, const Baseline &baseline) {
+		using namespace rapidjson;
+		auto file = fopen(path.c_str(), "w");
+		if (file == nullptr) {
+			printf("failed to create baseline %s\n", path.c_str());
+			return false;
+		}
+		char writeBuffer[65536];
+		FileWriteStream os(file, writeBuffer, sizeof(writeBuffer));
+		typedef EncodedOutputStream<ASCII<>, FileWriteStream> JSONOutputStream;
+		JSONOutputStream eos(os, false);
+		PrettyWriter<JSONOutputStream, ASCII<>, ASCII<> > writer(eos);
+
+		writer.StartObject();
+		writer.Key("throughputTolerance");
+		writer.Double(baseline.throughputTolerance);
+		writer.Key("memoryTolerance");
+		writer.Double(baseline.memoryTolerance);
+		writer.Key("matchers");
+		writer.StartObject();
+		for (auto &entry : baseline.matchers) {
+			writer.Key(entry.first.c_str());
+			writer.StartObject();
+			writer.Key("relativeThroughput");
+			writer.Double(entry.second.relativeThroughput);
+			writer.Key("peakBytes");
+			writer.Uint64(entry.second.peakBytes);
+			writer.Key("matchCount");
+			writer.Uint64(entry.second.matchCount);
+			writer.EndObject();
+		}
+		writer.EndObject();
+		writer.EndObject();
+		eos.Flush();
+		os.Flush();
+		bool success = !ferror(file);
+		return fclose(file) == 0 && success;
+	}
+
+	// prints the comparison of measured to baseline, returns false on a regression
+	bool compareToBaseline(const std::string &name, const Measurement &measured, const Baseline &baseline) {
+		auto it = baseline.matchers.find(name);
+		if (it == baseline.matchers.end()) {
+			printf("%-18s missing in baseline\n", name.c_str());
+			return false;
+		}
+		auto &expected = it->second;
+		bool success = true;
+		double minimumThroughput = expected.relativeThroughput * (1 - baseline.throughputTolerance);
+		if (measured.relativeThroughput < minimumThroughput) {
+			printf("%-18s throughput regressed: %.4f, baseline %.4f, minimum %.4f\n", name.c_str(), measured.relativeThroughput, expected.relativeThroughput, minimumThroughput);
+			success = false;
+		}
+		double maximumBytes = expected.peakBytes * (1 + baseline.memoryTolerance);
+		if (measured.peakBytes > maximumBytes) {
+			printf("%-18s peak memory regressed: %ju bytes, baseline %ju, maximum %.0f\n", name.c_str(), (uintmax_t)measured.peakBytes, (uintmax_t)expected.peakBytes, maximumBytes);
+			success = false;
+		}
+		if (measured.matchCount != expected.matchCount) {
+			printf("%-18s found %zu matches, baseline %zu, update the baseline if the workload changed\n", name.c_str(), measured.matchCount, expected.matchCount);
+			success = false;
+		}
+		return success;
+	}
+}
+
+void logging(const char *format, ...) {
+	va_list vaargs;
+	va_start(vaargs, format);
+	vprintf(format, vaargs);
+	va_end(vaargs);
+}
+
+int main(int argc, char *argv[]) {
+	IdiomMatcher::warning = logging;
+	IdiomMatcher::info = logging;
+	IdiomMatcher::msg = printf;
+
+	std::string baselinePath;
+	std::string writeBaselinePath;
+	double throughputTolerance = -1;
+	double memoryTolerance = -1;
+	unsigned repetitions = 3;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+			baselinePath = argv[++i];
+		} else if (strcmp(argv[i], "--writeBaseline") == 0 && i + 1 < argc) {
+			writeBaselinePath = argv[++i];
+		} else if (strcmp(argv[i], "--throughputTolerance") == 0 && i + 1 < argc) {
+			throughputTolerance = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--memoryTolerance") == 0 && i + 1 < argc) {
+			memoryTolerance = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+			repetitions = std::max(atoi(argv[++i]), 1);
+		} else {
+			printf("usage: %s [--baseline path] [--writeBaseline path] [--throughputTolerance fraction] [--memoryTolerance fraction] [--repetitions N]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	Baseline baseline;
+	if (!baselinePath.empty() && !readBaseline(baselinePath, baseline)) {
+		return EXIT_FAILURE;
+	}
+	if (throughputTolerance >= 0)
+		baseline.throughputTolerance = throughputTolerance;
+	if (memoryTolerance >= 0)
+		baseline.memoryTolerance = memoryTolerance;
+
+	SyntheticDisassemblerAPI syntheticAPI(workloadOptions(), "performance_dump.json");
+	auto patterns = syntheticAPI.patterns();
+	DumpDisassemblerAPI api(documentForAPI(syntheticAPI), syntheticAPI.executablePath());
+	const size_t instructionCount = (size_t)workloadOptions().instructionCount;
+
+	AllocationTracker::setEnabled(true);
+	const double decoding = decodingThroughput(api, instructionCount, repetitions);
+	printf("%-18s %14.0f instructions/s\n", "decoding", decoding);
+
+	std::unique_ptr<Matching> matchers[] = {
+		std::unique_ptr<Matching>(new NaiveMatching()),
+		std::unique_ptr<Matching>(new ControlFlowGraphMatching()),
+		std::unique_ptr<Matching>(new DependenceGraphMatching())
+	};
+	Baseline measured;
+	measured.throughputTolerance = baseline.throughputTolerance;
+	measured.memoryTolerance = baseline.memoryTolerance;
+	bool success = true;
+	for (auto &matcher : matchers) {
+		auto measurement = measureMatcher(*matcher, patterns, api, instructionCount, repetitions);
+		measurement.relativeThroughput = measurement.instructionsPerSecond / decoding;
+		printf("%-18s %14.0f instructions/s %10.4f relative %14ju peak bytes %8zu matches\n", matcher->getName().c_str(),
+			   measurement.instructionsPerSecond, measurement.relativeThroughput, (uintmax_t)measurement.peakBytes, measurement.matchCount);
+		measured.matchers[matcher->getName()] = measurement;
+		if (!baselinePath.empty()) {
+			success = compareToBaseline(matcher->getName(), measurement, baseline) && success;
+		}
+	}
+	AllocationTracker::setEnabled(false);
+	printf("peak resident %ju bytes\n", (uintmax_t)RunReport::peakResidentBytes());
+
+	if (!writeBaselinePath.empty()) {
+		if (!writeBaseline(writeBaselinePath, measured)) {
+			return EXIT_FAILURE;
+		}
+		printf("Wrote baseline to %s\n", writeBaselinePath.c_str());
+	}
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}